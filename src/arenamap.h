@@ -0,0 +1,352 @@
+// Copyright (c) 2022 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_ARENAMAP_H
+#define BITCOIN_ARENAMAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/** Hash map with open addressing whose entries live in a chunked arena.
+ *
+ * The hash table only holds a 32-bit arena index and an 8-bit hash tag per
+ * bucket and is probed linearly, so a lookup mostly reads adjacent table
+ * memory and compares a single key. Entries are constructed in place in
+ * fixed-size chunks instead of being allocated one by one, which avoids the
+ * per-entry allocation overhead of node based maps and turns iteration into
+ * a sequential walk over contiguous memory.
+ *
+ * Entries never move once inserted. Like std::unordered_map, references to
+ * an entry stay valid until it is erased. Unlike std::unordered_map, iterators
+ * also stay valid across rehashes. Iteration follows arena order, which is
+ * the insertion order unless erased entries were reused.
+ *
+ * Only the subset of the std::unordered_map interface its users need is
+ * implemented.
+ */
+template <typename K, typename T, typename Hash>
+class arenamap
+{
+public:
+    typedef K key_type;
+    typedef T mapped_type;
+    typedef std::pair<const K, T> value_type;
+    typedef size_t size_type;
+
+    /** Number of entries per arena chunk */
+    static constexpr size_t CHUNK_SIZE{64};
+
+private:
+    union Entry {
+        Entry() {}
+        ~Entry() {}
+        value_type value;
+        //! Next erased entry, while on the free list
+        uint32_t next_free;
+    };
+
+    struct Chunk {
+        //! Bit i is set while entries[i] holds a value
+        uint64_t live{0};
+        Entry entries[CHUNK_SIZE];
+    };
+    static_assert(CHUNK_SIZE == 64, "live bits must cover a chunk");
+
+    static constexpr uint32_t NO_INDEX{std::numeric_limits<uint32_t>::max()};
+    static constexpr uint8_t TAG_EMPTY{0};
+    static constexpr uint8_t TAG_ERASED{1};
+    static constexpr size_t MIN_BUCKETS{16};
+
+    std::vector<std::unique_ptr<Chunk>> m_chunks;
+    //! Arena index of each bucket's entry, valid if its tag is not empty or erased
+    std::unique_ptr<uint32_t[]> m_indexes;
+    std::unique_ptr<uint8_t[]> m_tags;
+    size_t m_bucket_count{0};
+    size_t m_size{0};
+    size_t m_erased{0};
+    //! Number of arena entries ever handed out
+    uint32_t m_used{0};
+    uint32_t m_free{NO_INDEX};
+    Hash m_hash;
+
+    Entry& At(uint32_t index) const { return m_chunks[index / CHUNK_SIZE]->entries[index % CHUNK_SIZE]; }
+
+    /** Tag stored in the table for a hash, leaving out TAG_EMPTY and TAG_ERASED */
+    static uint8_t Tag(size_t hash) { return 2 + (hash >> (std::numeric_limits<size_t>::digits - 8)) % 254; }
+
+    /** First live arena index at or after index, or NO_INDEX */
+    uint32_t NextLive(uint32_t index) const
+    {
+        while (index < m_used) {
+            uint64_t bits{m_chunks[index / CHUNK_SIZE]->live >> (index % CHUNK_SIZE)};
+            if (bits == 0) {
+                index = (index / CHUNK_SIZE + 1) * CHUNK_SIZE;
+                continue;
+            }
+            while (!(bits & 1)) {
+                bits >>= 1;
+                ++index;
+            }
+            return index;
+        }
+        return NO_INDEX;
+    }
+
+    uint32_t FindIndex(const K& key) const
+    {
+        if (m_size == 0) return NO_INDEX;
+        const size_t hash{m_hash(key)};
+        const uint8_t tag{Tag(hash)};
+        const size_t mask{m_bucket_count - 1};
+        for (size_t b = hash & mask; m_tags[b] != TAG_EMPTY; b = (b + 1) & mask) {
+            if (m_tags[b] == tag && At(m_indexes[b]).value.first == key) return m_indexes[b];
+        }
+        return NO_INDEX;
+    }
+
+    /** Rebuild the table with room for at least min_size entries at a load of 1/2, dropping erased buckets. */
+    void Rehash(size_t min_size)
+    {
+        size_t count{MIN_BUCKETS};
+        while (count < 2 * min_size) count *= 2;
+        std::unique_ptr<uint8_t[]> tags{new uint8_t[count]()};
+        std::unique_ptr<uint32_t[]> indexes{new uint32_t[count]};
+        const size_t mask{count - 1};
+        for (uint32_t i = NextLive(0); i != NO_INDEX; i = NextLive(i + 1)) {
+            const size_t hash{m_hash(At(i).value.first)};
+            size_t b{hash & mask};
+            while (tags[b] != TAG_EMPTY) b = (b + 1) & mask;
+            tags[b] = Tag(hash);
+            indexes[b] = i;
+        }
+        m_tags = std::move(tags);
+        m_indexes = std::move(indexes);
+        m_bucket_count = count;
+        m_erased = 0;
+    }
+
+    uint32_t Allocate()
+    {
+        if (m_free != NO_INDEX) {
+            const uint32_t index{m_free};
+            m_free = At(index).next_free;
+            return index;
+        }
+        if (m_used == m_chunks.size() * CHUNK_SIZE) m_chunks.push_back(std::make_unique<Chunk>());
+        return m_used++;
+    }
+
+    void Release(uint32_t index)
+    {
+        At(index).next_free = m_free;
+        m_free = index;
+    }
+
+    template <bool Const>
+    class Iterator
+    {
+        typedef std::conditional_t<Const, const arenamap, arenamap> map_type;
+        map_type* m_map{nullptr};
+        uint32_t m_index{NO_INDEX};
+
+        friend class arenamap;
+        Iterator(map_type* map, uint32_t index) : m_map{map}, m_index{index} {}
+
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef typename arenamap::value_type value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef std::conditional_t<Const, const value_type*, value_type*> pointer;
+        typedef std::conditional_t<Const, const value_type&, value_type&> reference;
+
+        Iterator() = default;
+        template <bool C = Const, typename = std::enable_if_t<C>>
+        Iterator(const Iterator<false>& other) : m_map{other.m_map}, m_index{other.m_index} {}
+
+        reference operator*() const { return m_map->At(m_index).value; }
+        pointer operator->() const { return &m_map->At(m_index).value; }
+        Iterator& operator++()
+        {
+            m_index = m_map->NextLive(m_index + 1);
+            return *this;
+        }
+        Iterator operator++(int)
+        {
+            Iterator copy{*this};
+            ++*this;
+            return copy;
+        }
+        friend bool operator==(const Iterator& a, const Iterator& b) { return a.m_index == b.m_index; }
+        friend bool operator!=(const Iterator& a, const Iterator& b) { return a.m_index != b.m_index; }
+    };
+
+public:
+    typedef Iterator<false> iterator;
+    typedef Iterator<true> const_iterator;
+
+    /** Bytes of a single arena chunk allocation, for memory usage accounting */
+    static constexpr size_t CHUNK_BYTES{sizeof(Chunk)};
+
+    arenamap() = default;
+    arenamap(const arenamap&) = delete;
+    arenamap& operator=(const arenamap&) = delete;
+    arenamap(arenamap&& other) noexcept
+        : m_chunks{std::move(other.m_chunks)}, m_indexes{std::move(other.m_indexes)}, m_tags{std::move(other.m_tags)},
+          m_bucket_count{other.m_bucket_count}, m_size{other.m_size}, m_erased{other.m_erased},
+          m_used{other.m_used}, m_free{other.m_free}, m_hash{other.m_hash}
+    {
+        other.m_chunks.clear();
+        other.m_bucket_count = other.m_size = other.m_erased = 0;
+        other.m_used = 0;
+        other.m_free = NO_INDEX;
+    }
+    ~arenamap() { clear(); }
+
+    iterator begin() { return {this, NextLive(0)}; }
+    iterator end() { return {this, NO_INDEX}; }
+    const_iterator begin() const { return {this, NextLive(0)}; }
+    const_iterator end() const { return {this, NO_INDEX}; }
+
+    bool empty() const { return m_size == 0; }
+    size_type size() const { return m_size; }
+    size_t bucket_count() const { return m_bucket_count; }
+    size_t chunk_count() const { return m_chunks.size(); }
+    size_t chunk_capacity() const { return m_chunks.capacity(); }
+
+    iterator find(const K& key) { return {this, FindIndex(key)}; }
+    const_iterator find(const K& key) const { return {this, FindIndex(key)}; }
+    size_type count(const K& key) const { return FindIndex(key) != NO_INDEX; }
+
+    template <typename... Args>
+    std::pair<iterator, bool> try_emplace(const K& key, Args&&... args)
+    {
+        const size_t hash{m_hash(key)};
+        const uint8_t tag{Tag(hash)};
+        size_t bucket{0};
+        bool reuse{false};
+        if (m_bucket_count > 0) {
+            const size_t mask{m_bucket_count - 1};
+            size_t b{hash & mask};
+            for (; m_tags[b] != TAG_EMPTY; b = (b + 1) & mask) {
+                if (m_tags[b] == TAG_ERASED) {
+                    if (!reuse) bucket = b;
+                    reuse = true;
+                } else if (m_tags[b] == tag && At(m_indexes[b]).value.first == key) {
+                    return {iterator{this, m_indexes[b]}, false};
+                }
+            }
+            if (!reuse) bucket = b;
+        }
+        if (!reuse && (m_size + m_erased + 1) * 4 > m_bucket_count * 3) {
+            Rehash(m_size + 1);
+            const size_t mask{m_bucket_count - 1};
+            for (bucket = hash & mask; m_tags[bucket] != TAG_EMPTY; bucket = (bucket + 1) & mask) {}
+        }
+
+        const uint32_t index{Allocate()};
+        try {
+            ::new (&At(index).value) value_type(std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(std::forward<Args>(args)...));
+        } catch (...) {
+            Release(index);
+            throw;
+        }
+        m_chunks[index / CHUNK_SIZE]->live |= uint64_t{1} << (index % CHUNK_SIZE);
+        if (reuse) --m_erased;
+        m_tags[bucket] = tag;
+        m_indexes[bucket] = index;
+        ++m_size;
+        return {iterator{this, index}, true};
+    }
+
+    template <typename V>
+    std::pair<iterator, bool> emplace(const K& key, V&& value) { return try_emplace(key, std::forward<V>(value)); }
+
+    T& operator[](const K& key) { return try_emplace(key).first->second; }
+
+    iterator erase(const_iterator pos)
+    {
+        const uint32_t index{pos.m_index};
+        const size_t mask{m_bucket_count - 1};
+        size_t b{m_hash(At(index).value.first) & mask};
+        while (m_tags[b] == TAG_ERASED || m_tags[b] == TAG_EMPTY || m_indexes[b] != index) b = (b + 1) & mask;
+        // A bucket followed by an empty one ends every probe sequence through
+        // it, so it can be emptied instead of being marked as erased.
+        if (m_tags[(b + 1) & mask] == TAG_EMPTY) {
+            m_tags[b] = TAG_EMPTY;
+        } else {
+            m_tags[b] = TAG_ERASED;
+            ++m_erased;
+        }
+        At(index).value.~value_type();
+        m_chunks[index / CHUNK_SIZE]->live &= ~(uint64_t{1} << (index % CHUNK_SIZE));
+        Release(index);
+        --m_size;
+        return {this, NextLive(index + 1)};
+    }
+    iterator erase(iterator pos) { return erase(const_iterator{pos}); }
+
+    size_type erase(const K& key)
+    {
+        const uint32_t index{FindIndex(key)};
+        if (index == NO_INDEX) return 0;
+        erase(const_iterator{this, index});
+        return 1;
+    }
+
+    /**
+     * Move the entries to the front of the arena and release the chunks and the
+     * table space no longer needed after erasing entries. Unlike other operations,
+     * this invalidates iterators and references to the entries. Moving an entry
+     * must not throw.
+     */
+    void shrink_to_fit()
+    {
+        // Fill the lowest unused arena entries with the highest live ones.
+        uint32_t low{0};
+        uint32_t high{m_used};
+        while (true) {
+            while (low < high && (m_chunks[low / CHUNK_SIZE]->live >> (low % CHUNK_SIZE)) & 1) ++low;
+            while (high > low && !((m_chunks[(high - 1) / CHUNK_SIZE]->live >> ((high - 1) % CHUNK_SIZE)) & 1)) --high;
+            if (low + 1 >= high) break;
+            --high;
+            ::new (&At(low).value) value_type(std::move(At(high).value));
+            At(high).value.~value_type();
+            m_chunks[low / CHUNK_SIZE]->live |= uint64_t{1} << (low % CHUNK_SIZE);
+            m_chunks[high / CHUNK_SIZE]->live &= ~(uint64_t{1} << (high % CHUNK_SIZE));
+        }
+        m_used = m_size;
+        m_free = NO_INDEX;
+        m_chunks.resize((m_used + CHUNK_SIZE - 1) / CHUNK_SIZE);
+        m_chunks.shrink_to_fit();
+        // Release the old table before allocating the smaller one.
+        m_indexes.reset();
+        m_tags.reset();
+        m_bucket_count = m_erased = 0;
+        if (m_size > 0) Rehash(m_size);
+    }
+
+    /** Remove all entries and release the arena and the table. */
+    void clear()
+    {
+        for (uint32_t i = NextLive(0); i != NO_INDEX; i = NextLive(i + 1)) {
+            At(i).value.~value_type();
+        }
+        decltype(m_chunks)().swap(m_chunks);
+        m_indexes.reset();
+        m_tags.reset();
+        m_bucket_count = m_size = m_erased = 0;
+        m_used = 0;
+        m_free = NO_INDEX;
+    }
+};
+
+#endif // BITCOIN_ARENAMAP_H
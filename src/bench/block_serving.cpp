@@ -0,0 +1,58 @@
+// Copyright (c) 2022 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <bench/data.h>
+
+#include <chainparams.h>
+#include <net.h>
+#include <netmessagemaker.h>
+#include <node/blockstorage.h>
+#include <protocol.h>
+#include <streams.h>
+#include <test/util/setup_common.h>
+#include <validation.h>
+#include <version.h>
+
+#include <cassert>
+#include <vector>
+
+using node::ReadBlockFromDisk;
+
+/** Store a block on disk and serve it as block message, like PeerManagerImpl::ProcessGetBlockData() does. */
+static void ServeBlock(benchmark::Bench& bench, bool raw)
+{
+    const auto testing_setup{MakeNoLogFileContext<const TestingSetup>(CBaseChainParams::REGTEST)};
+    ChainstateManager& chainman{*testing_setup->m_node.chainman};
+
+    CBlock block;
+    CDataStream stream(benchmark::data::block413567, SER_NETWORK, PROTOCOL_VERSION);
+    stream >> block;
+    const FlatFilePos pos{WITH_LOCK(::cs_main, return chainman.m_blockman.SaveBlockToDisk(block, /*nHeight=*/1, chainman.ActiveChain(), Params(), /*dbp=*/nullptr))};
+    assert(!pos.IsNull());
+
+    const CNetMsgMaker msg_maker(PROTOCOL_VERSION);
+    bench.unit("block").run([&] {
+        if (raw) {
+            CSerializedNetMsg msg;
+            msg.m_type = NetMsgType::BLOCK;
+            const bool read{chainman.m_blockman.ReadRawBlock(msg.data, pos, Params().MessageStart())};
+            assert(read);
+            const CSharedNetMsg block_msg{std::move(msg)};
+            assert(block_msg.data->size() == benchmark::data::block413567.size());
+        } else {
+            CBlock block_read;
+            const bool read{ReadBlockFromDisk(block_read, pos, Params().GetConsensus())};
+            assert(read);
+            const CSharedNetMsg block_msg{msg_maker.Make(NetMsgType::BLOCK, block_read)};
+            assert(block_msg.data->size() == benchmark::data::block413567.size());
+        }
+    });
+}
+
+static void BlockServingDeserialize(benchmark::Bench& bench) { ServeBlock(bench, /*raw=*/false); }
+static void BlockServingRaw(benchmark::Bench& bench) { ServeBlock(bench, /*raw=*/true); }
+
+BENCHMARK(BlockServingDeserialize);
+BENCHMARK(BlockServingRaw);
@@ -6,8 +6,10 @@
 #include <coins.h>
 #include <policy/policy.h>
 #include <script/signingprovider.h>
+#include <random.h>
 #include <test/util/transaction_utils.h>
 
+#include <unordered_map>
 #include <vector>
 
 // Microbenchmark for simple accesses to a CCoinsViewCache database. Note from
@@ -52,3 +54,47 @@ static void CCoinsCaching(benchmark::Bench& bench)
 }
 
 BENCHMARK(CCoinsCaching);
+
+// Fill a coins map, look every coin up and iterate over it, as a cache that
+// is filled by connecting blocks and then flushed does.
+template <typename Map>
+static void CoinsMapFillAndFlush(benchmark::Bench& bench)
+{
+    constexpr size_t NUM_COINS{50000};
+    FastRandomContext rng{/*fDeterministic=*/true};
+    std::vector<COutPoint> outpoints;
+    for (size_t i = 0; i < NUM_COINS; ++i) {
+        outpoints.emplace_back(rng.rand256(), 0);
+    }
+
+    bench.unit("coin").batch(NUM_COINS).run([&] {
+        Map map;
+        for (const COutPoint& outpoint : outpoints) {
+            CCoinsCacheEntry& entry = map[outpoint];
+            entry.coin.out.nValue = 1;
+            entry.flags = CCoinsCacheEntry::DIRTY;
+        }
+        for (const COutPoint& outpoint : outpoints) {
+            assert(map.find(outpoint) != map.end());
+        }
+        CAmount total{0};
+        for (const auto& entry : map) {
+            total += entry.second.coin.out.nValue;
+        }
+        assert(total == CAmount{NUM_COINS});
+    });
+}
+
+static void CCoinsMapFillAndFlush(benchmark::Bench& bench)
+{
+    CoinsMapFillAndFlush<CCoinsMap>(bench);
+}
+
+// The std::unordered_map CCoinsMap used to be, for comparison.
+static void CCoinsMapUnorderedFillAndFlush(benchmark::Bench& bench)
+{
+    CoinsMapFillAndFlush<std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher>>(bench);
+}
+
+BENCHMARK(CCoinsMapFillAndFlush);
+BENCHMARK(CCoinsMapUnorderedFillAndFlush);
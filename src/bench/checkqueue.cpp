@@ -4,18 +4,36 @@
 
 #include <bench/bench.h>
 #include <checkqueue.h>
+#include <crypto/sha256.h>
 #include <key.h>
+#include <policy/policy.h>
 #include <prevector.h>
+#include <primitives/transaction.h>
 #include <pubkey.h>
 #include <random.h>
+#include <script/sign.h>
+#include <script/signingprovider.h>
+#include <script/standard.h>
+#include <test/util/setup_common.h>
+#include <uint256.h>
 #include <util/system.h>
+#include <validation.h>
 
+#include <cassert>
+
+#include <algorithm>
 #include <vector>
 
 static const size_t BATCHES = 101;
 static const size_t BATCH_SIZE = 30;
 static const int PREVECTOR_SIZE = 28;
 static const unsigned int QUEUE_BATCH_SIZE = 128;
+static const size_t SMALL_BLOCKS = 64;
+static const size_t SMALL_BLOCK_CHECKS = 8;
+static const int CHECK_HASH_ROUNDS = 64;
+static const int CONNECT_HASH_ROUNDS = 128;
+static const size_t SCRIPT_CHECK_TXS = 20;
+static const size_t SCRIPT_CHECK_INPUTS = 20;
 
 // This Benchmark tests the CheckQueue with a slightly realistic workload,
 // where checks all contain a prevector that is indirect 50% of the time
@@ -69,3 +87,124 @@ static void CCheckQueueSpeedPrevectorJob(benchmark::Bench& bench)
     ECC_Stop();
 }
 BENCHMARK(CCheckQueueSpeedPrevectorJob);
+
+/** A check that takes a fixed amount of work, standing in for a signature check. */
+struct HashJob {
+    uint256 data;
+    bool operator()()
+    {
+        for (int i = 0; i < CHECK_HASH_ROUNDS; ++i) {
+            CSHA256().Write(data.begin(), data.size()).Finalize(data.begin());
+        }
+        return true;
+    }
+    void swap(HashJob& x) { std::swap(data, x.data); }
+};
+
+// Many small blocks with few checks each, where the master thread does some
+// work (like looking up the spent coins) before queuing each block's checks.
+// Waiting for the checks of every block leaves the workers idle while the
+// master connects the next one. Verifying a window of blocks at once, like
+// ConnectBlock does during initial block download, keeps them busy.
+static void CheckQueueSmallBlocks(benchmark::Bench& bench, size_t window)
+{
+    if (GetNumCores() <= 1) return;
+
+    CCheckQueue<HashJob> queue{QUEUE_BATCH_SIZE};
+    queue.StartWorkerThreads(GetNumCores() - 1);
+
+    uint256 connect_data;
+    bench.minEpochIterations(10).batch(SMALL_BLOCKS * SMALL_BLOCK_CHECKS).unit("job").run([&] {
+        for (size_t first = 0; first < SMALL_BLOCKS; first += window) {
+            CCheckQueueControl<HashJob> control(&queue);
+            for (size_t block = first; block < std::min(first + window, SMALL_BLOCKS); ++block) {
+                for (int i = 0; i < CONNECT_HASH_ROUNDS; ++i) {
+                    CSHA256().Write(connect_data.begin(), connect_data.size()).Finalize(connect_data.begin());
+                }
+                std::vector<HashJob> checks(SMALL_BLOCK_CHECKS);
+                control.Add(checks);
+            }
+            control.Wait();
+        }
+    });
+    queue.StopWorkerThreads();
+}
+
+static void CCheckQueueSmallBlocks(benchmark::Bench& bench)
+{
+    CheckQueueSmallBlocks(bench, /*window=*/1);
+}
+
+static void CCheckQueueSmallBlocksWindow(benchmark::Bench& bench)
+{
+    CheckQueueSmallBlocks(bench, /*window=*/DEFAULT_SCRIPT_CHECK_WINDOW);
+}
+
+BENCHMARK(CCheckQueueSmallBlocks);
+BENCHMARK(CCheckQueueSmallBlocksWindow);
+
+// Script checks of P2WPKH spends, each costing a signature verification like
+// most checks queued while connecting a block, added one transaction at a
+// time. Run with different numbers of threads (the master and threads - 1
+// workers) to see how verification scales.
+static void CheckQueueScriptChecks(benchmark::Bench& bench, int threads)
+{
+    const auto testing_setup{MakeNoLogFileContext<const BasicTestingSetup>()};
+
+    CKey key;
+    key.MakeNewKey(/*fCompressed=*/true);
+    FillableSigningProvider keystore;
+    keystore.AddKey(key);
+    const CTxOut spent{CAmount{100000}, GetScriptForDestination(WitnessV0KeyHash(key.GetPubKey()))};
+
+    FastRandomContext insecure_rand(true);
+    std::vector<CTransactionRef> txs;
+    std::vector<PrecomputedTransactionData> txsdata(SCRIPT_CHECK_TXS);
+    std::vector<std::vector<CScriptCheck>> tx_checks(SCRIPT_CHECK_TXS);
+    for (size_t i = 0; i < SCRIPT_CHECK_TXS; ++i) {
+        CMutableTransaction mtx;
+        for (size_t n = 0; n < SCRIPT_CHECK_INPUTS; ++n) {
+            mtx.vin.emplace_back(COutPoint{insecure_rand.rand256(), 0});
+        }
+        mtx.vout.emplace_back(spent.nValue * CAmount(SCRIPT_CHECK_INPUTS), spent.scriptPubKey);
+        for (size_t n = 0; n < SCRIPT_CHECK_INPUTS; ++n) {
+            const bool signed_input{SignSignature(keystore, spent.scriptPubKey, mtx, n, spent.nValue, SIGHASH_ALL)};
+            assert(signed_input);
+        }
+        txs.push_back(MakeTransactionRef(mtx));
+        txsdata[i].Init(*txs.back(), std::vector<CTxOut>(SCRIPT_CHECK_INPUTS, spent));
+        for (size_t n = 0; n < SCRIPT_CHECK_INPUTS; ++n) {
+            tx_checks[i].emplace_back(spent, *txs.back(), n, STANDARD_SCRIPT_VERIFY_FLAGS, /*cacheIn=*/false, &txsdata[i]);
+        }
+    }
+
+    CCheckQueue<CScriptCheck> queue{QUEUE_BATCH_SIZE};
+    queue.StartWorkerThreads(threads - 1);
+
+    bench.minEpochIterations(10).batch(SCRIPT_CHECK_TXS * SCRIPT_CHECK_INPUTS).unit("check").run([&] {
+        CCheckQueueControl<CScriptCheck> control(&queue);
+        for (const std::vector<CScriptCheck>& checks : tx_checks) {
+            std::vector<CScriptCheck> vChecks{checks};
+            control.Add(vChecks);
+        }
+        const bool verified{control.Wait()};
+        assert(verified);
+    });
+    queue.StopWorkerThreads();
+}
+
+static void CCheckQueueScriptChecks01Thread(benchmark::Bench& bench) { CheckQueueScriptChecks(bench, 1); }
+static void CCheckQueueScriptChecks02Threads(benchmark::Bench& bench) { CheckQueueScriptChecks(bench, 2); }
+static void CCheckQueueScriptChecks04Threads(benchmark::Bench& bench) { CheckQueueScriptChecks(bench, 4); }
+static void CCheckQueueScriptChecks08Threads(benchmark::Bench& bench) { CheckQueueScriptChecks(bench, 8); }
+static void CCheckQueueScriptChecks16Threads(benchmark::Bench& bench) { CheckQueueScriptChecks(bench, 16); }
+static void CCheckQueueScriptChecks32Threads(benchmark::Bench& bench) { CheckQueueScriptChecks(bench, 32); }
+static void CCheckQueueScriptChecks64Threads(benchmark::Bench& bench) { CheckQueueScriptChecks(bench, 64); }
+
+BENCHMARK(CCheckQueueScriptChecks01Thread);
+BENCHMARK(CCheckQueueScriptChecks02Threads);
+BENCHMARK(CCheckQueueScriptChecks04Threads);
+BENCHMARK(CCheckQueueScriptChecks08Threads);
+BENCHMARK(CCheckQueueScriptChecks16Threads);
+BENCHMARK(CCheckQueueScriptChecks32Threads);
+BENCHMARK(CCheckQueueScriptChecks64Threads);
@@ -0,0 +1,87 @@
+// Copyright (c) 2022 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <coins.h>
+#include <random.h>
+#include <test/util/setup_common.h>
+#include <txdb.h>
+
+#include <vector>
+
+static constexpr int INITIAL_HEIGHT{2000};
+static constexpr int COINS_PER_BLOCK{500};
+static constexpr int FLUSH_INTERVAL{20};
+static constexpr size_t MAX_CACHE_USAGE{4 << 20};
+
+/**
+ * Connect blocks against a coins cache limited to MAX_CACHE_USAGE, which is
+ * also flushed every FLUSH_INTERVAL blocks, as pruning does. Each block spends
+ * COINS_PER_BLOCK coins, most of them created by the last few blocks, and
+ * creates as many.
+ *
+ * Without retain_usage every flush empties the cache. Otherwise the flushes
+ * keep the cache, and one that is over the limit is trimmed to retain_usage
+ * instead, as long as the modified coins fit. This mirrors FlushStateToDisk().
+ */
+static void ConnectBlocks(benchmark::Bench& bench, size_t retain_usage)
+{
+    const auto testing_setup{MakeNoLogFileContext<const BasicTestingSetup>()};
+    FastRandomContext rng{/*fDeterministic=*/true};
+    // On disk with a small LevelDB cache, so that cache misses cost a read.
+    CCoinsViewDB db{testing_setup->m_path_root / "bench_flush", /*nCacheSize=*/1 << 20, /*fMemory=*/false, /*fWipe=*/true};
+    CCoinsViewCache cache{&db};
+
+    // Unspent coins in roughly the order they were created.
+    std::vector<COutPoint> unspent;
+    int height{0};
+    const auto add_block = [&] {
+        ++height;
+        for (int i = 0; i < COINS_PER_BLOCK; ++i) {
+            unspent.emplace_back(rng.rand256(), 0);
+            cache.AddCoin(unspent.back(), Coin{CTxOut{1000, CScript{} << OP_TRUE}, height, /*fCoinBaseIn=*/false}, /*possible_overwrite=*/false);
+        }
+        cache.SetBestBlock(rng.rand256());
+    };
+    while (height < INITIAL_HEIGHT) add_block();
+    assert(cache.Flush());
+
+    // Connect enough blocks per epoch to cover several flushes.
+    bench.unit("block").minEpochIterations(400).run([&] {
+        for (int i = 0; i < COINS_PER_BLOCK; ++i) {
+            // Spend a coin of the last 20 blocks three times out of four.
+            const size_t recent{std::min<size_t>(unspent.size(), 20 * COINS_PER_BLOCK)};
+            const size_t pos{rng.randrange(4) ? unspent.size() - 1 - rng.randrange(recent) : rng.randrange(unspent.size())};
+            assert(cache.SpendCoin(unspent[pos]));
+            unspent[pos] = unspent.back();
+            unspent.pop_back();
+        }
+        add_block();
+
+        const bool periodic{height % FLUSH_INTERVAL == 0};
+        const bool cache_full{cache.DynamicMemoryUsage() > MAX_CACHE_USAGE};
+        if (retain_usage == 0) {
+            if (periodic || cache_full) assert(cache.Flush());
+        } else if (cache_full && !cache.Trim(retain_usage)) {
+            assert(cache.Flush());
+        } else if (periodic) {
+            assert(cache.Sync());
+        }
+    });
+}
+
+// Every flush empties the cache.
+static void CoinsConnectFlush(benchmark::Bench& bench)
+{
+    ConnectBlocks(bench, /*retain_usage=*/0);
+}
+
+// Flushes keep the cache, see -dbcacheretain.
+static void CoinsConnectRetain(benchmark::Bench& bench)
+{
+    ConnectBlocks(bench, /*retain_usage=*/MAX_CACHE_USAGE / 2);
+}
+
+BENCHMARK(CoinsConnectFlush);
+BENCHMARK(CoinsConnectRetain);
@@ -0,0 +1,82 @@
+// Copyright (c) 2022 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <chainparams.h>
+#include <coins.h>
+#include <node/coinsprefetch.h>
+#include <random.h>
+#include <test/util/setup_common.h>
+#include <txdb.h>
+
+#include <memory>
+#include <vector>
+
+using node::CoinsPrefetcher;
+
+static constexpr int NUM_INPUTS{2000};
+
+/** Fill db with NUM_INPUTS coins and return a block spending all of them. */
+static std::shared_ptr<const CBlock> SetupCoins(CCoinsViewDB& db)
+{
+    FastRandomContext rng{/*fDeterministic=*/true};
+    CCoinsViewCache cache{&db};
+    CMutableTransaction tx;
+    for (int i = 0; i < NUM_INPUTS; ++i) {
+        const COutPoint outpoint{rng.rand256(), 0};
+        cache.AddCoin(outpoint, Coin{CTxOut{1000, CScript{} << OP_TRUE}, /*nHeightIn=*/1, /*fCoinBaseIn=*/false}, /*possible_overwrite=*/false);
+        tx.vin.emplace_back(outpoint);
+    }
+    cache.SetBestBlock(rng.rand256());
+    assert(cache.Flush());
+
+    auto block{std::make_shared<CBlock>()};
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    block->vtx.push_back(MakeTransactionRef(coinbase));
+    block->vtx.push_back(MakeTransactionRef(tx));
+    return block;
+}
+
+static void AccessInputs(const CBlock& block, CCoinsViewCache& cache)
+{
+    for (const CTxIn& txin : block.vtx[1]->vin) {
+        assert(!cache.AccessCoin(txin.prevout).IsSpent());
+    }
+}
+
+// Inputs fetched one by one from the coins database, as ConnectBlock does
+// without prefetching.
+static void CoinsPrefetchCold(benchmark::Bench& bench)
+{
+    const auto testing_setup{MakeNoLogFileContext<const BasicTestingSetup>()};
+    CCoinsViewDB db{"bench_prefetch", /*nCacheSize=*/8 << 20, /*fMemory=*/true, /*fWipe=*/false};
+    const auto block{SetupCoins(db)};
+
+    bench.unit("input").batch(NUM_INPUTS).run([&] {
+        CCoinsViewCache cache{&db};
+        AccessInputs(*block, cache);
+    });
+}
+
+// Inputs prefetched into the cache by worker threads before being accessed.
+static void CoinsPrefetchWarm(benchmark::Bench& bench)
+{
+    const auto testing_setup{MakeNoLogFileContext<const BasicTestingSetup>()};
+    CCoinsViewDB db{"bench_prefetch", /*nCacheSize=*/8 << 20, /*fMemory=*/true, /*fWipe=*/false};
+    const auto block{SetupCoins(db)};
+    CoinsPrefetcher prefetcher{Params().GetConsensus(), node::DEFAULT_COINS_PREFETCH_THREADS};
+
+    bench.unit("input").batch(NUM_INPUTS).run([&] {
+        CCoinsViewCache cache{&db};
+        prefetcher.Prefetch(block, db);
+        prefetcher.Merge(block->GetHash(), db, cache);
+        AccessInputs(*block, cache);
+    });
+    // Every input was served by the prefetcher.
+    assert(prefetcher.GetStats().HitRate() == 1.0);
+}
+
+BENCHMARK(CoinsPrefetchCold);
+BENCHMARK(CoinsPrefetchWarm);
@@ -0,0 +1,75 @@
+// Copyright (c) 2022 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <chainparams.h>
+#include <consensus/validation.h>
+#include <pow.h>
+#include <primitives/block.h>
+#include <test/util/setup_common.h>
+#include <validation.h>
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+//! Number of headers in the synthetic chain
+static constexpr size_t HEADERS_CHAIN_LENGTH{1000000};
+//! Number of headers per headers message
+static constexpr size_t HEADERS_PER_MESSAGE{2000};
+
+/** Mine a chain of headers on top of the regtest genesis block, one second apart. */
+static std::vector<CBlockHeader> CreateHeadersChain(const CChainParams& params, size_t length)
+{
+    std::vector<CBlockHeader> headers(length);
+    CBlockHeader prev{params.GenesisBlock().GetBlockHeader()};
+    for (CBlockHeader& header : headers) {
+        header.nVersion = 4;
+        header.hashPrevBlock = prev.GetHash();
+        header.hashMerkleRoot = prev.hashMerkleRoot;
+        header.nTime = prev.nTime + 1;
+        header.nBits = prev.nBits;
+        while (!CheckProofOfWork(header.GetHash(), header.nBits, params.GetConsensus())) ++header.nNonce;
+        prev = header;
+    }
+    return headers;
+}
+
+/** Split a chain of headers into headers messages. */
+static std::vector<std::vector<CBlockHeader>> CreateHeadersMessages(const std::vector<CBlockHeader>& headers)
+{
+    std::vector<std::vector<CBlockHeader>> messages;
+    for (size_t i = 0; i < headers.size(); i += HEADERS_PER_MESSAGE) {
+        messages.emplace_back(headers.begin() + i, headers.begin() + std::min(i + HEADERS_PER_MESSAGE, headers.size()));
+    }
+    return messages;
+}
+
+static void SyncHeaders(benchmark::Bench& bench, bool parallel)
+{
+    static const std::vector<std::vector<CBlockHeader>> messages{[] {
+        const auto testing_setup{MakeNoLogFileContext<const BasicTestingSetup>(CBaseChainParams::REGTEST)};
+        return CreateHeadersMessages(CreateHeadersChain(Params(), HEADERS_CHAIN_LENGTH));
+    }()};
+
+    bench.epochs(1).epochIterations(1).run([&] {
+        const auto testing_setup{MakeNoLogFileContext<const TestingSetup>(CBaseChainParams::REGTEST)};
+        // Checking the block index after every header would dominate the run time.
+        fCheckBlockIndex = false;
+        g_parallel_script_checks = parallel;
+        ChainstateManager& chainman{*testing_setup->m_node.chainman};
+        for (const std::vector<CBlockHeader>& message : messages) {
+            BlockValidationState state;
+            bool accepted{chainman.ProcessNewBlockHeaders(message, state, Params())};
+            assert(accepted);
+        }
+        assert(WITH_LOCK(::cs_main, return pindexBestHeader->nHeight) == int(HEADERS_CHAIN_LENGTH));
+    });
+}
+
+static void HeadersSync(benchmark::Bench& bench) { SyncHeaders(bench, /*parallel=*/true); }
+static void HeadersSyncSerial(benchmark::Bench& bench) { SyncHeaders(bench, /*parallel=*/false); }
+
+BENCHMARK(HeadersSync);
+BENCHMARK(HeadersSyncSerial);
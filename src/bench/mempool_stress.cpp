@@ -8,6 +8,9 @@
 #include <txmempool.h>
 #include <validation.h>
 
+#include <cassert>
+#include <limits>
+#include <string>
 #include <vector>
 
 static void AddTx(const CTransactionRef& tx, CTxMemPool& pool) EXCLUSIVE_LOCKS_REQUIRED(cs_main, pool.cs)
@@ -79,6 +82,25 @@ static std::vector<CTransactionRef> CreateOrderedCoins(FastRandomContext& det_ra
     return ordered_coins;
 }
 
+/** Create chains of transactions, each spending the only output of the one before it. */
+static std::vector<CTransactionRef> CreateChains(size_t chains, size_t length)
+{
+    std::vector<CTransactionRef> txs;
+    for (size_t chain = 0; chain < chains; ++chain) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].scriptSig = CScript() << CScriptNum(chain);
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+        tx.vout[0].nValue = 10 * COIN;
+        for (size_t i = 0; i < length; ++i) {
+            txs.emplace_back(MakeTransactionRef(tx));
+            tx.vin[0].prevout = COutPoint(txs.back()->GetHash(), 0);
+        }
+    }
+    return txs;
+}
+
 static void ComplexMemPool(benchmark::Bench& bench)
 {
     FastRandomContext det_rand{true};
@@ -115,5 +137,48 @@ static void MempoolCheck(benchmark::Bench& bench)
     });
 }
 
+static void MempoolLongChains(benchmark::Bench& bench)
+{
+    const size_t chains{10}, length{100};
+    const std::vector<CTransactionRef> txs{CreateChains(chains, length)};
+    const auto testing_setup = MakeNoLogFileContext<const TestingSetup>(CBaseChainParams::MAIN);
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    bench.run([&]() NO_THREAD_SAFETY_ANALYSIS {
+        // Every transaction walks its ancestors when it is added, and again
+        // when the chain is removed along with all descendants of its root.
+        for (const auto& tx : txs) {
+            AddTx(tx, pool);
+        }
+        for (size_t chain = 0; chain < chains; ++chain) {
+            pool.removeRecursive(*txs[chain * length], MemPoolRemovalReason::CONFLICT);
+        }
+        assert(pool.size() == 0);
+    });
+}
+
+static void MempoolLongChainWalks(benchmark::Bench& bench)
+{
+    const size_t chains{10}, length{100};
+    const std::vector<CTransactionRef> txs{CreateChains(chains, length)};
+    const auto testing_setup = MakeNoLogFileContext<const TestingSetup>(CBaseChainParams::MAIN);
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    for (const auto& tx : txs) AddTx(tx, pool);
+    const uint64_t no_limit{std::numeric_limits<uint64_t>::max()};
+    bench.run([&]() NO_THREAD_SAFETY_ANALYSIS {
+        for (const auto& tx : txs) {
+            const CTxMemPool::txiter it{*pool.GetIter(tx->GetHash())};
+            CTxMemPool::setEntries ancestors, descendants;
+            std::string dummy;
+            pool.CalculateMemPoolAncestors(*it, ancestors, no_limit, no_limit, no_limit, no_limit, dummy);
+            pool.CalculateDescendants(it, descendants);
+            assert(ancestors.size() + descendants.size() == length);
+        }
+    });
+}
+
 BENCHMARK(ComplexMemPool);
+BENCHMARK(MempoolLongChains);
+BENCHMARK(MempoolLongChainWalks);
 BENCHMARK(MempoolCheck);
@@ -0,0 +1,93 @@
+// Copyright (c) 2022 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <consensus/amount.h>
+#include <primitives/transaction.h>
+#include <random.h>
+#include <txorphanage.h>
+
+#include <cassert>
+#include <set>
+#include <vector>
+
+//! Number of chains of orphans
+static constexpr int ORPHAN_CHAINS{50};
+//! Number of transactions in each chain
+static constexpr int ORPHAN_CHAIN_LENGTH{20};
+//! Number of honest peers sending the chains
+static constexpr NodeId ORPHAN_PEERS{16};
+//! Number of orphans, whose parents never arrive, from a flooding peer
+static constexpr int FLOOD_ORPHANS{500};
+
+static CTransactionRef MakeOrphan(const COutPoint& prevout)
+{
+    CMutableTransaction tx;
+    tx.vin.emplace_back(prevout);
+    tx.vin[0].scriptSig = CScript() << OP_TRUE;
+    tx.vout.emplace_back(1 * COIN, CScript() << OP_TRUE);
+    return MakeTransactionRef(tx);
+}
+
+/**
+ * Chains of transactions are received child first from several peers, while
+ * another peer floods orphans. Then the parents of the chains arrive, and the
+ * orphans are reconsidered until all chains are resolved.
+ */
+static void OrphanageFlood(benchmark::Bench& bench)
+{
+    FastRandomContext rng{/*fDeterministic=*/true};
+    std::vector<std::vector<CTransactionRef>> chains(ORPHAN_CHAINS);
+    for (auto& chain : chains) {
+        COutPoint prevout{rng.rand256(), 0};
+        for (int i = 0; i < ORPHAN_CHAIN_LENGTH; i++) {
+            chain.push_back(MakeOrphan(prevout));
+            prevout = COutPoint{chain.back()->GetHash(), 0};
+        }
+    }
+    std::vector<CTransactionRef> flood;
+    for (int i = 0; i < FLOOD_ORPHANS; i++) {
+        flood.push_back(MakeOrphan(COutPoint{rng.rand256(), 0}));
+    }
+    const unsigned int max_orphans{ORPHAN_CHAINS * ORPHAN_CHAIN_LENGTH + FLOOD_ORPHANS / 2};
+
+    bench.run([&] {
+        TxOrphanage orphanage;
+        LOCK(g_cs_orphans);
+
+        // Each orphan arrives from two peers, children first, mixed with the flood.
+        NodeId next_peer{0};
+        auto flood_it = flood.begin();
+        for (int i = ORPHAN_CHAIN_LENGTH - 1; i >= 0; i--) {
+            for (const auto& chain : chains) {
+                orphanage.AddTx(chain[i], next_peer);
+                orphanage.AddAnnouncer(chain[i]->GetWitnessHash(), (next_peer + 1) % ORPHAN_PEERS);
+                next_peer = (next_peer + 1) % ORPHAN_PEERS;
+                if (flood_it != flood.end()) orphanage.AddTx(*flood_it++, ORPHAN_PEERS);
+                orphanage.LimitOrphans(max_orphans);
+            }
+        }
+
+        // The parents of the chains arrive.
+        std::set<uint256> work_set;
+        for (const auto& chain : chains) {
+            work_set.insert(chain[0]->GetHash());
+        }
+        const auto get_fee = [&](const CTransaction& tx) -> std::optional<CAmount> {
+            for (const CTxIn& txin : tx.vin) {
+                if (orphanage.HaveTx(GenTxid::Txid(txin.prevout.hash))) return std::nullopt;
+            }
+            return 1000;
+        };
+        while (!work_set.empty()) {
+            for (const CTransactionRef& tx : orphanage.GetWorkBatch(work_set, /*max_batch=*/16, /*max_candidates=*/64, get_fee)) {
+                orphanage.AddChildrenToWorkSet(*tx, work_set);
+                orphanage.EraseTx(tx->GetHash());
+            }
+        }
+        assert(orphanage.Size() == FLOOD_ORPHANS / 2);
+    });
+}
+
+BENCHMARK(OrphanageFlood);
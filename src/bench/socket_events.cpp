@@ -0,0 +1,127 @@
+// Copyright (c) 2022 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <compat.h>
+#include <util/epoll.h>
+#include <util/system.h>
+
+#include <algorithm>
+#include <cassert>
+#include <utility>
+#include <vector>
+
+#ifdef USE_POLL
+#include <poll.h>
+#endif
+
+#ifndef WIN32
+
+//! Number of connections, most of them idle
+static constexpr int SOCKET_PAIRS{4000};
+//! Number of connections that receive a message in each round
+static constexpr int ACTIVE_PAIRS{32};
+
+/** Local socket pairs, of which the first end is watched and the second one sends. */
+class SocketPairs
+{
+    std::vector<std::pair<int, int>> m_pairs;
+
+public:
+    SocketPairs()
+    {
+        // Leave some descriptors for the rest of the process.
+        const int count{std::min(SOCKET_PAIRS, (RaiseFileDescriptorLimit(2 * SOCKET_PAIRS + 100) - 100) / 2)};
+        for (int i = 0; i < count; ++i) {
+            int fds[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds) != 0) break;
+            m_pairs.emplace_back(fds[0], fds[1]);
+        }
+        assert(m_pairs.size() > size_t{ACTIVE_PAIRS});
+    }
+
+    ~SocketPairs()
+    {
+        for (const auto& [watched, sender] : m_pairs) {
+            close(watched);
+            close(sender);
+        }
+    }
+
+    const std::vector<std::pair<int, int>>& Get() const { return m_pairs; }
+
+    /** Send a byte on the next ACTIVE_PAIRS connections, spread over all of them. */
+    void Send(size_t& round)
+    {
+        const uint8_t byte{0};
+        for (int i = 0; i < ACTIVE_PAIRS; ++i) {
+            const size_t n{(round * ACTIVE_PAIRS + i) * 7919 % m_pairs.size()};
+            [[maybe_unused]] const ssize_t sent{send(m_pairs[n].second, &byte, 1, 0)};
+        }
+        ++round;
+    }
+};
+
+static void ReceiveByte(int fd)
+{
+    uint8_t byte;
+    [[maybe_unused]] const ssize_t received{recv(fd, &byte, 1, MSG_DONTWAIT)};
+}
+
+#ifdef USE_POLL
+/** Build the set of all sockets and poll it in every round, like CConnman::SocketEvents() does. */
+static void SocketEventsPoll(benchmark::Bench& bench)
+{
+    SocketPairs pairs;
+    size_t round{0};
+    bench.run([&] {
+        pairs.Send(round);
+        std::vector<pollfd> fds;
+        fds.reserve(pairs.Get().size());
+        for (const auto& [watched, sender] : pairs.Get()) {
+            fds.push_back(pollfd{watched, POLLIN, 0});
+        }
+        const int ready{poll(fds.data(), fds.size(), /*timeout=*/0)};
+        assert(ready == ACTIVE_PAIRS);
+        for (const pollfd& fd : fds) {
+            if (fd.revents & POLLIN) ReceiveByte(fd.fd);
+        }
+    });
+}
+
+BENCHMARK(SocketEventsPoll);
+#endif // USE_POLL
+
+#ifdef USE_EPOLL
+/** Register all sockets once and only get the ready ones reported, like CConnman::SocketHandlerEpoll() does. */
+static void SocketEventsEpoll(benchmark::Bench& bench)
+{
+    SocketPairs pairs;
+    Epoll epoll;
+    assert(epoll.IsValid());
+    for (const auto& [watched, sender] : pairs.Get()) {
+        const bool added{epoll.Add(watched, watched, /*edge_triggered=*/true)};
+        assert(added);
+    }
+    // Consume the initial write readiness.
+    std::vector<Epoll::Event> events;
+    do {
+        epoll.Wait(std::chrono::milliseconds{0}, events);
+    } while (!events.empty());
+
+    size_t round{0};
+    bench.run([&] {
+        pairs.Send(round);
+        epoll.Wait(std::chrono::milliseconds{0}, events);
+        assert(events.size() == size_t{ACTIVE_PAIRS});
+        for (const Epoll::Event& event : events) {
+            if (event.recv) ReceiveByte(event.id);
+        }
+    });
+}
+
+BENCHMARK(SocketEventsEpoll);
+#endif // USE_EPOLL
+
+#endif // WIN32
@@ -10,9 +10,12 @@
 #include <script/script.h>
 #include <script/standard.h>
 #include <streams.h>
+#include <test/util/setup_common.h>
 #include <test/util/transaction_utils.h>
+#include <validation.h>
 
 #include <array>
+#include <vector>
 
 // Microbenchmark for verification of a basic P2WPKH script. Can be easily
 // modified to measure performance of other types of scripts.
@@ -96,5 +99,82 @@ static void VerifyNestedIfScript(benchmark::Bench& bench)
     });
 }
 
+static constexpr int SCHNORR_INPUTS{100};
+
+/** A transaction spending SCHNORR_INPUTS Taproot outputs through their key paths. */
+struct SchnorrSpend {
+    CMutableTransaction tx_credit;
+    CTransaction tx_spend;
+    PrecomputedTransactionData txdata;
+
+    static CTransaction Sign(const CMutableTransaction& tx_credit, const std::vector<CKey>& keys)
+    {
+        CMutableTransaction tx;
+        for (int i = 0; i < SCHNORR_INPUTS; ++i) {
+            tx.vin.emplace_back(COutPoint{tx_credit.GetHash(), uint32_t(i)});
+        }
+        tx.vout.emplace_back(SCHNORR_INPUTS, CScript() << OP_TRUE);
+        PrecomputedTransactionData txdata;
+        // The witnesses are still empty, so force the Taproot precomputation.
+        txdata.Init(tx, std::vector<CTxOut>{tx_credit.vout}, /*force=*/true);
+        for (int i = 0; i < SCHNORR_INPUTS; ++i) {
+            ScriptExecutionData execdata;
+            execdata.m_annex_init = true;
+            execdata.m_annex_present = false;
+            uint256 hash;
+            bool ok{SignatureHashSchnorr(hash, execdata, tx, i, SIGHASH_DEFAULT, SigVersion::TAPROOT, txdata, MissingDataBehavior::FAIL)};
+            std::vector<unsigned char> sig(64);
+            const uint256 merkle_root;
+            ok = ok && keys[i].SignSchnorr(hash, sig, &merkle_root, uint256::ONE);
+            assert(ok);
+            tx.vin[i].scriptWitness.stack.push_back(sig);
+        }
+        return CTransaction{tx};
+    }
+
+    static CMutableTransaction Credit(const std::vector<CKey>& keys)
+    {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        for (const CKey& key : keys) {
+            const XOnlyPubKey output_key{XOnlyPubKey{key.GetPubKey()}.CreateTapTweak(nullptr)->first};
+            tx.vout.emplace_back(1, CScript() << OP_1 << ToByteVector(output_key));
+        }
+        return tx;
+    }
+
+    explicit SchnorrSpend(const std::vector<CKey>& keys) : tx_credit{Credit(keys)}, tx_spend{Sign(tx_credit, keys)}
+    {
+        txdata.Init(tx_spend, std::vector<CTxOut>{tx_credit.vout});
+    }
+
+    CScriptCheck Check(int input)
+    {
+        return CScriptCheck(tx_credit.vout[input], tx_spend, input, STANDARD_SCRIPT_VERIFY_FLAGS, /*cacheIn=*/false, &txdata);
+    }
+};
+
+static std::vector<CKey> SchnorrKeys()
+{
+    std::vector<CKey> keys(SCHNORR_INPUTS);
+    for (CKey& key : keys) key.MakeNewKey(true);
+    return keys;
+}
+
+// Verification of the scripts of a transaction with many Taproot key path
+// inputs.
+static void VerifySchnorrScripts(benchmark::Bench& bench)
+{
+    const auto testing_setup{MakeNoLogFileContext<const BasicTestingSetup>()};
+    SchnorrSpend spend{SchnorrKeys()};
+    bench.unit("input").batch(SCHNORR_INPUTS).minEpochIterations(10).run([&] {
+        for (int i = 0; i < SCHNORR_INPUTS; ++i) {
+            bool ok{spend.Check(i)()};
+            assert(ok);
+        }
+    });
+}
+
 BENCHMARK(VerifyScriptBench);
 BENCHMARK(VerifyNestedIfScript);
+BENCHMARK(VerifySchnorrScripts);
@@ -156,7 +156,8 @@ public:
         }};
 
         m_assumeutxo_data = MapAssumeutxo{
-            // TODO to be specified in a future patch.
+            // Add the txoutset_hash and nchaintx reported by dumptxoutset for
+            // each UTXO snapshot that is published for loadtxoutset.
         };
 
         chainTxData = ChainTxData{
@@ -458,6 +459,11 @@ public:
                 200,
                 {AssumeutxoHash{uint256S("0x51c8d11d8b5c1de51543c579736e786aa2736206d1e11e627568029ce092cf62")}, 200},
             },
+            {
+                // Used by feature_assumeutxo.py
+                299,
+                {AssumeutxoHash{uint256S("0xc824341476dda73a2c194d11561532aa7ede143084fc2c4ce4a07171b367fe6c")}, 300},
+            },
         };
 
         chainTxData = ChainTxData{
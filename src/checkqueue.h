@@ -11,6 +11,12 @@
 #include <util/threadnames.h>
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
 #include <vector>
 
 template <typename T>
@@ -25,10 +31,110 @@ class CCheckQueueControl;
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * Work is distributed by work stealing: every thread owns a deque of ranges
+  * of checks. The master pushes each added batch onto its own deque. A thread
+  * takes ranges from the bottom of its own deque, and when that is empty,
+  * steals from the top of another one. Before running a range, a thread
+  * splits it in halves, pushing the upper half onto its deque for others to
+  * steal, until it is small enough. Threads only synchronize on the deques'
+  * atomic indexes, the mutex is used for sleeping and waking up only.
   */
 template <typename T>
 class CCheckQueue
 {
+public:
+    // Task and WorkDeque are public for unit tests only.
+
+    //! A range of checks within a batch
+    struct Task {
+        T* begin{nullptr};
+        T* end{nullptr};
+        //! Ranges larger than this are split before running them
+        size_t grain{1};
+    };
+
+    /**
+     * Fixed size work-stealing deque (Chase and Lev, with the memory orderings
+     * of Le et al. 2013). Only the owning thread pushes and pops at the
+     * bottom, other threads steal from the top.
+     */
+    class WorkDeque
+    {
+    public:
+        static constexpr int64_t CAPACITY{1024};
+
+    private:
+
+        struct Slot {
+            std::atomic<T*> begin{nullptr};
+            std::atomic<T*> end{nullptr};
+            std::atomic<size_t> grain{1};
+        };
+
+        alignas(64) std::atomic<int64_t> m_top{0};
+        alignas(64) std::atomic<int64_t> m_bottom{0};
+        alignas(64) Slot m_slots[CAPACITY];
+
+        void Read(int64_t index, Task& task) const
+        {
+            const Slot& slot{m_slots[index % CAPACITY]};
+            task.begin = slot.begin.load(std::memory_order_relaxed);
+            task.end = slot.end.load(std::memory_order_relaxed);
+            task.grain = slot.grain.load(std::memory_order_relaxed);
+        }
+
+    public:
+        //! Push a task at the bottom. Owner only. Returns false if the deque is full.
+        bool Push(const Task& task)
+        {
+            const int64_t b{m_bottom.load(std::memory_order_relaxed)};
+            const int64_t t{m_top.load(std::memory_order_acquire)};
+            if (b - t >= CAPACITY) return false;
+            Slot& slot{m_slots[b % CAPACITY]};
+            slot.begin.store(task.begin, std::memory_order_relaxed);
+            slot.end.store(task.end, std::memory_order_relaxed);
+            slot.grain.store(task.grain, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            m_bottom.store(b + 1, std::memory_order_relaxed);
+            return true;
+        }
+
+        //! Pop the most recently pushed task. Owner only.
+        bool Pop(Task& task)
+        {
+            const int64_t b{m_bottom.load(std::memory_order_relaxed) - 1};
+            m_bottom.store(b, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t t{m_top.load(std::memory_order_relaxed)};
+            bool found{t <= b};
+            if (found) {
+                Read(b, task);
+                if (t == b) {
+                    // Last task, race against thieves for it.
+                    found = m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+                    m_bottom.store(b + 1, std::memory_order_relaxed);
+                }
+            } else {
+                m_bottom.store(b + 1, std::memory_order_relaxed);
+            }
+            return found;
+        }
+
+        //! Steal the least recently pushed task. Any thread.
+        bool Steal(Task& task)
+        {
+            int64_t t{m_top.load(std::memory_order_acquire)};
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            const int64_t b{m_bottom.load(std::memory_order_acquire)};
+            if (t >= b) return false;
+            // The slot may be overwritten once the task was taken by someone
+            // else, in which case the exchange fails and the read is discarded.
+            Read(t, task);
+            return m_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+        }
+    };
+
 private:
     //! Mutex to protect the inner state
     Mutex m_mutex;
@@ -39,25 +145,27 @@ private:
     //! Master thread blocks on this when out of work
     std::condition_variable m_master_cv;
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue GUARDED_BY(m_mutex);
+    //! One deque per thread, the master's first. Only resized while no worker threads are running.
+    std::vector<std::unique_ptr<WorkDeque>> m_deques;
 
-    //! The number of workers (including the master) that are idle.
-    int nIdle GUARDED_BY(m_mutex){0};
+    //! Batches added since the last Wait(), only accessed by the master
+    std::vector<std::vector<T>> m_batches;
 
-    //! The total number of workers (including the master).
-    int nTotal GUARDED_BY(m_mutex){0};
+    //! Incremented whenever work was added for sleeping workers to pick up
+    uint64_t m_work_epoch GUARDED_BY(m_mutex){0};
+
+    //! The number of threads, including the master, that are sleeping.
+    std::atomic<int> m_idle{0};
 
     //! The temporary evaluation result.
-    bool fAllOk GUARDED_BY(m_mutex){true};
+    std::atomic<bool> m_all_ok{true};
 
     /**
      * Number of verifications that haven't completed yet.
-     * This includes elements that are no longer queued, but still in the
-     * worker's own batches.
+     * This includes elements that are no longer queued, but still in a
+     * thread's own range.
      */
-    unsigned int nTodo GUARDED_BY(m_mutex){0};
+    std::atomic<size_t> m_todo{0};
 
     //! The maximum number of elements to be processed in one batch
     const unsigned int nBatchSize;
@@ -65,68 +173,68 @@ private:
     std::vector<std::thread> m_worker_threads;
     bool m_request_stop GUARDED_BY(m_mutex){false};
 
-    /** Internal function that does bulk of the verification work. */
-    bool Loop(bool fMaster)
+    void WakeWorker()
     {
-        std::condition_variable& cond = fMaster ? m_master_cv : m_worker_cv;
-        std::vector<T> vChecks;
-        vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
-        do {
-            {
-                WAIT_LOCK(m_mutex, lock);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master it can exit and return the result
-                        m_master_cv.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
-                }
-                // logically, the do loop starts here
-                while (queue.empty() && !m_request_stop) {
-                    if (fMaster && nTodo == 0) {
-                        nTotal--;
-                        bool fRet = fAllOk;
-                        // reset the status for new work later
-                        fAllOk = true;
-                        // return the current status
-                        return fRet;
-                    }
-                    nIdle++;
-                    cond.wait(lock); // wait
-                    nIdle--;
-                }
-                if (m_request_stop) {
-                    return false;
-                }
+        WITH_LOCK(m_mutex, ++m_work_epoch);
+        m_worker_cv.notify_one();
+        // The master steals, too, while it waits for the checks to complete.
+        m_master_cv.notify_one();
+    }
 
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the m_mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
-                }
-                // Check whether we need to do work at all
-                fOk = fAllOk;
+    /** Take a task from the own deque, or steal one from another thread's. */
+    bool FindTask(size_t self, Task& task)
+    {
+        if (m_deques[self]->Pop(task)) return true;
+        const size_t count{m_deques.size()};
+        for (size_t i = 1; i < count; ++i) {
+            if (m_deques[(self + i) % count]->Steal(task)) return true;
+        }
+        return false;
+    }
+
+    void RunTask(size_t self, Task task)
+    {
+        // Leave the upper halves for other threads to steal.
+        while (size_t(task.end - task.begin) > task.grain) {
+            T* const middle{task.begin + (task.end - task.begin) / 2};
+            if (!m_deques[self]->Push({middle, task.end, task.grain})) break;
+            task.end = middle;
+            if (m_idle.load(std::memory_order_relaxed) > 0) WakeWorker();
+        }
+
+        bool ok{m_all_ok.load(std::memory_order_relaxed)};
+        for (T* check = task.begin; check != task.end; ++check) {
+            // Check whether we need to do work at all
+            if (ok) ok = (*check)();
+            // Destroy the check right away, its batch is freed at the end of Wait()
+            T().swap(*check);
+        }
+        if (!ok) m_all_ok.store(false, std::memory_order_relaxed);
+
+        const size_t count(task.end - task.begin);
+        if (m_todo.fetch_sub(count, std::memory_order_acq_rel) == count) {
+            // We processed the last element; inform the master it can exit and return the result
+            WITH_LOCK(m_mutex, m_master_cv.notify_one());
+        }
+    }
+
+    /** Worker thread loop, running tasks until stopped. */
+    void Loop(size_t self)
+    {
+        uint64_t epoch{WITH_LOCK(m_mutex, return m_work_epoch)};
+        while (true) {
+            Task task;
+            if (FindTask(self, task)) {
+                RunTask(self, task);
+                continue;
             }
-            // execute work
-            for (T& check : vChecks)
-                if (fOk)
-                    fOk = check();
-            vChecks.clear();
-        } while (true);
+            WAIT_LOCK(m_mutex, lock);
+            ++m_idle;
+            m_worker_cv.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return m_work_epoch != epoch || m_request_stop; });
+            --m_idle;
+            if (m_request_stop) return;
+            epoch = m_work_epoch;
+        }
     }
 
 public:
@@ -137,23 +245,23 @@ public:
     explicit CCheckQueue(unsigned int nBatchSizeIn)
         : nBatchSize(nBatchSizeIn)
     {
+        m_deques.push_back(std::make_unique<WorkDeque>());
     }
 
-    //! Create a pool of new worker threads.
-    void StartWorkerThreads(const int threads_num)
+    //! Create a pool of new worker threads, named thread_name.<n>.
+    void StartWorkerThreads(const int threads_num, const std::string& thread_name = "scriptch")
     {
-        {
-            LOCK(m_mutex);
-            nIdle = 0;
-            nTotal = 0;
-            fAllOk = true;
-        }
         assert(m_worker_threads.empty());
+        m_all_ok = true;
+        m_deques.resize(1);
+        for (int n = 0; n < threads_num; ++n) {
+            m_deques.push_back(std::make_unique<WorkDeque>());
+        }
         for (int n = 0; n < threads_num; ++n) {
-            m_worker_threads.emplace_back([this, n]() {
-                util::ThreadRename(strprintf("scriptch.%i", n));
+            m_worker_threads.emplace_back([this, n, thread_name]() {
+                util::ThreadRename(strprintf("%s.%i", thread_name, n));
                 SetSyscallSandboxPolicy(SyscallSandboxPolicy::VALIDATION_SCRIPT_CHECK);
-                Loop(false /* worker thread */);
+                Loop(n + 1);
             });
         }
     }
@@ -161,7 +269,26 @@ public:
     //! Wait until execution finishes, and return whether all evaluations were successful.
     bool Wait()
     {
-        return Loop(true /* master thread */);
+        uint64_t epoch{WITH_LOCK(m_mutex, return m_work_epoch)};
+        while (m_todo.load(std::memory_order_acquire) > 0) {
+            Task task;
+            if (FindTask(0, task)) {
+                RunTask(0, task);
+                continue;
+            }
+            // The remaining checks are being run by workers. Wake up when they
+            // are done, or when they split off work to steal.
+            WAIT_LOCK(m_mutex, lock);
+            ++m_idle;
+            m_master_cv.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) {
+                return m_todo.load(std::memory_order_acquire) == 0 || m_work_epoch != epoch;
+            });
+            --m_idle;
+            epoch = m_work_epoch;
+        }
+        m_batches.clear();
+        // reset the status for new work later, and return the current status
+        return m_all_ok.exchange(true);
     }
 
     //! Add a batch of checks to the queue
@@ -171,20 +298,19 @@ public:
             return;
         }
 
-        {
-            LOCK(m_mutex);
-            for (T& check : vChecks) {
-                queue.emplace_back();
-                check.swap(queue.back());
-            }
-            nTodo += vChecks.size();
-        }
-
-        if (vChecks.size() == 1) {
-            m_worker_cv.notify_one();
-        } else {
-            m_worker_cv.notify_all();
+        // Keep the checks where they are until they are run, so taking a range
+        // never moves any of them. Aim for ranges small enough that all
+        // threads get a share, but not larger than nBatchSize.
+        std::vector<T>& batch{m_batches.emplace_back()};
+        batch.swap(vChecks);
+        Task task{batch.data(), batch.data() + batch.size(), std::max<size_t>(1, std::min<size_t>(nBatchSize, batch.size() / m_deques.size()))};
+        m_todo.fetch_add(batch.size(), std::memory_order_relaxed);
+        while (!m_deques[0]->Push(task)) {
+            // Our deque is full; run some of the work ourselves.
+            Task own;
+            if (m_deques[0]->Pop(own)) RunTask(0, own);
         }
+        if (!m_worker_threads.empty()) WakeWorker();
     }
 
     //! Stop all of the worker threads.
@@ -10,10 +10,22 @@
 #include <util/trace.h>
 #include <version.h>
 
+#include <algorithm>
+
 bool CCoinsView::GetCoin(const COutPoint &outpoint, Coin &coin) const { return false; }
 uint256 CCoinsView::GetBestBlock() const { return uint256(); }
 std::vector<uint256> CCoinsView::GetHeadBlocks() const { return std::vector<uint256>(); }
 bool CCoinsView::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) { return false; }
+bool CCoinsView::BatchWriteDirty(CCoinsMap &mapCoins, const uint256 &hashBlock)
+{
+    CCoinsMap dirty;
+    for (const auto& [outpoint, entry] : mapCoins) {
+        if (entry.flags & CCoinsCacheEntry::DIRTY) {
+            dirty.try_emplace(outpoint, Coin{entry.coin}, entry.flags);
+        }
+    }
+    return BatchWrite(dirty, hashBlock);
+}
 std::unique_ptr<CCoinsViewCursor> CCoinsView::Cursor() const { return nullptr; }
 
 bool CCoinsView::HaveCoin(const COutPoint &outpoint) const
@@ -29,6 +41,7 @@ uint256 CCoinsViewBacked::GetBestBlock() const { return base->GetBestBlock(); }
 std::vector<uint256> CCoinsViewBacked::GetHeadBlocks() const { return base->GetHeadBlocks(); }
 void CCoinsViewBacked::SetBackend(CCoinsView &viewIn) { base = &viewIn; }
 bool CCoinsViewBacked::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) { return base->BatchWrite(mapCoins, hashBlock); }
+bool CCoinsViewBacked::BatchWriteDirty(CCoinsMap &mapCoins, const uint256 &hashBlock) { return base->BatchWriteDirty(mapCoins, hashBlock); }
 std::unique_ptr<CCoinsViewCursor> CCoinsViewBacked::Cursor() const { return base->Cursor(); }
 size_t CCoinsViewBacked::EstimateSize() const { return base->EstimateSize(); }
 
@@ -45,7 +58,7 @@ CCoinsMap::iterator CCoinsViewCache::FetchCoin(const COutPoint &outpoint) const
     Coin tmp;
     if (!base->GetCoin(outpoint, tmp))
         return cacheCoins.end();
-    CCoinsMap::iterator ret = cacheCoins.emplace(std::piecewise_construct, std::forward_as_tuple(outpoint), std::forward_as_tuple(std::move(tmp))).first;
+    CCoinsMap::iterator ret = cacheCoins.try_emplace(outpoint, std::move(tmp)).first;
     if (ret->second.coin.IsSpent()) {
         // The parent only has an empty entry for this outpoint; we can consider our
         // version as fresh.
@@ -69,7 +82,7 @@ void CCoinsViewCache::AddCoin(const COutPoint &outpoint, Coin&& coin, bool possi
     if (coin.out.scriptPubKey.IsUnspendable()) return;
     CCoinsMap::iterator it;
     bool inserted;
-    std::tie(it, inserted) = cacheCoins.emplace(std::piecewise_construct, std::forward_as_tuple(outpoint), std::tuple<>());
+    std::tie(it, inserted) = cacheCoins.try_emplace(outpoint);
     bool fresh = false;
     if (!inserted) {
         cachedCoinsUsage -= it->second.coin.DynamicMemoryUsage();
@@ -106,10 +119,14 @@ void CCoinsViewCache::AddCoin(const COutPoint &outpoint, Coin&& coin, bool possi
 
 void CCoinsViewCache::EmplaceCoinInternalDANGER(COutPoint&& outpoint, Coin&& coin) {
     cachedCoinsUsage += coin.DynamicMemoryUsage();
-    cacheCoins.emplace(
-        std::piecewise_construct,
-        std::forward_as_tuple(std::move(outpoint)),
-        std::forward_as_tuple(std::move(coin), CCoinsCacheEntry::DIRTY));
+    cacheCoins.try_emplace(outpoint, std::move(coin), CCoinsCacheEntry::DIRTY);
+}
+
+bool CCoinsViewCache::EmplaceFetchedCoin(const COutPoint& outpoint, Coin&& coin) {
+    assert(!coin.IsSpent());
+    auto [it, inserted] = cacheCoins.try_emplace(outpoint, std::move(coin));
+    if (inserted) cachedCoinsUsage += it->second.coin.DynamicMemoryUsage();
+    return inserted;
 }
 
 void AddCoins(CCoinsViewCache& cache, const CTransaction &tx, int nHeight, bool check_for_overwrite) {
@@ -239,6 +256,90 @@ bool CCoinsViewCache::Flush() {
     return fOk;
 }
 
+bool CCoinsViewCache::Sync() {
+    // The base reads the dirty entries in place, so they are not copied
+    // unless it has to keep them beyond the call.
+    if (!base->BatchWriteDirty(cacheCoins, hashBlock)) return false;
+    for (auto it = cacheCoins.begin(); it != cacheCoins.end();) {
+        if (it->second.coin.IsSpent()) {
+            // Spent entries are written now, and not worth keeping.
+            it = cacheCoins.erase(it);
+        } else {
+            it->second.flags = 0;
+            ++it;
+        }
+    }
+    return true;
+}
+
+bool CCoinsViewCache::Trim(size_t max_usage) {
+    // The average entry size changes with the evicted entries, so a second pass
+    // may be needed to get below max_usage.
+    for (int pass = 0; pass < 2; ++pass) {
+        const size_t usage{DynamicMemoryUsage()};
+        if (usage <= max_usage) return true;
+        if (cacheCoins.empty()) {
+            ReallocateCache();
+            return true;
+        }
+
+        // Keep as many entries as fit in max_usage once the map is compacted, the
+        // modified ones and then those created at the greatest heights. A kept
+        // entry costs its coin, its arena entry and up to four table buckets, and
+        // the last arena chunk may be partly used.
+        const size_t entry_usage{(cachedCoinsUsage + cacheCoins.size() - 1) / cacheCoins.size() +
+                                 memusage::MallocUsage(CCoinsMap::CHUNK_BYTES) / CCoinsMap::CHUNK_SIZE + 4 * (sizeof(uint32_t) + 1)};
+        const size_t fixed_usage{memusage::MallocUsage(CCoinsMap::CHUNK_BYTES)};
+        const size_t keep{max_usage > fixed_usage ? (max_usage - fixed_usage) / entry_usage : 0};
+        uint32_t max_height{0};
+        size_t dirty{0};
+        for (const auto& entry : cacheCoins) {
+            max_height = std::max<uint32_t>(max_height, entry.second.coin.nHeight);
+            if (entry.second.flags != 0) ++dirty;
+        }
+        if (dirty > keep) return false;
+        std::vector<size_t> clean_per_height(size_t{max_height} + 1);
+        for (const auto& entry : cacheCoins) {
+            if (entry.second.flags == 0) ++clean_per_height[entry.second.coin.nHeight];
+        }
+        // Clean coins above min_height are kept, and up to min_height_keep at min_height.
+        uint32_t min_height{max_height};
+        size_t min_height_keep{keep - dirty};
+        while (min_height_keep > clean_per_height[min_height] && min_height > 0) {
+            min_height_keep -= clean_per_height[min_height];
+            --min_height;
+        }
+
+        // Evict in place and compact the map afterwards, so that trimming
+        // never needs more memory than the cache already uses.
+        const size_t old_size{cacheCoins.size()};
+        for (auto it = cacheCoins.begin(); it != cacheCoins.end();) {
+            const CCoinsCacheEntry& entry{it->second};
+            bool evict{false};
+            if (entry.flags == 0) {
+                if (entry.coin.nHeight < min_height) {
+                    evict = true;
+                } else if (entry.coin.nHeight == min_height) {
+                    if (min_height_keep == 0) {
+                        evict = true;
+                    } else {
+                        --min_height_keep;
+                    }
+                }
+            }
+            if (evict) {
+                cachedCoinsUsage -= entry.coin.DynamicMemoryUsage();
+                it = cacheCoins.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        cacheCoins.shrink_to_fit();
+        if (cacheCoins.size() == old_size) break;
+    }
+    return DynamicMemoryUsage() <= max_usage;
+}
+
 void CCoinsViewCache::Uncache(const COutPoint& hash)
 {
     CCoinsMap::iterator it = cacheCoins.find(hash);
@@ -6,6 +6,7 @@
 #ifndef BITCOIN_COINS_H
 #define BITCOIN_COINS_H
 
+#include <arenamap.h>
 #include <compressor.h>
 #include <core_memusage.h>
 #include <memusage.h>
@@ -18,7 +19,6 @@
 #include <stdint.h>
 
 #include <functional>
-#include <unordered_map>
 
 /**
  * A UTXO entry.
@@ -131,7 +131,17 @@ struct CCoinsCacheEntry
     CCoinsCacheEntry(Coin&& coin_, unsigned char flag) : coin(std::move(coin_)), flags(flag) {}
 };
 
-typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> CCoinsMap;
+/**
+ * The coins cache: an open-addressing table indexing entries stored in
+ * contiguous chunks, see arenamap. References to entries stay valid until
+ * they are erased, as code handing out `const Coin&` relies on.
+ *
+ * Only the entries are pooled. The scriptPubKey of a coin is a prevector
+ * that stores scripts of up to 28 bytes (P2PKH, P2SH, P2WPKH) inside the
+ * entry, while longer ones such as P2WSH and P2TR are allocated on their
+ * own and counted by Coin::DynamicMemoryUsage().
+ */
+typedef arenamap<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> CCoinsMap;
 
 /** Cursor for iterating over CoinsView state */
 class CCoinsViewCursor
@@ -179,6 +189,10 @@ public:
     //! The passed mapCoins can be modified.
     virtual bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
 
+    //! Write the dirty entries of mapCoins like BatchWrite(), but leave mapCoins
+    //! unchanged. By default, the dirty entries are copied and passed to BatchWrite().
+    virtual bool BatchWriteDirty(CCoinsMap &mapCoins, const uint256 &hashBlock);
+
     //! Get a cursor to iterate over the whole state
     virtual std::unique_ptr<CCoinsViewCursor> Cursor() const;
 
@@ -204,6 +218,7 @@ public:
     std::vector<uint256> GetHeadBlocks() const override;
     void SetBackend(CCoinsView &viewIn);
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    bool BatchWriteDirty(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
     std::unique_ptr<CCoinsViewCursor> Cursor() const override;
     size_t EstimateSize() const override;
 };
@@ -275,6 +290,16 @@ public:
      */
     void EmplaceCoinInternalDANGER(COutPoint&& outpoint, Coin&& coin);
 
+    /**
+     * Add an unspent coin that was read from the base view elsewhere, as if it
+     * had been fetched by AccessCoin(). Nothing happens if the cache already
+     * has an entry for the outpoint.
+     *
+     * The coin must be the base view's current version of the outpoint.
+     * Used by node::CoinsPrefetcher to warm the cache ahead of ConnectBlock().
+     */
+    bool EmplaceFetchedCoin(const COutPoint& outpoint, Coin&& coin);
+
     /**
      * Spend a coin. Pass moveto in order to get the deleted data.
      * If no unspent output exists for the passed outpoint, this call
@@ -289,6 +314,25 @@ public:
      */
     bool Flush();
 
+    /**
+     * Push the modifications applied to this cache to its base, like Flush(),
+     * but keep the unspent coins cached as unmodified entries so that lookups
+     * after the flush still hit the cache. Spent coins are removed.
+     * If false is returned, the state of this cache (and its backing view) will be undefined.
+     */
+    bool Sync();
+
+    /**
+     * Evict unmodified coins until the memory usage of the cache is at most
+     * max_usage bytes. The coins created at the greatest heights are kept, as
+     * recently created coins are the most likely to be spent soon. The cache
+     * map is reallocated to release the memory of the evicted entries.
+     *
+     * @returns false if the modified coins alone need more than max_usage
+     *          bytes, in which case nothing may have been evicted.
+     */
+    bool Trim(size_t max_usage);
+
     /**
      * Removes the UTXO with the given outpoint from the cache, if it is
      * not modified.
@@ -474,6 +474,21 @@ public:
             }
         return false;
     }
+
+    /** for_each calls fn with every element that is not marked for garbage
+     * collection, for example to save the contents of the cache.
+     *
+     * Like insert, for_each must not run concurrently with other calls.
+     *
+     * @param fn the function to call with each element
+     */
+    template <typename Fn>
+    void for_each(Fn&& fn) const
+    {
+        for (uint32_t i = 0; i < size; ++i) {
+            if (!collection_flags.bit_is_set(i)) fn(table[i]);
+        }
+    }
 };
 } // namespace CuckooCache
 
@@ -21,10 +21,12 @@
 #include <util/threadnames.h>
 #include <util/translation.h>
 
+#include <chrono>
 #include <deque>
 #include <memory>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdexcept>
 #include <string>
 
 #include <sys/types.h>
@@ -41,6 +43,9 @@
 /** Maximum size of http request (request line + headers) */
 static const size_t MAX_HEADERS_SIZE = 8192;
 
+/** Maximum number of chunks of a chunked reply that are queued for the client */
+static const size_t MAX_REPLY_CHUNKS_IN_FLIGHT = 4;
+
 /** HTTP request work item */
 class HTTPWorkItem final : public HTTPClosure
 {
@@ -146,6 +151,8 @@ static std::unique_ptr<WorkQueue<HTTPClosure>> g_work_queue{nullptr};
 static std::vector<HTTPPathHandler> pathHandlers;
 //! Bound listening sockets
 static std::vector<evhttp_bound_socket *> boundSockets;
+//! Time a worker may wait in total for a client to receive a chunked reply (-rpcservertimeout)
+static std::chrono::seconds g_reply_write_timeout{DEFAULT_HTTP_SERVER_TIMEOUT};
 
 /** Check if a network address is allowed to access the HTTP server */
 static bool ClientAllowed(const CNetAddr& netaddr)
@@ -381,7 +388,9 @@ bool InitHTTPServer()
         return false;
     }
 
-    evhttp_set_timeout(http, gArgs.GetIntArg("-rpcservertimeout", DEFAULT_HTTP_SERVER_TIMEOUT));
+    const int64_t server_timeout{gArgs.GetIntArg("-rpcservertimeout", DEFAULT_HTTP_SERVER_TIMEOUT)};
+    evhttp_set_timeout(http, server_timeout);
+    g_reply_write_timeout = std::chrono::seconds{server_timeout};
     evhttp_set_max_headers_size(http, MAX_HEADERS_SIZE);
     evhttp_set_max_body_size(http, MAX_SIZE);
     evhttp_set_gencb(http, http_request_cb, nullptr);
@@ -506,13 +515,51 @@ void HTTPEvent::trigger(struct timeval* tv)
     else
         evtimer_add(ev, tv); // trigger after timeval passed
 }
+/** State of a chunked reply, shared between the worker writing it and the http thread sending it. */
+struct HTTPReplyChunks {
+    Mutex cs;
+    std::condition_variable cond GUARDED_BY(cs);
+    //! Chunks written by the worker that the client did not receive yet
+    size_t in_flight GUARDED_BY(cs){0};
+    //! Chunks passed to libevent since its output buffer was last drained
+    size_t passed GUARDED_BY(cs){0};
+    //! Whether the connection was closed
+    bool closed GUARDED_BY(cs){false};
+    //! Whether the client took too long to receive the reply, and the connection is to be closed
+    bool timed_out GUARDED_BY(cs){false};
+    //! Time the worker waited for the client so far
+    std::chrono::steady_clock::duration waited GUARDED_BY(cs){0};
+};
+
+/** Called by libevent when the output buffer of a connection with a chunked reply is drained. */
+static void http_reply_chunks_sent_cb(struct evhttp_connection*, void* arg)
+{
+    HTTPReplyChunks* chunks = static_cast<HTTPReplyChunks*>(arg);
+    LOCK(chunks->cs);
+    chunks->in_flight -= chunks->passed;
+    chunks->passed = 0;
+    chunks->cond.notify_all();
+}
+
+/** Called by libevent when a connection with a chunked reply is closed. */
+static void http_reply_chunks_close_cb(struct evhttp_connection*, void* arg)
+{
+    HTTPReplyChunks* chunks = static_cast<HTTPReplyChunks*>(arg);
+    LOCK(chunks->cs);
+    chunks->closed = true;
+    chunks->cond.notify_all();
+}
+
 HTTPRequest::HTTPRequest(struct evhttp_request* _req, bool _replySent) : req(_req), replySent(_replySent)
 {
 }
 
 HTTPRequest::~HTTPRequest()
 {
-    if (!replySent) {
+    if (replyStarted && !replySent) {
+        // A chunked reply can no longer change its status, just complete it
+        WriteReplyEnd();
+    } else if (!replySent) {
         // Keep track of whether reply was sent to avoid request leaks
         LogPrintf("%s: Unhandled request\n", __func__);
         WriteReply(HTTP_INTERNAL_SERVER_ERROR, "Unhandled request");
@@ -558,6 +605,21 @@ void HTTPRequest::WriteHeader(const std::string& hdr, const std::string& value)
     evhttp_add_header(headers, hdr.c_str(), value.c_str());
 }
 
+/** Re-enable reading from the socket once a reply is sent. This is the
+ * second part of the libevent workaround in http_request_cb.
+ */
+static void ReenableReading(evhttp_connection* conn)
+{
+    if (event_get_version_number() >= 0x02010600 && event_get_version_number() < 0x02020001) {
+        if (conn) {
+            bufferevent* bev = evhttp_connection_get_bufferevent(conn);
+            if (bev) {
+                bufferevent_enable(bev, EV_READ | EV_WRITE);
+            }
+        }
+    }
+}
+
 /** Closure sent to main thread to request a reply to be sent to
  * a HTTP request.
  * Replies must be sent in the main loop in the main http thread,
@@ -575,18 +637,91 @@ void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
     evbuffer_add(evb, strReply.data(), strReply.size());
     auto req_copy = req;
     HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, nStatus]{
+        evhttp_connection* conn = evhttp_request_get_connection(req_copy);
         evhttp_send_reply(req_copy, nStatus, nullptr, nullptr);
-        // Re-enable reading from the socket. This is the second part of the libevent
-        // workaround above.
-        if (event_get_version_number() >= 0x02010600 && event_get_version_number() < 0x02020001) {
-            evhttp_connection* conn = evhttp_request_get_connection(req_copy);
-            if (conn) {
-                bufferevent* bev = evhttp_connection_get_bufferevent(conn);
-                if (bev) {
-                    bufferevent_enable(bev, EV_READ | EV_WRITE);
-                }
+        ReenableReading(conn);
+    });
+    ev->trigger(nullptr);
+    replySent = true;
+    req = nullptr; // transferred back to main thread
+}
+
+void HTTPRequest::WriteReplyStart(int nStatus)
+{
+    assert(!replySent && !replyStarted && req);
+    if (ShutdownRequested()) {
+        WriteHeader("Connection", "close");
+    }
+    auto req_copy = req;
+    replyChunks = std::make_shared<HTTPReplyChunks>();
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, nStatus, chunks = replyChunks]{
+        evhttp_connection* conn = evhttp_request_get_connection(req_copy);
+        if (conn) {
+            // The callback is cleared by WriteReplyEnd, while chunks is still alive.
+            evhttp_connection_set_closecb(conn, http_reply_chunks_close_cb, chunks.get());
+        } else {
+            WITH_LOCK(chunks->cs, chunks->closed = true);
+        }
+        evhttp_send_reply_start(req_copy, nStatus, nullptr);
+    });
+    ev->trigger(nullptr);
+    replyStarted = true;
+}
+
+bool HTTPRequest::WriteReplyChunk(const std::string& chunk)
+{
+    assert(replyStarted && !replySent && req);
+    {
+        WAIT_LOCK(replyChunks->cs, lock);
+        // Stop waiting on shutdown or timeout, a client that does not read must not keep the worker busy.
+        while (!replyChunks->closed && replyChunks->in_flight >= MAX_REPLY_CHUNKS_IN_FLIGHT && !ShutdownRequested()) {
+            if (replyChunks->waited >= g_reply_write_timeout) {
+                LogPrint(BCLog::HTTP, "Timed out writing a reply to %s, closing the connection\n", GetPeer().ToString());
+                replyChunks->timed_out = true;
+                replyChunks->closed = true;
+                break;
             }
+            const auto start{std::chrono::steady_clock::now()};
+            replyChunks->cond.wait_for(lock, std::chrono::milliseconds{100});
+            replyChunks->waited += std::chrono::steady_clock::now() - start;
         }
+        if (replyChunks->closed) return false;
+        // An empty chunk would mark the end of the reply
+        if (chunk.empty()) return true;
+        ++replyChunks->in_flight;
+    }
+    struct evbuffer* evb = evbuffer_new();
+    assert(evb);
+    evbuffer_add(evb, chunk.data(), chunk.size());
+    auto req_copy = req;
+    // Chunks are sent in order, as events triggered from the same thread run in order.
+    // If the client is gone, libevent drops the chunk.
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, evb, chunks = replyChunks]{
+        WITH_LOCK(chunks->cs, ++chunks->passed);
+        evhttp_send_reply_chunk_with_cb(req_copy, evb, http_reply_chunks_sent_cb, chunks.get());
+        evbuffer_free(evb);
+    });
+    ev->trigger(nullptr);
+    return true;
+}
+
+void HTTPRequest::WriteReplyEnd()
+{
+    assert(replyStarted && !replySent && req);
+    auto req_copy = req;
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, chunks = replyChunks]{
+        // The request may be freed by evhttp_send_reply_end
+        evhttp_connection* conn = evhttp_request_get_connection(req_copy);
+        // The connection may be kept alive for other requests, which must not
+        // call back into chunks. evhttp_send_reply_end replaces the write callback.
+        if (conn) evhttp_connection_set_closecb(conn, nullptr, nullptr);
+        if (conn && WITH_LOCK(chunks->cs, return chunks->timed_out)) {
+            // The reply cannot be completed, drop the connection with its requests
+            evhttp_connection_free(conn);
+            return;
+        }
+        evhttp_send_reply_end(req_copy);
+        ReenableReading(conn);
     });
     ev->trigger(nullptr);
     replySent = true;
@@ -618,6 +753,33 @@ std::string HTTPRequest::GetURI() const
     return evhttp_request_get_uri(req);
 }
 
+std::optional<std::string> HTTPRequest::GetQueryParameter(const std::string& key) const
+{
+    evhttp_uri* uri_parsed{evhttp_uri_parse(evhttp_request_get_uri(req))};
+    if (!uri_parsed) {
+        throw std::runtime_error("URI parsing failed, it likely contained RFC 3986 invalid characters");
+    }
+    const char* query{evhttp_uri_get_query(uri_parsed)};
+    std::optional<std::string> result;
+
+    if (query) {
+        // Parse the query string into a key-value queue and iterate over it
+        struct evkeyvalq params_q;
+        evhttp_parse_query_str(query, &params_q);
+
+        for (struct evkeyval* param{params_q.tqh_first}; param != nullptr; param = param->next.tqe_next) {
+            if (param->key == key) {
+                result = param->value;
+                break;
+            }
+        }
+        evhttp_clear_headers(&params_q);
+    }
+    evhttp_uri_free(uri_parsed);
+
+    return result;
+}
+
 HTTPRequest::RequestMethod HTTPRequest::GetRequestMethod() const
 {
     switch (evhttp_request_get_command(req)) {
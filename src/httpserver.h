@@ -7,6 +7,8 @@
 
 #include <string>
 #include <functional>
+#include <memory>
+#include <optional>
 
 static const int DEFAULT_HTTP_THREADS=4;
 static const int DEFAULT_HTTP_WORKQUEUE=16;
@@ -16,6 +18,7 @@ struct evhttp_request;
 struct event_base;
 class CService;
 class HTTPRequest;
+struct HTTPReplyChunks;
 
 /** Initialize HTTP server.
  * Call this before RegisterHTTPHandler or EventBase().
@@ -58,6 +61,10 @@ class HTTPRequest
 private:
     struct evhttp_request* req;
     bool replySent;
+    //! Whether a chunked reply was started with WriteReplyStart
+    bool replyStarted{false};
+    //! Chunks of the reply not sent yet, shared with the http thread
+    std::shared_ptr<HTTPReplyChunks> replyChunks;
 
 public:
     explicit HTTPRequest(struct evhttp_request* req, bool replySent = false);
@@ -89,6 +96,14 @@ public:
      */
     std::pair<bool, std::string> GetHeader(const std::string& hdr) const;
 
+    /**
+     * Get the query parameter value from request uri for a specified key, or
+     * std::nullopt if the key is not found.
+     *
+     * If the query string contains duplicate keys, the first value is returned.
+     */
+    std::optional<std::string> GetQueryParameter(const std::string& key) const;
+
     /**
      * Read request body.
      *
@@ -113,6 +128,35 @@ public:
      * main thread, do not call any other HTTPRequest methods after calling this.
      */
     void WriteReply(int nStatus, const std::string& strReply = "");
+
+    /**
+     * Start a chunked HTTP reply, for a body that is written in parts with
+     * WriteReplyChunk and completed with WriteReplyEnd. This lets a large
+     * reply be sent while it is generated, instead of building it in memory
+     * first.
+     *
+     * @note Call this instead of WriteReply, after the headers are written.
+     */
+    void WriteReplyStart(int nStatus);
+
+    /**
+     * Write a part of a chunked reply. Empty chunks are skipped.
+     *
+     * Waits while a few chunks are still queued for the client, so that a
+     * slow client does not make the whole reply pile up in memory.
+     * Returns false if the client is gone and the remaining chunks can be
+     * skipped. This is also the case once the worker waited longer than
+     * -rpcservertimeout in total for the client, which then has its
+     * connection closed by WriteReplyEnd.
+     */
+    bool WriteReplyChunk(const std::string& chunk);
+
+    /**
+     * Complete a chunked reply.
+     *
+     * @note As for WriteReply, do not call any other HTTPRequest methods after calling this.
+     */
+    void WriteReplyEnd();
 };
 
 /** Event handler closure.
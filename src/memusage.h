@@ -5,6 +5,7 @@
 #ifndef BITCOIN_MEMUSAGE_H
 #define BITCOIN_MEMUSAGE_H
 
+#include <arenamap.h>
 #include <indirectmap.h>
 #include <prevector.h>
 
@@ -133,6 +134,16 @@ static inline size_t IncrementalDynamicUsage(const indirectmap<X, Y>& m)
     return MallocUsage(sizeof(stl_tree_node<std::pair<const X*, Y> >));
 }
 
+// arenamap allocates its hash table (an index and a tag per bucket) and
+// fixed-size chunks of entries
+
+template<typename X, typename Y, typename Z>
+static inline size_t DynamicUsage(const arenamap<X, Y, Z>& m)
+{
+    return MallocUsage(m.bucket_count() * sizeof(uint32_t)) + MallocUsage(m.bucket_count()) +
+           MallocUsage(arenamap<X, Y, Z>::CHUNK_BYTES) * m.chunk_count() + MallocUsage(m.chunk_capacity() * sizeof(void*));
+}
+
 template<typename X>
 static inline size_t DynamicUsage(const std::unique_ptr<X>& p)
 {
@@ -103,6 +103,16 @@ enum BindFlags {
 // The sleep time needs to be small to avoid new sockets stalling
 static const uint64_t SELECT_TIMEOUT_MILLISECONDS = 50;
 
+// Sockets watched with epoll stay registered and are reported as soon as they
+// get ready, so the wait only times out to check the nodes for inactivity
+static constexpr auto INACTIVITY_CHECK_INTERVAL{250ms};
+
+//! Set in the ids of the listening sockets watched with epoll, which are node ids otherwise
+static constexpr uint64_t EPOLL_LISTEN_SOCKET_FLAG{uint64_t{1} << 63};
+
+/** Maximum number of queued headers and payloads to send with one system call. */
+static constexpr size_t MAX_SEND_BUFFERS{64};
+
 const std::string NET_MESSAGE_COMMAND_OTHER = "*other*";
 
 static const uint64_t RANDOMIZER_ID_NETGROUP = 0x6c0edd8036ef4036ULL; // SHA256("netgroup")[0:8]
@@ -822,13 +832,17 @@ CNetMessage V1TransportDeserializer::GetMessage(const std::chrono::microseconds
     return msg;
 }
 
-void V1TransportSerializer::prepareForTransport(CSerializedNetMsg& msg, std::vector<unsigned char>& header) {
-    // create dbl-sha256 checksum
-    uint256 hash = Hash(msg.data);
+CSharedNetMsg::CSharedNetMsg(CSerializedNetMsg&& msg)
+    : data{std::make_shared<const std::vector<unsigned char>>(std::move(msg.data))},
+      m_type{std::move(msg.m_type)},
+      m_hash{Hash(*data)}
+{
+}
 
+void V1TransportSerializer::prepareForTransport(const CSharedNetMsg& msg, std::vector<unsigned char>& header) {
     // create header
-    CMessageHeader hdr(Params().MessageStart(), msg.m_type.c_str(), msg.data.size());
-    memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+    CMessageHeader hdr(Params().MessageStart(), msg.m_type.c_str(), msg.data->size());
+    memcpy(hdr.pchChecksum, msg.m_hash.begin(), CMessageHeader::CHECKSUM_SIZE);
 
     // serialize header
     header.reserve(CMessageHeader::HEADER_SIZE);
@@ -837,32 +851,49 @@ void V1TransportSerializer::prepareForTransport(CSerializedNetMsg& msg, std::vec
 
 size_t CConnman::SocketSendData(CNode& node) const
 {
-    auto it = node.vSendMsg.begin();
     size_t nSentSize = 0;
 
-    while (it != node.vSendMsg.end()) {
-        const auto& data = *it;
-        assert(data.size() > node.nSendOffset);
-        int nBytes = 0;
+    while (!node.vSendMsg.empty()) {
+        // Gather as many queued headers and payloads as one system call takes.
+        std::array<Span<const unsigned char>, MAX_SEND_BUFFERS> buffers;
+        size_t count{0};
+        size_t requested{0};
+        for (auto it = node.vSendMsg.begin(); it != node.vSendMsg.end() && count < buffers.size(); ++it) {
+            buffers[count] = Span{**it};
+            if (count == 0) {
+                assert(buffers[0].size() > node.nSendOffset);
+                buffers[0] = buffers[0].subspan(node.nSendOffset);
+            }
+            requested += buffers[count++].size();
+        }
+        ssize_t nBytes = 0;
         {
             LOCK(node.m_sock_mutex);
             if (!node.m_sock) {
                 break;
             }
-            nBytes = node.m_sock->Send(reinterpret_cast<const char*>(data.data()) + node.nSendOffset, data.size() - node.nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+            nBytes = node.m_sock->SendMany(Span{buffers.data(), count}, MSG_NOSIGNAL | MSG_DONTWAIT);
         }
         if (nBytes > 0) {
             node.m_last_send = GetTime<std::chrono::seconds>();
             node.nSendBytes += nBytes;
-            node.nSendOffset += nBytes;
             nSentSize += nBytes;
-            if (node.nSendOffset == data.size()) {
+            // Drop the buffers that were sent completely.
+            size_t sent = nBytes;
+            while (sent > 0) {
+                const size_t front_size{node.vSendMsg.front()->size()};
+                if (sent < front_size - node.nSendOffset) {
+                    node.nSendOffset += sent;
+                    break;
+                }
+                sent -= front_size - node.nSendOffset;
                 node.nSendOffset = 0;
-                node.nSendSize -= data.size();
-                node.fPauseSend = node.nSendSize > nSendBufferMaxSize;
-                it++;
-            } else {
-                // could not send full message; stop sending more
+                node.nSendSize -= front_size;
+                node.vSendMsg.pop_front();
+            }
+            node.fPauseSend = node.nSendSize > nSendBufferMaxSize;
+            if (size_t(nBytes) < requested) {
+                // could not send all of it; stop sending more
                 break;
             }
         } else {
@@ -879,11 +910,10 @@ size_t CConnman::SocketSendData(CNode& node) const
         }
     }
 
-    if (it == node.vSendMsg.end()) {
+    if (node.vSendMsg.empty()) {
         assert(node.nSendOffset == 0);
         assert(node.nSendSize == 0);
     }
-    node.vSendMsg.erase(node.vSendMsg.begin(), it);
     return nSentSize;
 }
 
@@ -1265,6 +1295,7 @@ void CConnman::CreateNodeFromAcceptedSocket(std::unique_ptr<Sock>&& sock,
         LOCK(m_nodes_mutex);
         m_nodes.push_back(pnode);
     }
+    WatchNodeSocket(*pnode);
 
     // We received a new connection, harvest entropy from the time (and our peer count)
     RandAddEvent((uint32_t)id);
@@ -1335,6 +1366,7 @@ void CConnman::DisconnectNodes()
 
                 // close socket and cleanup
                 pnode->CloseSocketDisconnect();
+                m_nodes_recv_ready.erase(pnode->GetId());
 
                 // hold in disconnected pool until all refs are released
                 pnode->Release();
@@ -1581,6 +1613,13 @@ void CConnman::SocketEvents(const std::vector<CNode*>& nodes,
 
 void CConnman::SocketHandler()
 {
+#ifdef USE_EPOLL
+    if (m_epoll) {
+        SocketHandlerEpoll();
+        return;
+    }
+#endif
+
     std::set<SOCKET> recv_set;
     std::set<SOCKET> send_set;
     std::set<SOCKET> error_set;
@@ -1611,9 +1650,6 @@ void CConnman::SocketHandlerConnected(const std::vector<CNode*>& nodes,
         if (interruptNet)
             return;
 
-        //
-        // Receive
-        //
         bool recvSet = false;
         bool sendSet = false;
         bool errorSet = false;
@@ -1626,72 +1662,189 @@ void CConnman::SocketHandlerConnected(const std::vector<CNode*>& nodes,
             sendSet = send_set.count(pnode->m_sock->Get()) > 0;
             errorSet = error_set.count(pnode->m_sock->Get()) > 0;
         }
-        if (recvSet || errorSet)
+        SocketHandlerNode(*pnode, recvSet || errorSet, sendSet);
+
+        if (InactivityCheck(*pnode)) pnode->fDisconnect = true;
+    }
+}
+
+bool CConnman::SocketHandlerNode(CNode& node, bool recv, bool send)
+{
+    CNode* pnode = &node;
+    bool more_to_recv = false;
+
+    //
+    // Receive
+    //
+    if (recv)
+    {
+        // typical socket buffer is 8K-64K
+        uint8_t pchBuf[0x10000];
+        int nBytes = 0;
         {
-            // typical socket buffer is 8K-64K
-            uint8_t pchBuf[0x10000];
-            int nBytes = 0;
-            {
-                LOCK(pnode->m_sock_mutex);
-                if (!pnode->m_sock) {
-                    continue;
-                }
-                nBytes = pnode->m_sock->Recv(pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+            LOCK(pnode->m_sock_mutex);
+            if (!pnode->m_sock) {
+                return false;
             }
-            if (nBytes > 0)
-            {
-                bool notify = false;
-                if (!pnode->ReceiveMsgBytes({pchBuf, (size_t)nBytes}, notify)) {
-                    pnode->CloseSocketDisconnect();
+            nBytes = pnode->m_sock->Recv(pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+        }
+        if (nBytes > 0)
+        {
+            more_to_recv = nBytes == sizeof(pchBuf);
+            bool notify = false;
+            if (!pnode->ReceiveMsgBytes({pchBuf, (size_t)nBytes}, notify)) {
+                pnode->CloseSocketDisconnect();
+            }
+            RecordBytesRecv(nBytes);
+            if (notify) {
+                size_t nSizeAdded = 0;
+                auto it(pnode->vRecvMsg.begin());
+                for (; it != pnode->vRecvMsg.end(); ++it) {
+                    // vRecvMsg contains only completed CNetMessage
+                    // the single possible partially deserialized message are held by TransportDeserializer
+                    nSizeAdded += it->m_raw_message_size;
                 }
-                RecordBytesRecv(nBytes);
-                if (notify) {
-                    size_t nSizeAdded = 0;
-                    auto it(pnode->vRecvMsg.begin());
-                    for (; it != pnode->vRecvMsg.end(); ++it) {
-                        // vRecvMsg contains only completed CNetMessage
-                        // the single possible partially deserialized message are held by TransportDeserializer
-                        nSizeAdded += it->m_raw_message_size;
-                    }
-                    {
-                        LOCK(pnode->cs_vProcessMsg);
-                        pnode->vProcessMsg.splice(pnode->vProcessMsg.end(), pnode->vRecvMsg, pnode->vRecvMsg.begin(), it);
-                        pnode->nProcessQueueSize += nSizeAdded;
-                        pnode->fPauseRecv = pnode->nProcessQueueSize > nReceiveFloodSize;
-                    }
-                    WakeMessageHandler();
+                {
+                    LOCK(pnode->cs_vProcessMsg);
+                    pnode->vProcessMsg.splice(pnode->vProcessMsg.end(), pnode->vRecvMsg, pnode->vRecvMsg.begin(), it);
+                    pnode->nProcessQueueSize += nSizeAdded;
+                    pnode->fPauseRecv = pnode->nProcessQueueSize > nReceiveFloodSize;
                 }
+                WakeMessageHandler(pnode->GetId());
+            }
+        }
+        else if (nBytes == 0)
+        {
+            // socket closed gracefully
+            if (!pnode->fDisconnect) {
+                LogPrint(BCLog::NET, "socket closed for peer=%d\n", pnode->GetId());
             }
-            else if (nBytes == 0)
+            pnode->CloseSocketDisconnect();
+        }
+        else if (nBytes < 0)
+        {
+            // error
+            int nErr = WSAGetLastError();
+            if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
             {
-                // socket closed gracefully
                 if (!pnode->fDisconnect) {
-                    LogPrint(BCLog::NET, "socket closed for peer=%d\n", pnode->GetId());
+                    LogPrint(BCLog::NET, "socket recv error for peer=%d: %s\n", pnode->GetId(), NetworkErrorString(nErr));
                 }
                 pnode->CloseSocketDisconnect();
             }
-            else if (nBytes < 0)
-            {
-                // error
-                int nErr = WSAGetLastError();
-                if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
-                {
-                    if (!pnode->fDisconnect) {
-                        LogPrint(BCLog::NET, "socket recv error for peer=%d: %s\n", pnode->GetId(), NetworkErrorString(nErr));
-                    }
-                    pnode->CloseSocketDisconnect();
-                }
-            }
         }
+    }
+
+    if (send) {
+        // Send data
+        size_t bytes_sent = WITH_LOCK(pnode->cs_vSend, return SocketSendData(*pnode));
+        if (bytes_sent) RecordBytesSent(bytes_sent);
+    }
+
+    return more_to_recv;
+}
+
+#ifdef USE_EPOLL
+void CConnman::SocketHandlerEpoll()
+{
+    // Don't wait while data is left in the socket of a node.
+    const auto wait_until{m_nodes_recv_ready.empty() ? m_next_inactivity_check : std::chrono::steady_clock::now()};
+    const auto timeout{std::chrono::ceil<std::chrono::milliseconds>(wait_until - std::chrono::steady_clock::now())};
+    std::vector<Epoll::Event> events;
+    if (!m_epoll->Wait(std::max(timeout, 0ms), events)) {
+        LogPrintf("epoll_wait() failed: %s\n", NetworkErrorString(WSAGetLastError()));
+        if (!interruptNet.sleep_for(std::chrono::milliseconds(SELECT_TIMEOUT_MILLISECONDS))) return;
+    }
+    if (interruptNet) return;
+
+    std::set<NodeId> send_ready;
+    std::vector<size_t> listen_ready;
+    for (const Epoll::Event& event : events) {
+        if (event.id & EPOLL_LISTEN_SOCKET_FLAG) {
+            listen_ready.push_back(event.id & ~EPOLL_LISTEN_SOCKET_FLAG);
+            continue;
+        }
+        if (event.recv || event.error) m_nodes_recv_ready.insert(event.id);
+        if (event.send) send_ready.insert(event.id);
+    }
+    {
+        // Nodes that got data queued or resumed receiving
+        LOCK(m_nodes_to_service_mutex);
+        for (const NodeId id : m_nodes_to_service) {
+            m_nodes_recv_ready.insert(id);
+            send_ready.insert(id);
+        }
+        m_nodes_to_service.clear();
+    }
+
+    const auto now{std::chrono::steady_clock::now()};
+    const bool check_inactivity{now >= m_next_inactivity_check};
+    if (check_inactivity) m_next_inactivity_check = now + INACTIVITY_CHECK_INTERVAL;
+    bool disconnect{false};
+
+    if (check_inactivity || !m_nodes_recv_ready.empty() || !send_ready.empty()) {
+        // Only nodes that are still connected and have data left in their
+        // socket are kept. The ids of nodes that are gone, e.g. woken by a
+        // message pushed while they were disconnected, are dropped.
+        std::set<NodeId> recv_ready_left;
+        const NodesSnapshot snap{*this, /*shuffle=*/false};
+        for (CNode* pnode : snap.Nodes()) {
+            if (interruptNet) return;
+
+            const NodeId id{pnode->GetId()};
+            // Paused nodes are serviced again once receiving is resumed, see WakeSocketHandler(NodeId)
+            const bool recv{m_nodes_recv_ready.count(id) > 0 && !pnode->fPauseRecv};
+            const bool send{send_ready.count(id) > 0};
+            if ((recv || send) && SocketHandlerNode(*pnode, recv, send) && recv) {
+                recv_ready_left.insert(id);
+            }
 
-        if (sendSet) {
-            // Send data
-            size_t bytes_sent = WITH_LOCK(pnode->cs_vSend, return SocketSendData(*pnode));
-            if (bytes_sent) RecordBytesSent(bytes_sent);
+            if (check_inactivity && InactivityCheck(*pnode)) {
+                pnode->fDisconnect = true;
+                disconnect = true;
+            }
         }
+        m_nodes_recv_ready = std::move(recv_ready_left);
+    }
+    // Remove the inactive nodes without waiting.
+    if (disconnect) m_epoll->Wake();
 
-        if (InactivityCheck(*pnode)) pnode->fDisconnect = true;
+    // Accept new connections from listening sockets.
+    for (const size_t i : listen_ready) {
+        if (interruptNet) return;
+        if (i < vhListenSocket.size()) AcceptConnection(vhListenSocket[i]);
+    }
+}
+#endif
+
+void CConnman::WatchNodeSocket(CNode& node)
+{
+#ifdef USE_EPOLL
+    if (!m_epoll) return;
+    LOCK(node.m_sock_mutex);
+    if (node.m_sock) m_epoll->Add(node.m_sock->Get(), node.GetId(), /*edge_triggered=*/true);
+#endif
+}
+
+void CConnman::WakeSocketHandler(NodeId id)
+{
+#ifdef USE_EPOLL
+    if (!m_epoll) return;
+    bool wake;
+    {
+        LOCK(m_nodes_to_service_mutex);
+        wake = m_nodes_to_service.empty();
+        m_nodes_to_service.insert(id);
     }
+    if (wake) m_epoll->Wake();
+#endif
+}
+
+void CConnman::WakeSocketHandler()
+{
+#ifdef USE_EPOLL
+    if (m_epoll) m_epoll->Wake();
+#endif
 }
 
 void CConnman::SocketHandlerListening(const std::set<SOCKET>& recv_set)
@@ -1719,11 +1872,38 @@ void CConnman::ThreadSocketHandler()
 
 void CConnman::WakeMessageHandler()
 {
+    for (int i = 0; i < m_num_message_handlers; ++i) {
+        MessageHandler& handler{m_message_handlers[i]};
+        WITH_LOCK(handler.mutex, handler.wake = true);
+        handler.cond.notify_one();
+    }
+}
+
+void CConnman::WakeMessageHandler(NodeId id)
+{
+    MessageHandler& handler{m_message_handlers[id % m_num_message_handlers]};
+    WITH_LOCK(handler.mutex, handler.wake = true);
+    handler.cond.notify_one();
+}
+
+std::vector<MessageHandlerStats> CConnman::GetMessageHandlerStats() const
+{
+    const int num_handlers{m_num_message_handlers};
+    std::vector<MessageHandlerStats> stats(num_handlers);
     {
-        LOCK(mutexMsgProc);
-        fMsgProcWake = true;
+        LOCK(m_nodes_mutex);
+        for (const CNode* pnode : m_nodes) {
+            ++stats[pnode->GetId() % num_handlers].nodes;
+        }
     }
-    condMsgProc.notify_one();
+    const auto now{std::chrono::steady_clock::now()};
+    for (int i = 0; i < num_handlers; ++i) {
+        const MessageHandler& handler{m_message_handlers[i]};
+        if (!handler.thread.joinable()) continue;
+        stats[i].busy_time = std::chrono::microseconds{handler.busy_time.load()};
+        stats[i].run_time = std::chrono::duration_cast<std::chrono::microseconds>(now - handler.start_time.load());
+    }
+    return stats;
 }
 
 void CConnman::ThreadDNSAddressSeed()
@@ -2308,14 +2488,20 @@ void CConnman::OpenNetworkConnection(const CAddress& addrConnect, bool fCountFai
         LOCK(m_nodes_mutex);
         m_nodes.push_back(pnode);
     }
+    // Only watched once it is listed, the socket handler drops events of
+    // nodes it does not find.
+    WatchNodeSocket(*pnode);
 }
 
-void CConnman::ThreadMessageHandler()
+void CConnman::ThreadMessageHandler(int index)
 {
     SetSyscallSandboxPolicy(SyscallSandboxPolicy::MESSAGE_HANDLER);
+    MessageHandler& handler{m_message_handlers[index]};
+    handler.start_time = std::chrono::steady_clock::now();
     while (!flagInterruptMsgProc)
     {
         bool fMoreWork = false;
+        const auto busy_start{std::chrono::steady_clock::now()};
 
         {
             // Randomize the order in which we process messages from/to our peers.
@@ -2323,9 +2509,13 @@ void CConnman::ThreadMessageHandler()
             // consecutive connections in the m_nodes list.
             const NodesSnapshot snap{*this, /*shuffle=*/true};
 
+            bool disconnect_pending{false};
             for (CNode* pnode : snap.Nodes()) {
-                if (pnode->fDisconnect)
+                if (pnode->GetId() % m_num_message_handlers != index) continue;
+                if (pnode->fDisconnect) {
+                    disconnect_pending = true;
                     continue;
+                }
 
                 // Receive messages
                 bool fMoreNodeWork = m_msgproc->ProcessMessages(pnode, flagInterruptMsgProc);
@@ -2341,13 +2531,16 @@ void CConnman::ThreadMessageHandler()
                 if (flagInterruptMsgProc)
                     return;
             }
+            // Have the socket handler remove the nodes to be disconnected.
+            if (disconnect_pending) WakeSocketHandler();
         }
+        handler.busy_time += count_microseconds(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - busy_start));
 
-        WAIT_LOCK(mutexMsgProc, lock);
+        WAIT_LOCK(handler.mutex, lock);
         if (!fMoreWork) {
-            condMsgProc.wait_until(lock, std::chrono::steady_clock::now() + std::chrono::milliseconds(100), [this]() EXCLUSIVE_LOCKS_REQUIRED(mutexMsgProc) { return fMsgProcWake; });
+            handler.cond.wait_until(lock, std::chrono::steady_clock::now() + std::chrono::milliseconds(100), [&handler]() EXCLUSIVE_LOCKS_REQUIRED(handler.mutex) { return handler.wake; });
         }
-        fMsgProcWake = false;
+        handler.wake = false;
     }
 }
 
@@ -2511,6 +2704,7 @@ void CConnman::SetNetworkActive(bool active)
     }
 
     fNetworkActive = active;
+    if (!active) WakeSocketHandler();
 
     if (m_client_interface) {
         m_client_interface->NotifyNetworkActiveChanged(fNetworkActive);
@@ -2632,10 +2826,22 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
     interruptNet.reset();
     flagInterruptMsgProc = false;
 
-    {
-        LOCK(mutexMsgProc);
-        fMsgProcWake = false;
+    for (MessageHandler& handler : m_message_handlers) {
+        LOCK(handler.mutex);
+        handler.wake = false;
+    }
+
+#ifdef USE_EPOLL
+    m_epoll = std::make_unique<Epoll>();
+    bool epoll_ok{m_epoll->IsValid()};
+    for (size_t i = 0; epoll_ok && i < vhListenSocket.size(); ++i) {
+        epoll_ok = m_epoll->Add(vhListenSocket[i].sock->Get(), i | EPOLL_LISTEN_SOCKET_FLAG, /*edge_triggered=*/false);
+    }
+    if (!epoll_ok) {
+        LogPrintf("Failed to watch sockets with epoll, using poll instead\n");
+        m_epoll.reset();
     }
+#endif
 
     // Send and receive from sockets, accept connections
     threadSocketHandler = std::thread(&util::TraceThread, "net", [this] { ThreadSocketHandler(); });
@@ -2663,7 +2869,11 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
     }
 
     // Process messages
-    threadMessageHandler = std::thread(&util::TraceThread, "msghand", [this] { ThreadMessageHandler(); });
+    LogPrintf("Using %d message handler threads\n", m_num_message_handlers.load());
+    for (int i = 0; i < m_num_message_handlers; ++i) {
+        const std::string name{i == 0 ? "msghand" : strprintf("msghand.%d", i)};
+        m_message_handlers[i].thread = std::thread([this, i, name] { util::TraceThread(name.c_str(), [this, i] { ThreadMessageHandler(i); }); });
+    }
 
     if (connOptions.m_i2p_accept_incoming && m_i2p_sam_session.get() != nullptr) {
         threadI2PAcceptIncoming =
@@ -2693,13 +2903,13 @@ static CNetCleanup instance_of_cnetcleanup;
 
 void CConnman::Interrupt()
 {
-    {
-        LOCK(mutexMsgProc);
-        flagInterruptMsgProc = true;
+    for (MessageHandler& handler : m_message_handlers) {
+        WITH_LOCK(handler.mutex, flagInterruptMsgProc = true);
+        handler.cond.notify_all();
     }
-    condMsgProc.notify_all();
 
     interruptNet();
+    WakeSocketHandler();
     InterruptSocks5(true);
 
     if (semOutbound) {
@@ -2720,8 +2930,9 @@ void CConnman::StopThreads()
     if (threadI2PAcceptIncoming.joinable()) {
         threadI2PAcceptIncoming.join();
     }
-    if (threadMessageHandler.joinable())
-        threadMessageHandler.join();
+    for (MessageHandler& handler : m_message_handlers) {
+        if (handler.thread.joinable()) handler.thread.join();
+    }
     if (threadOpenConnections.joinable())
         threadOpenConnections.join();
     if (threadOpenAddedConnections.joinable())
@@ -2761,6 +2972,11 @@ void CConnman::StopNodes()
     }
     m_nodes_disconnected.clear();
     vhListenSocket.clear();
+#ifdef USE_EPOLL
+    m_epoll.reset();
+#endif
+    m_nodes_recv_ready.clear();
+    WITH_LOCK(m_nodes_to_service_mutex, m_nodes_to_service.clear());
     semOutbound.reset();
     semAddnode.reset();
 }
@@ -3056,10 +3272,15 @@ bool CConnman::NodeFullyConnected(const CNode* pnode)
 
 void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
 {
-    size_t nMessageSize = msg.data.size();
+    PushMessage(pnode, CSharedNetMsg{std::move(msg)});
+}
+
+void CConnman::PushMessage(CNode* pnode, const CSharedNetMsg& msg)
+{
+    size_t nMessageSize = msg.data->size();
     LogPrint(BCLog::NET, "sending %s (%d bytes) peer=%d\n", msg.m_type, nMessageSize, pnode->GetId());
     if (gArgs.GetBoolArg("-capturemessages", false)) {
-        CaptureMessage(pnode->addr, msg.m_type, msg.data, /*is_incoming=*/false);
+        CaptureMessage(pnode->addr, msg.m_type, *msg.data, /*is_incoming=*/false);
     }
 
     TRACE6(net, outbound_message,
@@ -3067,8 +3288,8 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
         pnode->m_addr_name.c_str(),
         pnode->ConnectionTypeAsString().c_str(),
         msg.m_type.c_str(),
-        msg.data.size(),
-        msg.data.data()
+        msg.data->size(),
+        msg.data->data()
     );
 
     // make sure we use the appropriate network transport format
@@ -3077,6 +3298,7 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
     size_t nTotalSize = nMessageSize + serializedHeader.size();
 
     size_t nBytesSent = 0;
+    bool queued = false;
     {
         LOCK(pnode->cs_vSend);
         bool optimisticSend(pnode->vSendMsg.empty());
@@ -3086,13 +3308,19 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
         pnode->nSendSize += nTotalSize;
 
         if (pnode->nSendSize > nSendBufferMaxSize) pnode->fPauseSend = true;
-        pnode->vSendMsg.push_back(std::move(serializedHeader));
-        if (nMessageSize) pnode->vSendMsg.push_back(std::move(msg.data));
+        pnode->vSendMsg.push_back(std::make_shared<const std::vector<unsigned char>>(std::move(serializedHeader)));
+        if (nMessageSize) pnode->vSendMsg.push_back(msg.data);
 
         // If write queue empty, attempt "optimistic write"
-        if (optimisticSend) nBytesSent = SocketSendData(*pnode);
+        if (optimisticSend) {
+            nBytesSent = SocketSendData(*pnode);
+            queued = !pnode->vSendMsg.empty();
+        }
     }
     if (nBytesSent) RecordBytesSent(nBytesSent);
+    // The rest is sent by the socket handler, which has to be told while it waits with epoll.
+    // A disconnected node is not sent to anymore, its socket is closed by DisconnectNodes().
+    if (queued && !pnode->fDisconnect) WakeSocketHandler(pnode->GetId());
 }
 
 bool CConnman::ForNode(NodeId id, std::function<bool(CNode* pnode)> func)
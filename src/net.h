@@ -26,9 +26,13 @@
 #include <threadinterrupt.h>
 #include <uint256.h>
 #include <util/check.h>
+#include <util/epoll.h>
 #include <util/sock.h>
 
+#include <algorithm>
+#include <array>
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <cstdint>
 #include <deque>
@@ -37,6 +41,7 @@
 #include <map>
 #include <memory>
 #include <optional>
+#include <set>
 #include <thread>
 #include <vector>
 
@@ -79,6 +84,10 @@ static const std::string DEFAULT_MAX_UPLOAD_TARGET{"0M"};
 static const bool DEFAULT_BLOCKSONLY = false;
 /** -peertimeout default */
 static const int64_t DEFAULT_PEER_CONNECT_TIMEOUT = 60;
+/** -msghandthreads default: number of message handler threads, between which the peers are divided */
+static constexpr int DEFAULT_MESSAGE_HANDLER_THREADS{2};
+/** Maximum number of message handler threads */
+static constexpr int MAX_MESSAGE_HANDLER_THREADS{16};
 /** Number of file descriptors required for message capture **/
 static const int NUM_FDS_MESSAGE_CAPTURE = 1;
 
@@ -114,6 +123,21 @@ struct CSerializedNetMsg
     std::string m_type;
 };
 
+/**
+ * A serialized message whose payload can no longer change. It is queued for
+ * sending by reference, so that a message sent to many peers, like a new block,
+ * is serialized, hashed and kept in memory only once.
+ */
+struct CSharedNetMsg
+{
+    explicit CSharedNetMsg(CSerializedNetMsg&& msg);
+
+    std::shared_ptr<const std::vector<unsigned char>> data;
+    std::string m_type;
+    /** Double-SHA256 of the payload, whose first bytes are the checksum in the message header */
+    uint256 m_hash;
+};
+
 /** Different types of connections to a peer. This enum encapsulates the
  * information we have available at the time of opening or accepting the
  * connection. Aside from INBOUND, all types are initiated by us.
@@ -392,13 +416,13 @@ public:
 class TransportSerializer {
 public:
     // prepare message for transport (header construction, error-correction computation, payload encryption, etc.)
-    virtual void prepareForTransport(CSerializedNetMsg& msg, std::vector<unsigned char>& header) = 0;
+    virtual void prepareForTransport(const CSharedNetMsg& msg, std::vector<unsigned char>& header) = 0;
     virtual ~TransportSerializer() {}
 };
 
 class V1TransportSerializer  : public TransportSerializer {
 public:
-    void prepareForTransport(CSerializedNetMsg& msg, std::vector<unsigned char>& header) override;
+    void prepareForTransport(const CSharedNetMsg& msg, std::vector<unsigned char>& header) override;
 };
 
 /** Information about a peer */
@@ -429,7 +453,8 @@ public:
     /** Offset inside the first vSendMsg already sent */
     size_t nSendOffset GUARDED_BY(cs_vSend){0};
     uint64_t nSendBytes GUARDED_BY(cs_vSend){0};
-    std::deque<std::vector<unsigned char>> vSendMsg GUARDED_BY(cs_vSend);
+    /** Message headers and payloads to send. Payloads may be shared with the queues of other peers. */
+    std::deque<std::shared_ptr<const std::vector<unsigned char>>> vSendMsg GUARDED_BY(cs_vSend);
     Mutex cs_vSend;
     Mutex m_sock_mutex;
     Mutex cs_vRecv;
@@ -722,6 +747,9 @@ private:
 
 /**
  * Interface for message handling
+ *
+ * ProcessMessages() and SendMessages() are called from several message
+ * handler threads, but for a given node always from the same one.
  */
 class NetEventsInterface
 {
@@ -758,6 +786,16 @@ protected:
     ~NetEventsInterface() = default;
 };
 
+/** Utilization of a message handler thread, see CConnman::GetMessageHandlerStats(). */
+struct MessageHandlerStats {
+    //! Number of connected nodes whose messages the thread handles
+    int nodes{0};
+    //! Time spent processing and sending messages since the thread started
+    std::chrono::microseconds busy_time{0};
+    //! Time since the thread started
+    std::chrono::microseconds run_time{0};
+};
+
 class CConnman
 {
 public:
@@ -789,6 +827,7 @@ public:
         std::vector<std::string> m_specified_outgoing;
         std::vector<std::string> m_added_nodes;
         bool m_i2p_accept_incoming;
+        int m_message_handler_threads = DEFAULT_MESSAGE_HANDLER_THREADS;
     };
 
     void Init(const Options& connOptions) {
@@ -806,6 +845,7 @@ public:
         nSendBufferMaxSize = connOptions.nSendBufferMaxSize;
         nReceiveFloodSize = connOptions.nReceiveFloodSize;
         m_peer_connect_timeout = std::chrono::seconds{connOptions.m_peer_connect_timeout};
+        m_num_message_handlers = std::clamp(connOptions.m_message_handler_threads, 1, MAX_MESSAGE_HANDLER_THREADS);
         {
             LOCK(cs_totalBytesSent);
             nMaxOutboundLimit = connOptions.nMaxOutboundLimit;
@@ -840,6 +880,8 @@ public:
     bool ForNode(NodeId id, std::function<bool(CNode* pnode)> func);
 
     void PushMessage(CNode* pnode, CSerializedNetMsg&& msg);
+    /** Queue a message whose payload may be queued for other peers, too, without copying it. */
+    void PushMessage(CNode* pnode, const CSharedNetMsg& msg);
 
     using NodeFn = std::function<void(CNode*)>;
     void ForEachNode(const NodeFn& func)
@@ -954,8 +996,26 @@ public:
 
     unsigned int GetReceiveFloodSize() const;
 
+    /** Wake up all message handler threads. */
     void WakeMessageHandler();
 
+    /** Wake up the message handler thread that handles a node. */
+    void WakeMessageHandler(NodeId id);
+
+    /** Utilization of the running message handler threads. */
+    std::vector<MessageHandlerStats> GetMessageHandlerStats() const;
+
+    /**
+     * Have the socket handler send to and receive from a node's socket soon,
+     * because data got queued for it or it no longer pauses receiving. Only
+     * needed while sockets are watched with epoll, which does not report
+     * sockets that are ready as before.
+     */
+    void WakeSocketHandler(NodeId id);
+
+    /** Wake up the socket handler, e.g. to disconnect nodes, if it waits with epoll. */
+    void WakeSocketHandler();
+
     /** Return true if we should disconnect the peer for failing an inactivity check. */
     bool ShouldRunInactivityChecks(const CNode& node, std::chrono::seconds now) const;
 
@@ -981,7 +1041,7 @@ private:
     void AddAddrFetch(const std::string& strDest);
     void ProcessAddrFetch();
     void ThreadOpenConnections(std::vector<std::string> connect);
-    void ThreadMessageHandler();
+    void ThreadMessageHandler(int index);
     void ThreadI2PAcceptIncoming();
     void AcceptConnection(const ListenSocket& hListenSocket);
 
@@ -1053,6 +1113,28 @@ private:
      */
     void SocketHandlerListening(const std::set<SOCKET>& recv_set);
 
+    /**
+     * Do the read/write for a connected node's socket.
+     * @param[in] node Node to process.
+     * @param[in] recv Whether to read, because the socket is ready for read or has an error.
+     * @param[in] send Whether to send queued data, because the socket is ready for send.
+     * @return true if a full buffer was read, so more data may be waiting in the socket
+     */
+    bool SocketHandlerNode(CNode& node, bool recv, bool send);
+
+#ifdef USE_EPOLL
+    /**
+     * Wait for events on the sockets watched with epoll and process them
+     * accordingly. Only the nodes whose socket got ready, that asked to be
+     * serviced or that have data left in their socket are processed, and the
+     * inactivity checks run a few times a second.
+     */
+    void SocketHandlerEpoll();
+#endif
+
+    /** Watch the socket of a new node with epoll, if used. */
+    void WatchNodeSocket(CNode& node);
+
     void ThreadSocketHandler();
     void ThreadDNSAddressSeed();
 
@@ -1123,6 +1205,17 @@ private:
     std::vector<CNode*> m_nodes GUARDED_BY(m_nodes_mutex);
     std::list<CNode*> m_nodes_disconnected;
     mutable RecursiveMutex m_nodes_mutex;
+#ifdef USE_EPOLL
+    /** Watches the sockets of the nodes and the listening sockets. Set up in Start(), unless epoll is unavailable. */
+    std::unique_ptr<Epoll> m_epoll;
+#endif
+    /** Nodes whose socket is to be serviced, see WakeSocketHandler(NodeId). */
+    std::set<NodeId> m_nodes_to_service GUARDED_BY(m_nodes_to_service_mutex);
+    Mutex m_nodes_to_service_mutex;
+    /** Nodes whose socket may hold data that was not read yet. Only used by the socket handler thread. */
+    std::set<NodeId> m_nodes_recv_ready;
+    /** When to check the nodes for inactivity next, while sockets are watched with epoll. */
+    std::chrono::steady_clock::time_point m_next_inactivity_check{};
     std::atomic<NodeId> nLastNodeId{0};
     unsigned int nPrevNodeCount{0};
 
@@ -1196,11 +1289,24 @@ private:
     /** SipHasher seeds for deterministic randomness */
     const uint64_t nSeed0, nSeed1;
 
-    /** flag for waking the message processor. */
-    bool fMsgProcWake GUARDED_BY(mutexMsgProc);
+    /**
+     * A message handler thread. It processes the messages of the nodes whose
+     * id modulo the number of message handler threads is its index.
+     */
+    struct MessageHandler {
+        std::thread thread;
+        Mutex mutex;
+        std::condition_variable cond;
+        /** flag for waking the message processor. */
+        bool wake GUARDED_BY(mutex){false};
+        std::atomic<std::chrono::steady_clock::time_point> start_time{};
+        /** Time spent processing and sending messages, in microseconds. */
+        std::atomic<int64_t> busy_time{0};
+    };
 
-    std::condition_variable condMsgProc;
-    Mutex mutexMsgProc;
+    /** Number of message handler threads, set before they are started. */
+    std::atomic<int> m_num_message_handlers{1};
+    std::array<MessageHandler, MAX_MESSAGE_HANDLER_THREADS> m_message_handlers;
     std::atomic<bool> flagInterruptMsgProc{false};
 
     /**
@@ -1221,7 +1327,6 @@ private:
     std::thread threadSocketHandler;
     std::thread threadOpenAddedConnections;
     std::thread threadOpenConnections;
-    std::thread threadMessageHandler;
     std::thread threadI2PAcceptIncoming;
 
     /** flag for deciding to connect to an extra outbound peer,
@@ -18,7 +18,9 @@
 #include <merkleblock.h>
 #include <netbase.h>
 #include <netmessagemaker.h>
+#include <node/blockpipeline.h>
 #include <node/blockstorage.h>
+#include <node/rawblockcache.h>
 #include <policy/fees.h>
 #include <policy/policy.h>
 #include <primitives/block.h>
@@ -41,12 +43,13 @@
 #include <algorithm>
 #include <atomic>
 #include <chrono>
+#include <list>
 #include <memory>
 #include <optional>
 #include <typeinfo>
 
+using node::IsBlockPruned;
 using node::ReadBlockFromDisk;
-using node::ReadRawBlockFromDisk;
 using node::fImporting;
 using node::fPruneMode;
 using node::fReindex;
@@ -85,6 +88,10 @@ static constexpr auto PING_INTERVAL{2min};
 static const unsigned int MAX_LOCATOR_SZ = 101;
 /** The maximum number of entries in an 'inv' protocol message */
 static const unsigned int MAX_INV_SZ = 50000;
+/** Maximum number of transactions from a peer, or of orphans, that are accepted to the mempool together */
+static constexpr size_t MAX_TX_BATCH_SIZE{16};
+/** Maximum number of orphans taken out of a work set to be picked from on each reconsideration */
+static constexpr size_t MAX_ORPHAN_CANDIDATES{4 * MAX_TX_BATCH_SIZE};
 /** Maximum number of in-flight transaction requests from a peer. It is not a hard limit, but the threshold at which
  *  point the OVERLOADED_PEER_TX_DELAY kicks in. */
 static constexpr int32_t MAX_PEER_TX_REQUEST_IN_FLIGHT = 100;
@@ -172,6 +179,8 @@ static constexpr double MAX_ADDR_RATE_PER_SECOND{0.1};
  *  based increments won't go above this, but the MAX_ADDR_TO_SEND increment following GETADDR
  *  is exempt from this limit). */
 static constexpr size_t MAX_ADDR_PROCESSING_TOKEN_BUCKET{MAX_ADDR_TO_SEND};
+/** Maximum total size of the raw blocks kept after serving them, for other peers syncing the same blocks */
+static constexpr size_t MAX_RAW_BLOCK_CACHE_SIZE{16 << 20};
 
 // Internal stuff
 namespace {
@@ -290,6 +299,11 @@ struct Peer {
     /** Work queue of items requested by this peer **/
     std::deque<CInv> m_getdata_requests GUARDED_BY(m_getdata_requests_mutex);
 
+    /** Number of this peer's blocks submitted to the block pipeline that
+     *  have not been connected yet. Other messages from the peer are held
+     *  back until this drops to zero, to preserve message ordering. */
+    std::atomic<int> m_blocks_in_pipeline{0};
+
     explicit Peer(NodeId id)
         : m_id(id)
     {}
@@ -322,6 +336,9 @@ public:
     void CheckForStaleTipAndEvictPeers() override;
     std::optional<std::string> FetchBlock(NodeId peer_id, const CBlockIndex& block_index) override;
     bool GetNodeStateStats(NodeId nodeid, CNodeStateStats& stats) const override;
+    bool GetBlockPipelineStats(node::BlockPipelineStats& stats) const override;
+    void StopBlockPipeline() override;
+    TxOrphanageStats GetOrphanStats() const override;
     bool IgnoresIncomingTxs() override { return m_ignore_incoming_txs; }
     void SendPings() override;
     void RelayTransaction(const uint256& txid, const uint256& wtxid) override;
@@ -380,6 +397,12 @@ private:
     bool MaybeDiscourageAndDisconnect(CNode& pnode, Peer& peer);
 
     void ProcessOrphanTx(std::set<uint256>& orphan_work_set) EXCLUSIVE_LOCKS_REQUIRED(cs_main, g_cs_orphans);
+    /** Deserialize a tx message. Returns nullptr if the peer may not send
+     *  transactions, or if we cannot validate them yet. */
+    CTransactionRef ReceiveTransaction(CNode& pfrom, CDataStream& vRecv);
+    /** Process transactions received from a peer. Those we do not have yet
+     *  are accepted to the mempool together. */
+    void ProcessTransactions(CNode& pfrom, Peer& peer, const std::vector<CTransactionRef>& txs);
     /** Process a single headers message from a peer. */
     void ProcessHeadersMessage(CNode& pfrom, const Peer& peer,
                                const std::vector<CBlockHeader>& headers,
@@ -439,6 +462,15 @@ private:
       * on extra block-relay-only peers. */
     bool m_initial_sync_finished{false};
 
+    /**
+     * Serializes the message handler threads, which process and send the
+     * messages of different peers. Only messages that touch nothing but the
+     * state of their peer and state with a lock of its own are processed
+     * without it, see IsParallelMessage(), as are pending getdata requests
+     * and pings sent by SendMessages(). Must be locked before cs_main.
+     */
+    Mutex m_msgproc_mutex;
+
     /** Protects m_peer_map. This mutex must not be locked while holding a lock
      *  on any of the mutexes inside a Peer object. */
     mutable Mutex m_peer_mutex;
@@ -557,6 +589,11 @@ private:
      */
     void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<const CBlockIndex*>& vBlocks, NodeId& nodeStaller) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+    /** While a snapshot is validated in the background, add not-in-flight missing blocks beneath the snapshot
+     *  base, following the tip of the background chainstate, to vBlocks, until it has at most count entries.
+     */
+    void FindNextHistoricalBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<const CBlockIndex*>& vBlocks) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
     std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> > mapBlocksInFlight GUARDED_BY(cs_main);
 
     /** When our tip was last updated. */
@@ -570,6 +607,10 @@ private:
     /** Process a new block. Perform any post-processing housekeeping */
     void ProcessBlock(CNode& node, const std::shared_ptr<const CBlock>& block, bool force_processing);
 
+    /** Connect stage of the block pipeline: the counterpart of ProcessBlock for
+     *  blocks that were decoded and checked off the message handler thread. */
+    void ProcessPipelinedBlock(node::BlockPipeline::Result&& result) LOCKS_EXCLUDED(cs_main);
+
     /** Relay map (txid or wtxid -> CTransactionRef) */
     typedef std::map<uint256, CTransactionRef> MapRelay;
     MapRelay mapRelay GUARDED_BY(cs_main);
@@ -618,6 +659,16 @@ private:
     bool AlreadyHaveBlock(const uint256& block_hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
     void ProcessGetBlockData(CNode& pfrom, Peer& peer, const CInv& inv);
 
+    /**
+     * Get a witness block message with the block as it is stored on disk,
+     * from m_raw_block_cache or by reading it.
+     * @returns nullptr if the block could not be read
+     */
+    std::shared_ptr<const CSharedNetMsg> GetRawBlockMsg(const uint256& hash, const FlatFilePos& pos);
+
+    /** Recently served raw block messages */
+    node::RawBlockCache m_raw_block_cache{MAX_RAW_BLOCK_CACHE_SIZE};
+
     /**
      * Validation logic for compact filters request handling.
      *
@@ -675,6 +726,10 @@ private:
      *            False if address relay is disallowed
      */
     bool SetupAddressRelay(const CNode& node, Peer& peer);
+
+    /** Decodes and checks received blocks in parallel, nullptr if -blockpipelinethreads=0.
+     *  Declared last so that its threads are stopped before any other member is destroyed. */
+    std::unique_ptr<node::BlockPipeline> m_block_pipeline;
 };
 } // namespace
 
@@ -1119,6 +1174,41 @@ void PeerManagerImpl::FindNextBlocksToDownload(NodeId nodeid, unsigned int count
     }
 }
 
+void PeerManagerImpl::FindNextHistoricalBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<const CBlockIndex*>& vBlocks)
+{
+    if (vBlocks.size() >= count) return;
+
+    const CBlockIndex* background_tip{m_chainman.GetBackgroundSyncTip()};
+    const CBlockIndex* snapshot_base{m_chainman.GetSnapshotBaseBlock()};
+    if (!background_tip || !snapshot_base || background_tip->nHeight >= snapshot_base->nHeight) return;
+
+    CNodeState *state = State(nodeid);
+    assert(state != nullptr);
+    if (state->pindexBestKnownBlock == nullptr || state->pindexBestKnownBlock->GetAncestor(snapshot_base->nHeight) != snapshot_base) {
+        // This peer is not known to have the blocks beneath the snapshot.
+        return;
+    }
+
+    // Stay within BLOCK_DOWNLOAD_WINDOW of the background tip, so blocks can be connected as they arrive.
+    const int nWindowEnd = std::min<int>(background_tip->nHeight + BLOCK_DOWNLOAD_WINDOW, snapshot_base->nHeight);
+    std::vector<const CBlockIndex*> vToFetch(nWindowEnd - background_tip->nHeight);
+    vToFetch.back() = snapshot_base->GetAncestor(nWindowEnd);
+    for (size_t i = vToFetch.size() - 1; i > 0; i--) {
+        vToFetch[i - 1] = vToFetch[i]->pprev;
+    }
+
+    const Consensus::Params& consensusParams = m_chainparams.GetConsensus();
+    for (const CBlockIndex* pindex : vToFetch) {
+        if (!state->fHaveWitness && DeploymentActiveAt(*pindex, consensusParams, Consensus::DEPLOYMENT_SEGWIT)) {
+            // We wouldn't download this block or its descendants from this peer.
+            return;
+        }
+        if (pindex->nStatus & BLOCK_HAVE_DATA || IsBlockRequested(pindex->GetBlockHash())) continue;
+        vBlocks.push_back(pindex);
+        if (vBlocks.size() == count) return;
+    }
+}
+
 } // namespace
 
 void PeerManagerImpl::PushNodeVersion(CNode& pnode)
@@ -1338,6 +1428,23 @@ bool PeerManagerImpl::GetNodeStateStats(NodeId nodeid, CNodeStateStats& stats) c
     return true;
 }
 
+void PeerManagerImpl::StopBlockPipeline()
+{
+    if (m_block_pipeline) m_block_pipeline->Stop();
+}
+
+bool PeerManagerImpl::GetBlockPipelineStats(node::BlockPipelineStats& stats) const
+{
+    if (!m_block_pipeline) return false;
+    stats = m_block_pipeline->GetStats();
+    return true;
+}
+
+TxOrphanageStats PeerManagerImpl::GetOrphanStats() const
+{
+    return m_orphanage.GetStats();
+}
+
 void PeerManagerImpl::AddToCompactExtraTransactions(const CTransactionRef& tx)
 {
     size_t max_extra_txn = gArgs.GetIntArg("-blockreconstructionextratxn", DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN);
@@ -1513,6 +1620,13 @@ PeerManagerImpl::PeerManagerImpl(const CChainParams& chainparams, CConnman& conn
       m_mempool(pool),
       m_ignore_incoming_txs(ignore_incoming_txs)
 {
+    const int pipeline_threads{std::clamp<int>(gArgs.GetIntArg("-blockpipelinethreads", node::DEFAULT_BLOCK_PIPELINE_THREADS), 0, node::MAX_BLOCK_PIPELINE_THREADS)};
+    if (pipeline_threads > 0) {
+        LogPrintf("Using %d threads for block decoding and checking\n", pipeline_threads);
+        m_block_pipeline = std::make_unique<node::BlockPipeline>(
+            m_chainparams.GetConsensus(), pipeline_threads,
+            [this](node::BlockPipeline::Result&& result) { ProcessPipelinedBlock(std::move(result)); });
+    }
 }
 
 void PeerManagerImpl::StartScheduledTasks(CScheduler& scheduler)
@@ -1577,6 +1691,23 @@ static std::shared_ptr<const CBlock> most_recent_block GUARDED_BY(cs_most_recent
 static std::shared_ptr<const CBlockHeaderAndShortTxIDs> most_recent_compact_block GUARDED_BY(cs_most_recent_block);
 static uint256 most_recent_block_hash GUARDED_BY(cs_most_recent_block);
 static bool fWitnessesPresentInMostRecentCompactBlock GUARDED_BY(cs_most_recent_block);
+// The messages are serialized once and their payload is shared by the send queues of all peers
+static std::shared_ptr<const CSharedNetMsg> most_recent_compact_block_msg GUARDED_BY(cs_most_recent_block);
+static std::shared_ptr<const CSharedNetMsg> most_recent_block_msg GUARDED_BY(cs_most_recent_block);
+
+/**
+ * Get the most recent block as a witness block message, if it has the given
+ * hash. It is serialized when the first peer asks for it.
+ */
+static std::shared_ptr<const CSharedNetMsg> GetMostRecentBlockMsg(const uint256& hash)
+{
+    LOCK(cs_most_recent_block);
+    if (!most_recent_block || most_recent_block_hash != hash) return nullptr;
+    if (!most_recent_block_msg) {
+        most_recent_block_msg = std::make_shared<const CSharedNetMsg>(CNetMsgMaker(PROTOCOL_VERSION).Make(NetMsgType::BLOCK, *most_recent_block));
+    }
+    return most_recent_block_msg;
+}
 
 /**
  * Maintain state about the best-seen block and fast-announce a compact block
@@ -1586,6 +1717,7 @@ void PeerManagerImpl::NewPoWValidBlock(const CBlockIndex *pindex, const std::sha
 {
     std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcmpctblock = std::make_shared<const CBlockHeaderAndShortTxIDs> (*pblock, true);
     const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
+    const auto pcmpctblock_msg{std::make_shared<const CSharedNetMsg>(msgMaker.Make(NetMsgType::CMPCTBLOCK, *pcmpctblock))};
 
     LOCK(cs_main);
 
@@ -1603,12 +1735,13 @@ void PeerManagerImpl::NewPoWValidBlock(const CBlockIndex *pindex, const std::sha
         most_recent_block = pblock;
         most_recent_compact_block = pcmpctblock;
         fWitnessesPresentInMostRecentCompactBlock = fWitnessEnabled;
+        most_recent_compact_block_msg = pcmpctblock_msg;
+        most_recent_block_msg.reset();
     }
 
-    m_connman.ForEachNode([this, &pcmpctblock, pindex, &msgMaker, fWitnessEnabled, &hashBlock](CNode* pnode) EXCLUSIVE_LOCKS_REQUIRED(::cs_main) {
+    m_connman.ForEachNode([this, &pcmpctblock_msg, pindex, fWitnessEnabled, &hashBlock](CNode* pnode) EXCLUSIVE_LOCKS_REQUIRED(::cs_main) {
         AssertLockHeld(::cs_main);
 
-        // TODO: Avoid the repeated-serialization here
         if (pnode->GetCommonVersion() < INVALID_CB_NO_BAN_VERSION || pnode->fDisconnect)
             return;
         ProcessBlockAvailability(pnode->GetId());
@@ -1620,7 +1753,7 @@ void PeerManagerImpl::NewPoWValidBlock(const CBlockIndex *pindex, const std::sha
 
             LogPrint(BCLog::NET, "%s sending header-and-ids %s to peer=%d\n", "PeerManager::NewPoWValidBlock",
                     hashBlock.ToString(), pnode->GetId());
-            m_connman.PushMessage(pnode, msgMaker.Make(NetMsgType::CMPCTBLOCK, *pcmpctblock));
+            m_connman.PushMessage(pnode, *pcmpctblock_msg);
             state.pindexBestHeaderSent = pindex;
         }
     });
@@ -1807,15 +1940,31 @@ void PeerManagerImpl::RelayAddress(NodeId originator,
     }
 }
 
+std::shared_ptr<const CSharedNetMsg> PeerManagerImpl::GetRawBlockMsg(const uint256& hash, const FlatFilePos& pos)
+{
+    if (auto cached{m_raw_block_cache.Get(hash)}) return cached;
+
+    // Read and hash the block without holding the cache's lock, so other blocks can be served meanwhile.
+    CSerializedNetMsg msg;
+    msg.m_type = NetMsgType::BLOCK;
+    if (!m_chainman.m_blockman.ReadRawBlock(msg.data, pos, m_chainparams.MessageStart())) {
+        return nullptr;
+    }
+    // Another peer may have requested the same block at the same time, then its message is used.
+    return m_raw_block_cache.Insert(hash, std::make_shared<const CSharedNetMsg>(std::move(msg)));
+}
+
 void PeerManagerImpl::ProcessGetBlockData(CNode& pfrom, Peer& peer, const CInv& inv)
 {
     std::shared_ptr<const CBlock> a_recent_block;
     std::shared_ptr<const CBlockHeaderAndShortTxIDs> a_recent_compact_block;
+    std::shared_ptr<const CSharedNetMsg> a_recent_compact_block_msg;
     bool fWitnessesPresentInARecentCompactBlock;
     {
         LOCK(cs_most_recent_block);
         a_recent_block = most_recent_block;
         a_recent_compact_block = most_recent_compact_block;
+        a_recent_compact_block_msg = most_recent_compact_block_msg;
         fWitnessesPresentInARecentCompactBlock = fWitnessesPresentInMostRecentCompactBlock;
     }
 
@@ -1842,56 +1991,81 @@ void PeerManagerImpl::ProcessGetBlockData(CNode& pfrom, Peer& peer, const CInv&
         }
     }
 
-    LOCK(cs_main);
-    const CBlockIndex* pindex = m_chainman.m_blockman.LookupBlockIndex(inv.hash);
-    if (!pindex) {
-        return;
-    }
-    if (!BlockRequestAllowed(pindex)) {
-        LogPrint(BCLog::NET, "%s: ignoring request from peer=%i for old block that isn't in the main chain\n", __func__, pfrom.GetId());
-        return;
-    }
     const CNetMsgMaker msgMaker(pfrom.GetCommonVersion());
-    // disconnect node in case we have reached the outbound limit for serving historical blocks
-    if (m_connman.OutboundTargetReached(true) &&
-        (((pindexBestHeader != nullptr) && (pindexBestHeader->GetBlockTime() - pindex->GetBlockTime() > HISTORICAL_BLOCK_AGE)) || inv.IsMsgFilteredBlk()) &&
-        !pfrom.HasPermission(NetPermissionFlags::Download) // nodes with the download permission may exceed target
-    ) {
-        LogPrint(BCLog::NET, "historical block serving limit reached, disconnect peer=%d\n", pfrom.GetId());
-        pfrom.fDisconnect = true;
-        return;
-    }
-    // Avoid leaking prune-height by never sending blocks below the NODE_NETWORK_LIMITED threshold
-    if (!pfrom.HasPermission(NetPermissionFlags::NoBan) && (
-            (((pfrom.GetLocalServices() & NODE_NETWORK_LIMITED) == NODE_NETWORK_LIMITED) && ((pfrom.GetLocalServices() & NODE_NETWORK) != NODE_NETWORK) && (m_chainman.ActiveChain().Tip()->nHeight - pindex->nHeight > (int)NODE_NETWORK_LIMITED_MIN_BLOCKS + 2 /* add two blocks buffer extension for possible races */) )
-       )) {
-        LogPrint(BCLog::NET, "Ignore block request below NODE_NETWORK_LIMITED threshold, disconnect peer=%d\n", pfrom.GetId());
-        //disconnect node and prevent it from stalling (would otherwise wait for the missing block)
+    const CBlockIndex* pindex;
+    FlatFilePos block_pos;
+    bool fPeerWantsWitness{false};
+    bool send_compact_block{false};
+    uint256 tip_hash;
+    {
+        LOCK(cs_main);
+        pindex = m_chainman.m_blockman.LookupBlockIndex(inv.hash);
+        if (!pindex) {
+            return;
+        }
+        if (!BlockRequestAllowed(pindex)) {
+            LogPrint(BCLog::NET, "%s: ignoring request from peer=%i for old block that isn't in the main chain\n", __func__, pfrom.GetId());
+            return;
+        }
+        // disconnect node in case we have reached the outbound limit for serving historical blocks
+        if (m_connman.OutboundTargetReached(true) &&
+            (((pindexBestHeader != nullptr) && (pindexBestHeader->GetBlockTime() - pindex->GetBlockTime() > HISTORICAL_BLOCK_AGE)) || inv.IsMsgFilteredBlk()) &&
+            !pfrom.HasPermission(NetPermissionFlags::Download) // nodes with the download permission may exceed target
+        ) {
+            LogPrint(BCLog::NET, "historical block serving limit reached, disconnect peer=%d\n", pfrom.GetId());
+            pfrom.fDisconnect = true;
+            return;
+        }
+        // Avoid leaking prune-height by never sending blocks below the NODE_NETWORK_LIMITED threshold
+        if (!pfrom.HasPermission(NetPermissionFlags::NoBan) && (
+                (((pfrom.GetLocalServices() & NODE_NETWORK_LIMITED) == NODE_NETWORK_LIMITED) && ((pfrom.GetLocalServices() & NODE_NETWORK) != NODE_NETWORK) && (m_chainman.ActiveChain().Tip()->nHeight - pindex->nHeight > (int)NODE_NETWORK_LIMITED_MIN_BLOCKS + 2 /* add two blocks buffer extension for possible races */) )
+           )) {
+            LogPrint(BCLog::NET, "Ignore block request below NODE_NETWORK_LIMITED threshold, disconnect peer=%d\n", pfrom.GetId());
+            //disconnect node and prevent it from stalling (would otherwise wait for the missing block)
+            pfrom.fDisconnect = true;
+            return;
+        }
+        // Pruned nodes may have deleted the block, so check whether
+        // it's available before trying to send.
+        if (!(pindex->nStatus & BLOCK_HAVE_DATA)) {
+            return;
+        }
+        block_pos = pindex->GetBlockPos();
+        if (inv.IsMsgCmpctBlk()) {
+            fPeerWantsWitness = State(pfrom.GetId())->fWantsCmpctWitness;
+            send_compact_block = CanDirectFetch() && pindex->nHeight >= m_chainman.ActiveChain().Height() - MAX_CMPCTBLOCK_DEPTH;
+        }
+        tip_hash = m_chainman.ActiveChain().Tip()->GetBlockHash();
+    } // release cs_main before reading the block, so other peers can be served meanwhile
+
+    // The block may have been pruned since cs_main was released.
+    const auto read_failed{[&] {
+        if (WITH_LOCK(cs_main, return IsBlockPruned(pindex))) {
+            LogPrint(BCLog::NET, "Block was pruned before it could be read, disconnect peer=%d\n", pfrom.GetId());
+        } else {
+            LogPrintf("Cannot load block from disk, disconnect peer=%d\n", pfrom.GetId());
+        }
         pfrom.fDisconnect = true;
-        return;
-    }
-    // Pruned nodes may have deleted the block, so check whether
-    // it's available before trying to send.
-    if (!(pindex->nStatus & BLOCK_HAVE_DATA)) {
-        return;
-    }
+    }};
     std::shared_ptr<const CBlock> pblock;
     if (a_recent_block && a_recent_block->GetHash() == pindex->GetBlockHash()) {
         pblock = a_recent_block;
-    } else if (inv.IsMsgWitnessBlk()) {
+    } else if (inv.IsMsgWitnessBlk() || (inv.IsMsgCmpctBlk() && !send_compact_block && fPeerWantsWitness)) {
         // Fast-path: in this case it is possible to serve the block directly from disk,
         // as the network format matches the format on disk
-        std::vector<uint8_t> block_data;
-        if (!ReadRawBlockFromDisk(block_data, pindex->GetBlockPos(), m_chainparams.MessageStart())) {
-            assert(!"cannot load block from disk");
+        const auto block_msg{GetRawBlockMsg(pindex->GetBlockHash(), block_pos)};
+        if (!block_msg) {
+            read_failed();
+            return;
         }
-        m_connman.PushMessage(&pfrom, msgMaker.Make(NetMsgType::BLOCK, Span{block_data}));
+        m_connman.PushMessage(&pfrom, *block_msg);
         // Don't set pblock as we've sent the block
     } else {
         // Send block from disk
         std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
-        if (!ReadBlockFromDisk(*pblockRead, pindex, m_chainparams.GetConsensus())) {
-            assert(!"cannot load block from disk");
+        if (!ReadBlockFromDisk(*pblockRead, block_pos, m_chainparams.GetConsensus())) {
+            read_failed();
+            return;
         }
         pblock = pblockRead;
     }
@@ -1899,7 +2073,11 @@ void PeerManagerImpl::ProcessGetBlockData(CNode& pfrom, Peer& peer, const CInv&
         if (inv.IsMsgBlk()) {
             m_connman.PushMessage(&pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, *pblock));
         } else if (inv.IsMsgWitnessBlk()) {
-            m_connman.PushMessage(&pfrom, msgMaker.Make(NetMsgType::BLOCK, *pblock));
+            if (const auto block_msg{pblock == a_recent_block ? GetMostRecentBlockMsg(pblock->GetHash()) : nullptr}) {
+                m_connman.PushMessage(&pfrom, *block_msg);
+            } else {
+                m_connman.PushMessage(&pfrom, msgMaker.Make(NetMsgType::BLOCK, *pblock));
+            }
         } else if (inv.IsMsgFilteredBlk()) {
             bool sendMerkleBlock = false;
             CMerkleBlock merkleBlock;
@@ -1929,11 +2107,11 @@ void PeerManagerImpl::ProcessGetBlockData(CNode& pfrom, Peer& peer, const CInv&
             // they won't have a useful mempool to match against a compact block,
             // and we don't feel like constructing the object for them, so
             // instead we respond with the full, non-compact block.
-            bool fPeerWantsWitness = State(pfrom.GetId())->fWantsCmpctWitness;
             int nSendFlags = fPeerWantsWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
-            if (CanDirectFetch() && pindex->nHeight >= m_chainman.ActiveChain().Height() - MAX_CMPCTBLOCK_DEPTH) {
+            if (send_compact_block) {
                 if ((fPeerWantsWitness || !fWitnessesPresentInARecentCompactBlock) && a_recent_compact_block && a_recent_compact_block->header.GetHash() == pindex->GetBlockHash()) {
-                    m_connman.PushMessage(&pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, *a_recent_compact_block));
+                    // Without witnesses in the block, the serialization does not depend on nSendFlags.
+                    m_connman.PushMessage(&pfrom, *a_recent_compact_block_msg);
                 } else {
                     CBlockHeaderAndShortTxIDs cmpctblock(*pblock, fPeerWantsWitness);
                     m_connman.PushMessage(&pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
@@ -1952,7 +2130,7 @@ void PeerManagerImpl::ProcessGetBlockData(CNode& pfrom, Peer& peer, const CInv&
             // and we want it right after the last block so they don't
             // wait for other stuff first.
             std::vector<CInv> vInv;
-            vInv.push_back(CInv(MSG_BLOCK, m_chainman.ActiveChain().Tip()->GetBlockHash()));
+            vInv.push_back(CInv(MSG_BLOCK, tip_hash));
             m_connman.PushMessage(&pfrom, msgMaker.Make(NetMsgType::INV, vInv));
             peer.m_continuation_block.SetNull();
         }
@@ -2295,24 +2473,45 @@ void PeerManagerImpl::ProcessHeadersMessage(CNode& pfrom, const Peer& peer,
 /**
  * Reconsider orphan transactions after a parent has been accepted to the mempool.
  *
- * @param[in,out]  orphan_work_set  The set of orphan transactions to reconsider. Generally only one
- *                                  orphan will be reconsidered on each call of this function. This set
- *                                  may be added to if accepting an orphan causes its children to be
- *                                  reconsidered.
+ * @param[in,out]  orphan_work_set  The set of orphan transactions to reconsider. On each call of this
+ *                                  function, up to MAX_ORPHAN_CANDIDATES orphans are looked at. Those still
+ *                                  missing inputs are dropped from the set without being validated, and
+ *                                  up to MAX_TX_BATCH_SIZE of the others are reconsidered together, highest
+ *                                  fee rate first. This set may be added to if accepting an orphan causes
+ *                                  its children to be reconsidered.
  */
 void PeerManagerImpl::ProcessOrphanTx(std::set<uint256>& orphan_work_set)
 {
     AssertLockHeld(cs_main);
     AssertLockHeld(g_cs_orphans);
 
-    while (!orphan_work_set.empty()) {
-        const uint256 orphanHash = *orphan_work_set.begin();
-        orphan_work_set.erase(orphan_work_set.begin());
-
-        const auto [porphanTx, from_peer] = m_orphanage.GetTx(orphanHash);
-        if (porphanTx == nullptr) continue;
-
-        const MempoolAcceptResult result = m_chainman.ProcessTransaction(porphanTx);
+    std::vector<CTransactionRef> orphans;
+    {
+        LOCK(m_mempool.cs);
+        CCoinsViewMemPool view{&m_chainman.ActiveChainstate().CoinsTip(), m_mempool};
+        const auto get_fee = [&](const CTransaction& tx) -> std::optional<CAmount> {
+            CAmount value_in{0};
+            for (const CTxIn& txin : tx.vin) {
+                Coin coin;
+                if (!view.GetCoin(txin.prevout, coin) || coin.IsSpent()) return std::nullopt;
+                value_in += coin.out.nValue;
+            }
+            return value_in - tx.GetValueOut();
+        };
+        orphans = m_orphanage.GetWorkBatch(orphan_work_set, MAX_TX_BATCH_SIZE, MAX_ORPHAN_CANDIDATES, get_fee);
+    }
+    if (orphans.empty()) return;
+    std::vector<NodeId> from_peers;
+    for (const CTransactionRef& porphanTx : orphans) {
+        from_peers.push_back(m_orphanage.GetTx(porphanTx->GetHash()).second);
+    }
+
+    const std::vector<MempoolAcceptResult> results{m_chainman.ProcessTransactions(orphans)};
+    for (size_t i = 0; i < orphans.size(); ++i) {
+        const CTransactionRef& porphanTx{orphans[i]};
+        const uint256& orphanHash{porphanTx->GetHash()};
+        const NodeId from_peer{from_peers[i]};
+        const MempoolAcceptResult& result{results[i]};
         const TxValidationState& state = result.m_state;
 
         if (result.m_result_type == MempoolAcceptResult::ResultType::VALID) {
@@ -2323,7 +2522,6 @@ void PeerManagerImpl::ProcessOrphanTx(std::set<uint256>& orphan_work_set)
             for (const CTransactionRef& removedTx : result.m_replaced_transactions.value()) {
                 AddToCompactExtraTransactions(removedTx);
             }
-            break;
         } else if (state.GetResult() != TxValidationResult::TX_MISSING_INPUTS) {
             if (state.IsInvalid()) {
                 LogPrint(BCLog::MEMPOOL, "   invalid orphan tx %s from peer=%d. %s\n",
@@ -2366,11 +2564,245 @@ void PeerManagerImpl::ProcessOrphanTx(std::set<uint256>& orphan_work_set)
                 }
             }
             m_orphanage.EraseTx(orphanHash);
-            break;
         }
     }
 }
 
+CTransactionRef PeerManagerImpl::ReceiveTransaction(CNode& pfrom, CDataStream& vRecv)
+{
+    // Stop processing the transaction early if
+    // 1) We are in blocks only mode and peer has no relay permission
+    // 2) This peer is a block-relay-only peer
+    if ((m_ignore_incoming_txs && !pfrom.HasPermission(NetPermissionFlags::Relay)) || (pfrom.m_tx_relay == nullptr))
+    {
+        LogPrint(BCLog::NET, "transaction sent in violation of protocol peer=%d\n", pfrom.GetId());
+        pfrom.fDisconnect = true;
+        return nullptr;
+    }
+
+    // Stop processing the transaction early if we are still in IBD since we don't
+    // have enough information to validate it yet. Sending unsolicited transactions
+    // is not considered a protocol violation, so don't punish the peer.
+    if (m_chainman.ActiveChainstate().IsInitialBlockDownload()) return nullptr;
+
+    CTransactionRef ptx;
+    vRecv >> ptx;
+    return ptx;
+}
+
+void PeerManagerImpl::ProcessTransactions(CNode& pfrom, Peer& peer, const std::vector<CTransactionRef>& txs)
+{
+    LOCK2(cs_main, g_cs_orphans);
+
+    CNodeState* nodestate = State(pfrom.GetId());
+
+    std::vector<CTransactionRef> new_txs;
+    for (const CTransactionRef& ptx : txs) {
+        const CTransaction& tx = *ptx;
+        const uint256& txid = ptx->GetHash();
+        const uint256& wtxid = ptx->GetWitnessHash();
+
+        const uint256& hash = nodestate->m_wtxid_relay ? wtxid : txid;
+        pfrom.AddKnownTx(hash);
+        if (nodestate->m_wtxid_relay && txid != wtxid) {
+            // Insert txid into filterInventoryKnown, even for
+            // wtxidrelay peers. This prevents re-adding of
+            // unconfirmed parents to the recently_announced
+            // filter, when a child tx is requested. See
+            // ProcessGetData().
+            pfrom.AddKnownTx(txid);
+        }
+
+        m_txrequest.ReceivedResponse(pfrom.GetId(), txid);
+        if (tx.HasWitness()) m_txrequest.ReceivedResponse(pfrom.GetId(), wtxid);
+
+        // We do the AlreadyHaveTx() check using wtxid, rather than txid - in the
+        // absence of witness malleation, this is strictly better, because the
+        // recent rejects filter may contain the wtxid but rarely contains
+        // the txid of a segwit transaction that has been rejected.
+        // In the presence of witness malleation, it's possible that by only
+        // doing the check with wtxid, we could overlook a transaction which
+        // was confirmed with a different witness, or exists in our mempool
+        // with a different witness, but this has limited downside:
+        // mempool validation does its own lookup of whether we have the txid
+        // already; and an adversary can already relay us old transactions
+        // (older than our recency filter) if trying to DoS us, without any need
+        // for witness malleation.
+        if (AlreadyHaveTx(GenTxid::Wtxid(wtxid))) {
+            // Keep an orphan around for as long as any peer that sent it is connected.
+            m_orphanage.AddAnnouncer(wtxid, pfrom.GetId());
+            if (pfrom.HasPermission(NetPermissionFlags::ForceRelay)) {
+                // Always relay transactions received from peers with forcerelay
+                // permission, even if they were already in the mempool, allowing
+                // the node to function as a gateway for nodes hidden behind it.
+                if (!m_mempool.exists(GenTxid::Txid(tx.GetHash()))) {
+                    LogPrintf("Not relaying non-mempool transaction %s from forcerelay peer=%d\n", tx.GetHash().ToString(), pfrom.GetId());
+                } else {
+                    LogPrintf("Force relaying tx %s from peer=%d\n", tx.GetHash().ToString(), pfrom.GetId());
+                    _RelayTransaction(tx.GetHash(), tx.GetWitnessHash());
+                }
+            }
+            continue;
+        }
+
+        new_txs.push_back(ptx);
+    }
+    if (new_txs.empty()) return;
+
+    const std::vector<MempoolAcceptResult> results{m_chainman.ProcessTransactions(new_txs)};
+    bool accepted{false};
+    for (size_t i = 0; i < new_txs.size(); ++i) {
+        const CTransactionRef& ptx{new_txs[i]};
+        const CTransaction& tx = *ptx;
+        const MempoolAcceptResult& result{results[i]};
+        const TxValidationState& state = result.m_state;
+
+        if (result.m_result_type == MempoolAcceptResult::ResultType::VALID) {
+            // As this version of the transaction was acceptable, we can forget about any
+            // requests for it.
+            m_txrequest.ForgetTxHash(tx.GetHash());
+            m_txrequest.ForgetTxHash(tx.GetWitnessHash());
+            _RelayTransaction(tx.GetHash(), tx.GetWitnessHash());
+            m_orphanage.AddChildrenToWorkSet(tx, peer.m_orphan_work_set);
+
+            pfrom.m_last_tx_time = GetTime<std::chrono::seconds>();
+
+            LogPrint(BCLog::MEMPOOL, "AcceptToMemoryPool: peer=%d: accepted %s (poolsz %u txn, %u kB)\n",
+                pfrom.GetId(),
+                tx.GetHash().ToString(),
+                m_mempool.size(), m_mempool.DynamicMemoryUsage() / 1000);
+
+            for (const CTransactionRef& removedTx : result.m_replaced_transactions.value()) {
+                AddToCompactExtraTransactions(removedTx);
+            }
+
+            accepted = true;
+        }
+        else if (state.GetResult() == TxValidationResult::TX_MISSING_INPUTS)
+        {
+            bool fRejectedParents = false; // It may be the case that the orphans parents have all been rejected
+
+            // Deduplicate parent txids, so that we don't have to loop over
+            // the same parent txid more than once down below.
+            std::vector<uint256> unique_parents;
+            unique_parents.reserve(tx.vin.size());
+            for (const CTxIn& txin : tx.vin) {
+                // We start with all parents, and then remove duplicates below.
+                unique_parents.push_back(txin.prevout.hash);
+            }
+            std::sort(unique_parents.begin(), unique_parents.end());
+            unique_parents.erase(std::unique(unique_parents.begin(), unique_parents.end()), unique_parents.end());
+            for (const uint256& parent_txid : unique_parents) {
+                if (m_recent_rejects.contains(parent_txid)) {
+                    fRejectedParents = true;
+                    break;
+                }
+            }
+            if (!fRejectedParents) {
+                const auto current_time{GetTime<std::chrono::microseconds>()};
+
+                for (const uint256& parent_txid : unique_parents) {
+                    // Here, we only have the txid (and not wtxid) of the
+                    // inputs, so we only request in txid mode, even for
+                    // wtxidrelay peers.
+                    // Eventually we should replace this with an improved
+                    // protocol for getting all unconfirmed parents.
+                    const auto gtxid{GenTxid::Txid(parent_txid)};
+                    pfrom.AddKnownTx(parent_txid);
+                    if (!AlreadyHaveTx(gtxid)) AddTxAnnouncement(pfrom, gtxid, current_time);
+                }
+
+                if (m_orphanage.AddTx(ptx, pfrom.GetId())) {
+                    AddToCompactExtraTransactions(ptx);
+                }
+
+                // Once added to the orphan pool, a tx is considered AlreadyHave, and we shouldn't request it anymore.
+                m_txrequest.ForgetTxHash(tx.GetHash());
+                m_txrequest.ForgetTxHash(tx.GetWitnessHash());
+
+                // DoS prevention: do not allow m_orphanage to grow unbounded (see CVE-2012-3789)
+                unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, gArgs.GetIntArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
+                unsigned int nEvicted = m_orphanage.LimitOrphans(nMaxOrphanTx);
+                if (nEvicted > 0) {
+                    LogPrint(BCLog::MEMPOOL, "orphanage overflow, removed %u tx\n", nEvicted);
+                }
+            } else {
+                LogPrint(BCLog::MEMPOOL, "not keeping orphan with rejected parents %s\n",tx.GetHash().ToString());
+                // We will continue to reject this tx since it has rejected
+                // parents so avoid re-requesting it from other peers.
+                // Here we add both the txid and the wtxid, as we know that
+                // regardless of what witness is provided, we will not accept
+                // this, so we don't need to allow for redownload of this txid
+                // from any of our non-wtxidrelay peers.
+                m_recent_rejects.insert(tx.GetHash());
+                m_recent_rejects.insert(tx.GetWitnessHash());
+                m_txrequest.ForgetTxHash(tx.GetHash());
+                m_txrequest.ForgetTxHash(tx.GetWitnessHash());
+            }
+        } else {
+            if (state.GetResult() != TxValidationResult::TX_WITNESS_STRIPPED) {
+                // We can add the wtxid of this transaction to our reject filter.
+                // Do not add txids of witness transactions or witness-stripped
+                // transactions to the filter, as they can have been malleated;
+                // adding such txids to the reject filter would potentially
+                // interfere with relay of valid transactions from peers that
+                // do not support wtxid-based relay. See
+                // https://github.com/bitcoin/bitcoin/issues/8279 for details.
+                // We can remove this restriction (and always add wtxids to
+                // the filter even for witness stripped transactions) once
+                // wtxid-based relay is broadly deployed.
+                // See also comments in https://github.com/bitcoin/bitcoin/pull/18044#discussion_r443419034
+                // for concerns around weakening security of unupgraded nodes
+                // if we start doing this too early.
+                m_recent_rejects.insert(tx.GetWitnessHash());
+                m_txrequest.ForgetTxHash(tx.GetWitnessHash());
+                // If the transaction failed for TX_INPUTS_NOT_STANDARD,
+                // then we know that the witness was irrelevant to the policy
+                // failure, since this check depends only on the txid
+                // (the scriptPubKey being spent is covered by the txid).
+                // Add the txid to the reject filter to prevent repeated
+                // processing of this transaction in the event that child
+                // transactions are later received (resulting in
+                // parent-fetching by txid via the orphan-handling logic).
+                if (state.GetResult() == TxValidationResult::TX_INPUTS_NOT_STANDARD && tx.GetWitnessHash() != tx.GetHash()) {
+                    m_recent_rejects.insert(tx.GetHash());
+                    m_txrequest.ForgetTxHash(tx.GetHash());
+                }
+                if (RecursiveDynamicUsage(*ptx) < 100000) {
+                    AddToCompactExtraTransactions(ptx);
+                }
+            }
+        }
+
+        // If a tx has been detected by m_recent_rejects, we will have reached
+        // this point and the tx will have been ignored. Because we haven't
+        // submitted the tx to our mempool, we won't have computed a DoS
+        // score for it or determined exactly why we consider it invalid.
+        //
+        // This means we won't penalize any peer subsequently relaying a DoSy
+        // tx (even if we penalized the first peer who gave it to us) because
+        // we have to account for m_recent_rejects showing false positives. In
+        // other words, we shouldn't penalize a peer if we aren't *sure* they
+        // submitted a DoSy tx.
+        //
+        // Note that m_recent_rejects doesn't just record DoSy or invalid
+        // transactions, but any tx not accepted by the mempool, which may be
+        // due to node policy (vs. consensus). So we can't blanket penalize a
+        // peer simply for relaying a tx that our m_recent_rejects has caught,
+        // regardless of false positives.
+
+        if (state.IsInvalid()) {
+            LogPrint(BCLog::MEMPOOLREJ, "%s from peer=%d was not accepted: %s\n", tx.GetHash().ToString(),
+                pfrom.GetId(),
+                state.ToString());
+            MaybePunishNodeForTx(pfrom.GetId(), state);
+        }
+    }
+
+    // Recursively process any orphan transactions that depended on the accepted ones
+    if (accepted) ProcessOrphanTx(peer.m_orphan_work_set);
+}
+
 bool PeerManagerImpl::PrepareBlockFilterRequest(CNode& peer,
                                                 BlockFilterType filter_type, uint32_t start_height,
                                                 const uint256& stop_hash, uint32_t max_height_diff,
@@ -2551,6 +2983,44 @@ void PeerManagerImpl::ProcessBlock(CNode& node, const std::shared_ptr<const CBlo
     }
 }
 
+void PeerManagerImpl::ProcessPipelinedBlock(node::BlockPipeline::Result&& result)
+{
+    if (result.block) {
+        const uint256 hash{result.block->GetHash()};
+        LogPrint(BCLog::NET, "received block %s peer=%d\n", hash.ToString(), result.peer);
+
+        bool force_processing{false};
+        {
+            LOCK(cs_main);
+            // Same bookkeeping as the synchronous path in ProcessMessage. The
+            // request stays in flight while the block is in the pipeline, so
+            // it is not requested again from another peer in the meantime.
+            force_processing = IsBlockRequested(hash);
+            RemoveBlockRequest(hash);
+            mapBlockSource.emplace(hash, std::make_pair(result.peer, true));
+        }
+        // If the context-free checks failed, ProcessNewBlock repeats them and
+        // reports the failure through BlockChecked, which punishes the peer.
+        bool new_block{false};
+        m_chainman.ProcessNewBlock(m_chainparams, result.block, force_processing, &new_block);
+        if (new_block) {
+            m_connman.ForNode(result.peer, [](CNode* node) {
+                node->m_last_block_time = GetTime<std::chrono::seconds>();
+                return true;
+            });
+        } else {
+            LOCK(cs_main);
+            mapBlockSource.erase(hash);
+        }
+    } else {
+        LogPrint(BCLog::NET, "%s peer=%d\n", result.state.ToString(), result.peer);
+    }
+
+    if (PeerRef peer{GetPeerRef(result.peer)}) {
+        if (--peer->m_blocks_in_pipeline == 0) m_connman.WakeMessageHandler(result.peer);
+    }
+}
+
 void PeerManagerImpl::ProcessMessage(CNode& pfrom, const std::string& msg_type, CDataStream& vRecv,
                                      const std::chrono::microseconds time_received,
                                      const std::atomic<bool>& interruptMsgProc)
@@ -3275,216 +3745,8 @@ void PeerManagerImpl::ProcessMessage(CNode& pfrom, const std::string& msg_type,
     }
 
     if (msg_type == NetMsgType::TX) {
-        // Stop processing the transaction early if
-        // 1) We are in blocks only mode and peer has no relay permission
-        // 2) This peer is a block-relay-only peer
-        if ((m_ignore_incoming_txs && !pfrom.HasPermission(NetPermissionFlags::Relay)) || (pfrom.m_tx_relay == nullptr))
-        {
-            LogPrint(BCLog::NET, "transaction sent in violation of protocol peer=%d\n", pfrom.GetId());
-            pfrom.fDisconnect = true;
-            return;
-        }
-
-        // Stop processing the transaction early if we are still in IBD since we don't
-        // have enough information to validate it yet. Sending unsolicited transactions
-        // is not considered a protocol violation, so don't punish the peer.
-        if (m_chainman.ActiveChainstate().IsInitialBlockDownload()) return;
-
-        CTransactionRef ptx;
-        vRecv >> ptx;
-        const CTransaction& tx = *ptx;
-
-        const uint256& txid = ptx->GetHash();
-        const uint256& wtxid = ptx->GetWitnessHash();
-
-        LOCK2(cs_main, g_cs_orphans);
-
-        CNodeState* nodestate = State(pfrom.GetId());
-
-        const uint256& hash = nodestate->m_wtxid_relay ? wtxid : txid;
-        pfrom.AddKnownTx(hash);
-        if (nodestate->m_wtxid_relay && txid != wtxid) {
-            // Insert txid into filterInventoryKnown, even for
-            // wtxidrelay peers. This prevents re-adding of
-            // unconfirmed parents to the recently_announced
-            // filter, when a child tx is requested. See
-            // ProcessGetData().
-            pfrom.AddKnownTx(txid);
-        }
-
-        m_txrequest.ReceivedResponse(pfrom.GetId(), txid);
-        if (tx.HasWitness()) m_txrequest.ReceivedResponse(pfrom.GetId(), wtxid);
-
-        // We do the AlreadyHaveTx() check using wtxid, rather than txid - in the
-        // absence of witness malleation, this is strictly better, because the
-        // recent rejects filter may contain the wtxid but rarely contains
-        // the txid of a segwit transaction that has been rejected.
-        // In the presence of witness malleation, it's possible that by only
-        // doing the check with wtxid, we could overlook a transaction which
-        // was confirmed with a different witness, or exists in our mempool
-        // with a different witness, but this has limited downside:
-        // mempool validation does its own lookup of whether we have the txid
-        // already; and an adversary can already relay us old transactions
-        // (older than our recency filter) if trying to DoS us, without any need
-        // for witness malleation.
-        if (AlreadyHaveTx(GenTxid::Wtxid(wtxid))) {
-            if (pfrom.HasPermission(NetPermissionFlags::ForceRelay)) {
-                // Always relay transactions received from peers with forcerelay
-                // permission, even if they were already in the mempool, allowing
-                // the node to function as a gateway for nodes hidden behind it.
-                if (!m_mempool.exists(GenTxid::Txid(tx.GetHash()))) {
-                    LogPrintf("Not relaying non-mempool transaction %s from forcerelay peer=%d\n", tx.GetHash().ToString(), pfrom.GetId());
-                } else {
-                    LogPrintf("Force relaying tx %s from peer=%d\n", tx.GetHash().ToString(), pfrom.GetId());
-                    _RelayTransaction(tx.GetHash(), tx.GetWitnessHash());
-                }
-            }
-            return;
-        }
-
-        const MempoolAcceptResult result = m_chainman.ProcessTransaction(ptx);
-        const TxValidationState& state = result.m_state;
-
-        if (result.m_result_type == MempoolAcceptResult::ResultType::VALID) {
-            // As this version of the transaction was acceptable, we can forget about any
-            // requests for it.
-            m_txrequest.ForgetTxHash(tx.GetHash());
-            m_txrequest.ForgetTxHash(tx.GetWitnessHash());
-            _RelayTransaction(tx.GetHash(), tx.GetWitnessHash());
-            m_orphanage.AddChildrenToWorkSet(tx, peer->m_orphan_work_set);
-
-            pfrom.m_last_tx_time = GetTime<std::chrono::seconds>();
-
-            LogPrint(BCLog::MEMPOOL, "AcceptToMemoryPool: peer=%d: accepted %s (poolsz %u txn, %u kB)\n",
-                pfrom.GetId(),
-                tx.GetHash().ToString(),
-                m_mempool.size(), m_mempool.DynamicMemoryUsage() / 1000);
-
-            for (const CTransactionRef& removedTx : result.m_replaced_transactions.value()) {
-                AddToCompactExtraTransactions(removedTx);
-            }
-
-            // Recursively process any orphan transactions that depended on this one
-            ProcessOrphanTx(peer->m_orphan_work_set);
-        }
-        else if (state.GetResult() == TxValidationResult::TX_MISSING_INPUTS)
-        {
-            bool fRejectedParents = false; // It may be the case that the orphans parents have all been rejected
-
-            // Deduplicate parent txids, so that we don't have to loop over
-            // the same parent txid more than once down below.
-            std::vector<uint256> unique_parents;
-            unique_parents.reserve(tx.vin.size());
-            for (const CTxIn& txin : tx.vin) {
-                // We start with all parents, and then remove duplicates below.
-                unique_parents.push_back(txin.prevout.hash);
-            }
-            std::sort(unique_parents.begin(), unique_parents.end());
-            unique_parents.erase(std::unique(unique_parents.begin(), unique_parents.end()), unique_parents.end());
-            for (const uint256& parent_txid : unique_parents) {
-                if (m_recent_rejects.contains(parent_txid)) {
-                    fRejectedParents = true;
-                    break;
-                }
-            }
-            if (!fRejectedParents) {
-                const auto current_time{GetTime<std::chrono::microseconds>()};
-
-                for (const uint256& parent_txid : unique_parents) {
-                    // Here, we only have the txid (and not wtxid) of the
-                    // inputs, so we only request in txid mode, even for
-                    // wtxidrelay peers.
-                    // Eventually we should replace this with an improved
-                    // protocol for getting all unconfirmed parents.
-                    const auto gtxid{GenTxid::Txid(parent_txid)};
-                    pfrom.AddKnownTx(parent_txid);
-                    if (!AlreadyHaveTx(gtxid)) AddTxAnnouncement(pfrom, gtxid, current_time);
-                }
-
-                if (m_orphanage.AddTx(ptx, pfrom.GetId())) {
-                    AddToCompactExtraTransactions(ptx);
-                }
-
-                // Once added to the orphan pool, a tx is considered AlreadyHave, and we shouldn't request it anymore.
-                m_txrequest.ForgetTxHash(tx.GetHash());
-                m_txrequest.ForgetTxHash(tx.GetWitnessHash());
-
-                // DoS prevention: do not allow m_orphanage to grow unbounded (see CVE-2012-3789)
-                unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, gArgs.GetIntArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
-                unsigned int nEvicted = m_orphanage.LimitOrphans(nMaxOrphanTx);
-                if (nEvicted > 0) {
-                    LogPrint(BCLog::MEMPOOL, "orphanage overflow, removed %u tx\n", nEvicted);
-                }
-            } else {
-                LogPrint(BCLog::MEMPOOL, "not keeping orphan with rejected parents %s\n",tx.GetHash().ToString());
-                // We will continue to reject this tx since it has rejected
-                // parents so avoid re-requesting it from other peers.
-                // Here we add both the txid and the wtxid, as we know that
-                // regardless of what witness is provided, we will not accept
-                // this, so we don't need to allow for redownload of this txid
-                // from any of our non-wtxidrelay peers.
-                m_recent_rejects.insert(tx.GetHash());
-                m_recent_rejects.insert(tx.GetWitnessHash());
-                m_txrequest.ForgetTxHash(tx.GetHash());
-                m_txrequest.ForgetTxHash(tx.GetWitnessHash());
-            }
-        } else {
-            if (state.GetResult() != TxValidationResult::TX_WITNESS_STRIPPED) {
-                // We can add the wtxid of this transaction to our reject filter.
-                // Do not add txids of witness transactions or witness-stripped
-                // transactions to the filter, as they can have been malleated;
-                // adding such txids to the reject filter would potentially
-                // interfere with relay of valid transactions from peers that
-                // do not support wtxid-based relay. See
-                // https://github.com/bitcoin/bitcoin/issues/8279 for details.
-                // We can remove this restriction (and always add wtxids to
-                // the filter even for witness stripped transactions) once
-                // wtxid-based relay is broadly deployed.
-                // See also comments in https://github.com/bitcoin/bitcoin/pull/18044#discussion_r443419034
-                // for concerns around weakening security of unupgraded nodes
-                // if we start doing this too early.
-                m_recent_rejects.insert(tx.GetWitnessHash());
-                m_txrequest.ForgetTxHash(tx.GetWitnessHash());
-                // If the transaction failed for TX_INPUTS_NOT_STANDARD,
-                // then we know that the witness was irrelevant to the policy
-                // failure, since this check depends only on the txid
-                // (the scriptPubKey being spent is covered by the txid).
-                // Add the txid to the reject filter to prevent repeated
-                // processing of this transaction in the event that child
-                // transactions are later received (resulting in
-                // parent-fetching by txid via the orphan-handling logic).
-                if (state.GetResult() == TxValidationResult::TX_INPUTS_NOT_STANDARD && tx.GetWitnessHash() != tx.GetHash()) {
-                    m_recent_rejects.insert(tx.GetHash());
-                    m_txrequest.ForgetTxHash(tx.GetHash());
-                }
-                if (RecursiveDynamicUsage(*ptx) < 100000) {
-                    AddToCompactExtraTransactions(ptx);
-                }
-            }
-        }
-
-        // If a tx has been detected by m_recent_rejects, we will have reached
-        // this point and the tx will have been ignored. Because we haven't
-        // submitted the tx to our mempool, we won't have computed a DoS
-        // score for it or determined exactly why we consider it invalid.
-        //
-        // This means we won't penalize any peer subsequently relaying a DoSy
-        // tx (even if we penalized the first peer who gave it to us) because
-        // we have to account for m_recent_rejects showing false positives. In
-        // other words, we shouldn't penalize a peer if we aren't *sure* they
-        // submitted a DoSy tx.
-        //
-        // Note that m_recent_rejects doesn't just record DoSy or invalid
-        // transactions, but any tx not accepted by the mempool, which may be
-        // due to node policy (vs. consensus). So we can't blanket penalize a
-        // peer simply for relaying a tx that our m_recent_rejects has caught,
-        // regardless of false positives.
-
-        if (state.IsInvalid()) {
-            LogPrint(BCLog::MEMPOOLREJ, "%s from peer=%d was not accepted: %s\n", tx.GetHash().ToString(),
-                pfrom.GetId(),
-                state.ToString());
-            MaybePunishNodeForTx(pfrom.GetId(), state);
+        if (CTransactionRef ptx{ReceiveTransaction(pfrom, vRecv)}) {
+            ProcessTransactions(pfrom, *peer, {ptx});
         }
         return;
     }
@@ -3813,6 +4075,16 @@ void PeerManagerImpl::ProcessMessage(CNode& pfrom, const std::string& msg_type,
             return;
         }
 
+        if (m_block_pipeline) {
+            // Counted before it is queued, as it may be connected before Submit() returns.
+            ++peer->m_blocks_in_pipeline;
+            if (!m_block_pipeline->Submit(pfrom.GetId(), std::move(vRecv))) {
+                // The pipeline was stopped on shutdown and dropped the block.
+                --peer->m_blocks_in_pipeline;
+            }
+            return;
+        }
+
         std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
         vRecv >> *pblock;
 
@@ -4128,6 +4400,17 @@ bool PeerManagerImpl::MaybeDiscourageAndDisconnect(CNode& pnode, Peer& peer)
     return true;
 }
 
+/**
+ * Whether a message can be processed while the message handler threads process
+ * the messages of other peers. This covers messages that are frequent or slow
+ * to answer, like serving blocks from disk, but do not change the state shared
+ * between peers.
+ */
+static bool IsParallelMessage(const std::string& msg_type)
+{
+    return msg_type == NetMsgType::GETDATA || msg_type == NetMsgType::PING || msg_type == NetMsgType::PONG;
+}
+
 bool PeerManagerImpl::ProcessMessages(CNode* pfrom, std::atomic<bool>& interruptMsgProc)
 {
     bool fMoreWork = false;
@@ -4142,7 +4425,8 @@ bool PeerManagerImpl::ProcessMessages(CNode* pfrom, std::atomic<bool>& interrupt
         }
     }
 
-    {
+    if (WITH_LOCK(g_cs_orphans, return !peer->m_orphan_work_set.empty())) {
+        LOCK(m_msgproc_mutex);
         LOCK2(cs_main, g_cs_orphans);
         if (!peer->m_orphan_work_set.empty()) {
             ProcessOrphanTx(peer->m_orphan_work_set);
@@ -4171,31 +4455,63 @@ bool PeerManagerImpl::ProcessMessages(CNode* pfrom, std::atomic<bool>& interrupt
     {
         LOCK(pfrom->cs_vProcessMsg);
         if (pfrom->vProcessMsg.empty()) return false;
-        // Just take one message
-        msgs.splice(msgs.begin(), pfrom->vProcessMsg, pfrom->vProcessMsg.begin());
-        pfrom->nProcessQueueSize -= msgs.front().m_raw_message_size;
+        // Blocks from this peer are still in the block pipeline. Only further
+        // blocks may overtake them; anything else (e.g. a ping) waits until
+        // they are connected, as it would with synchronous processing.
+        if (peer->m_blocks_in_pipeline > 0 && pfrom->vProcessMsg.front().m_type != NetMsgType::BLOCK) return false;
+        // Just take one message, or the transactions queued back to back, which
+        // are accepted to the mempool together. Before the handshake is complete,
+        // messages are taken one by one so that ProcessMessage() rejects them.
+        do {
+            msgs.splice(msgs.end(), pfrom->vProcessMsg, pfrom->vProcessMsg.begin());
+            pfrom->nProcessQueueSize -= msgs.back().m_raw_message_size;
+        } while (pfrom->fSuccessfullyConnected && msgs.front().m_type == NetMsgType::TX && msgs.size() < MAX_TX_BATCH_SIZE &&
+                 !pfrom->vProcessMsg.empty() && pfrom->vProcessMsg.front().m_type == NetMsgType::TX);
+        const bool was_paused{pfrom->fPauseRecv};
         pfrom->fPauseRecv = pfrom->nProcessQueueSize > m_connman.GetReceiveFloodSize();
+        if (was_paused && !pfrom->fPauseRecv) m_connman.WakeSocketHandler(pfrom->GetId());
         fMoreWork = !pfrom->vProcessMsg.empty();
     }
-    CNetMessage& msg(msgs.front());
 
-    TRACE6(net, inbound_message,
-        pfrom->GetId(),
-        pfrom->m_addr_name.c_str(),
-        pfrom->ConnectionTypeAsString().c_str(),
-        msg.m_type.c_str(),
-        msg.m_recv.size(),
-        msg.m_recv.data()
-    );
+    for (CNetMessage& msg : msgs) {
+        TRACE6(net, inbound_message,
+            pfrom->GetId(),
+            pfrom->m_addr_name.c_str(),
+            pfrom->ConnectionTypeAsString().c_str(),
+            msg.m_type.c_str(),
+            msg.m_recv.size(),
+            msg.m_recv.data()
+        );
+
+        if (gArgs.GetBoolArg("-capturemessages", false)) {
+            CaptureMessage(pfrom->addr, msg.m_type, MakeUCharSpan(msg.m_recv), /*is_incoming=*/true);
+        }
 
-    if (gArgs.GetBoolArg("-capturemessages", false)) {
-        CaptureMessage(pfrom->addr, msg.m_type, MakeUCharSpan(msg.m_recv), /*is_incoming=*/true);
+        msg.SetVersion(pfrom->GetCommonVersion());
     }
 
-    msg.SetVersion(pfrom->GetCommonVersion());
+    if (msgs.size() > 1) {
+        std::vector<CTransactionRef> txs;
+        for (CNetMessage& msg : msgs) {
+            try {
+                if (CTransactionRef ptx{ReceiveTransaction(*pfrom, msg.m_recv)}) txs.push_back(ptx);
+            } catch (const std::exception& e) {
+                LogPrint(BCLog::NET, "%s(%s, %u bytes): Exception '%s' (%s) caught\n", __func__, SanitizeString(msg.m_type), msg.m_message_size, e.what(), typeid(e).name());
+            }
+        }
+        LOCK(m_msgproc_mutex);
+        ProcessTransactions(*pfrom, *peer, txs);
+        return fMoreWork;
+    }
+    CNetMessage& msg(msgs.front());
 
     try {
-        ProcessMessage(*pfrom, msg.m_type, msg.m_recv, msg.m_time, interruptMsgProc);
+        if (IsParallelMessage(msg.m_type)) {
+            ProcessMessage(*pfrom, msg.m_type, msg.m_recv, msg.m_time, interruptMsgProc);
+        } else {
+            LOCK(m_msgproc_mutex);
+            ProcessMessage(*pfrom, msg.m_type, msg.m_recv, msg.m_time, interruptMsgProc);
+        }
         if (interruptMsgProc) return false;
         {
             LOCK(peer->m_getdata_requests_mutex);
@@ -4609,11 +4925,15 @@ bool PeerManagerImpl::SendMessages(CNode* pto)
         return true;
     }
 
+    // Pings only touch the state of this peer, like ping and pong messages.
     MaybeSendPing(*pto, *peer, current_time);
 
     // MaybeSendPing may have marked peer for disconnection
     if (pto->fDisconnect) return true;
 
+    // Everything below uses state shared between peers.
+    LOCK(m_msgproc_mutex);
+
     MaybeSendAddr(*pto, *peer, current_time);
 
     {
@@ -4732,7 +5052,7 @@ bool PeerManagerImpl::SendMessages(CNode* pto)
                         LOCK(cs_most_recent_block);
                         if (most_recent_block_hash == pBestIndex->GetBlockHash()) {
                             if (state.fWantsCmpctWitness || !fWitnessesPresentInMostRecentCompactBlock)
-                                m_connman.PushMessage(pto, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, *most_recent_compact_block));
+                                m_connman.PushMessage(pto, *most_recent_compact_block_msg);
                             else {
                                 CBlockHeaderAndShortTxIDs cmpctblock(*most_recent_block, state.fWantsCmpctWitness);
                                 m_connman.PushMessage(pto, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
@@ -5010,6 +5330,10 @@ bool PeerManagerImpl::SendMessages(CNode* pto)
             std::vector<const CBlockIndex*> vToDownload;
             NodeId staller = -1;
             FindNextBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload, staller);
+            if (!pto->m_limited_node && m_chainman.BackgroundSyncInProgress()) {
+                // Spare download slots go to the blocks the snapshot in use is validated with.
+                FindNextHistoricalBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload);
+            }
             for (const CBlockIndex *pindex : vToDownload) {
                 uint32_t nFetchFlags = GetFetchFlags(*pto);
                 vGetData.push_back(CInv(MSG_BLOCK | nFetchFlags, pindex->GetBlockHash()));
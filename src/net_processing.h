@@ -13,6 +13,10 @@ class AddrMan;
 class CChainParams;
 class CTxMemPool;
 class ChainstateManager;
+struct TxOrphanageStats;
+namespace node {
+struct BlockPipelineStats;
+} // namespace node
 
 /** Default for -maxorphantx, maximum number of orphan transactions kept in memory */
 static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 100;
@@ -57,6 +61,18 @@ public:
     /** Get statistics from node state */
     virtual bool GetNodeStateStats(NodeId nodeid, CNodeStateStats& stats) const = 0;
 
+    /** Get statistics from the block pipeline. Returns false if it is disabled. */
+    virtual bool GetBlockPipelineStats(node::BlockPipelineStats& stats) const = 0;
+
+    /**
+     * Stop the block pipeline threads, dropping blocks that were not connected yet.
+     * Must be called before the components used to connect blocks are stopped.
+     */
+    virtual void StopBlockPipeline() = 0;
+
+    /** Get statistics from the orphan pool */
+    virtual TxOrphanageStats GetOrphanStats() const = 0;
+
     /** Whether this node ignores txs received over p2p. */
     virtual bool IgnoresIncomingTxs() = 0;
 
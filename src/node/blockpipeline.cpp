@@ -0,0 +1,181 @@
+// Copyright (c) 2022 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <node/blockpipeline.h>
+
+#include <logging.h>
+#include <tinyformat.h>
+#include <util/threadnames.h>
+#include <util/time.h>
+#include <validation.h>
+
+#include <exception>
+#include <optional>
+
+namespace node {
+static std::chrono::microseconds Now()
+{
+    return std::chrono::microseconds{GetTimeMicros()};
+}
+
+BlockPipeline::BlockPipeline(const Consensus::Params& consensus, int worker_threads, ConnectFn connect)
+    : m_consensus{consensus}, m_connect{std::move(connect)}
+{
+    assert(worker_threads > 0);
+    WITH_LOCK(m_mutex, m_stats.workers = worker_threads);
+    for (int n = 0; n < worker_threads; ++n) {
+        m_worker_threads.emplace_back([this, n]() {
+            util::ThreadRename(strprintf("blkcheck.%i", n));
+            WorkerLoop();
+        });
+    }
+    m_connect_thread = std::thread([this]() {
+        util::ThreadRename("blkconnect");
+        ConnectLoop();
+    });
+}
+
+BlockPipeline::~BlockPipeline()
+{
+    Stop();
+}
+
+bool BlockPipeline::Submit(NodeId peer, CDataStream&& data)
+{
+    {
+        WAIT_LOCK(m_mutex, lock);
+        const auto wait_start{Now()};
+        // Apply back-pressure to the message handler instead of buffering
+        // an unbounded number of blocks.
+        m_submit_cv.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) {
+            return m_request_stop || m_next_seq - m_next_connect_seq < MAX_BLOCK_PIPELINE_DEPTH;
+        });
+        if (m_request_stop) return false;
+        m_stats.submit_wait_time += Now() - wait_start;
+        m_decode_queue.push_back(Job{m_next_seq++, peer, std::move(data)});
+        ++m_stats.submitted;
+    }
+    m_worker_cv.notify_one();
+    return true;
+}
+
+void BlockPipeline::WorkerLoop()
+{
+    while (true) {
+        std::optional<Job> job;
+        {
+            WAIT_LOCK(m_mutex, lock);
+            m_worker_cv.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) {
+                return m_request_stop || !m_decode_queue.empty();
+            });
+            if (m_request_stop) return;
+            job.emplace(std::move(m_decode_queue.front()));
+            m_decode_queue.pop_front();
+            ++m_in_progress;
+        }
+
+        Result result;
+        result.peer = job->peer;
+        bool decoded{false};
+        const auto decode_start{Now()};
+        try {
+            auto block{std::make_shared<CBlock>()};
+            job->data >> *block;
+            result.block = std::move(block);
+            decoded = true;
+        } catch (const std::exception& e) {
+            result.state.Error(strprintf("block deserialization failed: %s", e.what()));
+        }
+        const auto check_start{Now()};
+        bool checked{false};
+        if (decoded) {
+            // On success this sets CBlock::fChecked, so ProcessNewBlock() does
+            // not repeat the work under cs_main. The block is not shared with
+            // any other thread until it is handed to the connect stage below.
+            checked = CheckBlock(*result.block, result.state, m_consensus);
+        }
+        const auto check_end{Now()};
+
+        {
+            LOCK(m_mutex);
+            --m_in_progress;
+            m_stats.decode_time += check_start - decode_start;
+            m_stats.check_time += check_end - check_start;
+            if (!decoded) {
+                ++m_stats.decode_failures;
+            } else if (!checked) {
+                ++m_stats.check_failures;
+            }
+            m_checked.emplace(job->seq, Checked{std::move(result), check_end});
+        }
+        m_connect_cv.notify_one();
+    }
+}
+
+void BlockPipeline::ConnectLoop()
+{
+    while (true) {
+        std::optional<Checked> next;
+        {
+            WAIT_LOCK(m_mutex, lock);
+            m_connect_cv.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) {
+                return m_request_stop || (!m_checked.empty() && m_checked.begin()->first == m_next_connect_seq);
+            });
+            if (m_request_stop) return;
+            auto it{m_checked.begin()};
+            next.emplace(std::move(it->second));
+            m_checked.erase(it);
+            m_connecting = true;
+        }
+
+        const auto connect_start{Now()};
+        try {
+            m_connect(std::move(next->result));
+        } catch (const std::exception& e) {
+            LogPrintf("%s: unexpected exception: %s\n", __func__, e.what());
+        }
+        const auto connect_end{Now()};
+
+        {
+            LOCK(m_mutex);
+            m_connecting = false;
+            ++m_next_connect_seq;
+            ++m_stats.completed;
+            m_stats.connect_wait_time += connect_start - next->ready_time;
+            m_stats.connect_time += connect_end - connect_start;
+        }
+        m_submit_cv.notify_all();
+    }
+}
+
+void BlockPipeline::Stop()
+{
+    WITH_LOCK(m_mutex, m_request_stop = true);
+    m_worker_cv.notify_all();
+    m_connect_cv.notify_all();
+    m_submit_cv.notify_all();
+    for (std::thread& t : m_worker_threads) {
+        t.join();
+    }
+    m_worker_threads.clear();
+    if (m_connect_thread.joinable()) m_connect_thread.join();
+}
+
+BlockPipelineStats BlockPipeline::GetStats() const
+{
+    LOCK(m_mutex);
+    BlockPipelineStats stats{m_stats};
+    stats.decode_queue = m_decode_queue.size();
+    stats.in_progress = m_in_progress;
+    // Blocks form the connect queue only once all earlier submissions are checked.
+    uint64_t seq{m_next_connect_seq + (m_connecting ? 1 : 0)};
+    for (const auto& [checked_seq, checked] : m_checked) {
+        if (checked_seq != seq) break;
+        ++stats.connect_queue;
+        ++seq;
+    }
+    stats.reorder_queue = m_checked.size() - stats.connect_queue;
+    return stats;
+}
+} // namespace node
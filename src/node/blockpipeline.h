@@ -0,0 +1,137 @@
+// Copyright (c) 2022 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_NODE_BLOCKPIPELINE_H
+#define BITCOIN_NODE_BLOCKPIPELINE_H
+
+#include <consensus/validation.h>
+#include <net.h>
+#include <primitives/block.h>
+#include <streams.h>
+#include <sync.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace Consensus {
+struct Params;
+} // namespace Consensus
+
+namespace node {
+/** Default for -blockpipelinethreads, 0 processes blocks on the message handler thread */
+static constexpr int DEFAULT_BLOCK_PIPELINE_THREADS{0};
+/** Maximum number of -blockpipelinethreads */
+static constexpr int MAX_BLOCK_PIPELINE_THREADS{16};
+/** Maximum number of blocks inside the pipeline before Submit() waits for room */
+static constexpr size_t MAX_BLOCK_PIPELINE_DEPTH{128};
+
+/** A snapshot of the pipeline's queue depths and cumulative stage timings. */
+struct BlockPipelineStats {
+    int workers{0};
+    //! Blocks waiting to be decoded and checked
+    size_t decode_queue{0};
+    //! Blocks currently being decoded or checked by a worker
+    size_t in_progress{0};
+    //! Checked blocks waiting for an earlier block before they can be connected
+    size_t reorder_queue{0};
+    //! Checked blocks ready to be handed to the connect stage
+    size_t connect_queue{0};
+    uint64_t submitted{0};
+    uint64_t completed{0};
+    uint64_t decode_failures{0};
+    uint64_t check_failures{0};
+    std::chrono::microseconds decode_time{0};
+    std::chrono::microseconds check_time{0};
+    std::chrono::microseconds connect_time{0};
+    //! Time spent by checked blocks waiting for the connect stage
+    std::chrono::microseconds connect_wait_time{0};
+    //! Time the submitting thread spent blocked on a full pipeline
+    std::chrono::microseconds submit_wait_time{0};
+};
+
+/**
+ * Staged pipeline for blocks received from the network.
+ *
+ * Raw `block` message payloads are deserialized and run through the
+ * context-free CheckBlock() (including the merkle root) by a pool of worker
+ * threads. Checked blocks are then handed, in submission order, to a single
+ * connect thread that invokes the ConnectFn (normally ProcessNewBlock, i.e.
+ * AcceptBlock and ActivateBestChain). Because CheckBlock() caches its result
+ * in CBlock::fChecked, the check is not repeated under cs_main, and
+ * decoding/checking later blocks overlaps with connecting the tip.
+ */
+class BlockPipeline
+{
+public:
+    struct Result {
+        NodeId peer{-1};
+        //! The decoded block, nullptr if deserialization failed
+        std::shared_ptr<const CBlock> block;
+        //! Outcome of the context-free checks, or the deserialization error
+        BlockValidationState state;
+    };
+    using ConnectFn = std::function<void(Result&&)>;
+
+    BlockPipeline(const Consensus::Params& consensus, int worker_threads, ConnectFn connect);
+    ~BlockPipeline();
+
+    /**
+     * Queue a serialized block for processing. Waits while the pipeline is full.
+     * @returns false if the pipeline was stopped and the block was dropped
+     */
+    bool Submit(NodeId peer, CDataStream&& data) LOCKS_EXCLUDED(m_mutex);
+
+    /** Stop all threads. Queued blocks that have not been connected yet are dropped. */
+    void Stop() LOCKS_EXCLUDED(m_mutex);
+
+    BlockPipelineStats GetStats() const LOCKS_EXCLUDED(m_mutex);
+
+private:
+    struct Job {
+        uint64_t seq;
+        NodeId peer;
+        CDataStream data;
+    };
+    struct Checked {
+        Result result;
+        std::chrono::microseconds ready_time;
+    };
+
+    void WorkerLoop() LOCKS_EXCLUDED(m_mutex);
+    void ConnectLoop() LOCKS_EXCLUDED(m_mutex);
+
+    const Consensus::Params& m_consensus;
+    const ConnectFn m_connect;
+
+    mutable Mutex m_mutex;
+    //! Workers wait on this for decode jobs
+    std::condition_variable m_worker_cv;
+    //! The connect thread waits on this for the next block in sequence
+    std::condition_variable m_connect_cv;
+    //! Submit() waits on this when the pipeline is full
+    std::condition_variable m_submit_cv;
+
+    std::deque<Job> m_decode_queue GUARDED_BY(m_mutex);
+    //! Checked blocks keyed by submission sequence number
+    std::map<uint64_t, Checked> m_checked GUARDED_BY(m_mutex);
+    uint64_t m_next_seq GUARDED_BY(m_mutex){0};
+    uint64_t m_next_connect_seq GUARDED_BY(m_mutex){0};
+    size_t m_in_progress GUARDED_BY(m_mutex){0};
+    bool m_connecting GUARDED_BY(m_mutex){false};
+    bool m_request_stop GUARDED_BY(m_mutex){false};
+    BlockPipelineStats m_stats GUARDED_BY(m_mutex);
+
+    std::vector<std::thread> m_worker_threads;
+    std::thread m_connect_thread;
+};
+} // namespace node
+
+#endif // BITCOIN_NODE_BLOCKPIPELINE_H
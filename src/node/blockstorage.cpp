@@ -39,12 +39,11 @@ CBlockIndex* BlockManager::LookupBlockIndex(const uint256& hash) const
     return it == m_block_index.end() ? nullptr : it->second;
 }
 
-CBlockIndex* BlockManager::AddToBlockIndex(const CBlockHeader& block)
+CBlockIndex* BlockManager::AddToBlockIndex(const CBlockHeader& block, const uint256& hash)
 {
     AssertLockHeld(cs_main);
 
     // Check for duplicate
-    uint256 hash = block.GetHash();
     BlockMap::iterator it = m_block_index.find(hash);
     if (it != m_block_index.end()) {
         return it->second;
@@ -320,6 +319,20 @@ bool BlockManager::LoadBlockIndex(
             pindexBestHeader = pindex;
     }
 
+    // The background chainstate still has to connect the blocks beneath the
+    // snapshot base that were downloaded, but not validated yet.
+    const std::optional<uint256> snapshot_blockhash{chainman.SnapshotBlockhash()};
+    if (CBlockIndex* snapshot_base{snapshot_blockhash ? LookupBlockIndex(*snapshot_blockhash) : nullptr}) {
+        for (CChainState* chainstate : chainman.GetAll()) {
+            if (chainstate->reliesOnAssumedValid()) continue;
+            for (CBlockIndex* pindex = snapshot_base; pindex && pindex->nHeight >= first_assumed_valid_height; pindex = pindex->pprev) {
+                if (pindex->IsValid(BLOCK_VALID_TRANSACTIONS) && pindex->HaveTxsDownloaded()) {
+                    chainstate->setBlockIndexCandidates.insert(pindex);
+                }
+            }
+        }
+    }
+
     return true;
 }
 
@@ -786,7 +799,7 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus
     return true;
 }
 
-bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const FlatFilePos& pos, const CMessageHeader::MessageStartChars& message_start)
+bool BlockManager::ReadRawBlock(std::vector<uint8_t>& block, const FlatFilePos& pos, const CMessageHeader::MessageStartChars& message_start) const
 {
     FlatFilePos hpos = pos;
     hpos.nPos -= 8; // Seek back 8 bytes for meta header
@@ -907,13 +920,10 @@ void ThreadImport(ChainstateManager& chainman, std::vector<fs::path> vImportFile
         }
 
         // scan for better chains in the block chain database, that are not yet connected in the active best chain
-
-        // We can't hold cs_main during ActivateBestChain even though we're accessing
-        // the chainman unique_ptrs since ABC requires us not to be holding cs_main, so retrieve
-        // the relevant pointers before the ABC call.
-        for (CChainState* chainstate : WITH_LOCK(::cs_main, return chainman.GetAll())) {
+        // (a background validation chainstate is advanced by its own thread)
+        {
             BlockValidationState state;
-            if (!chainstate->ActivateBestChain(state, nullptr)) {
+            if (!chainman.ActiveChainstate().ActivateBestChain(state, nullptr)) {
                 LogPrintf("Failed to connect best block (%s)\n", state.ToString());
                 StartShutdown();
                 return;
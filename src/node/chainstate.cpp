@@ -5,10 +5,67 @@
 #include <node/chainstate.h>
 
 #include <consensus/params.h>
+#include <fs.h>
+#include <logging.h>
 #include <node/blockstorage.h>
+#include <uint256.h>
+#include <util/strencodings.h>
+#include <util/system.h>
 #include <validation.h>
 
 namespace node {
+static const std::string SNAPSHOT_CHAINSTATE_PREFIX{"chainstate_"};
+
+static fs::path SnapshotChainstateDir(const uint256& base_blockhash)
+{
+    return gArgs.GetDataDirNet() / fs::PathFromString(SNAPSHOT_CHAINSTATE_PREFIX + base_blockhash.ToString());
+}
+
+//! Find the coins database of a snapshot activated in an earlier run, named
+//! after the snapshot base block.
+static std::optional<uint256> FindSnapshotChainstate()
+{
+    for (fs::directory_iterator it(gArgs.GetDataDirNet()); it != fs::directory_iterator(); it++) {
+        const std::string name{fs::PathToString(it->path().filename())};
+        const std::string hex{name.substr(std::min(name.size(), SNAPSHOT_CHAINSTATE_PREFIX.size()))};
+        if (fs::is_directory(*it) && name.rfind(SNAPSHOT_CHAINSTATE_PREFIX, 0) == 0 && hex.size() == 64 && IsHex(hex)) {
+            return uint256S(hex);
+        }
+    }
+    return std::nullopt;
+}
+
+//! Close the chainstates, and either let the coins database of the validated
+//! snapshot replace the one of the IBD chainstate, or set the invalid snapshot
+//! aside so the IBD chainstate takes over again.
+static bool RetireSnapshotChainstate(ChainstateManager& chainman, bool validated) EXCLUSIVE_LOCKS_REQUIRED(::cs_main)
+{
+    const uint256 base_blockhash{*chainman.SnapshotBlockhash()};
+    for (CChainState* chainstate : chainman.GetAll()) {
+        chainstate->ForceFlushStateToDisk();
+    }
+    chainman.Reset();
+
+    const fs::path ibd_dir{gArgs.GetDataDirNet() / "chainstate"};
+    const fs::path snapshot_dir{SnapshotChainstateDir(base_blockhash)};
+    const fs::path invalid_dir{snapshot_dir + "_INVALID"};
+    try {
+        if (validated) {
+            LogPrintf("[snapshot] replacing the IBD chainstate with the validated snapshot chainstate\n");
+            fs::remove_all(ibd_dir);
+            fs::rename(snapshot_dir, ibd_dir);
+        } else {
+            LogPrintf("[snapshot] moving the invalid snapshot chainstate to %s\n", fs::PathToString(invalid_dir));
+            fs::remove_all(invalid_dir);
+            fs::rename(snapshot_dir, invalid_dir);
+        }
+    } catch (const fs::filesystem_error& e) {
+        LogPrintf("[snapshot] failed to retire the snapshot chainstate: %s\n", fsbridge::get_filesystem_error_message(e));
+        return false;
+    }
+    return true;
+}
+
 std::optional<ChainstateLoadingError> LoadChainstate(bool fReset,
                                                      ChainstateManager& chainman,
                                                      CTxMemPool* mempool,
@@ -34,6 +91,18 @@ std::optional<ChainstateLoadingError> LoadChainstate(bool fReset,
 
     UnloadBlockIndex(mempool, chainman);
 
+    // Continue to use a snapshot activated in an earlier run.
+    if (const std::optional<uint256> snapshot_blockhash{FindSnapshotChainstate()}) {
+        if (fReset) {
+            LogPrintf("[snapshot] discarding the snapshot chainstate when reindexing\n");
+            fs::remove_all(SnapshotChainstateDir(*snapshot_blockhash));
+        } else if (fReindexChainState) {
+            return ChainstateLoadingError::ERROR_SNAPSHOT_REINDEX_CHAINSTATE;
+        } else {
+            chainman.ActivateExistingSnapshot(mempool, *snapshot_blockhash);
+        }
+    }
+
     auto& pblocktree{chainman.m_blockman.m_block_tree_db};
     // new CBlockTreeDB tries to delete the existing file, which
     // fails if it's still open from the previous loop. Close it first:
@@ -122,6 +191,23 @@ std::optional<ChainstateLoadingError> LoadChainstate(bool fReset,
         }
     }
 
+    if (chainman.IsSnapshotActive()) {
+        // Retire the snapshot if background validation reached its base block
+        // before the last shutdown, and start over with a single chainstate.
+        // If its UTXO set cannot be hashed, keep the snapshot and let the
+        // background validation try again.
+        const SnapshotCompletionResult result{chainman.MaybeCompleteSnapshotValidation()};
+        if (result == SnapshotCompletionResult::SUCCESS || result == SnapshotCompletionResult::HASH_MISMATCH) {
+            if (!RetireSnapshotChainstate(chainman, result == SnapshotCompletionResult::SUCCESS)) {
+                return ChainstateLoadingError::ERROR_SNAPSHOT_RETIREMENT_FAILED;
+            }
+            return LoadChainstate(fReset, chainman, mempool, fPruneMode, consensus_params, fReindexChainState,
+                                  nBlockTreeDBCache, nCoinDBCache, nCoinCacheUsage, block_tree_db_in_memory,
+                                  coins_db_in_memory, shutdown_requested, coins_error_cb);
+        }
+        chainman.MaybeRebalanceCaches();
+    }
+
     return std::nullopt;
 }
 
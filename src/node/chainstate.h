@@ -26,6 +26,8 @@ enum class ChainstateLoadingError {
     ERROR_LOADCHAINTIP_FAILED,
     ERROR_GENERIC_BLOCKDB_OPEN_FAILED,
     ERROR_BLOCKS_WITNESS_INSUFFICIENTLY_VALIDATED,
+    ERROR_SNAPSHOT_REINDEX_CHAINSTATE,
+    ERROR_SNAPSHOT_RETIREMENT_FAILED,
     SHUTDOWN_PROBED,
 };
 
@@ -0,0 +1,229 @@
+// Copyright (c) 2022 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <node/coinsprefetch.h>
+
+#include <chain.h>
+#include <logging.h>
+#include <node/blockstorage.h>
+#include <tinyformat.h>
+#include <txdb.h>
+#include <util/hasher.h>
+#include <util/threadnames.h>
+#include <util/time.h>
+
+#include <algorithm>
+#include <exception>
+#include <unordered_set>
+
+namespace node {
+/** Number of outpoints looked up per task */
+static constexpr size_t PREFETCH_BATCH_SIZE{64};
+
+CoinsPrefetcher::CoinsPrefetcher(const Consensus::Params& consensus, int worker_threads)
+    : m_consensus{consensus}
+{
+    assert(worker_threads > 0);
+    for (int n = 0; n < worker_threads; ++n) {
+        m_worker_threads.emplace_back([this, n]() {
+            util::ThreadRename(strprintf("prefetch.%i", n));
+            WorkerLoop();
+        });
+    }
+}
+
+CoinsPrefetcher::~CoinsPrefetcher()
+{
+    WITH_LOCK(m_mutex, m_request_stop = true);
+    m_worker_cv.notify_all();
+    m_done_cv.notify_all();
+    for (std::thread& t : m_worker_threads) {
+        t.join();
+    }
+}
+
+void CoinsPrefetcher::Prefetch(const uint256& hash, const FlatFilePos& pos, const CCoinsViewDB& db)
+{
+    auto job{std::make_shared<Job>()};
+    job->hash = hash;
+    job->pos = pos;
+    job->db = &db;
+    job->generation = db.GetWriteGeneration();
+    {
+        LOCK(m_mutex);
+        Enqueue(std::move(job));
+    }
+    m_worker_cv.notify_one();
+}
+
+void CoinsPrefetcher::Prefetch(const std::shared_ptr<const CBlock>& block, const CCoinsViewDB& db)
+{
+    auto job{std::make_shared<Job>()};
+    job->hash = block->GetHash();
+    job->db = &db;
+    job->generation = db.GetWriteGeneration();
+    job->block = block;
+    {
+        LOCK(m_mutex);
+        Enqueue(std::move(job));
+    }
+    m_worker_cv.notify_one();
+}
+
+void CoinsPrefetcher::Enqueue(JobRef job)
+{
+    AssertLockHeld(m_mutex);
+    for (const JobRef& existing : m_jobs) {
+        if (existing->hash == job->hash && existing->db == job->db) return;
+    }
+    // Prefetches for blocks that never get connected (e.g. after a reorg or
+    // an invalid block) are forgotten once enough newer ones were started.
+    if (m_jobs.size() > COINS_PREFETCH_LOOKAHEAD) m_jobs.pop_front();
+    m_tasks.push_back(Task{job, 0, 0, /*load=*/true});
+    m_jobs.push_back(std::move(job));
+}
+
+void CoinsPrefetcher::RunLoad(Job& job)
+{
+    try {
+        if (!job.block) {
+            auto block{std::make_shared<CBlock>()};
+            if (!ReadBlockFromDisk(*block, job.pos, m_consensus) || block->GetHash() != job.hash) {
+                job.failed = true;
+                return;
+            }
+            job.block = std::move(block);
+            job.read_from_disk = true;
+        }
+    } catch (const std::exception& e) {
+        LogPrint(BCLog::BENCH, "%s: failed to read block %s: %s\n", __func__, job.hash.ToString(), e.what());
+        job.failed = true;
+        return;
+    }
+
+    // Outputs created within the block are not in the database yet.
+    std::unordered_set<uint256, SaltedTxidHasher> block_txids;
+    for (const auto& tx : job.block->vtx) {
+        block_txids.insert(tx->GetHash());
+    }
+    for (const auto& tx : job.block->vtx) {
+        if (tx->IsCoinBase()) continue;
+        for (const CTxIn& txin : tx->vin) {
+            if (block_txids.count(txin.prevout.hash)) continue;
+            job.outpoints.push_back(txin.prevout);
+        }
+    }
+}
+
+void CoinsPrefetcher::FinishTask(Job& job)
+{
+    AssertLockHeld(m_mutex);
+    assert(job.tasks_pending > 0);
+    if (--job.tasks_pending == 0) {
+        job.done = true;
+        m_done_cv.notify_all();
+    }
+}
+
+void CoinsPrefetcher::WorkerLoop()
+{
+    std::vector<std::pair<COutPoint, Coin>> found;
+    while (true) {
+        Task task;
+        {
+            WAIT_LOCK(m_mutex, lock);
+            m_worker_cv.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return m_request_stop || !m_tasks.empty(); });
+            if (m_request_stop) return;
+            task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+            ++m_busy_workers;
+            // The load task accounts for itself until it is split into lookups.
+            if (task.load) task.job->tasks_pending = 1;
+        }
+        Job& job{*task.job};
+
+        bool new_tasks{false};
+        if (task.load) {
+            RunLoad(job);
+            LOCK(m_mutex);
+            if (!job.failed) {
+                for (size_t begin = 0; begin < job.outpoints.size(); begin += PREFETCH_BATCH_SIZE) {
+                    m_tasks.push_back(Task{task.job, begin, std::min(begin + PREFETCH_BATCH_SIZE, job.outpoints.size()), /*load=*/false});
+                    ++job.tasks_pending;
+                    new_tasks = true;
+                }
+            }
+            FinishTask(job);
+        } else {
+            found.clear();
+            try {
+                for (size_t i = task.begin; i < task.end; ++i) {
+                    Coin coin;
+                    if (job.db->GetCoin(job.outpoints[i], coin)) {
+                        found.emplace_back(job.outpoints[i], std::move(coin));
+                    }
+                }
+            } catch (const std::exception& e) {
+                // Leave read errors to be reported by the regular (non-prefetching) code path.
+                LogPrint(BCLog::BENCH, "%s: coins database read failed: %s\n", __func__, e.what());
+                found.clear();
+            }
+            LOCK(m_mutex);
+            std::move(found.begin(), found.end(), std::back_inserter(job.coins));
+            FinishTask(job);
+        }
+
+        {
+            LOCK(m_mutex);
+            --m_busy_workers;
+        }
+        if (new_tasks) m_worker_cv.notify_all();
+        m_done_cv.notify_all();
+    }
+}
+
+std::shared_ptr<const CBlock> CoinsPrefetcher::Merge(const uint256& hash, const CCoinsViewDB& db, CCoinsViewCache& cache)
+{
+    JobRef job;
+    {
+        WAIT_LOCK(m_mutex, lock);
+        auto it{std::find_if(m_jobs.begin(), m_jobs.end(), [&](const JobRef& j) { return j->hash == hash && j->db == &db; })};
+        if (it == m_jobs.end()) return nullptr;
+        job = *it;
+        m_jobs.erase(it);
+        const auto wait_start{GetTimeMicros()};
+        m_done_cv.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return m_request_stop || job->done; });
+        m_stats.wait_time += std::chrono::microseconds{GetTimeMicros() - wait_start};
+        if (!job->done || job->failed) return nullptr;
+        if (job->generation != db.GetWriteGeneration()) {
+            ++m_stats.stale;
+            return job->block;
+        }
+        ++m_stats.blocks;
+        m_stats.lookups += job->outpoints.size();
+        m_stats.hits += job->coins.size();
+        m_stats.misses += job->outpoints.size() - job->coins.size();
+    }
+
+    for (auto& [outpoint, coin] : job->coins) {
+        cache.EmplaceFetchedCoin(outpoint, std::move(coin));
+    }
+    return job->block;
+}
+
+void CoinsPrefetcher::Clear()
+{
+    WAIT_LOCK(m_mutex, lock);
+    m_tasks.clear();
+    m_jobs.clear();
+    m_done_cv.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return m_request_stop || m_busy_workers == 0; });
+    // Lookups queued by a load that was still running above.
+    m_tasks.clear();
+}
+
+CoinsPrefetchStats CoinsPrefetcher::GetStats() const
+{
+    return WITH_LOCK(m_mutex, return m_stats);
+}
+} // namespace node
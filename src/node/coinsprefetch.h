@@ -0,0 +1,141 @@
+// Copyright (c) 2022 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_NODE_COINSPREFETCH_H
+#define BITCOIN_NODE_COINSPREFETCH_H
+
+#include <coins.h>
+#include <flatfile.h>
+#include <primitives/block.h>
+#include <primitives/transaction.h>
+#include <sync.h>
+#include <uint256.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <memory>
+#include <thread>
+#include <vector>
+
+class CCoinsViewDB;
+namespace Consensus {
+struct Params;
+} // namespace Consensus
+
+namespace node {
+/** Default for -prefetchthreads, the number of threads warming the coins cache for upcoming blocks */
+static constexpr int DEFAULT_COINS_PREFETCH_THREADS{2};
+/** Maximum number of -prefetchthreads */
+static constexpr int MAX_COINS_PREFETCH_THREADS{16};
+/** Number of blocks ahead of the one being connected whose coins are prefetched */
+static constexpr int COINS_PREFETCH_LOOKAHEAD{4};
+
+/** Counters describing how well the prefetcher served ConnectBlock. */
+struct CoinsPrefetchStats {
+    //! Blocks whose inputs were prefetched and merged
+    uint64_t blocks{0};
+    //! Inputs looked up in the coins database
+    uint64_t lookups{0};
+    //! Inputs whose coin was found and handed to the coins cache
+    uint64_t hits{0};
+    //! Inputs that were not found, e.g. because they are created by a block that is not connected yet
+    uint64_t misses{0};
+    //! Prefetches discarded because the coins database was written to in the meantime
+    uint64_t stale{0};
+    //! Time ConnectTip spent waiting for unfinished prefetches
+    std::chrono::microseconds wait_time{0};
+
+    double HitRate() const { return lookups ? double(hits) / lookups : 0.0; }
+};
+
+/**
+ * Warms the coins cache for blocks that are queued for connection.
+ *
+ * For each prefetched block, the block is read from disk and the outpoints
+ * it spends (other than those created within the block) are looked up in the
+ * coins database in parallel by a pool of worker threads. The found coins are
+ * kept in a side buffer until Merge() moves them into the chainstate's coins
+ * cache under cs_main, right before the block is connected, so ConnectBlock()
+ * does not have to hit LevelDB for them.
+ *
+ * Reads bypass the coins cache, so a result is only valid if the database was
+ * not written to between Prefetch() and Merge(): callers pass the database's
+ * write generation at both points and stale results are discarded. Coins that
+ * the cache already holds (possibly spent) are never overwritten.
+ */
+class CoinsPrefetcher
+{
+public:
+    explicit CoinsPrefetcher(const Consensus::Params& consensus, int worker_threads);
+    ~CoinsPrefetcher();
+
+    /** Start prefetching the block stored at pos. No-op if it is already being prefetched. */
+    void Prefetch(const uint256& hash, const FlatFilePos& pos, const CCoinsViewDB& db) LOCKS_EXCLUDED(m_mutex);
+    /** Start prefetching an in-memory block. No-op if it is already being prefetched. */
+    void Prefetch(const std::shared_ptr<const CBlock>& block, const CCoinsViewDB& db) LOCKS_EXCLUDED(m_mutex);
+
+    /**
+     * Wait for the prefetch of the given block to finish and add the found
+     * coins to cache, unless db was written to after the prefetch started.
+     *
+     * @returns the block, if it was read from disk by the prefetcher, so the
+     *          caller does not have to read it again.
+     */
+    std::shared_ptr<const CBlock> Merge(const uint256& hash, const CCoinsViewDB& db, CCoinsViewCache& cache) LOCKS_EXCLUDED(m_mutex);
+
+    /** Drop all pending prefetches and wait for the workers to become idle. */
+    void Clear() LOCKS_EXCLUDED(m_mutex);
+
+    CoinsPrefetchStats GetStats() const LOCKS_EXCLUDED(m_mutex);
+
+private:
+    struct Job {
+        uint256 hash;
+        FlatFilePos pos;
+        const CCoinsViewDB* db;
+        uint64_t generation;
+        std::shared_ptr<const CBlock> block;
+        //! Block read from disk by the prefetcher, returned by Merge()
+        bool read_from_disk{false};
+        std::vector<COutPoint> outpoints;
+        std::vector<std::pair<COutPoint, Coin>> coins;
+        size_t tasks_pending{0};
+        bool failed{false};
+        bool done{false};
+    };
+    using JobRef = std::shared_ptr<Job>;
+    /** A unit of work: load (and index) a block, or look up outpoints [begin, end) */
+    struct Task {
+        JobRef job;
+        size_t begin;
+        size_t end;
+        bool load;
+    };
+
+    void Enqueue(JobRef job) EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+    void WorkerLoop() LOCKS_EXCLUDED(m_mutex);
+    void RunLoad(Job& job) LOCKS_EXCLUDED(m_mutex);
+    void FinishTask(Job& job) EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+
+    const Consensus::Params& m_consensus;
+
+    mutable Mutex m_mutex;
+    std::condition_variable m_worker_cv;
+    //! Signalled when a job completes or a worker becomes idle
+    std::condition_variable m_done_cv;
+    std::deque<Task> m_tasks GUARDED_BY(m_mutex);
+    //! Prefetches in the order they were started, at most COINS_PREFETCH_LOOKAHEAD + 1
+    std::list<JobRef> m_jobs GUARDED_BY(m_mutex);
+    int m_busy_workers GUARDED_BY(m_mutex){0};
+    bool m_request_stop GUARDED_BY(m_mutex){false};
+    CoinsPrefetchStats m_stats GUARDED_BY(m_mutex);
+
+    std::vector<std::thread> m_worker_threads;
+};
+} // namespace node
+
+#endif // BITCOIN_NODE_COINSPREFETCH_H
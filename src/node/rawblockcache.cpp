@@ -0,0 +1,47 @@
+// Copyright (c) 2022 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <node/rawblockcache.h>
+
+namespace node {
+std::shared_ptr<const CSharedNetMsg> RawBlockCache::Get(const uint256& hash)
+{
+    LOCK(m_mutex);
+    const auto it{m_index.find(hash)};
+    if (it == m_index.end()) return nullptr;
+    m_entries.splice(m_entries.begin(), m_entries, it->second);
+    return it->second->second;
+}
+
+std::shared_ptr<const CSharedNetMsg> RawBlockCache::Insert(const uint256& hash, std::shared_ptr<const CSharedNetMsg> msg)
+{
+    LOCK(m_mutex);
+    const auto [index_it, inserted]{m_index.try_emplace(hash)};
+    if (!inserted) {
+        m_entries.splice(m_entries.begin(), m_entries, index_it->second);
+        return index_it->second->second;
+    }
+    m_payload_size += msg->data->size();
+    m_entries.emplace_front(hash, std::move(msg));
+    index_it->second = m_entries.begin();
+    while (m_payload_size > m_max_size && m_entries.size() > 1) {
+        m_payload_size -= m_entries.back().second->data->size();
+        m_index.erase(m_entries.back().first);
+        m_entries.pop_back();
+    }
+    return m_entries.front().second;
+}
+
+size_t RawBlockCache::Count() const
+{
+    LOCK(m_mutex);
+    return m_entries.size();
+}
+
+size_t RawBlockCache::PayloadSize() const
+{
+    LOCK(m_mutex);
+    return m_payload_size;
+}
+} // namespace node
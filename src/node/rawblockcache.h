@@ -0,0 +1,64 @@
+// Copyright (c) 2022 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_NODE_RAWBLOCKCACHE_H
+#define BITCOIN_NODE_RAWBLOCKCACHE_H
+
+#include <net.h>
+#include <sync.h>
+#include <uint256.h>
+#include <util/hasher.h>
+
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+
+namespace node {
+/**
+ * Recently served block messages by block hash, for other peers syncing the
+ * same blocks. The least recently used messages are evicted once the total
+ * payload size exceeds the limit, but the most recent one is always kept.
+ * Thread-safe.
+ */
+class RawBlockCache
+{
+public:
+    explicit RawBlockCache(size_t max_size) : m_max_size{max_size} {}
+
+    /**
+     * Get the message of a block and mark it as the most recently used.
+     * @returns nullptr if the block is not cached
+     */
+    std::shared_ptr<const CSharedNetMsg> Get(const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(!m_mutex);
+
+    /**
+     * Cache the message of a block as the most recently used, unless the
+     * block is cached already.
+     * @returns the cached message, which is the one cached before if
+     *          another thread inserted the same block first
+     */
+    std::shared_ptr<const CSharedNetMsg> Insert(const uint256& hash, std::shared_ptr<const CSharedNetMsg> msg) EXCLUSIVE_LOCKS_REQUIRED(!m_mutex);
+
+    /** Number of cached messages */
+    size_t Count() const EXCLUSIVE_LOCKS_REQUIRED(!m_mutex);
+
+    /** Total payload size of the cached messages */
+    size_t PayloadSize() const EXCLUSIVE_LOCKS_REQUIRED(!m_mutex);
+
+private:
+    using Entry = std::pair<uint256, std::shared_ptr<const CSharedNetMsg>>;
+
+    const size_t m_max_size;
+    mutable Mutex m_mutex;
+    /** The cached messages, most recently used first */
+    std::list<Entry> m_entries GUARDED_BY(m_mutex);
+    /** Index of m_entries by block hash */
+    std::unordered_map<uint256, std::list<Entry>::iterator, BlockHasher> m_index GUARDED_BY(m_mutex);
+    size_t m_payload_size GUARDED_BY(m_mutex){0};
+};
+} // namespace node
+
+#endif // BITCOIN_NODE_RAWBLOCKCACHE_H
@@ -0,0 +1 @@
+#define BUILD_GIT_COMMIT "421462d1eee6"
@@ -5,8 +5,10 @@
 
 #include <policy/fees.h>
 
+#include <chainparams.h>
 #include <clientversion.h>
 #include <fs.h>
+#include <hash.h>
 #include <logging.h>
 #include <streams.h>
 #include <txmempool.h>
@@ -14,6 +16,11 @@
 #include <util/system.h>
 
 static const char* FEE_ESTIMATES_FILENAME = "fee_estimates.dat";
+static const char* FEE_ESTIMATES_JOURNAL_FILENAME = "fee_estimates.journal";
+
+/** Version required to read fee_estimates.dat, independent of the client version */
+static constexpr int CURRENT_FEES_FILE_VERSION{149900};
+static constexpr int CURRENT_FEES_JOURNAL_VERSION{1};
 
 static constexpr double INF_FEERATE = 1e99;
 
@@ -44,6 +51,18 @@ struct EncodedDoubleFormatter
     }
 };
 
+/** What a block changed in the tracked data, as appended to the journal */
+struct FeeJournalRecord
+{
+    unsigned int height;
+    //! Transactions dropped without confirming since the previous block: blocks waited and bucket index
+    std::vector<std::pair<uint32_t, uint32_t>> failures;
+    //! Transactions confirmed in the block: blocks to confirm and feerate per kvB
+    std::vector<std::pair<uint32_t, int64_t>> confirmations;
+
+    SERIALIZE_METHODS(FeeJournalRecord, obj) { READWRITE(obj.height, obj.failures, obj.confirmations); }
+};
+
 } // namespace
 
 /**
@@ -93,8 +112,17 @@ private:
     // transactions still unconfirmed after GetMaxConfirms for each bucket
     std::vector<int> oldUnconfTxs;
 
+    // For each bucket X, the number of transactions in the mempool that are
+    // unconfirmed for Y or more blocks, summed up from unconfTxs and
+    // oldUnconfTxs when first needed after they changed
+    mutable std::vector<std::vector<int>> m_unconf_since; // m_unconf_since[Y][X]
+    mutable unsigned int m_unconf_since_height{0};
+
     void resizeInMemoryCounters(size_t newbuckets);
 
+    /** Return the numbers of transactions unconfirmed for at least Y blocks at nBlockHeight, per bucket */
+    const std::vector<int>& UnconfirmedSince(unsigned int confTarget, unsigned int nBlockHeight) const;
+
 public:
     /**
      * Create new TxConfirmStats. This is called by BlockPolicyEstimator's
@@ -124,6 +152,9 @@ public:
     void removeTx(unsigned int entryHeight, unsigned int nBestSeenHeight,
                   unsigned int bucketIndex, bool inBlock);
 
+    /** Record a transaction that left the mempool after waiting blocksAgo blocks without confirming */
+    void RecordFailure(unsigned int blocksAgo, unsigned int bucketIndex);
+
     /** Update our estimates by decaying our historical moving average and updating
         with the data gathered from the current block */
     void UpdateMovingAverages();
@@ -181,6 +212,22 @@ void TxConfirmStats::resizeInMemoryCounters(size_t newbuckets) {
         unconfTxs[i].resize(newbuckets);
     }
     oldUnconfTxs.resize(newbuckets);
+    m_unconf_since.clear();
+}
+
+const std::vector<int>& TxConfirmStats::UnconfirmedSince(unsigned int confTarget, unsigned int nBlockHeight) const
+{
+    const unsigned int bins = unconfTxs.size();
+    if (m_unconf_since.empty() || m_unconf_since_height != nBlockHeight) {
+        m_unconf_since.assign(bins + 1, oldUnconfTxs);
+        for (unsigned int confct = bins; confct-- > 0;) {
+            for (unsigned int bucket = 0; bucket < oldUnconfTxs.size(); ++bucket) {
+                m_unconf_since[confct][bucket] = m_unconf_since[confct + 1][bucket] + unconfTxs[(nBlockHeight - confct) % bins][bucket];
+            }
+        }
+        m_unconf_since_height = nBlockHeight;
+    }
+    return m_unconf_since[std::min(confTarget, bins)];
 }
 
 // Roll the unconfirmed txs circular buffer
@@ -190,6 +237,7 @@ void TxConfirmStats::ClearCurrent(unsigned int nBlockHeight)
         oldUnconfTxs[j] += unconfTxs[nBlockHeight % unconfTxs.size()][j];
         unconfTxs[nBlockHeight%unconfTxs.size()][j] = 0;
     }
+    m_unconf_since.clear();
 }
 
 
@@ -244,7 +292,7 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
     unsigned int bestFarBucket = maxbucketindex;
 
     bool foundAnswer = false;
-    unsigned int bins = unconfTxs.size();
+    const std::vector<int>& unconf_since = UnconfirmedSince(confTarget, nBlockHeight);
     bool newBucketRange = true;
     bool passing = true;
     EstimatorBucket passBucket;
@@ -260,9 +308,7 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
         nConf += confAvg[periodTarget - 1][bucket];
         totalNum += txCtAvg[bucket];
         failNum += failAvg[periodTarget - 1][bucket];
-        for (unsigned int confct = confTarget; confct < GetMaxConfirms(); confct++)
-            extraNum += unconfTxs[(nBlockHeight - confct) % bins][bucket];
-        extraNum += oldUnconfTxs[bucket];
+        extraNum += unconf_since[bucket];
         // If we have enough transaction data points in this range of buckets,
         // we can test for success
         // (Only count the confirmed data points, so that each confirmation count
@@ -445,11 +491,13 @@ unsigned int TxConfirmStats::NewTx(unsigned int nBlockHeight, double val)
     unsigned int bucketindex = bucketMap.lower_bound(val)->second;
     unsigned int blockIndex = nBlockHeight % unconfTxs.size();
     unconfTxs[blockIndex][bucketindex]++;
+    m_unconf_since.clear();
     return bucketindex;
 }
 
 void TxConfirmStats::removeTx(unsigned int entryHeight, unsigned int nBestSeenHeight, unsigned int bucketindex, bool inBlock)
 {
+    m_unconf_since.clear();
     //nBestSeenHeight is not updated yet for the new block
     int blocksAgo = nBestSeenHeight - entryHeight;
     if (nBestSeenHeight == 0)  // the BlockPolicyEstimator hasn't seen any blocks yet
@@ -476,7 +524,12 @@ void TxConfirmStats::removeTx(unsigned int entryHeight, unsigned int nBestSeenHe
                      blockIndex, bucketindex);
         }
     }
-    if (!inBlock && (unsigned int)blocksAgo >= scale) { // Only counts as a failure if not confirmed for entire period
+    if (!inBlock) RecordFailure(blocksAgo, bucketindex);
+}
+
+void TxConfirmStats::RecordFailure(unsigned int blocksAgo, unsigned int bucketindex)
+{
+    if (blocksAgo >= scale) { // Only counts as a failure if not confirmed for entire period
         assert(scale != 0);
         unsigned int periodsAgo = blocksAgo / scale;
         for (size_t i = 0; i < periodsAgo && i < failAvg.size(); i++) {
@@ -493,7 +546,9 @@ void TxConfirmStats::removeTx(unsigned int entryHeight, unsigned int nBestSeenHe
 bool CBlockPolicyEstimator::removeTx(uint256 hash, bool inBlock)
 {
     LOCK(m_cs_fee_estimator);
-    return _removeTx(hash, inBlock);
+    const bool removed{_removeTx(hash, inBlock)};
+    if (m_removed_since_table >= SMART_FEE_REFRESH_REMOVALS) UpdateSmartFeeTable();
+    return removed;
 }
 
 bool CBlockPolicyEstimator::_removeTx(const uint256& hash, bool inBlock)
@@ -501,6 +556,11 @@ bool CBlockPolicyEstimator::_removeTx(const uint256& hash, bool inBlock)
     AssertLockHeld(m_cs_fee_estimator);
     std::map<uint256, TxStatsInfo>::iterator pos = mapMemPoolTxs.find(hash);
     if (pos != mapMemPoolTxs.end()) {
+        // Transactions that waited for a block count as failures to confirm.
+        if (!inBlock && pos->second.blockHeight < nBestSeenHeight) {
+            ++m_removed_since_table;
+            m_journal_failures.emplace_back(nBestSeenHeight - pos->second.blockHeight, pos->second.bucketIndex);
+        }
         feeStats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex, inBlock);
         shortStats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex, inBlock);
         longStats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex, inBlock);
@@ -512,7 +572,9 @@ bool CBlockPolicyEstimator::_removeTx(const uint256& hash, bool inBlock)
 }
 
 CBlockPolicyEstimator::CBlockPolicyEstimator()
-    : nBestSeenHeight(0), firstRecordedHeight(0), historicalFirst(0), historicalBest(0), trackedTxs(0), untrackedTxs(0)
+    : nBestSeenHeight(0), firstRecordedHeight(0), historicalFirst(0), historicalBest(0), trackedTxs(0), untrackedTxs(0),
+      m_backlog_feerates{std::make_shared<const std::vector<CFeeRate>>()},
+      m_backlog_blocks(MEMPOOL_BACKLOG_HORIZON.count() / Params().GetConsensus().nPowTargetSpacing)
 {
     static_assert(MIN_BUCKET_FEERATE > 0, "Min feerate must be nonzero");
     size_t bucketIndex = 0;
@@ -528,6 +590,7 @@ CBlockPolicyEstimator::CBlockPolicyEstimator()
     feeStats = std::unique_ptr<TxConfirmStats>(new TxConfirmStats(buckets, bucketMap, MED_BLOCK_PERIODS, MED_DECAY, MED_SCALE));
     shortStats = std::unique_ptr<TxConfirmStats>(new TxConfirmStats(buckets, bucketMap, SHORT_BLOCK_PERIODS, SHORT_DECAY, SHORT_SCALE));
     longStats = std::unique_ptr<TxConfirmStats>(new TxConfirmStats(buckets, bucketMap, LONG_BLOCK_PERIODS, LONG_DECAY, LONG_SCALE));
+    WITH_LOCK(m_cs_fee_estimator, UpdateSmartFeeTable());
 
     // If the fee estimation file is present, read recorded estimations
     fs::path est_filepath = gArgs.GetDataDirNet() / FEE_ESTIMATES_FILENAME;
@@ -535,6 +598,16 @@ CBlockPolicyEstimator::CBlockPolicyEstimator()
     if (est_file.IsNull() || !Read(est_file)) {
         LogPrintf("Failed to read fee estimates from %s. Continue anyway.\n", fs::PathToString(est_filepath));
     }
+
+    // Blocks processed since the estimates file was written, if the node did not shut down cleanly
+    fs::path journal_filepath = gArgs.GetDataDirNet() / FEE_ESTIMATES_JOURNAL_FILENAME;
+    CAutoFile journal_file(fsbridge::fopen(journal_filepath, "rb"), SER_DISK, CLIENT_VERSION);
+    LOCK(m_cs_fee_estimator);
+    if (!journal_file.IsNull() && ReplayJournal(journal_file) > 0) {
+        FlushEstimates();
+    } else {
+        StartJournal();
+    }
 }
 
 CBlockPolicyEstimator::~CBlockPolicyEstimator()
@@ -605,6 +678,7 @@ bool CBlockPolicyEstimator::processBlockTx(unsigned int nBlockHeight, const CTxM
     feeStats->Record(blocksToConfirm, (double)feeRate.GetFeePerK());
     shortStats->Record(blocksToConfirm, (double)feeRate.GetFeePerK());
     longStats->Record(blocksToConfirm, (double)feeRate.GetFeePerK());
+    m_journal_confirmations.emplace_back(blocksToConfirm, feeRate.GetFeePerK());
     return true;
 }
 
@@ -655,6 +729,8 @@ void CBlockPolicyEstimator::processBlock(unsigned int nBlockHeight,
 
     trackedTxs = 0;
     untrackedTxs = 0;
+    AppendToJournal();
+    UpdateSmartFeeTable();
 }
 
 CFeeRate CBlockPolicyEstimator::estimateFee(int confTarget) const
@@ -753,26 +829,26 @@ double CBlockPolicyEstimator::estimateCombinedFee(unsigned int confTarget, doubl
     if (confTarget >= 1 && confTarget <= longStats->GetMaxConfirms()) {
         // Find estimate from shortest time horizon possible
         if (confTarget <= shortStats->GetMaxConfirms()) { // short horizon
-            estimate = shortStats->EstimateMedianVal(confTarget, SUFFICIENT_TXS_SHORT, successThreshold, nBestSeenHeight, result);
+            estimate = EstimateMedianVal(*shortStats, confTarget, SUFFICIENT_TXS_SHORT, successThreshold, result);
         }
         else if (confTarget <= feeStats->GetMaxConfirms()) { // medium horizon
-            estimate = feeStats->EstimateMedianVal(confTarget, SUFFICIENT_FEETXS, successThreshold, nBestSeenHeight, result);
+            estimate = EstimateMedianVal(*feeStats, confTarget, SUFFICIENT_FEETXS, successThreshold, result);
         }
         else { // long horizon
-            estimate = longStats->EstimateMedianVal(confTarget, SUFFICIENT_FEETXS, successThreshold, nBestSeenHeight, result);
+            estimate = EstimateMedianVal(*longStats, confTarget, SUFFICIENT_FEETXS, successThreshold, result);
         }
         if (checkShorterHorizon) {
             EstimationResult tempResult;
             // If a lower confTarget from a more recent horizon returns a lower answer use it.
             if (confTarget > feeStats->GetMaxConfirms()) {
-                double medMax = feeStats->EstimateMedianVal(feeStats->GetMaxConfirms(), SUFFICIENT_FEETXS, successThreshold, nBestSeenHeight, &tempResult);
+                double medMax = EstimateMedianVal(*feeStats, feeStats->GetMaxConfirms(), SUFFICIENT_FEETXS, successThreshold, &tempResult);
                 if (medMax > 0 && (estimate == -1 || medMax < estimate)) {
                     estimate = medMax;
                     if (result) *result = tempResult;
                 }
             }
             if (confTarget > shortStats->GetMaxConfirms()) {
-                double shortMax = shortStats->EstimateMedianVal(shortStats->GetMaxConfirms(), SUFFICIENT_TXS_SHORT, successThreshold, nBestSeenHeight, &tempResult);
+                double shortMax = EstimateMedianVal(*shortStats, shortStats->GetMaxConfirms(), SUFFICIENT_TXS_SHORT, successThreshold, &tempResult);
                 if (shortMax > 0 && (estimate == -1 || shortMax < estimate)) {
                     estimate = shortMax;
                     if (result) *result = tempResult;
@@ -791,10 +867,10 @@ double CBlockPolicyEstimator::estimateConservativeFee(unsigned int doubleTarget,
     double estimate = -1;
     EstimationResult tempResult;
     if (doubleTarget <= shortStats->GetMaxConfirms()) {
-        estimate = feeStats->EstimateMedianVal(doubleTarget, SUFFICIENT_FEETXS, DOUBLE_SUCCESS_PCT, nBestSeenHeight, result);
+        estimate = EstimateMedianVal(*feeStats, doubleTarget, SUFFICIENT_FEETXS, DOUBLE_SUCCESS_PCT, result);
     }
     if (doubleTarget <= feeStats->GetMaxConfirms()) {
-        double longEstimate = longStats->EstimateMedianVal(doubleTarget, SUFFICIENT_FEETXS, DOUBLE_SUCCESS_PCT, nBestSeenHeight, &tempResult);
+        double longEstimate = EstimateMedianVal(*longStats, doubleTarget, SUFFICIENT_FEETXS, DOUBLE_SUCCESS_PCT, &tempResult);
         if (longEstimate > estimate) {
             estimate = longEstimate;
             if (result) *result = tempResult;
@@ -803,16 +879,16 @@ double CBlockPolicyEstimator::estimateConservativeFee(unsigned int doubleTarget,
     return estimate;
 }
 
-/** estimateSmartFee returns the max of the feerates calculated with a 60%
+/** EstimateSmartFeeFromStats returns the max of the feerates calculated with a 60%
  * threshold required at target / 2, an 85% threshold required at target and a
  * 95% threshold required at 2 * target.  Each calculation is performed at the
  * shortest time horizon which tracks the required target.  Conservative
  * estimates, however, required the 95% threshold at 2 * target be met for any
  * longer time horizons also.
  */
-CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, FeeCalculation *feeCalc, bool conservative) const
+CFeeRate CBlockPolicyEstimator::EstimateSmartFeeFromStats(int confTarget, FeeCalculation *feeCalc, bool conservative) const
 {
-    LOCK(m_cs_fee_estimator);
+    AssertLockHeld(m_cs_fee_estimator);
 
     if (feeCalc) {
         feeCalc->desiredTarget = confTarget;
@@ -888,21 +964,230 @@ CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, FeeCalculation
     return CFeeRate(llround(median));
 }
 
+double CBlockPolicyEstimator::EstimateMedianVal(const TxConfirmStats& stats, int confTarget, double sufficientTxVal, double successThreshold, EstimationResult* result) const
+{
+    AssertLockHeld(m_cs_fee_estimator);
+    if (!m_cache_medians) return stats.EstimateMedianVal(confTarget, sufficientTxVal, successThreshold, nBestSeenHeight, result);
+    auto [it, inserted] = m_median_cache.try_emplace({&stats, confTarget, sufficientTxVal, successThreshold});
+    auto& [median, median_result] = it->second;
+    if (inserted) median = stats.EstimateMedianVal(confTarget, sufficientTxVal, successThreshold, nBestSeenHeight, &median_result);
+    if (result) *result = median_result;
+    return median;
+}
+
+void CBlockPolicyEstimator::UpdateSmartFeeTable()
+{
+    AssertLockHeld(m_cs_fee_estimator);
+    const int64_t start{GetTimeMicros()};
+    // Neighbouring targets and both modes share most of their calculations.
+    m_cache_medians = true;
+    auto table{std::make_shared<SmartFeeTable>()};
+    table->max_target = longStats->GetMaxConfirms();
+    table->max_usable = MaxUsableEstimate();
+    for (const bool conservative : {false, true}) {
+        auto& estimates{table->estimates[conservative]};
+        estimates.resize(table->max_usable + 1);
+        for (unsigned int target = 2; target <= table->max_usable; ++target) {
+            auto& [feerate, calc] = estimates[target];
+            feerate = EstimateSmartFeeFromStats(target, &calc, conservative);
+        }
+    }
+    m_cache_medians = false;
+    m_median_cache.clear();
+    std::atomic_store(&m_smart_fee_table, std::shared_ptr<const SmartFeeTable>{std::move(table)});
+    m_removed_since_table = 0;
+    LogPrint(BCLog::ESTIMATEFEE, "Computed smart fee estimates up to target %u in %gs\n", MaxUsableEstimate(), (GetTimeMicros() - start) * 0.000001);
+}
+
+CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, FeeCalculation *feeCalc, bool conservative) const
+{
+    const auto table{std::atomic_load(&m_smart_fee_table)};
+
+    if (feeCalc) {
+        feeCalc->desiredTarget = confTarget;
+        feeCalc->returnedTarget = confTarget;
+    }
+
+    // Return failure if trying to analyze a target we're not tracking
+    if (confTarget <= 0 || (unsigned int)confTarget > table->max_target) {
+        return CFeeRate(0);  // error condition
+    }
+
+    // It's not possible to get reasonable estimates for confTarget of 1
+    if (confTarget == 1) confTarget = 2;
+
+    if ((unsigned int)confTarget > table->max_usable) {
+        confTarget = table->max_usable;
+    }
+    if (feeCalc) feeCalc->returnedTarget = confTarget;
+
+    if (confTarget <= 1) return CFeeRate(0); // error condition
+
+    const auto& estimates{table->estimates[conservative]};
+    const auto& [feerate, calc] = estimates[confTarget];
+    if (feeCalc) {
+        feeCalc->est = calc.est;
+        feeCalc->reason = calc.reason;
+    }
+    if (feerate == CFeeRate(0)) return feerate;
+
+    // Do not ask for more than the mempool needs to get into a block within
+    // the target, but never for less than the estimate at the highest target,
+    // which keeps the estimates decreasing with the target.
+    const auto backlog{std::atomic_load(&m_backlog_feerates)};
+    const CFeeRate floor{estimates[table->max_usable].first};
+    if ((unsigned int)confTarget <= backlog->size() && floor > CFeeRate(0)) {
+        const CFeeRate backlog_feerate{std::max((*backlog)[confTarget - 1], floor)};
+        if (backlog_feerate < feerate) {
+            if (feeCalc) feeCalc->reason = FeeReason::MEMPOOL_BACKLOG;
+            return backlog_feerate;
+        }
+    }
+    return feerate;
+}
+
+void CBlockPolicyEstimator::processMempoolBacklog(std::vector<CFeeRate> block_feerates)
+{
+    std::atomic_store(&m_backlog_feerates, std::shared_ptr<const std::vector<CFeeRate>>{std::make_shared<const std::vector<CFeeRate>>(std::move(block_feerates))});
+}
+
 void CBlockPolicyEstimator::Flush() {
     FlushUnconfirmed();
+    WITH_LOCK(m_cs_fee_estimator, FlushEstimates());
+}
 
+void CBlockPolicyEstimator::FlushEstimates()
+{
+    AssertLockHeld(m_cs_fee_estimator);
+    // Retry after the next JOURNAL_COMPACT_BLOCKS blocks if this fails.
+    m_journal_blocks = 0;
+
+    // Write to a temporary file first, so the journal keeps applying to the
+    // old file until the new one is complete.
     fs::path est_filepath = gArgs.GetDataDirNet() / FEE_ESTIMATES_FILENAME;
-    CAutoFile est_file(fsbridge::fopen(est_filepath, "wb"), SER_DISK, CLIENT_VERSION);
-    if (est_file.IsNull() || !Write(est_file)) {
+    fs::path tmp_filepath = gArgs.GetDataDirNet() / (std::string{FEE_ESTIMATES_FILENAME} + ".new");
+    CAutoFile est_file(fsbridge::fopen(tmp_filepath, "wb"), SER_DISK, CLIENT_VERSION);
+    if (est_file.IsNull() || !_Write(est_file) || !FileCommit(est_file.Get())) {
         LogPrintf("Failed to write fee estimates to %s. Continue anyway.\n", fs::PathToString(est_filepath));
+        return;
+    }
+    est_file.fclose();
+    if (!RenameOver(tmp_filepath, est_filepath)) {
+        LogPrintf("Failed to rename fee estimates to %s. Continue anyway.\n", fs::PathToString(est_filepath));
+        return;
+    }
+    StartJournal();
+}
+
+void CBlockPolicyEstimator::StartJournal()
+{
+    AssertLockHeld(m_cs_fee_estimator);
+    m_journal_blocks = 0;
+    fs::path journal_filepath = gArgs.GetDataDirNet() / FEE_ESTIMATES_JOURNAL_FILENAME;
+    m_journal = std::make_unique<CAutoFile>(fsbridge::fopen(journal_filepath, "wb"), SER_DISK, CLIENT_VERSION);
+    try {
+        if (m_journal->IsNull()) throw std::ios_base::failure("unable to open file");
+        // Records only apply to the estimates file written at this height.
+        *m_journal << CURRENT_FEES_JOURNAL_VERSION << nBestSeenHeight;
+        if (fflush(m_journal->Get()) != 0) throw std::ios_base::failure("fflush failed");
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to start fee estimates journal %s (non-fatal): %s\n", fs::PathToString(journal_filepath), e.what());
+        m_journal.reset();
+    }
+}
+
+void CBlockPolicyEstimator::AppendToJournal()
+{
+    AssertLockHeld(m_cs_fee_estimator);
+    FeeJournalRecord record{nBestSeenHeight, std::move(m_journal_failures), std::move(m_journal_confirmations)};
+    m_journal_failures.clear();
+    m_journal_confirmations.clear();
+    if (!m_journal) return;
+
+    try {
+        std::vector<unsigned char> data;
+        CVectorWriter{SER_DISK, CLIENT_VERSION, data, 0} << record;
+        *m_journal << data << Hash(data);
+        // Records have to survive the node being killed, but not a system crash,
+        // so they are not synced to disk.
+        if (fflush(m_journal->Get()) != 0) throw std::ios_base::failure("fflush failed");
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to append to fee estimates journal (non-fatal): %s\n", e.what());
+        m_journal.reset();
+        return;
+    }
+    if (++m_journal_blocks >= JOURNAL_COMPACT_BLOCKS) FlushEstimates();
+}
+
+unsigned int CBlockPolicyEstimator::ReplayJournal(CAutoFile& filein)
+{
+    AssertLockHeld(m_cs_fee_estimator);
+    unsigned int replayed{0};
+    try {
+        int version;
+        unsigned int base_height;
+        filein >> version >> base_height;
+        if (version != CURRENT_FEES_JOURNAL_VERSION || base_height != nBestSeenHeight) {
+            // Left behind by a different version, or already contained in the estimates file
+            return 0;
+        }
+        while (true) {
+            std::vector<unsigned char> data;
+            uint256 checksum;
+            // Stops at the end of the file, or at a record that was only partially written.
+            filein >> data >> checksum;
+            if (checksum != Hash(data)) throw std::runtime_error("Corrupt fee estimates journal. Checksum mismatch");
+            FeeJournalRecord record;
+            SpanReader{SER_DISK, CLIENT_VERSION, data} >> record;
+            if (record.height <= nBestSeenHeight) throw std::runtime_error("Corrupt fee estimates journal. Heights are not increasing");
+            for (const auto& [blocks_ago, bucket_index] : record.failures) {
+                if (bucket_index >= buckets.size()) throw std::runtime_error("Corrupt fee estimates journal. Invalid bucket");
+            }
+
+            for (const auto& [blocks_ago, bucket_index] : record.failures) {
+                feeStats->RecordFailure(blocks_ago, bucket_index);
+                shortStats->RecordFailure(blocks_ago, bucket_index);
+                longStats->RecordFailure(blocks_ago, bucket_index);
+            }
+            // No transactions are tracked yet, so there is no unconfirmed
+            // circular buffer to roll.
+            nBestSeenHeight = record.height;
+            feeStats->UpdateMovingAverages();
+            shortStats->UpdateMovingAverages();
+            longStats->UpdateMovingAverages();
+            for (const auto& [blocks_to_confirm, feerate] : record.confirmations) {
+                feeStats->Record(blocks_to_confirm, (double)feerate);
+                shortStats->Record(blocks_to_confirm, (double)feerate);
+                longStats->Record(blocks_to_confirm, (double)feerate);
+            }
+            // The replayed blocks were recorded by the previous run.
+            if (historicalFirst == 0 && !record.confirmations.empty()) historicalFirst = record.height;
+            historicalBest = record.height;
+            ++replayed;
+        }
+    } catch (const std::ios_base::failure&) {
+        // End of the journal
+    } catch (const std::exception& e) {
+        LogPrintf("CBlockPolicyEstimator::ReplayJournal(): stopped replaying fee estimates journal (non-fatal): %s\n", e.what());
+    }
+    if (replayed > 0) {
+        LogPrintf("Replayed %u blocks from the fee estimates journal up to height %u\n", replayed, nBestSeenHeight);
+        UpdateSmartFeeTable();
     }
+    return replayed;
 }
 
 bool CBlockPolicyEstimator::Write(CAutoFile& fileout) const
 {
+    LOCK(m_cs_fee_estimator);
+    return _Write(fileout);
+}
+
+bool CBlockPolicyEstimator::_Write(CAutoFile& fileout) const
+{
+    AssertLockHeld(m_cs_fee_estimator);
     try {
-        LOCK(m_cs_fee_estimator);
-        fileout << 149900; // version required to read: 0.14.99 or later
+        fileout << CURRENT_FEES_FILE_VERSION; // version required to read
         fileout << CLIENT_VERSION; // version that wrote the file
         fileout << nBestSeenHeight;
         if (BlockSpan() > HistoricalBlockSpan()/2) {
@@ -929,7 +1214,7 @@ bool CBlockPolicyEstimator::Read(CAutoFile& filein)
         LOCK(m_cs_fee_estimator);
         int nVersionRequired, nVersionThatWrote;
         filein >> nVersionRequired >> nVersionThatWrote;
-        if (nVersionRequired > CLIENT_VERSION) {
+        if (nVersionRequired > CURRENT_FEES_FILE_VERSION) {
             throw std::runtime_error(strprintf("up-version (%d) fee estimate file", nVersionRequired));
         }
 
@@ -976,6 +1261,7 @@ bool CBlockPolicyEstimator::Read(CAutoFile& filein)
             nBestSeenHeight = nFileBestSeenHeight;
             historicalFirst = nFileHistoricalFirst;
             historicalBest = nFileHistoricalBest;
+            UpdateSmartFeeTable();
         }
     }
     catch (const std::exception& e) {
@@ -994,6 +1280,7 @@ void CBlockPolicyEstimator::FlushUnconfirmed() {
         auto mi = mapMemPoolTxs.begin();
         _removeTx(mi->first, false); // this calls erase() on mapMemPoolTxs
     }
+    UpdateSmartFeeTable();
     int64_t endclear = GetTimeMicros();
     LogPrint(BCLog::ESTIMATEFEE, "Recorded %u unconfirmed txs from mempool in %gs\n", num_entries, (endclear - startclear)*0.000001);
 }
@@ -12,9 +12,12 @@
 #include <sync.h>
 
 #include <array>
+#include <chrono>
 #include <map>
 #include <memory>
 #include <string>
+#include <tuple>
+#include <utility>
 #include <vector>
 
 class CAutoFile;
@@ -46,6 +49,7 @@ enum class FeeReason {
     FULL_ESTIMATE,
     DOUBLE_ESTIMATE,
     CONSERVATIVE,
+    MEMPOOL_BACKLOG,
     MEMPOOL_MIN,
     PAYTXFEE,
     FALLBACK,
@@ -179,7 +183,20 @@ private:
      */
     static constexpr double FEE_SPACING = 1.05;
 
+    /** Number of unconfirmed transactions dropped from tracking after which the
+     * smart fee estimates are recomputed before the next block arrives */
+    static constexpr unsigned int SMART_FEE_REFRESH_REMOVALS = 100;
+
+    /** Targets within this much time are capped by the feerates the current
+     * mempool needs to get into the next blocks. With 2 minute blocks this is
+     * 10 blocks, far shorter than the history the short horizon decays over. */
+    static constexpr std::chrono::seconds MEMPOOL_BACKLOG_HORIZON{20 * 60};
+
 public:
+    /** Number of blocks appended to the journal after which the estimates
+     * file is rewritten and the journal started over, about 6 hours */
+    static constexpr unsigned int JOURNAL_COMPACT_BLOCKS = 180;
+
     /** Create new BlockPolicyEstimator and initialize stats tracking classes with default values */
     CBlockPolicyEstimator();
     ~CBlockPolicyEstimator();
@@ -205,9 +222,18 @@ public:
      *  blocks. If no answer can be given at confTarget, return an estimate at
      *  the closest target where one can be given.  'conservative' estimates are
      *  valid over longer time horizons also.
+     *
+     *  Answers come from a table that is computed for all targets whenever the
+     *  tracked data changes, so this does not take m_cs_fee_estimator.
      */
-    CFeeRate estimateSmartFee(int confTarget, FeeCalculation *feeCalc, bool conservative) const
-        EXCLUSIVE_LOCKS_REQUIRED(!m_cs_fee_estimator);
+    CFeeRate estimateSmartFee(int confTarget, FeeCalculation *feeCalc, bool conservative) const;
+
+    /** Record the lowest feerates that the current mempool gets into each of
+     *  the next blocks, CFeeRate(0) for blocks it does not fill */
+    void processMempoolBacklog(std::vector<CFeeRate> block_feerates);
+
+    /** Number of blocks processMempoolBacklog should be given feerates for */
+    unsigned int MempoolBacklogBlocks() const { return m_backlog_blocks; }
 
     /** Return a specific fee estimate calculation with a given success
      * threshold and time horizon, and optionally return detailed data about
@@ -237,6 +263,12 @@ public:
     void Flush()
         EXCLUSIVE_LOCKS_REQUIRED(!m_cs_fee_estimator);
 
+    /** Number of blocks in the journal since the estimates file was written */
+    unsigned int JournalBlocks() const EXCLUSIVE_LOCKS_REQUIRED(!m_cs_fee_estimator)
+    {
+        return WITH_LOCK(m_cs_fee_estimator, return m_journal_blocks);
+    }
+
 private:
     mutable Mutex m_cs_fee_estimator;
 
@@ -262,6 +294,37 @@ private:
 
     unsigned int trackedTxs GUARDED_BY(m_cs_fee_estimator);
     unsigned int untrackedTxs GUARDED_BY(m_cs_fee_estimator);
+    //! Unconfirmed transactions dropped from tracking since the smart fee table was computed
+    unsigned int m_removed_since_table GUARDED_BY(m_cs_fee_estimator){0};
+
+    /** Answers of estimateSmartFee for every target that can be estimated */
+    struct SmartFeeTable {
+        //! Highest target that is tracked, higher targets are an error
+        unsigned int max_target{0};
+        //! Highest target that can be estimated, higher targets are answered for it
+        unsigned int max_usable{0};
+        //! Estimates indexed by target, for the economical and the conservative mode
+        std::vector<std::pair<CFeeRate, FeeCalculation>> estimates[2];
+    };
+    //! Replaced as a whole, only accessed through std::atomic_load and std::atomic_store
+    std::shared_ptr<const SmartFeeTable> m_smart_fee_table;
+    //! Results of TxConfirmStats::EstimateMedianVal, cached while the smart fee table is computed
+    mutable std::map<std::tuple<const TxConfirmStats*, int, double, double>, std::pair<double, EstimationResult>> m_median_cache GUARDED_BY(m_cs_fee_estimator);
+    bool m_cache_medians GUARDED_BY(m_cs_fee_estimator){false};
+    //! Feerates from processMempoolBacklog, accessed like m_smart_fee_table
+    std::shared_ptr<const std::vector<CFeeRate>> m_backlog_feerates;
+    const unsigned int m_backlog_blocks;
+
+    /** Every processed block is appended to the journal, so the estimates
+     *  survive the node being killed. It is replayed on top of the estimates
+     *  file on startup, and started over whenever that file is written. */
+    std::unique_ptr<CAutoFile> m_journal GUARDED_BY(m_cs_fee_estimator);
+    //! Blocks appended to the journal since it was started
+    unsigned int m_journal_blocks GUARDED_BY(m_cs_fee_estimator){0};
+    //! Transactions dropped without confirming since the last block: blocks waited and bucket index
+    std::vector<std::pair<uint32_t, uint32_t>> m_journal_failures GUARDED_BY(m_cs_fee_estimator);
+    //! Transactions confirmed in the block being processed: blocks to confirm and feerate
+    std::vector<std::pair<uint32_t, int64_t>> m_journal_confirmations GUARDED_BY(m_cs_fee_estimator);
 
     std::vector<double> buckets GUARDED_BY(m_cs_fee_estimator); // The upper-bound of the range for the bucket (inclusive)
     std::map<double, unsigned int> bucketMap GUARDED_BY(m_cs_fee_estimator); // Map of bucket upper-bound to index into all vectors by bucket
@@ -269,6 +332,12 @@ private:
     /** Process a transaction confirmed in a block*/
     bool processBlockTx(unsigned int nBlockHeight, const CTxMemPoolEntry* entry) EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
 
+    /** Compute estimateSmartFee from the tracked data */
+    CFeeRate EstimateSmartFeeFromStats(int confTarget, FeeCalculation *feeCalc, bool conservative) const EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
+    /** TxConfirmStats::EstimateMedianVal at the best seen height, cached if m_cache_medians is set */
+    double EstimateMedianVal(const TxConfirmStats& stats, int confTarget, double sufficientTxVal, double successThreshold, EstimationResult* result) const EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
+    /** Recompute the table estimateSmartFee answers from */
+    void UpdateSmartFeeTable() EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
     /** Helper for estimateSmartFee */
     double estimateCombinedFee(unsigned int confTarget, double successThreshold, bool checkShorterHorizon, EstimationResult *result) const EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
     /** Helper for estimateSmartFee */
@@ -280,6 +349,17 @@ private:
     /** Calculation of highest target that reasonable estimate can be provided for */
     unsigned int MaxUsableEstimate() const EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
 
+    /** A non-thread-safe helper for the Write function */
+    bool _Write(CAutoFile& fileout) const EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
+    /** Replace the estimates file with the current estimations and start a new journal */
+    void FlushEstimates() EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
+    /** Start an empty journal that applies to the current estimations */
+    void StartJournal() EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
+    /** Append the changes of the block just processed to the journal */
+    void AppendToJournal() EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
+    /** Apply the blocks in a journal that belongs to the estimates file read, return how many */
+    unsigned int ReplayJournal(CAutoFile& filein) EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
+
     /** A non-thread-safe helper for the removeTx function */
     bool _removeTx(const uint256& hash, bool inBlock)
         EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
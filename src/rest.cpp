@@ -22,11 +22,14 @@
 #include <sync.h>
 #include <txmempool.h>
 #include <util/check.h>
+#include <util/strencodings.h>
 #include <util/system.h>
 #include <validation.h>
 #include <version.h>
 
 #include <any>
+#include <optional>
+#include <stdexcept>
 
 #include <boost/algorithm/string.hpp>
 
@@ -139,23 +142,25 @@ static ChainstateManager* GetChainman(const std::any& context, HTTPRequest* req)
 
 static RetFormat ParseDataFormat(std::string& param, const std::string& strReq)
 {
-    const std::string::size_type pos = strReq.rfind('.');
+    // Remove the query string (if any, separated with a "?") as it should not
+    // interfere with parsing param and data format
+    param = strReq.substr(0, strReq.rfind('?'));
+    const std::string::size_type pos = param.rfind('.');
     if (pos == std::string::npos)
     {
-        param = strReq;
         return rf_names[0].rf;
     }
 
-    param = strReq.substr(0, pos);
-    const std::string suff(strReq, pos + 1);
+    const std::string suff(param, pos + 1);
 
     for (const auto& rf_name : rf_names) {
-        if (suff == rf_name.name)
+        if (suff == rf_name.name) {
+            param.erase(pos);
             return rf_name.rf;
+        }
     }
 
-    /* If no suffix is found, return original string.  */
-    param = strReq;
+    /* If no suffix is found, return original string without the query string.  */
     return rf_names[0].rf;
 }
 
@@ -600,6 +605,9 @@ static bool rest_mempool_info(const std::any& context, HTTPRequest* req, const s
     }
 }
 
+/** Approximate size of the chunks a streamed mempool reply is sent in */
+static constexpr size_t MEMPOOL_REPLY_CHUNK_SIZE{64 * 1024};
+
 static bool rest_mempool_contents(const std::any& context, HTTPRequest* req, const std::string& strURIPart)
 {
     if (!CheckWarmup(req)) return false;
@@ -610,9 +618,91 @@ static bool rest_mempool_contents(const std::any& context, HTTPRequest* req, con
 
     switch (rf) {
     case RetFormat::JSON: {
-        UniValue mempoolObject = MempoolToJSON(*mempool, true);
+        std::optional<std::string> mempool_sequence_param;
+        try {
+            mempool_sequence_param = req->GetQueryParameter("mempool_sequence");
+        } catch (const std::runtime_error& e) {
+            return RESTERR(req, HTTP_BAD_REQUEST, e.what());
+        }
+        bool include_mempool_sequence{false};
+        if (mempool_sequence_param == "true") {
+            include_mempool_sequence = true;
+        } else if (mempool_sequence_param && *mempool_sequence_param != "false") {
+            return RESTERR(req, HTTP_BAD_REQUEST, "The \"mempool_sequence\" query parameter must be either \"true\" or \"false\".");
+        }
+
+        // The mempool is only locked while it is copied. The reply is written
+        // and sent in chunks, so it is never held in memory as a whole:
+        // WriteReplyChunk waits until the client has received most of the
+        // previous chunks.
+        const MempoolSnapshot snapshot{GetMempoolSnapshot(*mempool)};
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReplyStart(HTTP_OK);
+        std::string chunk;
+        if (include_mempool_sequence) {
+            chunk = strprintf("{\"mempool_sequence\":%u,\"txs\":{", snapshot.mempool_sequence);
+        } else {
+            chunk = "{";
+        }
+        bool first{true};
+        bool connected{true};
+        for (const MempoolEntryInfo& entry : snapshot.entries) {
+            if (!first) chunk += ",";
+            first = false;
+            chunk += "\"" + entry.tx->GetHash().ToString() + "\":" + MempoolEntryToJSON(entry).write();
+            if (chunk.size() >= MEMPOOL_REPLY_CHUNK_SIZE) {
+                connected = req->WriteReplyChunk(chunk);
+                chunk.clear();
+                // Stop writing when the client is gone, the request still has to be ended
+                if (!connected) break;
+            }
+        }
+        if (connected) {
+            chunk += include_mempool_sequence ? "}}\n" : "}\n";
+            req->WriteReplyChunk(chunk);
+        }
+        req->WriteReplyEnd();
+        return true;
+    }
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: json)");
+    }
+    }
+}
+
+static bool rest_mempool_changes(const std::any& context, HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req)) return false;
+    const CTxMemPool* mempool = GetMemPool(context, req);
+    if (!mempool) return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+
+    uint64_t since;
+    if (!ParseUInt64(param, &since)) {
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid mempool sequence: " + SanitizeString(param));
+    }
+
+    switch (rf) {
+    case RetFormat::JSON: {
+        const std::optional<MempoolChanges> changes{GetMempoolChanges(*mempool, since)};
+        if (!changes) {
+            return RESTERR(req, HTTP_NOT_FOUND, "Mempool changes since sequence " + param + " not available, get the mempool contents instead");
+        }
+        UniValue added(UniValue::VOBJ);
+        for (const MempoolEntryInfo& entry : changes->added) {
+            added.__pushKV(entry.tx->GetHash().ToString(), MempoolEntryToJSON(entry));
+        }
+        UniValue removed(UniValue::VARR);
+        for (const uint256& txid : changes->removed) {
+            removed.push_back(txid.ToString());
+        }
+        UniValue result(UniValue::VOBJ);
+        result.pushKV("mempool_sequence", changes->mempool_sequence);
+        result.pushKV("added", added);
+        result.pushKV("removed", removed);
 
-        std::string strJSON = mempoolObject.write() + "\n";
+        std::string strJSON = result.write() + "\n";
         req->WriteHeader("Content-Type", "application/json");
         req->WriteReply(HTTP_OK, strJSON);
         return true;
@@ -934,6 +1024,7 @@ static const struct {
       {"/rest/chaininfo", rest_chaininfo},
       {"/rest/mempool/info", rest_mempool_info},
       {"/rest/mempool/contents", rest_mempool_contents},
+      {"/rest/mempool/changes/", rest_mempool_changes},
       {"/rest/headers/", rest_headers},
       {"/rest/getutxos", rest_getutxos},
       {"/rest/blockhashbyheight/", rest_blockhash_by_height},
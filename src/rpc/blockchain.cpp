@@ -22,6 +22,7 @@
 #include <logging/timer.h>
 #include <net.h>
 #include <net_processing.h>
+#include <node/blockpipeline.h>
 #include <node/blockstorage.h>
 #include <node/coinstats.h>
 #include <node/context.h>
@@ -42,6 +43,8 @@
 #include <undo.h>
 #include <util/strencodings.h>
 #include <util/string.h>
+#include <util/hasher.h>
+#include <util/rbf.h>
 #include <util/translation.h>
 #include <validation.h>
 #include <validationinterface.h>
@@ -52,11 +55,14 @@
 
 #include <univalue.h>
 
+#include <algorithm>
 #include <condition_variable>
 #include <memory>
 #include <mutex>
+#include <unordered_map>
 
 using node::BlockManager;
+using node::BlockPipelineStats;
 using node::CCoinsStats;
 using node::CoinStatsHashType;
 using node::GetUTXOStats;
@@ -462,45 +468,71 @@ static std::vector<RPCResult> MempoolEntryDescription() { return {
     RPCResult{RPCResult::Type::BOOL, "unbroadcast", "Whether this transaction is currently unbroadcast (initial broadcast not yet acknowledged by any peers)"},
 };}
 
-static void entryToJSON(const CTxMemPool& pool, UniValue& info, const CTxMemPoolEntry& e) EXCLUSIVE_LOCKS_REQUIRED(pool.cs)
+static MempoolEntryInfo GetEntryInfo(const CTxMemPool& pool, const CTxMemPoolEntry& e, bool bip125_replaceable) EXCLUSIVE_LOCKS_REQUIRED(pool.cs)
 {
     AssertLockHeld(pool.cs);
 
-    info.pushKV("vsize", (int)e.GetTxSize());
-    info.pushKV("weight", (int)e.GetTxWeight());
+    MempoolEntryInfo info;
+    info.tx = e.GetSharedTx();
+    info.vsize = e.GetTxSize();
+    info.weight = e.GetTxWeight();
+    info.fee = e.GetFee();
+    info.modified_fee = e.GetModifiedFee();
+    info.time = e.GetTime();
+    info.height = e.GetHeight();
+    info.descendant_count = e.GetCountWithDescendants();
+    info.descendant_size = e.GetSizeWithDescendants();
+    info.descendant_fees = e.GetModFeesWithDescendants();
+    info.ancestor_count = e.GetCountWithAncestors();
+    info.ancestor_size = e.GetSizeWithAncestors();
+    info.ancestor_fees = e.GetModFeesWithAncestors();
+    info.bip125_replaceable = bip125_replaceable;
+    info.unbroadcast = pool.IsUnbroadcastTx(e.GetTx().GetHash());
+    // The in-mempool parents are the in-mempool transactions spent by this one.
+    for (const CTxMemPoolEntry& parent : e.GetMemPoolParentsConst()) {
+        info.depends.push_back(parent.GetTx().GetHash());
+    }
+    for (const CTxMemPoolEntry& child : e.GetMemPoolChildrenConst()) {
+        info.spentby.push_back(child.GetTx().GetHash());
+    }
+    return info;
+}
+
+UniValue MempoolEntryToJSON(const MempoolEntryInfo& e)
+{
+    UniValue info(UniValue::VOBJ);
+    info.pushKV("vsize", e.vsize);
+    info.pushKV("weight", e.weight);
     // TODO: top-level fee fields are deprecated. deprecated_fee_fields_enabled blocks should be removed in v24
     const bool deprecated_fee_fields_enabled{IsDeprecatedRPCEnabled("fees")};
     if (deprecated_fee_fields_enabled) {
-        info.pushKV("fee", ValueFromAmount(e.GetFee()));
-        info.pushKV("modifiedfee", ValueFromAmount(e.GetModifiedFee()));
+        info.pushKV("fee", ValueFromAmount(e.fee));
+        info.pushKV("modifiedfee", ValueFromAmount(e.modified_fee));
     }
-    info.pushKV("time", count_seconds(e.GetTime()));
-    info.pushKV("height", (int)e.GetHeight());
-    info.pushKV("descendantcount", e.GetCountWithDescendants());
-    info.pushKV("descendantsize", e.GetSizeWithDescendants());
+    info.pushKV("time", count_seconds(e.time));
+    info.pushKV("height", (int)e.height);
+    info.pushKV("descendantcount", e.descendant_count);
+    info.pushKV("descendantsize", e.descendant_size);
     if (deprecated_fee_fields_enabled) {
-        info.pushKV("descendantfees", e.GetModFeesWithDescendants());
+        info.pushKV("descendantfees", e.descendant_fees);
     }
-    info.pushKV("ancestorcount", e.GetCountWithAncestors());
-    info.pushKV("ancestorsize", e.GetSizeWithAncestors());
+    info.pushKV("ancestorcount", e.ancestor_count);
+    info.pushKV("ancestorsize", e.ancestor_size);
     if (deprecated_fee_fields_enabled) {
-        info.pushKV("ancestorfees", e.GetModFeesWithAncestors());
+        info.pushKV("ancestorfees", e.ancestor_fees);
     }
-    info.pushKV("wtxid", pool.vTxHashes[e.vTxHashesIdx].first.ToString());
+    info.pushKV("wtxid", e.tx->GetWitnessHash().ToString());
 
     UniValue fees(UniValue::VOBJ);
-    fees.pushKV("base", ValueFromAmount(e.GetFee()));
-    fees.pushKV("modified", ValueFromAmount(e.GetModifiedFee()));
-    fees.pushKV("ancestor", ValueFromAmount(e.GetModFeesWithAncestors()));
-    fees.pushKV("descendant", ValueFromAmount(e.GetModFeesWithDescendants()));
+    fees.pushKV("base", ValueFromAmount(e.fee));
+    fees.pushKV("modified", ValueFromAmount(e.modified_fee));
+    fees.pushKV("ancestor", ValueFromAmount(e.ancestor_fees));
+    fees.pushKV("descendant", ValueFromAmount(e.descendant_fees));
     info.pushKV("fees", fees);
 
-    const CTransaction& tx = e.GetTx();
     std::set<std::string> setDepends;
-    for (const CTxIn& txin : tx.vin)
-    {
-        if (pool.exists(GenTxid::Txid(txin.prevout.hash)))
-            setDepends.insert(txin.prevout.hash.ToString());
+    for (const uint256& parent : e.depends) {
+        setDepends.insert(parent.ToString());
     }
 
     UniValue depends(UniValue::VARR);
@@ -512,25 +544,79 @@ static void entryToJSON(const CTxMemPool& pool, UniValue& info, const CTxMemPool
     info.pushKV("depends", depends);
 
     UniValue spent(UniValue::VARR);
-    const CTxMemPool::txiter& it = pool.mapTx.find(tx.GetHash());
-    const CTxMemPoolEntry::Children& children = it->GetMemPoolChildrenConst();
-    for (const CTxMemPoolEntry& child : children) {
-        spent.push_back(child.GetTx().GetHash().ToString());
+    for (const uint256& child : e.spentby) {
+        spent.push_back(child.ToString());
     }
 
     info.pushKV("spentby", spent);
 
+    info.pushKV("bip125-replaceable", e.bip125_replaceable);
+    info.pushKV("unbroadcast", e.unbroadcast);
+    return info;
+}
+
+static void entryToJSON(const CTxMemPool& pool, UniValue& info, const CTxMemPoolEntry& e) EXCLUSIVE_LOCKS_REQUIRED(pool.cs)
+{
+    AssertLockHeld(pool.cs);
+
     // Add opt-in RBF status
     bool rbfStatus = false;
-    RBFTransactionState rbfState = IsRBFOptIn(tx, pool);
+    RBFTransactionState rbfState = IsRBFOptIn(e.GetTx(), pool);
     if (rbfState == RBFTransactionState::UNKNOWN) {
         throw JSONRPCError(RPC_MISC_ERROR, "Transaction is not in mempool");
     } else if (rbfState == RBFTransactionState::REPLACEABLE_BIP125) {
         rbfStatus = true;
     }
 
-    info.pushKV("bip125-replaceable", rbfStatus);
-    info.pushKV("unbroadcast", pool.IsUnbroadcastTx(tx.GetHash()));
+    info = MempoolEntryToJSON(GetEntryInfo(pool, e, rbfStatus));
+}
+
+MempoolSnapshot GetMempoolSnapshot(const CTxMemPool& pool)
+{
+    MempoolSnapshot snapshot;
+    {
+        LOCK(pool.cs);
+        snapshot.mempool_sequence = pool.GetSequence();
+        snapshot.entries.reserve(pool.mapTx.size());
+        for (const CTxMemPoolEntry& e : pool.mapTx) {
+            snapshot.entries.push_back(GetEntryInfo(pool, e, /*bip125_replaceable=*/false));
+        }
+    }
+
+    // A transaction is replaceable if it or one of its ancestors signals it
+    // (see IsRBFOptIn). Parents have fewer ancestors than their children, so
+    // they are decided first.
+    std::vector<MempoolEntryInfo*> by_ancestor_count;
+    by_ancestor_count.reserve(snapshot.entries.size());
+    std::unordered_map<uint256, const MempoolEntryInfo*, SaltedTxidHasher> by_txid;
+    for (MempoolEntryInfo& entry : snapshot.entries) {
+        by_ancestor_count.push_back(&entry);
+        by_txid.emplace(entry.tx->GetHash(), &entry);
+    }
+    std::sort(by_ancestor_count.begin(), by_ancestor_count.end(), [](const MempoolEntryInfo* a, const MempoolEntryInfo* b) {
+        return a->ancestor_count < b->ancestor_count;
+    });
+    for (MempoolEntryInfo* entry : by_ancestor_count) {
+        entry->bip125_replaceable = SignalsOptInRBF(*entry->tx) ||
+            std::any_of(entry->depends.begin(), entry->depends.end(), [&](const uint256& parent) {
+                return by_txid.at(parent)->bip125_replaceable;
+            });
+    }
+    return snapshot;
+}
+
+std::optional<MempoolChanges> GetMempoolChanges(const CTxMemPool& pool, uint64_t since)
+{
+    LOCK(pool.cs);
+    MempoolChanges changes;
+    std::vector<uint256> added;
+    if (!pool.GetChangesSince(since, added, changes.removed)) return std::nullopt;
+    changes.mempool_sequence = pool.GetSequence();
+    for (const uint256& txid : added) {
+        const auto it{pool.GetIter(txid)};
+        changes.added.push_back(GetEntryInfo(pool, **it, IsRBFOptIn((*it)->GetTx(), pool) == RBFTransactionState::REPLACEABLE_BIP125));
+    }
+    return changes;
 }
 
 UniValue MempoolToJSON(const CTxMemPool& pool, bool verbose, bool include_mempool_sequence)
@@ -539,16 +625,14 @@ UniValue MempoolToJSON(const CTxMemPool& pool, bool verbose, bool include_mempoo
         if (include_mempool_sequence) {
             throw JSONRPCError(RPC_INVALID_PARAMETER, "Verbose results cannot contain mempool sequence values.");
         }
-        LOCK(pool.cs);
+        // The mempool is not locked while the entries are converted.
+        const MempoolSnapshot snapshot{GetMempoolSnapshot(pool)};
         UniValue o(UniValue::VOBJ);
-        for (const CTxMemPoolEntry& e : pool.mapTx) {
-            const uint256& hash = e.GetTx().GetHash();
-            UniValue info(UniValue::VOBJ);
-            entryToJSON(pool, info, e);
+        for (const MempoolEntryInfo& e : snapshot.entries) {
             // Mempool has unique entries so there is no advantage in using
             // UniValue::pushKV, which checks if the key already exists in O(N).
             // UniValue::__pushKV is used instead which currently is O(1).
-            o.__pushKV(hash.ToString(), info);
+            o.__pushKV(e.tx->GetHash().ToString(), MempoolEntryToJSON(e));
         }
         return o;
     } else {
@@ -1817,7 +1901,9 @@ UniValue MempoolInfoToJSON(const CTxMemPool& pool)
     ret.pushKV("loaded", pool.IsLoaded());
     ret.pushKV("size", (int64_t)pool.size());
     ret.pushKV("bytes", (int64_t)pool.GetTotalTxSize());
-    ret.pushKV("usage", (int64_t)pool.DynamicMemoryUsage());
+    const size_t usage{pool.DynamicMemoryUsage()};
+    ret.pushKV("usage", (int64_t)usage);
+    ret.pushKV("usage_per_tx", pool.size() == 0 ? 0 : (int64_t)(usage / pool.size()));
     ret.pushKV("total_fee", ValueFromAmount(pool.GetTotalFee()));
     size_t maxmempool = gArgs.GetIntArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
     ret.pushKV("maxmempool", (int64_t) maxmempool);
@@ -1839,6 +1925,7 @@ static RPCHelpMan getmempoolinfo()
                         {RPCResult::Type::NUM, "size", "Current tx count"},
                         {RPCResult::Type::NUM, "bytes", "Sum of all virtual transaction sizes as defined in BIP 141. Differs from actual serialized size because witness data is discounted"},
                         {RPCResult::Type::NUM, "usage", "Total memory usage for the mempool"},
+                        {RPCResult::Type::NUM, "usage_per_tx", "Average memory usage per transaction in the mempool, including the indexes and the transaction itself (0 if the mempool is empty)"},
                         {RPCResult::Type::STR_AMOUNT, "total_fee", "Total fees for the mempool in " + CURRENCY_UNIT + ", ignoring modified fees through prioritisetransaction"},
                         {RPCResult::Type::NUM, "maxmempool", "Maximum memory usage for the mempool"},
                         {RPCResult::Type::STR_AMOUNT, "mempoolminfee", "Minimum fee rate in " + CURRENCY_UNIT + "/kvB for tx to be accepted. Is the maximum of minrelaytxfee and minimum mempool fee"},
@@ -1856,6 +1943,77 @@ static RPCHelpMan getmempoolinfo()
     };
 }
 
+static RPCHelpMan getblockpipelineinfo()
+{
+    return RPCHelpMan{"getblockpipelineinfo",
+                "\nReturns queue depths and cumulative stage timings of the pipeline that decodes and checks\n"
+                "blocks received from peers before they are connected (see -blockpipelinethreads).\n",
+                {},
+                RPCResult{
+                    RPCResult::Type::OBJ, "", "",
+                    {
+                        {RPCResult::Type::BOOL, "enabled", "Whether blocks are processed through the pipeline"},
+                        {RPCResult::Type::NUM, "threads", /*optional=*/true, "Number of decode/check worker threads"},
+                        {RPCResult::Type::OBJ, "queues", /*optional=*/true, "Number of blocks in each stage",
+                        {
+                            {RPCResult::Type::NUM, "decode", "Blocks waiting to be decoded and checked"},
+                            {RPCResult::Type::NUM, "checking", "Blocks being decoded or checked"},
+                            {RPCResult::Type::NUM, "reorder", "Checked blocks waiting for an earlier block"},
+                            {RPCResult::Type::NUM, "connect", "Checked blocks waiting to be connected"},
+                        }},
+                        {RPCResult::Type::NUM, "submitted", /*optional=*/true, "Total number of blocks submitted"},
+                        {RPCResult::Type::NUM, "completed", /*optional=*/true, "Total number of blocks handed to validation"},
+                        {RPCResult::Type::NUM, "decode_failures", /*optional=*/true, "Blocks that could not be deserialized"},
+                        {RPCResult::Type::NUM, "check_failures", /*optional=*/true, "Blocks that failed the context-free checks"},
+                        {RPCResult::Type::OBJ, "time", /*optional=*/true, "Cumulative time spent in each stage, in milliseconds",
+                        {
+                            {RPCResult::Type::NUM, "submit_wait", "Time the message handler waited for a full pipeline"},
+                            {RPCResult::Type::NUM, "decode", "Time spent deserializing blocks"},
+                            {RPCResult::Type::NUM, "check", "Time spent in the context-free checks"},
+                            {RPCResult::Type::NUM, "connect_wait", "Time checked blocks waited for the connect stage"},
+                            {RPCResult::Type::NUM, "connect", "Time spent accepting and connecting blocks"},
+                        }},
+                    }},
+                RPCExamples{
+                    HelpExampleCli("getblockpipelineinfo", "")
+            + HelpExampleRpc("getblockpipelineinfo", "")
+                },
+        [&](const RPCHelpMan& self, const JSONRPCRequest& request) -> UniValue
+{
+    const NodeContext& node = EnsureAnyNodeContext(request.context);
+    const PeerManager& peerman = EnsurePeerman(node);
+
+    UniValue ret(UniValue::VOBJ);
+    BlockPipelineStats stats;
+    if (!peerman.GetBlockPipelineStats(stats)) {
+        ret.pushKV("enabled", false);
+        return ret;
+    }
+    const auto to_ms = [](std::chrono::microseconds t) { return count_microseconds(t) / 1000.0; };
+    ret.pushKV("enabled", true);
+    ret.pushKV("threads", stats.workers);
+    UniValue queues(UniValue::VOBJ);
+    queues.pushKV("decode", (uint64_t)stats.decode_queue);
+    queues.pushKV("checking", (uint64_t)stats.in_progress);
+    queues.pushKV("reorder", (uint64_t)stats.reorder_queue);
+    queues.pushKV("connect", (uint64_t)stats.connect_queue);
+    ret.pushKV("queues", queues);
+    ret.pushKV("submitted", stats.submitted);
+    ret.pushKV("completed", stats.completed);
+    ret.pushKV("decode_failures", stats.decode_failures);
+    ret.pushKV("check_failures", stats.check_failures);
+    UniValue time(UniValue::VOBJ);
+    time.pushKV("submit_wait", to_ms(stats.submit_wait_time));
+    time.pushKV("decode", to_ms(stats.decode_time));
+    time.pushKV("check", to_ms(stats.check_time));
+    time.pushKV("connect_wait", to_ms(stats.connect_wait_time));
+    time.pushKV("connect", to_ms(stats.connect_time));
+    ret.pushKV("time", time);
+    return ret;
+},
+    };
+}
+
 static RPCHelpMan preciousblock()
 {
     return RPCHelpMan{"preciousblock",
@@ -2825,6 +2983,69 @@ UniValue CreateUTXOSnapshot(
     return result;
 }
 
+static RPCHelpMan loadtxoutset()
+{
+    return RPCHelpMan{
+        "loadtxoutset",
+        "Load the serialized UTXO set from disk and make it the active chainstate.\n"
+        "Once loaded, the node syncs from the base block of the snapshot onwards, while the blocks beneath it are\n"
+        "downloaded and validated in the background. The snapshot is retired once they produced the same UTXO set.\n"
+        "The header of the base block must be known, the mempool must be empty and pruning must be disabled.\n"
+        "The base block must be one of the assumeutxo chain parameters. This may take a while.",
+        {
+            {"path", RPCArg::Type::STR, RPCArg::Optional::NO, "Path to the snapshot file. If relative, will be prefixed by datadir."},
+        },
+        RPCResult{
+            RPCResult::Type::OBJ, "", "",
+                {
+                    {RPCResult::Type::NUM, "coins_loaded", "the number of coins loaded from the snapshot"},
+                    {RPCResult::Type::STR_HEX, "tip_hash", "the hash of the base of the snapshot"},
+                    {RPCResult::Type::NUM, "base_height", "the height of the base of the snapshot"},
+                    {RPCResult::Type::STR, "path", "the absolute path that the snapshot was loaded from"},
+                }
+        },
+        RPCExamples{
+            HelpExampleCli("loadtxoutset", "utxo.dat")
+        },
+        [&](const RPCHelpMan& self, const JSONRPCRequest& request) -> UniValue
+{
+    NodeContext& node = EnsureAnyNodeContext(request.context);
+    ChainstateManager& chainman = EnsureChainman(node);
+    const fs::path path{fsbridge::AbsPathJoin(EnsureAnyArgsman(request.context).GetDataDirNet(), fs::u8path(request.params[0].get_str()))};
+
+    FILE* file{fsbridge::fopen(path, "rb")};
+    CAutoFile afile{file, SER_DISK, CLIENT_VERSION};
+    if (afile.IsNull()) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Couldn't open file " + path.u8string() + " for reading.");
+    }
+
+    SnapshotMetadata metadata;
+    try {
+        afile >> metadata;
+    } catch (const std::ios_base::failure& e) {
+        throw JSONRPCError(RPC_DESERIALIZATION_ERROR, strprintf("Unable to parse snapshot metadata: %s", e.what()));
+    }
+
+    const CBlockIndex* snapshot_start_block{WITH_LOCK(::cs_main, return chainman.m_blockman.LookupBlockIndex(metadata.m_base_blockhash))};
+    if (!snapshot_start_block) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER,
+            strprintf("The base block header (%s) must appear in the headers chain. Make sure all headers are syncing, and call this RPC again.",
+                      metadata.m_base_blockhash.ToString()));
+    }
+    if (!chainman.ActivateSnapshot(afile, metadata, /*in_memory=*/false)) {
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to load UTXO snapshot " + path.u8string() + ", see debug.log for details");
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("coins_loaded", metadata.m_coins_count);
+    result.pushKV("tip_hash", snapshot_start_block->GetBlockHash().ToString());
+    result.pushKV("base_height", snapshot_start_block->nHeight);
+    result.pushKV("path", path.u8string());
+    return result;
+},
+    };
+}
+
 void RegisterBlockchainRPCCommands(CRPCTable &t)
 {
 // clang-format off
@@ -2838,6 +3059,7 @@ static const CRPCCommand commands[] =
     { "blockchain",         &getblockcount,                      },
     { "blockchain",         &getblock,                           },
     { "blockchain",         &getblockfrompeer,                   },
+    { "blockchain",         &getblockpipelineinfo,               },
     { "blockchain",         &getblockhash,                       },
     { "blockchain",         &getblockheader,                     },
     { "blockchain",         &getchaintips,                       },
@@ -2866,6 +3088,7 @@ static const CRPCCommand commands[] =
     { "hidden",              &waitforblockheight,                },
     { "hidden",              &syncwithvalidationinterfacequeue,  },
     { "hidden",              &dumptxoutset,                      },
+    { "hidden",              &loadtxoutset,                      },
 };
 // clang-format on
     for (const auto& c : commands) {
@@ -8,10 +8,14 @@
 #include <consensus/amount.h>
 #include <core_io.h>
 #include <fs.h>
+#include <primitives/transaction.h>
 #include <streams.h>
 #include <sync.h>
+#include <uint256.h>
 
 #include <any>
+#include <chrono>
+#include <optional>
 #include <stdint.h>
 #include <vector>
 
@@ -48,6 +52,50 @@ UniValue MempoolInfoToJSON(const CTxMemPool& pool);
 /** Mempool to JSON */
 UniValue MempoolToJSON(const CTxMemPool& pool, bool verbose = false, bool include_mempool_sequence = false);
 
+/** What getrawmempool reports about a mempool entry, copied out of the
+ *  mempool so it can be written out without holding its lock. */
+struct MempoolEntryInfo {
+    CTransactionRef tx;
+    int64_t vsize;
+    int64_t weight;
+    CAmount fee;
+    CAmount modified_fee;
+    std::chrono::seconds time;
+    unsigned int height;
+    uint64_t descendant_count;
+    uint64_t descendant_size;
+    CAmount descendant_fees;
+    uint64_t ancestor_count;
+    uint64_t ancestor_size;
+    CAmount ancestor_fees;
+    std::vector<uint256> depends;
+    std::vector<uint256> spentby;
+    bool bip125_replaceable;
+    bool unbroadcast;
+};
+
+/** All mempool entries, copied at one mempool sequence */
+struct MempoolSnapshot {
+    uint64_t mempool_sequence;
+    std::vector<MempoolEntryInfo> entries;
+};
+
+/** Copy all mempool entries. The mempool is only locked while they are copied. */
+MempoolSnapshot GetMempoolSnapshot(const CTxMemPool& pool);
+
+/** Entries of the transactions added to the mempool since a mempool sequence, and ids of those removed */
+struct MempoolChanges {
+    uint64_t mempool_sequence;
+    std::vector<MempoolEntryInfo> added;
+    std::vector<uint256> removed;
+};
+
+/** Get the changes to the mempool since its sequence was `since`, if they are still known. See CTxMemPool::GetChangesSince. */
+std::optional<MempoolChanges> GetMempoolChanges(const CTxMemPool& pool, uint64_t since);
+
+/** Mempool entry to JSON, as reported by getrawmempool */
+UniValue MempoolEntryToJSON(const MempoolEntryInfo& entry);
+
 /** Block header to JSON */
 UniValue blockheaderToJSON(const CBlockIndex* tip, const CBlockIndex* blockindex) LOCKS_EXCLUDED(cs_main);
 
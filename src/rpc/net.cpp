@@ -21,6 +21,7 @@
 #include <rpc/util.h>
 #include <sync.h>
 #include <timedata.h>
+#include <txorphanage.h>
 #include <util/strencodings.h>
 #include <util/string.h>
 #include <util/translation.h>
@@ -500,6 +501,55 @@ static RPCHelpMan getaddednodeinfo()
     };
 }
 
+static RPCHelpMan getorphaninfo()
+{
+    return RPCHelpMan{"getorphaninfo",
+                "\nReturns statistics of the orphan pool, which holds transactions received from peers whose inputs are missing.\n",
+                {},
+                RPCResult{
+                    RPCResult::Type::OBJ, "", "",
+                    {
+                        {RPCResult::Type::NUM, "size", "Number of orphan transactions"},
+                        {RPCResult::Type::NUM, "weight", "Total weight of the orphan transactions"},
+                        {RPCResult::Type::NUM, "announcements", "Number of orphan transactions announced by each peer, summed up"},
+                        {RPCResult::Type::NUM, "peers", "Number of peers that announced orphan transactions"},
+                        {RPCResult::Type::NUM, "outpoints", "Number of outpoints spent by orphan transactions"},
+                        {RPCResult::Type::NUM, "added", "Orphan transactions added since startup"},
+                        {RPCResult::Type::NUM, "duplicates", "Announcements of orphan transactions that were already known"},
+                        {RPCResult::Type::NUM, "reconsidered", "Orphan transactions reconsidered for the mempool"},
+                        {RPCResult::Type::NUM, "deferred", "Orphan transactions not reconsidered as inputs were still missing"},
+                        {RPCResult::Type::NUM, "evicted", "Orphan transactions evicted to keep the pool within -maxorphantx"},
+                        {RPCResult::Type::NUM, "expired", "Orphan transactions erased as they expired"},
+                        {RPCResult::Type::NUM, "erased_for_block", "Orphan transactions erased as they were included in or conflicted by a block"},
+                    }},
+                RPCExamples{
+                    HelpExampleCli("getorphaninfo", "")
+            + HelpExampleRpc("getorphaninfo", "")
+                },
+        [&](const RPCHelpMan& self, const JSONRPCRequest& request) -> UniValue
+{
+    const NodeContext& node = EnsureAnyNodeContext(request.context);
+    const PeerManager& peerman = EnsurePeerman(node);
+
+    const TxOrphanageStats stats{peerman.GetOrphanStats()};
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("size", (uint64_t)stats.orphans);
+    ret.pushKV("weight", (uint64_t)stats.weight);
+    ret.pushKV("announcements", (uint64_t)stats.announcements);
+    ret.pushKV("peers", (uint64_t)stats.peers);
+    ret.pushKV("outpoints", (uint64_t)stats.outpoints);
+    ret.pushKV("added", stats.added);
+    ret.pushKV("duplicates", stats.duplicates);
+    ret.pushKV("reconsidered", stats.reconsidered);
+    ret.pushKV("deferred", stats.deferred);
+    ret.pushKV("evicted", stats.evicted);
+    ret.pushKV("expired", stats.expired);
+    ret.pushKV("erased_for_block", stats.erased_for_block);
+    return ret;
+},
+    };
+}
+
 static RPCHelpMan getnettotals()
 {
     return RPCHelpMan{"getnettotals",
@@ -590,6 +640,15 @@ static RPCHelpMan getnetworkinfo()
                         {RPCResult::Type::NUM, "connections", "the total number of connections"},
                         {RPCResult::Type::NUM, "connections_in", "the number of inbound connections"},
                         {RPCResult::Type::NUM, "connections_out", "the number of outbound connections"},
+                        {RPCResult::Type::ARR, "message_handlers", "the message handler threads, between which the peers are divided (see -msghandthreads)",
+                        {
+                            {RPCResult::Type::OBJ, "", "",
+                            {
+                                {RPCResult::Type::NUM, "peers", "the number of connected peers whose messages the thread handles"},
+                                {RPCResult::Type::NUM, "busy_time", "seconds spent processing and sending messages since the thread started, including waiting for other threads to finish messages that are not processed in parallel"},
+                                {RPCResult::Type::NUM, "utilization", "busy_time as a fraction of the time since the thread started"},
+                            }},
+                        }},
                         {RPCResult::Type::BOOL, "networkactive", "whether p2p networking is enabled"},
                         {RPCResult::Type::ARR, "networks", "information per network",
                         {
@@ -642,6 +701,15 @@ static RPCHelpMan getnetworkinfo()
         obj.pushKV("connections", (int)node.connman->GetNodeCount(ConnectionDirection::Both));
         obj.pushKV("connections_in", (int)node.connman->GetNodeCount(ConnectionDirection::In));
         obj.pushKV("connections_out", (int)node.connman->GetNodeCount(ConnectionDirection::Out));
+        UniValue handlers(UniValue::VARR);
+        for (const MessageHandlerStats& stats : node.connman->GetMessageHandlerStats()) {
+            UniValue handler(UniValue::VOBJ);
+            handler.pushKV("peers", stats.nodes);
+            handler.pushKV("busy_time", CountSecondsDouble(stats.busy_time));
+            handler.pushKV("utilization", stats.run_time > 0s ? CountSecondsDouble(stats.busy_time) / CountSecondsDouble(stats.run_time) : 0.0);
+            handlers.push_back(handler);
+        }
+        obj.pushKV("message_handlers", handlers);
     }
     obj.pushKV("networks",      GetNetworksInfo());
     obj.pushKV("relayfee",      ValueFromAmount(::minRelayTxFee.GetFeePerK()));
@@ -972,6 +1040,7 @@ static const CRPCCommand commands[] =
     { "network",             &disconnectnode,          },
     { "network",             &getaddednodeinfo,        },
     { "network",             &getnettotals,            },
+    { "network",             &getorphaninfo,           },
     { "network",             &getnetworkinfo,          },
     { "network",             &setban,                  },
     { "network",             &listbanned,              },
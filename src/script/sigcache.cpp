@@ -7,6 +7,7 @@
 
 #include <pubkey.h>
 #include <random.h>
+#include <streams.h>
 #include <uint256.h>
 #include <util/system.h>
 
@@ -27,28 +28,34 @@ class CSignatureCache
 {
 private:
      //! Entries are SHA256(nonce || 'E' or 'S' || 31 zero bytes || signature hash || public key || signature):
+    uint256 m_nonce;
     CSHA256 m_salted_hasher_ecdsa;
     CSHA256 m_salted_hasher_schnorr;
     typedef CuckooCache::cache<uint256, SignatureCacheHasher> map_type;
     map_type setValid;
     std::shared_mutex cs_sigcache;
 
-public:
-    CSignatureCache()
+    void Salt(const uint256& nonce)
     {
-        uint256 nonce = GetRandHash();
+        m_nonce = nonce;
         // We want the nonce to be 64 bytes long to force the hasher to process
         // this chunk, which makes later hash computations more efficient. We
         // just write our 32-byte entropy, and then pad with 'E' for ECDSA and
         // 'S' for Schnorr (followed by 0 bytes).
         static constexpr unsigned char PADDING_ECDSA[32] = {'E'};
         static constexpr unsigned char PADDING_SCHNORR[32] = {'S'};
-        m_salted_hasher_ecdsa.Write(nonce.begin(), 32);
+        m_salted_hasher_ecdsa.Reset().Write(nonce.begin(), 32);
         m_salted_hasher_ecdsa.Write(PADDING_ECDSA, 32);
-        m_salted_hasher_schnorr.Write(nonce.begin(), 32);
+        m_salted_hasher_schnorr.Reset().Write(nonce.begin(), 32);
         m_salted_hasher_schnorr.Write(PADDING_SCHNORR, 32);
     }
 
+public:
+    CSignatureCache()
+    {
+        Salt(GetRandHash());
+    }
+
     void
     ComputeEntryECDSA(uint256& entry, const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubkey) const
     {
@@ -79,6 +86,31 @@ public:
     {
         return setValid.setup_bytes(n);
     }
+
+    void Dump(CAutoFile& file)
+    {
+        std::vector<uint256> entries;
+        uint256 nonce;
+        {
+            std::unique_lock<std::shared_mutex> lock(cs_sigcache);
+            nonce = m_nonce;
+            setValid.for_each([&](const uint256& entry) { entries.push_back(entry); });
+        }
+        file << nonce << entries;
+    }
+
+    size_t Load(CAutoFile& file)
+    {
+        uint256 nonce;
+        std::vector<uint256> entries;
+        file >> nonce >> entries;
+        std::unique_lock<std::shared_mutex> lock(cs_sigcache);
+        Salt(nonce);
+        for (const uint256& entry : entries) {
+            setValid.insert(entry);
+        }
+        return entries.size();
+    }
 };
 
 /* In previous versions of this code, signatureCache was a local static variable
@@ -102,6 +134,16 @@ void InitSignatureCache()
             (nElems*sizeof(uint256)) >>20, (nMaxCacheSize*2)>>20, nElems);
 }
 
+void DumpSignatureCache(CAutoFile& file)
+{
+    signatureCache.Dump(file);
+}
+
+size_t LoadSignatureCache(CAutoFile& file)
+{
+    return signatureCache.Load(file);
+}
+
 bool CachingTransactionSignatureChecker::VerifyECDSASignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
     uint256 entry;
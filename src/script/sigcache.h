@@ -19,6 +19,7 @@ static const unsigned int DEFAULT_MAX_SIG_CACHE_SIZE = 32;
 // Maximum sig cache size allowed
 static const int64_t MAX_MAX_SIG_CACHE_SIZE = 16384;
 
+class CAutoFile;
 class CPubKey;
 
 class CachingTransactionSignatureChecker : public TransactionSignatureChecker
@@ -35,4 +36,11 @@ public:
 
 void InitSignatureCache();
 
+/** Write the salt and the entries of the signature cache to file. */
+void DumpSignatureCache(CAutoFile& file);
+/** Replace the salt of the signature cache with the one in file and add the
+ *  entries computed with it. Returns the number of entries read. Must be
+ *  called before the cache is used. */
+size_t LoadSignatureCache(CAutoFile& file);
+
 #endif // BITCOIN_SCRIPT_SIGCACHE_H
@@ -0,0 +1,182 @@
+// Copyright (c) 2022 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+#define BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+
+#include <memusage.h>
+
+#include <array>
+#include <cstddef>
+#include <new>
+#include <vector>
+
+/**
+ * Memory resource that carves small blocks out of large chunks.
+ *
+ * Node based containers make one allocation per element, and malloc adds its
+ * own header and rounding to each of them. Here, a block only occupies its
+ * size rounded up to ALIGN_BYTES. Freed blocks are kept in a free list per
+ * size and handed out again before new chunk memory is used. Chunks are only
+ * returned to the system when the resource is destroyed.
+ *
+ * Blocks larger than MAX_BLOCK_SIZE_BYTES, or with a stricter alignment, are
+ * passed through to ::operator new.
+ *
+ * Not thread safe: the containers sharing a resource must be synchronized
+ * externally, and the resource has to outlive them.
+ */
+class PoolResource
+{
+public:
+    static constexpr size_t ALIGN_BYTES{alignof(std::max_align_t)};
+    static constexpr size_t MAX_BLOCK_SIZE_BYTES{512};
+    static constexpr size_t CHUNK_SIZE_BYTES{256 * 1024};
+
+private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    //! Free lists, indexed by block size in units of ALIGN_BYTES
+    std::array<FreeBlock*, MAX_BLOCK_SIZE_BYTES / ALIGN_BYTES + 1> m_free_lists{};
+    std::vector<std::byte*> m_chunks;
+    //! Unused remainder of the most recent chunk
+    std::byte* m_available_begin{nullptr};
+    std::byte* m_available_end{nullptr};
+    //! Bytes in blocks currently handed out
+    size_t m_used_bytes{0};
+    //! Estimated usage of the allocations passed through to ::operator new
+    size_t m_fallback_usage{0};
+
+    static constexpr size_t NumUnits(size_t bytes)
+    {
+        return bytes == 0 ? 1 : (bytes + ALIGN_BYTES - 1) / ALIGN_BYTES;
+    }
+
+    static constexpr bool IsPooled(size_t bytes, size_t alignment)
+    {
+        return bytes <= MAX_BLOCK_SIZE_BYTES && alignment <= ALIGN_BYTES;
+    }
+
+    void PushFree(void* p, size_t units)
+    {
+        m_free_lists[units] = new (p) FreeBlock{m_free_lists[units]};
+    }
+
+    void AllocateChunk()
+    {
+        // Keep what is left of the previous chunk available for smaller blocks.
+        const size_t remaining_units = (m_available_end - m_available_begin) / ALIGN_BYTES;
+        if (remaining_units > 0) PushFree(m_available_begin, remaining_units);
+        m_chunks.push_back(static_cast<std::byte*>(::operator new(CHUNK_SIZE_BYTES)));
+        m_available_begin = m_chunks.back();
+        m_available_end = m_available_begin + CHUNK_SIZE_BYTES;
+    }
+
+public:
+    PoolResource() = default;
+    PoolResource(const PoolResource&) = delete;
+    PoolResource& operator=(const PoolResource&) = delete;
+
+    ~PoolResource()
+    {
+        for (std::byte* chunk : m_chunks) ::operator delete(chunk);
+    }
+
+    void* Allocate(size_t bytes, size_t alignment)
+    {
+        if (!IsPooled(bytes, alignment)) {
+            m_fallback_usage += memusage::MallocUsage(bytes);
+            return ::operator new(bytes, std::align_val_t{alignment});
+        }
+        const size_t units{NumUnits(bytes)};
+        m_used_bytes += units * ALIGN_BYTES;
+        if (FreeBlock* block = m_free_lists[units]) {
+            m_free_lists[units] = block->next;
+            return block;
+        }
+        if (size_t(m_available_end - m_available_begin) < units * ALIGN_BYTES) AllocateChunk();
+        void* p{m_available_begin};
+        m_available_begin += units * ALIGN_BYTES;
+        return p;
+    }
+
+    void Deallocate(void* p, size_t bytes, size_t alignment) noexcept
+    {
+        if (!IsPooled(bytes, alignment)) {
+            m_fallback_usage -= memusage::MallocUsage(bytes);
+            ::operator delete(p, std::align_val_t{alignment});
+            return;
+        }
+        const size_t units{NumUnits(bytes)};
+        m_used_bytes -= units * ALIGN_BYTES;
+        PushFree(p, units);
+    }
+
+    /**
+     * Memory allocated from the system: all chunks, including their free
+     * blocks and unused remainder, and the blocks passed through to
+     * ::operator new.
+     */
+    size_t DynamicMemoryUsage() const
+    {
+        return memusage::MallocUsage(CHUNK_SIZE_BYTES) * m_chunks.size() + memusage::DynamicUsage(m_chunks) + m_fallback_usage;
+    }
+
+    //! Chunk memory not handed out, which is reused before new chunks are allocated
+    size_t FreeBytes() const { return CHUNK_SIZE_BYTES * m_chunks.size() - m_used_bytes; }
+
+    //! Number of chunks allocated so far
+    size_t NumChunks() const { return m_chunks.size(); }
+};
+
+/** Allocator that gets its memory from a PoolResource. */
+template <typename T>
+class PoolAllocator
+{
+    PoolResource* m_resource;
+
+    template <typename U>
+    friend class PoolAllocator;
+
+public:
+    using value_type = T;
+
+    explicit PoolAllocator(PoolResource& resource) noexcept : m_resource{&resource} {}
+
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>& other) noexcept : m_resource{other.m_resource} {}
+
+    template <typename U>
+    struct rebind {
+        using other = PoolAllocator<U>;
+    };
+
+    T* allocate(size_t n)
+    {
+        return static_cast<T*>(m_resource->Allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* p, size_t n) noexcept
+    {
+        m_resource->Deallocate(p, n * sizeof(T), alignof(T));
+    }
+
+    PoolResource& resource() const noexcept { return *m_resource; }
+
+    template <typename U>
+    friend bool operator==(const PoolAllocator& a, const PoolAllocator<U>& b) noexcept
+    {
+        return &a.resource() == &b.resource();
+    }
+
+    template <typename U>
+    friend bool operator!=(const PoolAllocator& a, const PoolAllocator<U>& b) noexcept
+    {
+        return !(a == b);
+    }
+};
+
+#endif // BITCOIN_SUPPORT_ALLOCATORS_POOL_H
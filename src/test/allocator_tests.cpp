@@ -2,10 +2,12 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <support/allocators/pool.h>
 #include <support/lockedpool.h>
 #include <util/system.h>
 
 #include <limits>
+#include <list>
 #include <memory>
 #include <stdexcept>
 #include <utility>
@@ -235,4 +237,60 @@ BOOST_AUTO_TEST_CASE(lockedpool_tests_live)
     BOOST_CHECK(pool.stats().used == initial.used);
 }
 
+BOOST_AUTO_TEST_CASE(pool_resource_tests)
+{
+    PoolResource resource;
+    constexpr size_t align{PoolResource::ALIGN_BYTES};
+    constexpr size_t chunk_size{PoolResource::CHUNK_SIZE_BYTES};
+    BOOST_CHECK_EQUAL(resource.DynamicMemoryUsage(), 0U);
+
+    // Blocks are rounded up to the alignment and carved from a single chunk
+    void* a0 = resource.Allocate(1, 1);
+    void* a1 = resource.Allocate(align + 1, align);
+    BOOST_CHECK_EQUAL(resource.FreeBytes(), chunk_size - 3 * align);
+    BOOST_CHECK_EQUAL(resource.NumChunks(), 1U);
+    BOOST_CHECK_GE(resource.DynamicMemoryUsage(), chunk_size);
+    BOOST_CHECK_EQUAL(static_cast<std::byte*>(a1) - static_cast<std::byte*>(a0), std::ptrdiff_t(align));
+    const size_t chunk_usage{resource.DynamicMemoryUsage()};
+
+    // A freed block is handed out again for the same size only. The chunk
+    // memory stays allocated.
+    resource.Deallocate(a1, align + 1, align);
+    BOOST_CHECK_EQUAL(resource.FreeBytes(), chunk_size - align);
+    BOOST_CHECK_EQUAL(resource.DynamicMemoryUsage(), chunk_usage);
+    void* a2 = resource.Allocate(align, align);
+    BOOST_CHECK(a2 != a1);
+    void* a3 = resource.Allocate(2 * align, align);
+    BOOST_CHECK(a3 == a1);
+
+    // Large blocks are not pooled
+    void* large = resource.Allocate(PoolResource::MAX_BLOCK_SIZE_BYTES + 1, align);
+    BOOST_CHECK_GT(resource.DynamicMemoryUsage(), chunk_usage + PoolResource::MAX_BLOCK_SIZE_BYTES);
+    resource.Deallocate(large, PoolResource::MAX_BLOCK_SIZE_BYTES + 1, align);
+    BOOST_CHECK_EQUAL(resource.DynamicMemoryUsage(), chunk_usage);
+    resource.Deallocate(a0, 1, 1);
+    resource.Deallocate(a2, align, align);
+    resource.Deallocate(a3, 2 * align, align);
+    BOOST_CHECK_EQUAL(resource.FreeBytes(), chunk_size);
+    BOOST_CHECK_EQUAL(resource.DynamicMemoryUsage(), chunk_usage);
+
+    // Containers allocate their nodes from the resource, which grows by chunks
+    {
+        std::list<uint64_t, PoolAllocator<uint64_t>> list{PoolAllocator<uint64_t>{resource}};
+        for (uint64_t i = 0; i < 100000; ++i) list.push_back(i);
+        const size_t chunks{resource.NumChunks()};
+        BOOST_CHECK_GT(chunks, 1U);
+        BOOST_CHECK_EQUAL(chunks * chunk_size - resource.FreeBytes(), 100000 * 2 * align);
+        BOOST_CHECK_GE(resource.DynamicMemoryUsage(), chunks * chunk_size);
+        const size_t usage{resource.DynamicMemoryUsage()};
+        list.clear();
+        BOOST_CHECK_EQUAL(resource.FreeBytes(), chunks * chunk_size);
+        BOOST_CHECK_EQUAL(resource.DynamicMemoryUsage(), usage);
+        for (uint64_t i = 0; i < 100000; ++i) list.push_back(i);
+        BOOST_CHECK_EQUAL(resource.NumChunks(), chunks);
+        BOOST_CHECK_EQUAL(resource.DynamicMemoryUsage(), usage);
+    }
+    BOOST_CHECK_EQUAL(resource.FreeBytes(), resource.NumChunks() * chunk_size);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,179 @@
+// Copyright (c) 2022 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <arenamap.h>
+#include <memusage.h>
+
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+BOOST_FIXTURE_TEST_SUITE(arenamap_tests, BasicTestingSetup)
+
+/** Hasher with few distinct values, so that probe sequences collide. */
+struct CollidingHasher {
+    size_t operator()(uint32_t key) const { return (key % 37) * 0x9e3779b97f4a7c15ULL; }
+};
+
+typedef arenamap<uint32_t, std::string, CollidingHasher> testmap;
+
+static void CheckEqual(const testmap& map, const std::map<uint32_t, std::string>& expected)
+{
+    BOOST_CHECK_EQUAL(map.size(), expected.size());
+    BOOST_CHECK_EQUAL(map.empty(), expected.empty());
+    size_t count{0};
+    for (const auto& [key, value] : map) {
+        const auto it{expected.find(key)};
+        BOOST_REQUIRE(it != expected.end());
+        BOOST_CHECK_EQUAL(value, it->second);
+        ++count;
+    }
+    BOOST_CHECK_EQUAL(count, expected.size());
+    for (const auto& [key, value] : expected) {
+        const auto it{map.find(key)};
+        BOOST_REQUIRE(it != map.end());
+        BOOST_CHECK_EQUAL(it->second, value);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(arenamap_random_operations)
+{
+    testmap map;
+    std::map<uint32_t, std::string> expected;
+
+    for (int i = 0; i < 20000; ++i) {
+        const uint32_t key = InsecureRandRange(1000);
+        switch (InsecureRandRange(5)) {
+        case 0:
+        case 1: {
+            const std::string value{std::to_string(InsecureRand32())};
+            const auto [it, inserted] = map.try_emplace(key, value);
+            const bool expect_inserted{expected.emplace(key, value).second};
+            BOOST_CHECK_EQUAL(inserted, expect_inserted);
+            BOOST_CHECK_EQUAL(it->first, key);
+            BOOST_CHECK_EQUAL(it->second, expected[key]);
+            break;
+        }
+        case 2:
+            map[key] += "x";
+            expected[key] += "x";
+            break;
+        case 3:
+            BOOST_CHECK_EQUAL(map.erase(key), expected.erase(key));
+            break;
+        case 4:
+            BOOST_CHECK_EQUAL(map.count(key), expected.count(key));
+            break;
+        }
+        if (i % 1000 == 0) CheckEqual(map, expected);
+    }
+    CheckEqual(map, expected);
+
+    map.clear();
+    expected.clear();
+    CheckEqual(map, expected);
+    BOOST_CHECK_EQUAL(memusage::DynamicUsage(map), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(arenamap_stability)
+{
+    testmap map;
+    std::vector<const std::string*> values;
+    for (uint32_t key = 0; key < 1000; ++key) {
+        values.push_back(&map.try_emplace(key, std::to_string(key)).first->second);
+    }
+    // Erase every other entry while iterating, and insert new ones. Neither
+    // moves the remaining entries, even though the table gets rehashed.
+    for (auto it = map.begin(); it != map.end();) {
+        if (it->first % 2) {
+            it = map.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    // Erased entries are reused before the arena grows.
+    const size_t chunks{map.chunk_count()};
+    for (uint32_t key = 1000; key < 1500; ++key) {
+        map.try_emplace(key, std::to_string(key));
+    }
+    BOOST_CHECK_EQUAL(map.chunk_count(), chunks);
+    for (uint32_t key = 1500; key < 5000; ++key) {
+        map.try_emplace(key, std::to_string(key));
+    }
+    BOOST_CHECK(map.chunk_count() > chunks);
+    for (uint32_t key = 0; key < 1000; key += 2) {
+        BOOST_CHECK_EQUAL(&map.find(key)->second, values[key]);
+        BOOST_CHECK_EQUAL(*values[key], std::to_string(key));
+    }
+    BOOST_CHECK_EQUAL(map.size(), 500U + 4000U);
+}
+
+BOOST_AUTO_TEST_CASE(arenamap_shrink_to_fit)
+{
+    testmap map;
+    std::map<uint32_t, std::string> expected;
+    for (uint32_t key = 0; key < 4000; ++key) {
+        map.try_emplace(key, std::to_string(key));
+        expected.emplace(key, std::to_string(key));
+    }
+    const size_t usage{memusage::DynamicUsage(map)};
+    // Keep every tenth entry, spread over the whole arena.
+    for (auto it = map.begin(); it != map.end();) {
+        if (it->first % 10) {
+            expected.erase(it->first);
+            it = map.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    BOOST_CHECK_EQUAL(memusage::DynamicUsage(map), usage);
+    map.shrink_to_fit();
+    CheckEqual(map, expected);
+    BOOST_CHECK_EQUAL(map.chunk_count(), (400 + testmap::CHUNK_SIZE - 1) / testmap::CHUNK_SIZE);
+    BOOST_CHECK(memusage::DynamicUsage(map) < usage / 5);
+
+    // The map keeps working as usual.
+    for (uint32_t key = 1; key < 4000; key += 10) {
+        map.try_emplace(key, std::to_string(key));
+        expected.emplace(key, std::to_string(key));
+    }
+    CheckEqual(map, expected);
+    for (auto it = map.begin(); it != map.end();) {
+        it = map.erase(it);
+    }
+    map.shrink_to_fit();
+    BOOST_CHECK_EQUAL(memusage::DynamicUsage(map), 0U);
+    map.try_emplace(7, "seven");
+    CheckEqual(map, {{7, "seven"}});
+}
+
+BOOST_AUTO_TEST_CASE(arenamap_move_and_memusage)
+{
+    testmap map;
+    BOOST_CHECK_EQUAL(memusage::DynamicUsage(map), 0U);
+    map.try_emplace(1, "one");
+    const size_t usage{memusage::DynamicUsage(map)};
+    BOOST_CHECK_EQUAL(map.chunk_count(), 1U);
+    BOOST_CHECK(usage >= testmap::CHUNK_BYTES);
+    // Entries within the first chunk and table do not allocate.
+    for (uint32_t key = 2; key <= 8; ++key) {
+        map.try_emplace(key, "");
+    }
+    BOOST_CHECK_EQUAL(memusage::DynamicUsage(map), usage);
+
+    testmap moved{std::move(map)};
+    BOOST_CHECK_EQUAL(moved.size(), 8U);
+    BOOST_CHECK_EQUAL(moved.find(1)->second, "one");
+    BOOST_CHECK(map.empty());
+    BOOST_CHECK(map.find(1) == map.end());
+    map.try_emplace(1, "again");
+    BOOST_CHECK_EQUAL(map.find(1)->second, "again");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,125 @@
+// Copyright (c) 2022 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <consensus/merkle.h>
+#include <node/blockpipeline.h>
+#include <pow.h>
+#include <streams.h>
+#include <sync.h>
+#include <version.h>
+
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <condition_variable>
+#include <vector>
+
+using node::BlockPipeline;
+using node::BlockPipelineStats;
+
+BOOST_FIXTURE_TEST_SUITE(blockpipeline_tests, RegTestingSetup)
+
+static CBlock BuildBlock(bool valid_merkle_root)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig.resize(10);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 42;
+
+    CBlock block;
+    block.vtx.push_back(MakeTransactionRef(tx));
+    tx.vin[0].prevout.hash = InsecureRand256();
+    tx.vin[0].prevout.n = 0;
+    block.vtx.push_back(MakeTransactionRef(tx));
+    block.nVersion = 42;
+    block.hashPrevBlock = InsecureRand256();
+    block.nBits = 0x207fffff;
+
+    bool mutated;
+    block.hashMerkleRoot = valid_merkle_root ? BlockMerkleRoot(block, &mutated) : InsecureRand256();
+    while (!CheckProofOfWork(block.GetHash(), block.nBits, Params().GetConsensus())) ++block.nNonce;
+    return block;
+}
+
+BOOST_AUTO_TEST_CASE(blockpipeline_order_and_failures)
+{
+    constexpr int NUM_BLOCKS{60};
+
+    Mutex mutex;
+    std::condition_variable cv;
+    std::vector<BlockPipeline::Result> results;
+
+    BlockPipeline pipeline{Params().GetConsensus(), /*worker_threads=*/4, [&](BlockPipeline::Result&& result) {
+        WITH_LOCK(mutex, results.push_back(std::move(result)));
+        cv.notify_one();
+    }};
+
+    std::vector<uint256> hashes;
+    for (int i = 0; i < NUM_BLOCKS; ++i) {
+        CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+        if (i % 11 == 5) {
+            // Truncated payload that cannot be deserialized
+            stream << uint32_t{42};
+            hashes.emplace_back();
+        } else {
+            const CBlock block{BuildBlock(/*valid_merkle_root=*/i % 7 != 3)};
+            stream << block;
+            hashes.push_back(block.GetHash());
+        }
+        // The peer id doubles as submission index so the order can be checked.
+        BOOST_CHECK(pipeline.Submit(/*peer=*/i, std::move(stream)));
+    }
+
+    {
+        WAIT_LOCK(mutex, lock);
+        cv.wait(lock, [&] { return results.size() == NUM_BLOCKS; });
+    }
+
+    int decode_failures{0};
+    int check_failures{0};
+    for (int i = 0; i < NUM_BLOCKS; ++i) {
+        const BlockPipeline::Result& result{results[i]};
+        // Blocks are handed to the connect stage in submission order.
+        BOOST_CHECK_EQUAL(result.peer, i);
+        if (i % 11 == 5) {
+            BOOST_CHECK(!result.block);
+            BOOST_CHECK(result.state.IsError());
+            ++decode_failures;
+        } else if (i % 7 == 3) {
+            BOOST_REQUIRE(result.block);
+            BOOST_CHECK(result.state.IsInvalid());
+            BOOST_CHECK_EQUAL(result.state.GetRejectReason(), "bad-txnmrklroot");
+            BOOST_CHECK(!result.block->fChecked);
+            ++check_failures;
+        } else {
+            BOOST_REQUIRE(result.block);
+            BOOST_CHECK(result.state.IsValid());
+            BOOST_CHECK(result.block->fChecked);
+            BOOST_CHECK(result.block->GetHash() == hashes[i]);
+        }
+    }
+
+    // Joining the threads makes sure the last completion has been accounted for.
+    pipeline.Stop();
+    const BlockPipelineStats stats{pipeline.GetStats()};
+    BOOST_CHECK_EQUAL(stats.workers, 4);
+    BOOST_CHECK_EQUAL(stats.submitted, uint64_t{NUM_BLOCKS});
+    BOOST_CHECK_EQUAL(stats.completed, uint64_t{NUM_BLOCKS});
+    BOOST_CHECK_EQUAL(stats.decode_failures, uint64_t(decode_failures));
+    BOOST_CHECK_EQUAL(stats.check_failures, uint64_t(check_failures));
+    BOOST_CHECK_EQUAL(stats.decode_queue, 0U);
+    BOOST_CHECK_EQUAL(stats.in_progress, 0U);
+    BOOST_CHECK_EQUAL(stats.reorder_queue, 0U);
+
+    // A stopped pipeline drops new blocks
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << BuildBlock(/*valid_merkle_root=*/true);
+    BOOST_CHECK(!pipeline.Submit(/*peer=*/NUM_BLOCKS, std::move(stream)));
+    BOOST_CHECK_EQUAL(pipeline.GetStats().submitted, uint64_t{NUM_BLOCKS});
+}
+
+BOOST_AUTO_TEST_SUITE_END()
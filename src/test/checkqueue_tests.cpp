@@ -434,4 +434,96 @@ BOOST_AUTO_TEST_CASE(test_CheckQueueControl_Locks)
         }
     }
 }
+
+/** Test that every task is taken exactly once when the owner and a thief race for the last one */
+BOOST_AUTO_TEST_CASE(test_CheckQueue_WorkDeque_Race)
+{
+    using Deque = Standard_Queue::WorkDeque;
+    constexpr size_t ROUNDS{20000};
+    constexpr size_t MAX_TASKS_PER_ROUND{3};
+    auto deque{std::make_unique<Deque>()};
+    std::vector<FakeCheck> checks(ROUNDS * MAX_TASKS_PER_ROUND);
+    std::vector<std::atomic<int>> taken(checks.size());
+    std::atomic<bool> done{false};
+
+    std::thread thief([&] {
+        while (!done.load()) {
+            Standard_Queue::Task task;
+            if (deque->Steal(task)) ++taken[task.begin - checks.data()];
+        }
+    });
+    size_t pushed{0};
+    for (size_t round = 0; round < ROUNDS; ++round) {
+        // Push a few tasks and pop them down to the last one, which the thief
+        // is most likely to be stealing at the same time.
+        const size_t count{1 + InsecureRandRange(MAX_TASKS_PER_ROUND)};
+        for (size_t i = 0; i < count; ++i, ++pushed) {
+            BOOST_REQUIRE(deque->Push({&checks[pushed], &checks[pushed] + 1, 1}));
+        }
+        Standard_Queue::Task task;
+        while (deque->Pop(task)) ++taken[task.begin - checks.data()];
+    }
+    done = true;
+    thief.join();
+
+    for (size_t i = 0; i < checks.size(); ++i) {
+        BOOST_REQUIRE_EQUAL(taken[i].load(), i < pushed ? 1 : 0);
+    }
+}
+
+/** Test that a full deque refuses tasks, and that the queue still runs all checks added then */
+BOOST_AUTO_TEST_CASE(test_CheckQueue_WorkDeque_Full)
+{
+    using Deque = Correct_Queue::WorkDeque;
+    auto deque{std::make_unique<Deque>()};
+    std::vector<FakeCheckCheckCompletion> checks(Deque::CAPACITY + 1);
+    for (int64_t i = 0; i < Deque::CAPACITY; ++i) {
+        BOOST_REQUIRE(deque->Push({&checks[i], &checks[i] + 1, 1}));
+    }
+    BOOST_CHECK(!deque->Push({&checks[Deque::CAPACITY], &checks[Deque::CAPACITY] + 1, 1}));
+    Correct_Queue::Task task;
+    BOOST_REQUIRE(deque->Steal(task));
+    BOOST_CHECK(task.begin == &checks[0]);
+    BOOST_CHECK(deque->Push({&checks[Deque::CAPACITY], &checks[Deque::CAPACITY] + 1, 1}));
+    BOOST_REQUIRE(deque->Pop(task));
+    BOOST_CHECK(task.begin == &checks[Deque::CAPACITY]);
+
+    // Without worker threads, every added batch stays on the master's deque
+    // until it is full, after which Add() runs some of them itself.
+    Correct_Queue queue{QUEUE_BATCH_SIZE};
+    FakeCheckCheckCompletion::n_calls = 0;
+    const size_t batches{Deque::CAPACITY * 2};
+    {
+        CCheckQueueControl<FakeCheckCheckCompletion> control(&queue);
+        for (size_t i = 0; i < batches; ++i) {
+            std::vector<FakeCheckCheckCompletion> batch(2);
+            control.Add(batch);
+        }
+        BOOST_CHECK(FakeCheckCheckCompletion::n_calls > 0);
+        BOOST_CHECK(control.Wait());
+    }
+    BOOST_CHECK_EQUAL(FakeCheckCheckCompletion::n_calls, batches * 2);
+}
+
+/** Test that all checks run once when the master and a single worker share the split work */
+BOOST_AUTO_TEST_CASE(test_CheckQueue_Master_And_One_Worker)
+{
+    auto queue = std::make_unique<Unique_Queue>(/*nBatchSizeIn=*/1);
+    queue->StartWorkerThreads(/*threads_num=*/1);
+    for (int i = 0; i < 100; ++i) {
+        {
+            LOCK(UniqueCheck::m);
+            UniqueCheck::results.clear();
+        }
+        {
+            CCheckQueueControl<UniqueCheck> control(queue.get());
+            std::vector<UniqueCheck> checks;
+            for (size_t id = 0; id < 1000; ++id) checks.emplace_back(id);
+            control.Add(checks);
+        }
+        LOCK(UniqueCheck::m);
+        BOOST_REQUIRE_EQUAL(UniqueCheck::results.size(), 1000U);
+    }
+    queue->StopWorkerThreads();
+}
 BOOST_AUTO_TEST_SUITE_END()
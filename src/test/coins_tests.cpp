@@ -878,4 +878,116 @@ BOOST_AUTO_TEST_CASE(ccoins_write)
                     CheckWriteCoins(parent_value, child_value, parent_value, parent_flags, child_flags, parent_flags);
 }
 
+BOOST_AUTO_TEST_CASE(ccoins_write_behind)
+{
+    CCoinsViewDB db{"test", /*nCacheSize=*/1 << 20, /*fMemory=*/true, /*fWipe=*/false};
+    db.StartWriteBehind();
+
+    std::vector<COutPoint> outpoints;
+    for (int round = 0; round < 5; ++round) {
+        CCoinsViewCache cache{&db};
+        // Spend a coin of the previous round, which may still be being written.
+        if (!outpoints.empty()) {
+            BOOST_CHECK(cache.SpendCoin(outpoints.back()));
+            outpoints.pop_back();
+        }
+        for (int i = 0; i < 100; ++i) {
+            outpoints.emplace_back(InsecureRand256(), 0);
+            cache.AddCoin(outpoints.back(), Coin{CTxOut{CAmount(InsecureRandRange(1000)), CScript{} << OP_TRUE}, 1, false}, /*possible_overwrite=*/false);
+        }
+        const uint256 best_block{InsecureRand256()};
+        cache.SetBestBlock(best_block);
+        // Sync hands over a copy of the modified coins, Flush the coins themselves.
+        BOOST_CHECK(round % 2 ? cache.Sync() : cache.Flush());
+
+        // Reads are served the flushed state whether or not it reached the disk yet.
+        BOOST_CHECK(db.GetBestBlock() == best_block);
+        for (const COutPoint& outpoint : outpoints) {
+            BOOST_CHECK(db.HaveCoin(outpoint));
+        }
+    }
+    BOOST_CHECK(db.WaitForWrites());
+    BOOST_CHECK(!db.HasPendingWrite());
+    BOOST_CHECK_EQUAL(db.PendingMemoryUsage(), 0U);
+    BOOST_CHECK(!db.WriteFailed());
+
+    size_t num_coins{0};
+    for (auto cursor{db.Cursor()}; cursor->Valid(); cursor->Next()) ++num_coins;
+    BOOST_CHECK_EQUAL(num_coins, outpoints.size());
+    for (const COutPoint& outpoint : outpoints) {
+        Coin coin;
+        BOOST_CHECK(db.GetCoin(outpoint, coin));
+    }
+    BOOST_CHECK(db.GetHeadBlocks().empty());
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_sync_and_trim)
+{
+    CCoinsViewDB db{"test", /*nCacheSize=*/1 << 20, /*fMemory=*/true, /*fWipe=*/false};
+    CCoinsViewCache cache{&db};
+
+    // Coins at heights 1 to 10, the first of each height to be spent.
+    std::vector<COutPoint> outpoints;
+    for (int height = 1; height <= 10; ++height) {
+        for (int i = 0; i < 100; ++i) {
+            outpoints.emplace_back(InsecureRand256(), 0);
+            cache.AddCoin(outpoints.back(), Coin{CTxOut{CAmount(InsecureRandRange(1000)), CScript{} << OP_TRUE}, height, false}, /*possible_overwrite=*/false);
+        }
+    }
+    cache.SetBestBlock(InsecureRand256());
+    BOOST_CHECK(cache.Flush());
+    for (size_t i = 0; i < outpoints.size(); i += 100) {
+        BOOST_CHECK(cache.SpendCoin(outpoints[i]));
+    }
+    // A coin read from the database is cached but not modified.
+    BOOST_CHECK(cache.HaveCoin(outpoints[1]));
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 11U);
+
+    // Sync writes the spends, keeping the unspent coins.
+    cache.SetBestBlock(InsecureRand256());
+    BOOST_CHECK(cache.Sync());
+    BOOST_CHECK(db.GetBestBlock() == cache.GetBestBlock());
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 1U);
+    BOOST_CHECK(cache.HaveCoinInCache(outpoints[1]));
+    for (size_t i = 0; i < outpoints.size(); i += 100) {
+        BOOST_CHECK(!db.HaveCoin(outpoints[i]));
+    }
+
+    // Coins that are kept by Sync are no longer modified, so they can be uncached.
+    cache.Uncache(outpoints[1]);
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 0U);
+    for (const COutPoint& outpoint : outpoints) {
+        cache.AccessCoin(outpoint);
+    }
+    const COutPoint added{InsecureRand256(), 0};
+    cache.AddCoin(added, Coin{CTxOut{1, CScript{} << OP_TRUE}, 1, false}, /*possible_overwrite=*/false);
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 991U);
+
+    // Trimming keeps the modified coin and the most recent coins.
+    const size_t usage{cache.DynamicMemoryUsage()};
+    BOOST_CHECK(cache.Trim(usage));
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 991U);
+    BOOST_CHECK(cache.Trim(usage / 2));
+    BOOST_CHECK(cache.DynamicMemoryUsage() <= usage / 2);
+    BOOST_CHECK(cache.GetCacheSize() > 0U);
+    BOOST_CHECK(cache.HaveCoinInCache(added));
+    BOOST_CHECK(cache.HaveCoinInCache(outpoints.back()));
+    BOOST_CHECK(!cache.HaveCoinInCache(outpoints[1]));
+    std::vector<int> cached_per_height(11);
+    for (size_t i = 0; i < outpoints.size(); ++i) {
+        if (i % 100 && cache.HaveCoinInCache(outpoints[i])) ++cached_per_height[i / 100 + 1];
+    }
+    for (uint32_t height = 2; height <= 10; ++height) {
+        if (cached_per_height[height - 1] > 0) BOOST_CHECK_EQUAL(cached_per_height[height], 99);
+    }
+    // Modified coins are never evicted.
+    BOOST_CHECK(!cache.Trim(0));
+    BOOST_CHECK(cache.HaveCoinInCache(added));
+
+    // Evicted coins are still read from the database.
+    BOOST_CHECK(cache.HaveCoin(outpoints[1]));
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(db.HaveCoin(added));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,143 @@
+// Copyright (c) 2022 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <coins.h>
+#include <node/coinsprefetch.h>
+#include <txdb.h>
+
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <memory>
+#include <vector>
+
+using node::CoinsPrefetcher;
+using node::CoinsPrefetchStats;
+
+BOOST_FIXTURE_TEST_SUITE(coinsprefetch_tests, BasicTestingSetup)
+
+/** Write num_coins coins to db and return their outpoints. */
+static std::vector<COutPoint> AddDBCoins(CCoinsViewDB& db, int num_coins)
+{
+    CCoinsViewCache cache{&db};
+    std::vector<COutPoint> outpoints;
+    for (int i = 0; i < num_coins; ++i) {
+        const COutPoint outpoint{InsecureRand256(), 0};
+        cache.AddCoin(outpoint, Coin{CTxOut{1000, CScript{} << OP_TRUE}, /*nHeightIn=*/1, /*fCoinBaseIn=*/false}, /*possible_overwrite=*/false);
+        outpoints.push_back(outpoint);
+    }
+    cache.SetBestBlock(InsecureRand256());
+    BOOST_REQUIRE(cache.Flush());
+    return outpoints;
+}
+
+/** A block spending the given outpoints, one unknown outpoint and an output created within the block. */
+static std::shared_ptr<const CBlock> BuildBlock(const std::vector<COutPoint>& spent)
+{
+    auto block{std::make_shared<CBlock>()};
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vout.resize(1);
+    block->vtx.push_back(MakeTransactionRef(coinbase));
+
+    CMutableTransaction tx;
+    for (const COutPoint& outpoint : spent) {
+        tx.vin.emplace_back(outpoint);
+    }
+    tx.vin.emplace_back(COutPoint{InsecureRand256(), 0});
+    tx.vout.resize(1);
+    const CTransactionRef parent{MakeTransactionRef(tx)};
+    block->vtx.push_back(parent);
+
+    CMutableTransaction child;
+    child.vin.emplace_back(COutPoint{parent->GetHash(), 0});
+    child.vout.resize(1);
+    block->vtx.push_back(MakeTransactionRef(child));
+    // Prefetches are keyed by block hash.
+    block->nNonce = InsecureRand32();
+    return block;
+}
+
+BOOST_AUTO_TEST_CASE(coinsprefetch_merge)
+{
+    CCoinsViewDB db{"prefetch_db", /*nCacheSize=*/1 << 20, /*fMemory=*/true, /*fWipe=*/false};
+    const std::vector<COutPoint> outpoints{AddDBCoins(db, 200)};
+    const auto block{BuildBlock(outpoints)};
+
+    CoinsPrefetcher prefetcher{Params().GetConsensus(), /*worker_threads=*/3};
+    prefetcher.Prefetch(block, db);
+
+    // A coin spent in the cache must not be resurrected by the prefetch.
+    CCoinsViewCache cache{&db};
+    BOOST_CHECK(cache.SpendCoin(outpoints[0]));
+
+    BOOST_CHECK(prefetcher.Merge(block->GetHash(), db, cache) == block);
+    for (const COutPoint& outpoint : outpoints) {
+        if (outpoint == outpoints[0]) {
+            BOOST_CHECK(!cache.HaveCoin(outpoint));
+        } else {
+            BOOST_CHECK(cache.HaveCoinInCache(outpoint));
+        }
+    }
+    BOOST_CHECK(!cache.HaveCoinInCache(block->vtx[2]->vin[0].prevout));
+
+    const CoinsPrefetchStats stats{prefetcher.GetStats()};
+    BOOST_CHECK_EQUAL(stats.blocks, 1U);
+    // Inputs spending outputs created within the block are not looked up.
+    BOOST_CHECK_EQUAL(stats.lookups, outpoints.size() + 1);
+    BOOST_CHECK_EQUAL(stats.hits, outpoints.size());
+    BOOST_CHECK_EQUAL(stats.misses, 1U);
+    BOOST_CHECK_EQUAL(stats.stale, 0U);
+
+    // Merging again (or merging an unknown block) is a no-op.
+    BOOST_CHECK(!prefetcher.Merge(block->GetHash(), db, cache));
+}
+
+BOOST_AUTO_TEST_CASE(coinsprefetch_stale)
+{
+    CCoinsViewDB db{"prefetch_db", /*nCacheSize=*/1 << 20, /*fMemory=*/true, /*fWipe=*/false};
+    const std::vector<COutPoint> outpoints{AddDBCoins(db, 50)};
+    const auto block{BuildBlock(outpoints)};
+
+    CoinsPrefetcher prefetcher{Params().GetConsensus(), /*worker_threads=*/2};
+    prefetcher.Prefetch(block, db);
+    // Writing to the database invalidates the prefetch, as the written
+    // coins may have been read before or after the write.
+    AddDBCoins(db, 1);
+
+    CCoinsViewCache cache{&db};
+    BOOST_CHECK(prefetcher.Merge(block->GetHash(), db, cache) == block);
+    for (const COutPoint& outpoint : outpoints) {
+        BOOST_CHECK(!cache.HaveCoinInCache(outpoint));
+    }
+    const CoinsPrefetchStats stats{prefetcher.GetStats()};
+    BOOST_CHECK_EQUAL(stats.blocks, 0U);
+    BOOST_CHECK_EQUAL(stats.stale, 1U);
+}
+
+BOOST_AUTO_TEST_CASE(coinsprefetch_clear)
+{
+    CCoinsViewDB db{"prefetch_db", /*nCacheSize=*/1 << 20, /*fMemory=*/true, /*fWipe=*/false};
+    const std::vector<COutPoint> outpoints{AddDBCoins(db, 50)};
+
+    CoinsPrefetcher prefetcher{Params().GetConsensus(), /*worker_threads=*/2};
+    std::vector<std::shared_ptr<const CBlock>> blocks;
+    for (int i = 0; i < node::COINS_PREFETCH_LOOKAHEAD + 3; ++i) {
+        blocks.push_back(BuildBlock(outpoints));
+        prefetcher.Prefetch(blocks.back(), db);
+    }
+    // Only the most recent prefetches are kept.
+    CCoinsViewCache cache{&db};
+    BOOST_CHECK(!prefetcher.Merge(blocks.front()->GetHash(), db, cache));
+    BOOST_CHECK(prefetcher.Merge(blocks.back()->GetHash(), db, cache) == blocks.back());
+
+    prefetcher.Clear();
+    CCoinsViewCache cache2{&db};
+    BOOST_CHECK(!prefetcher.Merge(blocks[blocks.size() - 2]->GetHash(), db, cache2));
+    BOOST_CHECK_EQUAL(cache2.GetCacheSize(), 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
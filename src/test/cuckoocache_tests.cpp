@@ -47,6 +47,37 @@ BOOST_AUTO_TEST_CASE(test_cuckoocache_no_fakes)
     }
 };
 
+/* Test that for_each visits the elements that are not marked for erasure,
+ * and that inserting them into a new cache restores it.
+ */
+BOOST_AUTO_TEST_CASE(cuckoocache_for_each)
+{
+    SeedInsecureRand(SeedRand::ZEROS);
+    CuckooCache::cache<uint256, SignatureCacheHasher> cc{};
+    cc.setup_bytes(1 << 20);
+    std::vector<uint256> hashes;
+    for (int x = 0; x < 1000; ++x) {
+        hashes.push_back(InsecureRand256());
+        cc.insert(hashes.back());
+    }
+    for (size_t x = 0; x < hashes.size(); x += 2) {
+        BOOST_CHECK(cc.contains(hashes[x], /*erase=*/true));
+    }
+
+    std::vector<uint256> kept;
+    cc.for_each([&](const uint256& e) { kept.push_back(e); });
+    BOOST_CHECK_EQUAL(kept.size(), hashes.size() / 2);
+
+    CuckooCache::cache<uint256, SignatureCacheHasher> restored{};
+    restored.setup_bytes(1 << 20);
+    for (const uint256& e : kept) {
+        restored.insert(e);
+    }
+    for (size_t x = 0; x < hashes.size(); ++x) {
+        BOOST_CHECK_EQUAL(restored.contains(hashes[x], false), x % 2 == 1);
+    }
+}
+
 /** This helper returns the hit rate when megabytes*load worth of entries are
  * inserted into a megabytes sized cache
  */
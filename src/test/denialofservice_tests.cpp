@@ -544,4 +544,105 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
     BOOST_CHECK(orphanage.CountOrphans() == 0);
 }
 
+BOOST_AUTO_TEST_CASE(DoS_orphanAnnouncers)
+{
+    TxOrphanageTest orphanage;
+    LOCK(g_cs_orphans);
+
+    const auto make_orphan = [] {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout.n = 0;
+        tx.vin[0].prevout.hash = InsecureRand256();
+        tx.vout.resize(1);
+        tx.vout[0].nValue = 1*CENT;
+        return MakeTransactionRef(tx);
+    };
+
+    // An orphan sent by two peers is kept until both disconnect.
+    const CTransactionRef shared = make_orphan();
+    BOOST_CHECK(orphanage.AddTx(shared, 0));
+    BOOST_CHECK(!orphanage.AddTx(shared, 1));
+    BOOST_CHECK(orphanage.AddAnnouncer(shared->GetWitnessHash(), 2));
+    BOOST_CHECK(!orphanage.AddAnnouncer(InsecureRand256(), 2));
+    BOOST_CHECK_EQUAL(orphanage.GetStats().announcements, 3U);
+    orphanage.EraseForPeer(0);
+    BOOST_CHECK_EQUAL(orphanage.CountOrphans(), 1U);
+    // The peer held responsible for it is one that is still connected.
+    BOOST_CHECK_EQUAL(orphanage.GetTx(shared->GetHash()).second, 1);
+    orphanage.EraseForPeer(1);
+    orphanage.EraseForPeer(2);
+    BOOST_CHECK_EQUAL(orphanage.CountOrphans(), 0U);
+
+    // A peer flooding orphans has its own orphans evicted.
+    std::vector<CTransactionRef> kept;
+    for (NodeId peer = 1; peer <= 5; peer++) {
+        kept.push_back(make_orphan());
+        orphanage.AddTx(kept.back(), peer);
+    }
+    for (int i = 0; i < 50; i++) {
+        orphanage.AddTx(make_orphan(), 0);
+        orphanage.LimitOrphans(20);
+    }
+    BOOST_CHECK_EQUAL(orphanage.CountOrphans(), 20U);
+    for (const CTransactionRef& tx : kept) {
+        BOOST_CHECK(orphanage.HaveTx(GenTxid::Txid(tx->GetHash())));
+    }
+    const TxOrphanageStats stats{orphanage.GetStats()};
+    BOOST_CHECK_EQUAL(stats.added, 56U);
+    BOOST_CHECK_EQUAL(stats.duplicates, 2U);
+    BOOST_CHECK_EQUAL(stats.evicted, 35U);
+    BOOST_CHECK_EQUAL(stats.peers, 6U);
+    orphanage.LimitOrphans(0);
+    BOOST_CHECK_EQUAL(orphanage.GetStats().weight, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(DoS_orphanWorkBatch)
+{
+    TxOrphanageTest orphanage;
+    LOCK(g_cs_orphans);
+
+    // Orphans paying fees of 1000 to 10000 satoshis, and one whose inputs are still missing
+    std::map<uint256, CAmount> fees;
+    std::set<uint256> work_set;
+    for (int i = 0; i < 11; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout.hash = InsecureRand256();
+        tx.vout.resize(1);
+        tx.vout[0].nValue = 1*CENT;
+        const CTransactionRef ptx = MakeTransactionRef(tx);
+        orphanage.AddTx(ptx, 0);
+        if (i < 10) fees[ptx->GetHash()] = (i + 1) * 1000;
+        work_set.insert(ptx->GetHash());
+    }
+    const auto get_fee = [&](const CTransaction& tx) -> std::optional<CAmount> {
+        const auto it = fees.find(tx.GetHash());
+        if (it == fees.end()) return std::nullopt;
+        return it->second;
+    };
+
+    // Only some of the work set is looked at
+    std::vector<CTransactionRef> batch = orphanage.GetWorkBatch(work_set, /*max_batch=*/2, /*max_candidates=*/4, get_fee);
+    BOOST_CHECK_EQUAL(batch.size(), 2U);
+    BOOST_CHECK_LE(work_set.size(), 11U - 2U);
+    BOOST_CHECK_GE(work_set.size(), 11U - 4U);
+
+    // The highest fee rates go first, the orphan missing inputs is dropped
+    work_set.clear();
+    for (const auto& [txid, fee] : fees) work_set.insert(txid);
+    for (const auto& tx : batch) work_set.erase(tx->GetHash());
+    CAmount last_fee{MAX_MONEY};
+    while (!work_set.empty()) {
+        batch = orphanage.GetWorkBatch(work_set, /*max_batch=*/3, /*max_candidates=*/100, get_fee);
+        BOOST_CHECK(!batch.empty());
+        for (const CTransactionRef& tx : batch) {
+            BOOST_CHECK_LT(fees.at(tx->GetHash()), last_fee);
+            last_fee = fees.at(tx->GetHash());
+        }
+    }
+    const TxOrphanageStats stats{orphanage.GetStats()};
+    BOOST_CHECK_EQUAL(stats.reconsidered, 10U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
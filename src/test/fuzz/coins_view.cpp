@@ -79,6 +79,12 @@ FUZZ_TARGET_INIT(coins_view, initialize_coins_view)
             [&] {
                 (void)coins_view_cache.Flush();
             },
+            [&] {
+                (void)coins_view_cache.Sync();
+            },
+            [&] {
+                (void)coins_view_cache.Trim(fuzzed_data_provider.ConsumeIntegralInRange<size_t>(0, coins_view_cache.DynamicMemoryUsage()));
+            },
             [&] {
                 coins_view_cache.SetBestBlock(ConsumeUInt256(fuzzed_data_provider));
             },
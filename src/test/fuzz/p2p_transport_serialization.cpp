@@ -77,7 +77,7 @@ FUZZ_TARGET_INIT(p2p_transport_serialization, initialize_p2p_transport_serializa
 
             std::vector<unsigned char> header;
             auto msg2 = CNetMsgMaker{msg.m_recv.GetVersion()}.Make(msg.m_type, MakeUCharSpan(msg.m_recv));
-            serializer.prepareForTransport(msg2, header);
+            serializer.prepareForTransport(CSharedNetMsg{std::move(msg2)}, header);
         }
     }
 }
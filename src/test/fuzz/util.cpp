@@ -73,6 +73,16 @@ ssize_t FuzzedSock::Send(const void* data, size_t len, int flags) const
     return r;
 }
 
+ssize_t FuzzedSock::SendMany(Span<const Span<const unsigned char>> buffers, int flags) const
+{
+    size_t len{0};
+    for (const auto& buffer : buffers) {
+        len += buffer.size();
+    }
+    // Send() only decides how many of the bytes are sent, it does not read them.
+    return Send(buffers[0].data(), len, flags);
+}
+
 ssize_t FuzzedSock::Recv(void* buf, size_t len, int flags) const
 {
     // Have a permanent error at recv_errnos[0] because when the fuzzed data is exhausted
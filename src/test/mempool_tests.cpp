@@ -443,13 +443,19 @@ BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
     tx2.vout[0].nValue = 10 * COIN;
     pool.addUnchecked(entry.Fee(5000LL).FromTx(tx2));
 
-    pool.TrimToSize(pool.DynamicMemoryUsage()); // should do nothing
+    // The entries are allocated from a whole chunk, which is counted in full
+    BOOST_CHECK_GE(pool.DynamicMemoryUsage(), PoolResource::CHUNK_SIZE_BYTES);
+    BOOST_CHECK_LE(pool.UsageForSizeLimit(), pool.DynamicMemoryUsage() + PoolResource::CHUNK_SIZE_BYTES);
+
+    pool.TrimToSize(pool.UsageForSizeLimit()); // should do nothing
     BOOST_CHECK(pool.exists(GenTxid::Txid(tx1.GetHash())));
     BOOST_CHECK(pool.exists(GenTxid::Txid(tx2.GetHash())));
 
-    pool.TrimToSize(pool.DynamicMemoryUsage() * 3 / 4); // should remove the lower-feerate transaction
+    pool.TrimToSize(pool.UsageForSizeLimit() - 1); // should remove the lower-feerate transaction
     BOOST_CHECK(pool.exists(GenTxid::Txid(tx1.GetHash())));
     BOOST_CHECK(!pool.exists(GenTxid::Txid(tx2.GetHash())));
+    // Its pool memory is kept for new entries
+    BOOST_CHECK_GE(pool.DynamicMemoryUsage(), PoolResource::CHUNK_SIZE_BYTES);
 
     pool.addUnchecked(entry.FromTx(tx2));
     CMutableTransaction tx3 = CMutableTransaction();
@@ -461,7 +467,7 @@ BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
     tx3.vout[0].nValue = 10 * COIN;
     pool.addUnchecked(entry.Fee(20000LL).FromTx(tx3));
 
-    pool.TrimToSize(pool.DynamicMemoryUsage() * 3 / 4); // tx3 should pay for tx2 (CPFP)
+    pool.TrimToSize(pool.UsageForSizeLimit() - 1); // tx3 should pay for tx2 (CPFP), so tx1 goes first
     BOOST_CHECK(!pool.exists(GenTxid::Txid(tx1.GetHash())));
     BOOST_CHECK(pool.exists(GenTxid::Txid(tx2.GetHash())));
     BOOST_CHECK(pool.exists(GenTxid::Txid(tx3.GetHash())));
@@ -527,17 +533,19 @@ BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
     pool.addUnchecked(entry.Fee(1100LL).FromTx(tx6));
     pool.addUnchecked(entry.Fee(9000LL).FromTx(tx7));
 
-    // we only require this to remove, at max, 2 txn, because it's not clear what we're really optimizing for aside from that
-    pool.TrimToSize(pool.DynamicMemoryUsage() - 1);
+    // tx7 pays for both of its parents, so tx5, tx6 and tx7 form the chunk
+    // with the lowest feerate, which is evicted as a whole
+    pool.TrimToSize(pool.UsageForSizeLimit() - 1);
     BOOST_CHECK(pool.exists(GenTxid::Txid(tx4.GetHash())));
-    BOOST_CHECK(pool.exists(GenTxid::Txid(tx6.GetHash())));
+    BOOST_CHECK(!pool.exists(GenTxid::Txid(tx5.GetHash())));
+    BOOST_CHECK(!pool.exists(GenTxid::Txid(tx6.GetHash())));
     BOOST_CHECK(!pool.exists(GenTxid::Txid(tx7.GetHash())));
 
-    if (!pool.exists(GenTxid::Txid(tx5.GetHash())))
-        pool.addUnchecked(entry.Fee(1000LL).FromTx(tx5));
+    pool.addUnchecked(entry.Fee(1000LL).FromTx(tx5));
+    pool.addUnchecked(entry.Fee(9000LL).FromTx(tx6));
     pool.addUnchecked(entry.Fee(9000LL).FromTx(tx7));
 
-    pool.TrimToSize(pool.DynamicMemoryUsage() / 2); // should maximize mempool size by only removing 5/7
+    pool.TrimToSize(pool.UsageForSizeLimit() - 1); // tx6 now joins the chunk of tx4, only 5/7 are removed
     BOOST_CHECK(pool.exists(GenTxid::Txid(tx4.GetHash())));
     BOOST_CHECK(!pool.exists(GenTxid::Txid(tx5.GetHash())));
     BOOST_CHECK(pool.exists(GenTxid::Txid(tx6.GetHash())));
@@ -557,11 +565,11 @@ BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
     // ... then feerate should drop 1/2 each halflife
 
     SetMockTime(42 + 2*CTxMemPool::ROLLING_FEE_HALFLIFE + CTxMemPool::ROLLING_FEE_HALFLIFE/2);
-    BOOST_CHECK_EQUAL(pool.GetMinFee(pool.DynamicMemoryUsage() * 5 / 2).GetFeePerK(), llround((maxFeeRateRemoved.GetFeePerK() + 1000)/4.0));
+    BOOST_CHECK_EQUAL(pool.GetMinFee(pool.UsageForSizeLimit() * 5 / 2).GetFeePerK(), llround((maxFeeRateRemoved.GetFeePerK() + 1000)/4.0));
     // ... with a 1/2 halflife when mempool is < 1/2 its target size
 
     SetMockTime(42 + 2*CTxMemPool::ROLLING_FEE_HALFLIFE + CTxMemPool::ROLLING_FEE_HALFLIFE/2 + CTxMemPool::ROLLING_FEE_HALFLIFE/4);
-    BOOST_CHECK_EQUAL(pool.GetMinFee(pool.DynamicMemoryUsage() * 9 / 2).GetFeePerK(), llround((maxFeeRateRemoved.GetFeePerK() + 1000)/8.0));
+    BOOST_CHECK_EQUAL(pool.GetMinFee(pool.UsageForSizeLimit() * 9 / 2).GetFeePerK(), llround((maxFeeRateRemoved.GetFeePerK() + 1000)/8.0));
     // ... with a 1/4 halflife when mempool is < 1/4 its target size
 
     SetMockTime(42 + 7*CTxMemPool::ROLLING_FEE_HALFLIFE + CTxMemPool::ROLLING_FEE_HALFLIFE/2 + CTxMemPool::ROLLING_FEE_HALFLIFE/4);
@@ -786,4 +794,184 @@ BOOST_AUTO_TEST_CASE(MempoolAncestryTests)
     BOOST_CHECK_EQUAL(descendants, 4ULL);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolClusterTests)
+{
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    TestMemPoolEntryHelper entry;
+
+    // The txids of the chunks, in the order they are mined
+    const auto chunks = [&]() EXCLUSIVE_LOCKS_REQUIRED(pool.cs) {
+        std::vector<std::vector<uint256>> txids;
+        for (const TxMemPoolChunk& chunk : pool.GetChunks()) {
+            txids.emplace_back();
+            for (const CTxMemPool::txiter& it : pool.GetChunkTxs(chunk)) {
+                txids.back().push_back(it->GetTx().GetHash());
+            }
+        }
+        return txids;
+    };
+    using Chunks = std::vector<std::vector<uint256>>;
+
+    /* Unrelated transactions form clusters of their own */
+    CTransactionRef ta = make_tx(/*output_values=*/{10 * COIN});
+    CTransactionRef tb = make_tx(/*output_values=*/{5 * COIN, 5 * COIN});
+    pool.addUnchecked(entry.Fee(1000LL).FromTx(ta));
+    pool.addUnchecked(entry.Fee(5000LL).FromTx(tb));
+    BOOST_CHECK(chunks() == Chunks({{tb->GetHash()}, {ta->GetHash()}}));
+
+    /* A child paying for its parent joins its chunk */
+    //
+    // [ta].0 <- [tc]
+    //
+    CTransactionRef tc = make_tx(/*output_values=*/{9 * COIN}, /*inputs=*/{ta});
+    pool.addUnchecked(entry.Fee(30000LL).FromTx(tc));
+    BOOST_CHECK(chunks() == Chunks({{ta->GetHash(), tc->GetHash()}, {tb->GetHash()}}));
+
+    pool.removeRecursive(*tc, REMOVAL_REASON_DUMMY);
+    BOOST_CHECK(chunks() == Chunks({{tb->GetHash()}, {ta->GetHash()}}));
+
+    /* Spending two clusters merges them */
+    //
+    // [ta].0 <- [td]
+    //             |
+    // [tb].0 <----/
+    //
+    CTransactionRef td = make_tx(/*output_values=*/{14 * COIN}, /*inputs=*/{ta, tb});
+    pool.addUnchecked(entry.Fee(10000LL).FromTx(td));
+    BOOST_CHECK(chunks() == Chunks({{tb->GetHash()}, {ta->GetHash(), td->GetHash()}}));
+    BOOST_CHECK_EQUAL(pool.GetChunks().begin()->cluster_id, pool.GetChunks().rbegin()->cluster_id);
+
+    /* Mining the parents splits the cluster */
+    //
+    // [tb].1 <- [te]
+    //
+    CTransactionRef te = make_tx(/*output_values=*/{4 * COIN}, /*inputs=*/{tb}, /*input_indices=*/{1});
+    pool.addUnchecked(entry.Fee(10000LL).FromTx(te));
+    pool.removeForBlock({ta, tb}, 1);
+    BOOST_CHECK(chunks() == Chunks({{te->GetHash()}, {td->GetHash()}}));
+    BOOST_CHECK(pool.GetChunks().begin()->cluster_id != pool.GetChunks().rbegin()->cluster_id);
+
+    /* Prioritisation reorders the chunks */
+    pool.PrioritiseTransaction(td->GetHash(), 1 * COIN);
+    BOOST_CHECK(chunks() == Chunks({{td->GetHash()}, {te->GetHash()}}));
+
+    /* Eviction takes the chunk with the lowest feerate */
+    pool.TrimToSize(pool.UsageForSizeLimit() - 1);
+    BOOST_CHECK(chunks() == Chunks({{td->GetHash()}}));
+
+    /* Transactions of a disconnected block are linked to their in-mempool children */
+    //
+    // [tf].0 <- [tg]
+    //
+    CTransactionRef tf = make_tx(/*output_values=*/{3 * COIN});
+    CTransactionRef tg = make_tx(/*output_values=*/{2 * COIN}, /*inputs=*/{tf});
+    pool.addUnchecked(entry.Fee(40000LL).FromTx(tg));
+    pool.addUnchecked(entry.Fee(0LL).FromTx(tf));
+    BOOST_CHECK(chunks() == Chunks({{td->GetHash()}, {tg->GetHash()}, {tf->GetHash()}}));
+    pool.UpdateTransactionsFromBlock({tf->GetHash()}, std::numeric_limits<uint64_t>::max(), std::numeric_limits<uint64_t>::max());
+    BOOST_CHECK(chunks() == Chunks({{td->GetHash()}, {tf->GetHash(), tg->GetHash()}}));
+}
+
+BOOST_AUTO_TEST_CASE(MempoolChangesTest)
+{
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    TestMemPoolEntryHelper entry;
+    std::vector<uint256> added, removed;
+    const auto changes_since = [&](uint64_t since) {
+        added.clear();
+        removed.clear();
+        return pool.GetChangesSince(since, added, removed);
+    };
+    // Validation takes the next sequence after adding a transaction
+    const auto add = [&](const CTransactionRef& tx) {
+        pool.addUnchecked(entry.FromTx(tx));
+        pool.GetAndIncrementSequence();
+    };
+
+    const uint64_t start{pool.GetSequence()};
+    BOOST_CHECK(changes_since(start));
+    BOOST_CHECK(added.empty() && removed.empty());
+    BOOST_CHECK(!changes_since(start + 1));
+
+    CTransactionRef tx1 = make_tx(/*output_values=*/{10 * COIN});
+    CTransactionRef tx2 = make_tx(/*output_values=*/{5 * COIN}, /*inputs=*/{tx1});
+    CTransactionRef tx3 = make_tx(/*output_values=*/{3 * COIN});
+    add(tx1);
+    add(tx2);
+    const uint64_t after_two{pool.GetSequence()};
+    BOOST_CHECK(changes_since(start));
+    BOOST_CHECK((std::set<uint256>{added.begin(), added.end()} == std::set<uint256>{tx1->GetHash(), tx2->GetHash()}));
+    BOOST_CHECK(removed.empty());
+    BOOST_CHECK(changes_since(after_two));
+    BOOST_CHECK(added.empty() && removed.empty());
+
+    /* A transaction added and removed since is left out, one removed and added again is added */
+    add(tx3);
+    pool.removeForBlock({tx1, tx3}, 1);
+    add(tx1);
+    BOOST_CHECK(changes_since(start));
+    BOOST_CHECK((std::set<uint256>{added.begin(), added.end()} == std::set<uint256>{tx1->GetHash(), tx2->GetHash()}));
+    BOOST_CHECK(removed.empty());
+    BOOST_CHECK(changes_since(after_two));
+    BOOST_CHECK(added == std::vector<uint256>{tx1->GetHash()});
+    BOOST_CHECK(removed.empty());
+
+    /* Clearing the mempool forgets the changes before */
+    pool.removeForBlock({tx1, tx2}, 2);
+    const uint64_t before_clear{pool.GetSequence()};
+    BOOST_CHECK(changes_since(after_two));
+    BOOST_CHECK(added.empty());
+    BOOST_CHECK((std::set<uint256>{removed.begin(), removed.end()} == std::set<uint256>{tx1->GetHash(), tx2->GetHash()}));
+    pool.clear();
+    BOOST_CHECK(!changes_since(before_clear));
+    BOOST_CHECK(changes_since(pool.GetSequence()));
+}
+
+BOOST_AUTO_TEST_CASE(MempoolClusterLimitTests)
+{
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    TestMemPoolEntryHelper entry;
+    std::string err_string;
+
+    // [ta].0 <- [tb]
+    //
+    // [tc]
+    //
+    CTransactionRef ta = make_tx(/*output_values=*/{10 * COIN});
+    CTransactionRef tb = make_tx(/*output_values=*/{9 * COIN}, /*inputs=*/{ta});
+    CTransactionRef tc = make_tx(/*output_values=*/{5 * COIN});
+    pool.addUnchecked(entry.Fee(1000LL).FromTx(ta));
+    pool.addUnchecked(entry.Fee(1000LL).FromTx(tb));
+    pool.addUnchecked(entry.Fee(1000LL).FromTx(tc));
+    const CTxMemPool::txiter ita{*pool.GetIter(ta->GetHash())};
+    const CTxMemPool::txiter itb{*pool.GetIter(tb->GetHash())};
+    const CTxMemPool::txiter itc{*pool.GetIter(tc->GetHash())};
+
+    /* A transaction joins the cluster of its ancestors */
+    BOOST_CHECK(pool.CheckClusterLimit({ita, itb}, /*new_count=*/1, /*replaced=*/{}, /*limitClusterCount=*/3, err_string));
+    BOOST_CHECK(!pool.CheckClusterLimit({ita, itb}, /*new_count=*/1, /*replaced=*/{}, /*limitClusterCount=*/2, err_string));
+    BOOST_CHECK(pool.CheckClusterLimit({itc}, /*new_count=*/1, /*replaced=*/{}, /*limitClusterCount=*/2, err_string));
+    BOOST_CHECK(pool.CheckClusterLimit({}, /*new_count=*/1, /*replaced=*/{}, /*limitClusterCount=*/1, err_string));
+
+    /* Spending both clusters merges them */
+    BOOST_CHECK(pool.CheckClusterLimit({ita, itb, itc}, /*new_count=*/1, /*replaced=*/{}, /*limitClusterCount=*/4, err_string));
+    BOOST_CHECK(!pool.CheckClusterLimit({ita, itb, itc}, /*new_count=*/1, /*replaced=*/{}, /*limitClusterCount=*/3, err_string));
+    BOOST_CHECK_EQUAL(err_string, "too many transactions in cluster [4 merging 2 clusters, limit: 3]");
+
+    /* Replaced transactions are not counted */
+    BOOST_CHECK(pool.CheckClusterLimit({ita, itc}, /*new_count=*/1, /*replaced=*/{itb}, /*limitClusterCount=*/3, err_string));
+    BOOST_CHECK(!pool.CheckClusterLimit({itc}, /*new_count=*/1, /*replaced=*/{itb}, /*limitClusterCount=*/1, err_string));
+
+    /* All transactions of a package are counted */
+    BOOST_CHECK(pool.CheckClusterLimit({itc}, /*new_count=*/3, /*replaced=*/{}, /*limitClusterCount=*/4, err_string));
+    BOOST_CHECK(!pool.CheckClusterLimit({itc}, /*new_count=*/3, /*replaced=*/{}, /*limitClusterCount=*/3, err_string));
+
+    /* Removed transactions leave the cluster */
+    pool.removeRecursive(*tb, REMOVAL_REASON_DUMMY);
+    BOOST_CHECK(pool.CheckClusterLimit({ita, itc}, /*new_count=*/1, /*replaced=*/{}, /*limitClusterCount=*/3, err_string));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
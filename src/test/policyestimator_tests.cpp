@@ -110,6 +110,22 @@ BOOST_AUTO_TEST_CASE(BlockPolicyEstimates)
         origFeeEst.push_back(feeEst.estimateFee(i).GetFeePerK());
     }
 
+    // A full mempool does not raise smart fee estimates, an empty one lowers
+    // them down to the estimate at the highest target
+    const unsigned int backlog_blocks{feeEst.MempoolBacklogBlocks()};
+    BOOST_CHECK(backlog_blocks >= 2);
+    const CFeeRate floor{feeEst.estimateSmartFee(feeEst.HighestTargetTracked(FeeEstimateHorizon::LONG_HALFLIFE), nullptr, false)};
+    feeEst.processMempoolBacklog(std::vector<CFeeRate>(backlog_blocks, CFeeRate(20 * baseRate.GetFeePerK())));
+    FeeCalculation feeCalc;
+    const CFeeRate smartFee{feeEst.estimateSmartFee(2, &feeCalc, false)};
+    BOOST_CHECK(smartFee > floor);
+    BOOST_CHECK(feeCalc.reason != FeeReason::MEMPOOL_BACKLOG);
+    BOOST_CHECK(feeEst.estimateSmartFee(backlog_blocks + 1, nullptr, false) > floor);
+    feeEst.processMempoolBacklog(std::vector<CFeeRate>(backlog_blocks));
+    BOOST_CHECK(feeEst.estimateSmartFee(2, &feeCalc, false) == floor);
+    BOOST_CHECK(feeCalc.reason == FeeReason::MEMPOOL_BACKLOG);
+    BOOST_CHECK(feeEst.estimateSmartFee(backlog_blocks + 1, nullptr, false) > floor);
+
     // Mine 50 more blocks with no transactions happening, estimates shouldn't change
     // We haven't decayed the moving average enough so we still have enough data points in every bucket
     while (blocknum < 250)
@@ -180,4 +196,57 @@ BOOST_AUTO_TEST_CASE(BlockPolicyEstimates)
     }
 }
 
+BOOST_AUTO_TEST_CASE(BlockPolicyEstimatesJournal)
+{
+    std::vector<CFeeRate> estimates;
+    {
+        CBlockPolicyEstimator feeEst;
+        CTxMemPool mpool(&feeEst);
+        LOCK2(cs_main, mpool.cs);
+        TestMemPoolEntryHelper entry;
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vout.resize(1);
+
+        // Confirm higher fee transactions faster, and let some transactions
+        // wait for a few blocks and stop being tracked, as if they had been
+        // evicted. Go past the point where the estimates file is rewritten.
+        std::vector<CTransactionRef> waiting;
+        for (int blocknum = 0; blocknum < 200; ++blocknum) {
+            std::vector<CTransactionRef> block;
+            for (int j = 0; j < 10; j++) {
+                tx.vin[0].prevout.n = 100 * blocknum + j;
+                mpool.addUnchecked(entry.Fee(1000 * (j + 1)).Height(blocknum).FromTx(tx));
+                CTransactionRef ptx{mpool.get(tx.GetHash())};
+                (j >= blocknum % 10 ? block : waiting).push_back(ptx);
+            }
+            if (blocknum % 5 == 4) {
+                for (const auto& ptx : waiting) feeEst.removeTx(ptx->GetHash(), /*inBlock=*/false);
+                waiting.clear();
+            }
+            mpool.removeForBlock(block, blocknum + 1);
+        }
+        for (const auto& ptx : waiting) feeEst.removeTx(ptx->GetHash(), /*inBlock=*/false);
+        mpool.removeForBlock({}, 201);
+        BOOST_CHECK_EQUAL(feeEst.JournalBlocks(), 201U - CBlockPolicyEstimator::JOURNAL_COMPACT_BLOCKS);
+
+        // Only the tracked data is restored, not the state of the mempool
+        feeEst.processMempoolBacklog({});
+        for (int target = 1; target <= 48; ++target) {
+            estimates.push_back(feeEst.estimateSmartFee(target, nullptr, false));
+            estimates.push_back(feeEst.estimateRawFee(target, 0.85, FeeEstimateHorizon::MED_HALFLIFE));
+        }
+        BOOST_CHECK(estimates[2] != CFeeRate(0));
+        // Destroyed without being flushed, as if the node was killed
+    }
+
+    // The estimates file and the journal restore the same estimates
+    CBlockPolicyEstimator feeEst;
+    BOOST_CHECK_EQUAL(feeEst.JournalBlocks(), 0U);
+    for (int target = 1; target <= 48; ++target) {
+        BOOST_CHECK(feeEst.estimateSmartFee(target, nullptr, false) == estimates[2 * (target - 1)]);
+        BOOST_CHECK(feeEst.estimateRawFee(target, 0.85, FeeEstimateHorizon::MED_HALFLIFE) == estimates[2 * (target - 1) + 1]);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
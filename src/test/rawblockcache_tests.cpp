@@ -0,0 +1,116 @@
+// Copyright (c) 2022 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <net.h>
+#include <node/rawblockcache.h>
+#include <protocol.h>
+#include <uint256.h>
+
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+using node::RawBlockCache;
+
+BOOST_FIXTURE_TEST_SUITE(rawblockcache_tests, BasicTestingSetup)
+
+static std::shared_ptr<const CSharedNetMsg> MakeBlockMsg(size_t size)
+{
+    CSerializedNetMsg msg;
+    msg.m_type = NetMsgType::BLOCK;
+    msg.data.assign(size, 0);
+    return std::make_shared<const CSharedNetMsg>(std::move(msg));
+}
+
+BOOST_AUTO_TEST_CASE(hit)
+{
+    RawBlockCache cache{1000};
+    const uint256 hash{InsecureRand256()};
+    BOOST_CHECK(!cache.Get(hash));
+
+    const auto msg{MakeBlockMsg(100)};
+    BOOST_CHECK(cache.Insert(hash, msg) == msg);
+    BOOST_CHECK(cache.Get(hash) == msg);
+    BOOST_CHECK(!cache.Get(InsecureRand256()));
+
+    // A block that is cached already keeps its message
+    BOOST_CHECK(cache.Insert(hash, MakeBlockMsg(100)) == msg);
+    BOOST_CHECK_EQUAL(cache.Count(), 1U);
+    BOOST_CHECK_EQUAL(cache.PayloadSize(), 100U);
+}
+
+BOOST_AUTO_TEST_CASE(eviction)
+{
+    RawBlockCache cache{300};
+    std::vector<uint256> hashes;
+    for (int i{0}; i < 3; ++i) {
+        hashes.push_back(InsecureRand256());
+        cache.Insert(hashes.back(), MakeBlockMsg(100));
+    }
+    BOOST_CHECK_EQUAL(cache.Count(), 3U);
+    BOOST_CHECK_EQUAL(cache.PayloadSize(), 300U);
+
+    // Getting the oldest block makes the second one the least recently used
+    BOOST_CHECK(cache.Get(hashes[0]));
+    cache.Insert(InsecureRand256(), MakeBlockMsg(100));
+    BOOST_CHECK(cache.Get(hashes[0]));
+    BOOST_CHECK(!cache.Get(hashes[1]));
+    BOOST_CHECK(cache.Get(hashes[2]));
+    BOOST_CHECK_EQUAL(cache.Count(), 3U);
+    BOOST_CHECK_EQUAL(cache.PayloadSize(), 300U);
+
+    // A block larger than the limit evicts all others, but is kept itself
+    const uint256 large_hash{InsecureRand256()};
+    cache.Insert(large_hash, MakeBlockMsg(500));
+    BOOST_CHECK(cache.Get(large_hash));
+    BOOST_CHECK(!cache.Get(hashes[0]));
+    BOOST_CHECK_EQUAL(cache.Count(), 1U);
+    BOOST_CHECK_EQUAL(cache.PayloadSize(), 500U);
+
+    // The evicted block can be cached again
+    cache.Insert(hashes[1], MakeBlockMsg(100));
+    BOOST_CHECK(cache.Get(hashes[1]));
+    BOOST_CHECK(!cache.Get(large_hash));
+    BOOST_CHECK_EQUAL(cache.PayloadSize(), 100U);
+}
+
+BOOST_AUTO_TEST_CASE(concurrent_insert)
+{
+    constexpr int NUM_THREADS{8};
+    constexpr int NUM_BLOCKS{50};
+    RawBlockCache cache{NUM_BLOCKS * 100};
+    std::vector<uint256> hashes;
+    for (int i{0}; i < NUM_BLOCKS; ++i) hashes.push_back(InsecureRand256());
+
+    // All threads read the same blocks at the same time and insert their own
+    // message for each of them. They must all get the same message back.
+    std::vector<std::vector<std::shared_ptr<const CSharedNetMsg>>> results(NUM_THREADS);
+    std::vector<std::thread> threads;
+    for (int t{0}; t < NUM_THREADS; ++t) {
+        threads.emplace_back([&, t] {
+            for (const uint256& hash : hashes) {
+                auto msg{cache.Get(hash)};
+                if (!msg) msg = cache.Insert(hash, MakeBlockMsg(100));
+                results[t].push_back(msg);
+            }
+        });
+    }
+    for (std::thread& thread : threads) thread.join();
+
+    for (int i{0}; i < NUM_BLOCKS; ++i) {
+        const auto cached{cache.Get(hashes[i])};
+        BOOST_REQUIRE(cached);
+        for (int t{0}; t < NUM_THREADS; ++t) {
+            BOOST_CHECK(results[t][i] == cached);
+        }
+    }
+    BOOST_CHECK_EQUAL(cache.Count(), size_t{NUM_BLOCKS});
+    BOOST_CHECK_EQUAL(cache.PayloadSize(), size_t{NUM_BLOCKS * 100});
+}
+
+BOOST_AUTO_TEST_SUITE_END()
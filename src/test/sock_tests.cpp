@@ -10,8 +10,10 @@
 
 #include <boost/test/unit_test.hpp>
 
+#include <array>
 #include <cassert>
 #include <thread>
+#include <vector>
 
 using namespace std::chrono_literals;
 
@@ -131,6 +133,24 @@ BOOST_AUTO_TEST_CASE(send_and_receive)
     BOOST_CHECK(SocketIsClosed(s[1]));
 }
 
+BOOST_AUTO_TEST_CASE(send_many)
+{
+    int s[2];
+    CreateSocketPair(s);
+
+    Sock sock0(s[0]);
+    Sock sock1(s[1]);
+
+    const std::vector<unsigned char> header{'a', 'b'};
+    const std::vector<unsigned char> payload{'c', 'd', 'e'};
+    const std::array<Span<const unsigned char>, 2> buffers{Span{header}, Span{payload}};
+    BOOST_CHECK_EQUAL(sock0.SendMany(buffers, 0), 5);
+
+    char recv_buf[10];
+    BOOST_CHECK_EQUAL(sock1.Recv(recv_buf, sizeof(recv_buf), 0), 5);
+    BOOST_CHECK_EQUAL(strncmp("abcde", recv_buf, 5), 0);
+}
+
 BOOST_AUTO_TEST_CASE(wait)
 {
     int s[2];
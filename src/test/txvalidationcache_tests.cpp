@@ -22,6 +22,9 @@ bool CheckInputScripts(const CTransaction& tx, TxValidationState& state,
                        const CCoinsViewCache& inputs, unsigned int flags, bool cacheSigStore,
                        bool cacheFullScriptStore, PrecomputedTransactionData& txdata,
                        std::vector<CScriptCheck>* pvChecks) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+bool CheckInputScriptsParallel(const CTransaction& tx, TxValidationState& state,
+                               const CCoinsViewCache& inputs, unsigned int flags, bool cacheSigStore,
+                               bool cacheFullScriptStore, PrecomputedTransactionData& txdata) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
 BOOST_AUTO_TEST_SUITE(txvalidationcache_tests)
 
@@ -383,4 +386,71 @@ BOOST_FIXTURE_TEST_CASE(checkinputs_test, Dersig100Setup)
     }
 }
 
+BOOST_FIXTURE_TEST_CASE(checkinputs_parallel_test, TestingSetup)
+{
+    // A transaction whose inputs are verified on the script check threads
+    // must be rejected for the same reason as when they are verified serially.
+    static constexpr int NUM_INPUTS{8};
+    CKey key;
+    key.MakeNewKey(true);
+    const CScript p2pk_scriptPubKey = CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
+
+    CCoinsView coins_dummy;
+    CCoinsViewCache coins(&coins_dummy);
+    const uint256 prev_txid{InsecureRand256()};
+    CMutableTransaction spend;
+    spend.nVersion = 1;
+    for (int i = 0; i < NUM_INPUTS; ++i) {
+        coins.AddCoin(COutPoint{prev_txid, uint32_t(i)}, Coin{CTxOut{11 * CENT, p2pk_scriptPubKey}, 1, false}, false);
+        spend.vin.emplace_back(COutPoint{prev_txid, uint32_t(i)});
+    }
+    spend.vout.emplace_back(NUM_INPUTS * 10 * CENT, p2pk_scriptPubKey);
+    for (int i = 0; i < NUM_INPUTS; ++i) {
+        std::vector<unsigned char> vchSig;
+        const uint256 hash = SignatureHash(p2pk_scriptPubKey, spend, i, SIGHASH_ALL, 0, SigVersion::BASE);
+        BOOST_CHECK(key.Sign(hash, vchSig));
+        vchSig.push_back((unsigned char)SIGHASH_ALL);
+        spend.vin[i].scriptSig << vchSig;
+    }
+
+    const auto check = [&](const CMutableTransaction& mtx, const std::string& reject_reason, TxValidationResult result) {
+        LOCK(cs_main);
+        const CTransaction tx{mtx};
+        TxValidationState serial_state, parallel_state;
+        PrecomputedTransactionData serial_txdata, parallel_txdata;
+        const bool serial{CheckInputScripts(tx, serial_state, coins, STANDARD_SCRIPT_VERIFY_FLAGS, /*cacheSigStore=*/false,
+                                            /*cacheFullScriptStore=*/false, serial_txdata, nullptr)};
+        const bool parallel{CheckInputScriptsParallel(tx, parallel_state, coins, STANDARD_SCRIPT_VERIFY_FLAGS, /*cacheSigStore=*/false,
+                                                      /*cacheFullScriptStore=*/false, parallel_txdata)};
+        BOOST_CHECK_EQUAL(serial, reject_reason.empty());
+        BOOST_CHECK_EQUAL(parallel, reject_reason.empty());
+        BOOST_CHECK_EQUAL(serial_state.GetRejectReason(), reject_reason);
+        BOOST_CHECK_EQUAL(parallel_state.GetRejectReason(), reject_reason);
+        if (!reject_reason.empty()) {
+            BOOST_CHECK(serial_state.GetResult() == result);
+            BOOST_CHECK(parallel_state.GetResult() == result);
+        }
+    };
+
+    check(spend, /*reject_reason=*/"", TxValidationResult::TX_RESULT_UNSET);
+
+    // An invalid signature encoding fails under the consensus flags.
+    CMutableTransaction invalid_sig{spend};
+    std::vector<unsigned char> vchSig(invalid_sig.vin[5].scriptSig.begin() + 1, invalid_sig.vin[5].scriptSig.end());
+    vchSig[0] ^= 1;
+    invalid_sig.vin[5].scriptSig = CScript() << vchSig;
+    check(invalid_sig, "mandatory-script-verify-flag-failed (Non-canonical DER signature)", TxValidationResult::TX_CONSENSUS);
+
+    // A signature over the wrong input fails under the consensus flags as well.
+    CMutableTransaction wrong_sig{spend};
+    wrong_sig.vin[3].scriptSig = spend.vin[4].scriptSig;
+    check(wrong_sig, "mandatory-script-verify-flag-failed (Signature must be zero for failed CHECK(MULTI)SIG operation)", TxValidationResult::TX_CONSENSUS);
+
+    // A signature pushed with a larger opcode than necessary only fails under the policy flags.
+    CMutableTransaction non_minimal{spend};
+    non_minimal.vin[6].scriptSig = CScript() << OP_PUSHDATA1;
+    non_minimal.vin[6].scriptSig.insert(non_minimal.vin[6].scriptSig.end(), spend.vin[6].scriptSig.begin(), spend.vin[6].scriptSig.end());
+    check(non_minimal, "non-mandatory-script-verify-flag (Data push larger than necessary)", TxValidationResult::TX_NOT_STANDARD);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -172,6 +172,7 @@ ChainTestingSetup::ChainTestingSetup(const std::string& chainName, const std::ve
 
 ChainTestingSetup::~ChainTestingSetup()
 {
+    if (m_node.peerman) m_node.peerman->StopBlockPipeline();
     if (m_node.scheduler) m_node.scheduler->stop();
     StopScriptCheckWorkerThreads();
     GetMainSignals().FlushBackgroundCallbacks();
@@ -356,4 +356,36 @@ BOOST_AUTO_TEST_CASE(witness_commitment_index)
 
     BOOST_CHECK_EQUAL(GetWitnessCommitmentIndex(pblock), 2);
 }
+
+BOOST_AUTO_TEST_CASE(process_new_block_headers_invalid_pow)
+{
+    // Build headers on top of the tip, the third of which fails its proof of work
+    const Consensus::Params& consensus{Params().GetConsensus()};
+    std::vector<CBlockHeader> headers;
+    CBlockHeader prev{WITH_LOCK(cs_main, return m_node.chainman->ActiveChain().Tip()->GetBlockHeader())};
+    for (int i = 0; i < 5; ++i) {
+        CBlockHeader header;
+        header.nVersion = 4;
+        header.hashPrevBlock = prev.GetHash();
+        header.nTime = prev.nTime + 1;
+        header.nBits = prev.nBits;
+        while (CheckProofOfWork(header.GetHash(), header.nBits, consensus) != (i != 2)) ++header.nNonce;
+        headers.push_back(header);
+        prev = header;
+    }
+
+    for (const bool parallel : {true, false}) {
+        g_parallel_script_checks = parallel;
+        BlockValidationState state;
+        const CBlockIndex* last{nullptr};
+        BOOST_CHECK(!m_node.chainman->ProcessNewBlockHeaders(headers, state, Params(), &last));
+        BOOST_CHECK_EQUAL(state.GetRejectReason(), "high-hash");
+        BOOST_CHECK(last && last->GetBlockHash() == headers[1].GetHash());
+        LOCK(cs_main);
+        for (size_t i = 0; i < headers.size(); ++i) {
+            BOOST_CHECK_EQUAL(m_node.chainman->m_blockman.LookupBlockIndex(headers[i].GetHash()) != nullptr, i < 2);
+        }
+    }
+    g_parallel_script_checks = true;
+}
 BOOST_AUTO_TEST_SUITE_END()
@@ -12,6 +12,7 @@
 #include <shutdown.h>
 #include <uint256.h>
 #include <util/system.h>
+#include <util/thread.h>
 #include <util/translation.h>
 #include <util/vector.h>
 
@@ -67,11 +68,22 @@ CCoinsViewDB::CCoinsViewDB(fs::path ldb_path, size_t nCacheSize, bool fMemory, b
     m_ldb_path(ldb_path),
     m_is_memory(fMemory) { }
 
+CCoinsViewDB::~CCoinsViewDB()
+{
+    if (m_writer_thread.joinable()) {
+        WaitForWrites();
+        WITH_LOCK(m_pending_mutex, m_stop_writer = true);
+        m_pending_cv.notify_all();
+        m_writer_thread.join();
+    }
+}
+
 void CCoinsViewDB::ResizeCache(size_t new_cache_size)
 {
     // We can't do this operation with an in-memory DB since we'll lose all the coins upon
     // reset.
     if (!m_is_memory) {
+        WaitForWrites();
         // Have to do a reset first to get the original `m_db` state to release its
         // filesystem lock.
         m_db.reset();
@@ -81,14 +93,40 @@ void CCoinsViewDB::ResizeCache(size_t new_cache_size)
 }
 
 bool CCoinsViewDB::GetCoin(const COutPoint &outpoint, Coin &coin) const {
+    {
+        LOCK(m_pending_mutex);
+        if (m_pending) {
+            // Entries that are not dirty match the database, so they can be served as well.
+            const auto it{m_pending->coins.find(outpoint)};
+            if (it != m_pending->coins.end()) {
+                coin = it->second.coin;
+                return !coin.IsSpent();
+            }
+        }
+    }
     return m_db->Read(CoinEntry(&outpoint), coin);
 }
 
 bool CCoinsViewDB::HaveCoin(const COutPoint &outpoint) const {
+    {
+        LOCK(m_pending_mutex);
+        if (m_pending) {
+            const auto it{m_pending->coins.find(outpoint)};
+            if (it != m_pending->coins.end()) return !it->second.coin.IsSpent();
+        }
+    }
     return m_db->Exists(CoinEntry(&outpoint));
 }
 
 uint256 CCoinsViewDB::GetBestBlock() const {
+    {
+        LOCK(m_pending_mutex);
+        if (m_pending) return m_pending->hash_block;
+    }
+    return ReadBestBlock();
+}
+
+uint256 CCoinsViewDB::ReadBestBlock() const {
     uint256 hashBestChain;
     if (!m_db->Read(DB_BEST_BLOCK, hashBestChain))
         return uint256();
@@ -96,6 +134,7 @@ uint256 CCoinsViewDB::GetBestBlock() const {
 }
 
 std::vector<uint256> CCoinsViewDB::GetHeadBlocks() const {
+    WaitForWrites();
     std::vector<uint256> vhashHeadBlocks;
     if (!m_db->Read(DB_HEAD_BLOCKS, vhashHeadBlocks)) {
         return std::vector<uint256>();
@@ -104,6 +143,32 @@ std::vector<uint256> CCoinsViewDB::GetHeadBlocks() const {
 }
 
 bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+    if (!m_writer_thread.joinable()) {
+        ++m_write_generation;
+        return WriteCoins(mapCoins, hashBlock, /*erase=*/true);
+    }
+    {
+        WAIT_LOCK(m_pending_mutex, lock);
+        m_pending_cv.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_pending_mutex) { return !m_pending || m_write_failed; });
+        if (m_write_failed) return false;
+        ++m_write_generation;
+        m_pending = std::make_unique<PendingWrite>(std::move(mapCoins), hashBlock);
+    }
+    m_pending_cv.notify_all();
+    return true;
+}
+
+bool CCoinsViewDB::BatchWriteDirty(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+    if (!m_writer_thread.joinable()) {
+        ++m_write_generation;
+        return WriteCoins(mapCoins, hashBlock, /*erase=*/false);
+    }
+    // A background write needs its own copy, as the caller keeps modifying its map.
+    return CCoinsView::BatchWriteDirty(mapCoins, hashBlock);
+}
+
+bool CCoinsViewDB::WriteCoins(CCoinsMap& mapCoins, const uint256& hashBlock, bool erase)
+{
     CDBBatch batch(*m_db);
     size_t count = 0;
     size_t changed = 0;
@@ -111,10 +176,11 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     int crash_simulate = gArgs.GetIntArg("-dbcrashratio", 0);
     assert(!hashBlock.IsNull());
 
-    uint256 old_tip = GetBestBlock();
+    uint256 old_tip = ReadBestBlock();
     if (old_tip.IsNull()) {
         // We may be in the middle of replaying.
-        std::vector<uint256> old_heads = GetHeadBlocks();
+        std::vector<uint256> old_heads;
+        m_db->Read(DB_HEAD_BLOCKS, old_heads);
         if (old_heads.size() == 2) {
             assert(old_heads[0] == hashBlock);
             old_tip = old_heads[1];
@@ -138,8 +204,11 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
             changed++;
         }
         count++;
-        CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
+        if (erase) {
+            it = mapCoins.erase(it);
+        } else {
+            ++it;
+        }
         if (batch.SizeEstimate() > batch_size) {
             LogPrint(BCLog::COINDB, "Writing partial batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
             m_db->WriteBatch(batch);
@@ -164,6 +233,76 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     return ret;
 }
 
+void CCoinsViewDB::StartWriteBehind()
+{
+    assert(!m_writer_thread.joinable());
+    m_writer_thread = std::thread(&util::TraceThread, "coinswrite", [this] { WriterLoop(); });
+}
+
+void CCoinsViewDB::WriterLoop()
+{
+    while (true) {
+        PendingWrite* pending;
+        {
+            WAIT_LOCK(m_pending_mutex, lock);
+            m_pending_cv.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_pending_mutex) { return m_stop_writer || (m_pending && !m_write_failed); });
+            if (m_stop_writer) return;
+            pending = m_pending.get();
+        }
+
+        size_t coins_usage{0};
+        for (const auto& entry : pending->coins) {
+            coins_usage += entry.second.coin.DynamicMemoryUsage();
+        }
+        WITH_LOCK(m_pending_mutex, pending->coins_usage = coins_usage);
+
+        const auto start{GetTimeMicros()};
+        bool ok{false};
+        try {
+            ok = WriteCoins(pending->coins, pending->hash_block, /*erase=*/false);
+        } catch (const std::exception& e) {
+            LogPrintf("%s: %s\n", __func__, e.what());
+        }
+        LogPrint(BCLog::COINDB, "Wrote %u coins in the background in %.2fs\n", pending->coins.size(), (GetTimeMicros() - start) * 0.000001);
+
+        {
+            LOCK(m_pending_mutex);
+            if (ok) {
+                m_pending.reset();
+            } else {
+                // Keep serving the coins; the next flush reports the failure.
+                LogPrintf("Error writing coins to the coin database in the background\n");
+                m_write_failed = true;
+            }
+        }
+        m_pending_cv.notify_all();
+    }
+}
+
+bool CCoinsViewDB::HasPendingWrite() const
+{
+    return WITH_LOCK(m_pending_mutex, return m_pending != nullptr);
+}
+
+size_t CCoinsViewDB::PendingMemoryUsage() const
+{
+    LOCK(m_pending_mutex);
+    if (!m_pending) return 0;
+    return memusage::DynamicUsage(m_pending->coins) + m_pending->coins_usage;
+}
+
+bool CCoinsViewDB::WaitForWrites() const
+{
+    WAIT_LOCK(m_pending_mutex, lock);
+    m_pending_cv.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_pending_mutex) { return !m_pending || m_write_failed; });
+    return !m_write_failed;
+}
+
+bool CCoinsViewDB::WriteFailed() const
+{
+    return WITH_LOCK(m_pending_mutex, return m_write_failed);
+}
+
 size_t CCoinsViewDB::EstimateSize() const
 {
     return m_db->EstimateSize(DB_COIN, uint8_t(DB_COIN + 1));
@@ -217,6 +356,8 @@ private:
 
 std::unique_ptr<CCoinsViewCursor> CCoinsViewDB::Cursor() const
 {
+    // The cursor iterates over the database itself.
+    WaitForWrites();
     auto i = std::make_unique<CCoinsViewDBCursor>(
         const_cast<CDBWrapper&>(*m_db).NewIterator(), GetBestBlock());
     /* It seems that there are no "const iterators" for LevelDB.  Since we
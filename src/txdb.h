@@ -8,10 +8,14 @@
 
 #include <coins.h>
 #include <dbwrapper.h>
+#include <sync.h>
 
+#include <atomic>
+#include <condition_variable>
 #include <memory>
 #include <optional>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -27,6 +31,10 @@ struct bilingual_str;
 static const int64_t nDefaultDbCache = 450;
 //! -dbbatchsize default (bytes)
 static const int64_t nDefaultDbBatchSize = 16 << 20;
+//! -dbcacheretain default (percent)
+static const int64_t nDefaultDbCacheRetain = 50;
+//! -coinswritebehind default
+static constexpr bool DEFAULT_COINS_WRITE_BEHIND{false};
 //! max. -dbcache (MiB)
 static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 16384 : 1024;
 //! min. -dbcache (MiB)
@@ -52,17 +60,44 @@ protected:
     std::unique_ptr<CDBWrapper> m_db;
     fs::path m_ldb_path;
     bool m_is_memory;
+    //! Incremented by every BatchWrite(), see GetWriteGeneration()
+    std::atomic<uint64_t> m_write_generation{0};
+
+    /** Coins handed over by BatchWrite() while they are written in the background. */
+    struct PendingWrite {
+        PendingWrite(CCoinsMap&& coins_in, const uint256& hash_block_in) : coins{std::move(coins_in)}, hash_block{hash_block_in} {}
+
+        //! Not modified until the write completes, so it can be read concurrently
+        CCoinsMap coins;
+        uint256 hash_block;
+        //! Dynamic memory usage of the coins themselves, computed by the writer
+        size_t coins_usage{0};
+    };
+    mutable Mutex m_pending_mutex;
+    mutable std::condition_variable m_pending_cv;
+    std::unique_ptr<PendingWrite> m_pending GUARDED_BY(m_pending_mutex);
+    bool m_write_failed GUARDED_BY(m_pending_mutex){false};
+    bool m_stop_writer GUARDED_BY(m_pending_mutex){false};
+    std::thread m_writer_thread;
+
+    uint256 ReadBestBlock() const;
+    /** Write the dirty coins of a map in batches of -dbbatchsize, erasing the entries as they are written if erase is set. */
+    bool WriteCoins(CCoinsMap& mapCoins, const uint256& hashBlock, bool erase);
+    void WriterLoop() LOCKS_EXCLUDED(m_pending_mutex);
+
 public:
     /**
      * @param[in] ldb_path    Location in the filesystem where leveldb data will be stored.
      */
     explicit CCoinsViewDB(fs::path ldb_path, size_t nCacheSize, bool fMemory, bool fWipe);
+    ~CCoinsViewDB();
 
     bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
     bool HaveCoin(const COutPoint &outpoint) const override;
     uint256 GetBestBlock() const override;
     std::vector<uint256> GetHeadBlocks() const override;
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    bool BatchWriteDirty(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
     std::unique_ptr<CCoinsViewCursor> Cursor() const override;
 
     //! Attempt to update from an older database format. Returns whether an error occurred.
@@ -71,6 +106,31 @@ public:
 
     //! Dynamically alter the underlying leveldb cache size.
     void ResizeCache(size_t new_cache_size) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
+    //! Counter of writes to the database. Readers that bypass the coins cache
+    //! compare it before and after reading to detect that their result may be stale.
+    uint64_t GetWriteGeneration() const { return m_write_generation; }
+
+    /**
+     * Make BatchWrite() hand the coins to a background thread instead of
+     * writing them before returning.
+     *
+     * The handed over coins keep being served by GetCoin() until they are
+     * written, and GetBestBlock() reports the block they were flushed at, so
+     * readers cannot tell the difference. Only one write is in flight at a
+     * time: BatchWrite() waits for the previous one to complete. The database
+     * goes through the DB_HEAD_BLOCKS transition as for synchronous writes, so
+     * an interrupted write is recovered from by ReplayBlocks() on startup.
+     */
+    void StartWriteBehind();
+    //! Whether coins handed over by BatchWrite() are still being written.
+    bool HasPendingWrite() const LOCKS_EXCLUDED(m_pending_mutex);
+    //! Memory used by coins handed over by BatchWrite() that are still being written.
+    size_t PendingMemoryUsage() const LOCKS_EXCLUDED(m_pending_mutex);
+    //! Wait until all coins handed over by BatchWrite() are on disk. Returns false if writing them failed.
+    bool WaitForWrites() const LOCKS_EXCLUDED(m_pending_mutex);
+    //! Whether writing coins in the background failed.
+    bool WriteFailed() const LOCKS_EXCLUDED(m_pending_mutex);
 };
 
 /** Access to the block database (blocks/index/) */
@@ -19,6 +19,7 @@
 #include <util/time.h>
 #include <validationinterface.h>
 
+#include <algorithm>
 #include <cmath>
 #include <optional>
 
@@ -86,18 +87,19 @@ CTxMemPoolEntry::CTxMemPoolEntry(const CTransactionRef& tx, CAmount fee,
                                  bool spends_coinbase, int64_t sigops_cost, LockPoints lp)
     : tx{tx},
       nFee{fee},
-      nTxWeight(GetTransactionWeight(*tx)),
-      nUsageSize{RecursiveDynamicUsage(tx)},
       nTime{time},
-      entryHeight{entry_height},
-      spendsCoinbase{spends_coinbase},
-      sigOpCost{sigops_cost},
       lockPoints{lp},
-      nSizeWithDescendants{GetTxSize()},
       nModFeesWithDescendants{nFee},
-      nSizeWithAncestors{GetTxSize()},
       nModFeesWithAncestors{nFee},
-      nSigOpCostWithAncestors{sigOpCost} {}
+      nSigOpCostWithAncestors{sigops_cost},
+      nTxWeight(GetTransactionWeight(*tx)),
+      nUsageSize(RecursiveDynamicUsage(tx)),
+      entryHeight{entry_height},
+      sigOpCost(sigops_cost),
+      spendsCoinbase{spends_coinbase}
+{
+    nSizeWithDescendants = nSizeWithAncestors = GetTxSize();
+}
 
 void CTxMemPoolEntry::UpdateFeeDelta(int64_t newFeeDelta)
 {
@@ -120,25 +122,32 @@ void CTxMemPool::UpdateForDescendants(txiter updateIt, cacheMap& cachedDescendan
                                       const std::set<uint256>& setExclude, std::set<uint256>& descendants_to_remove,
                                       uint64_t ancestor_size_limit, uint64_t ancestor_count_limit)
 {
-    CTxMemPoolEntry::Children stageEntries, descendants;
-    stageEntries = updateIt->GetMemPoolChildrenConst();
+    WITH_FRESH_EPOCH(m_epoch);
+    std::vector<txiter>& stage{m_epoch_walk};
+    stage.clear();
+    std::vector<txiter> descendants;
+    for (const CTxMemPoolEntry& child : updateIt->GetMemPoolChildrenConst()) {
+        const txiter childIter{mapTx.iterator_to(child)};
+        if (!visited(childIter)) stage.push_back(childIter);
+    }
 
-    while (!stageEntries.empty()) {
-        const CTxMemPoolEntry& descendant = *stageEntries.begin();
-        descendants.insert(descendant);
-        stageEntries.erase(descendant);
-        const CTxMemPoolEntry::Children& children = descendant.GetMemPoolChildrenConst();
+    while (!stage.empty()) {
+        const txiter descendant{stage.back()};
+        stage.pop_back();
+        descendants.push_back(descendant);
+        const CTxMemPoolEntry::Children& children = descendant->GetMemPoolChildrenConst();
         for (const CTxMemPoolEntry& childEntry : children) {
-            cacheMap::iterator cacheIt = cachedDescendants.find(mapTx.iterator_to(childEntry));
+            const txiter childIter{mapTx.iterator_to(childEntry)};
+            cacheMap::iterator cacheIt = cachedDescendants.find(childIter);
             if (cacheIt != cachedDescendants.end()) {
                 // We've already calculated this one, just add the entries for this set
                 // but don't traverse again.
                 for (txiter cacheEntry : cacheIt->second) {
-                    descendants.insert(*cacheEntry);
+                    if (!visited(cacheEntry)) descendants.push_back(cacheEntry);
                 }
-            } else if (!descendants.count(childEntry)) {
+            } else if (!visited(childIter)) {
                 // Schedule for later processing
-                stageEntries.insert(childEntry);
+                stage.push_back(childIter);
             }
         }
     }
@@ -147,19 +156,19 @@ void CTxMemPool::UpdateForDescendants(txiter updateIt, cacheMap& cachedDescendan
     int64_t modifySize = 0;
     CAmount modifyFee = 0;
     int64_t modifyCount = 0;
-    for (const CTxMemPoolEntry& descendant : descendants) {
-        if (!setExclude.count(descendant.GetTx().GetHash())) {
-            modifySize += descendant.GetTxSize();
-            modifyFee += descendant.GetModifiedFee();
+    for (const txiter descendant : descendants) {
+        if (!setExclude.count(descendant->GetTx().GetHash())) {
+            modifySize += descendant->GetTxSize();
+            modifyFee += descendant->GetModifiedFee();
             modifyCount++;
-            cachedDescendants[updateIt].insert(mapTx.iterator_to(descendant));
+            cachedDescendants[updateIt].push_back(descendant);
             // Update ancestor state for each descendant
-            mapTx.modify(mapTx.iterator_to(descendant), update_ancestor_state(updateIt->GetTxSize(), updateIt->GetModifiedFee(), 1, updateIt->GetSigOpCost()));
+            mapTx.modify(descendant, update_ancestor_state(updateIt->GetTxSize(), updateIt->GetModifiedFee(), 1, updateIt->GetSigOpCost()));
             // Don't directly remove the transaction here -- doing so would
             // invalidate iterators in cachedDescendants. Mark it for removal
             // by inserting into descendants_to_remove.
-            if (descendant.GetCountWithAncestors() > ancestor_count_limit || descendant.GetSizeWithAncestors() > ancestor_size_limit) {
-                descendants_to_remove.insert(descendant.GetTx().GetHash());
+            if (descendant->GetCountWithAncestors() > ancestor_count_limit || descendant->GetSizeWithAncestors() > ancestor_size_limit) {
+                descendants_to_remove.insert(descendant->GetTx().GetHash());
             }
         }
     }
@@ -206,11 +215,13 @@ void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256> &vHashes
                 if (!visited(childIter) && !setAlreadyIncluded.count(childHash)) {
                     UpdateChild(it, childIter, true);
                     UpdateParent(childIter, it, true);
+                    MergeClusters(it->m_cluster_id, childIter->m_cluster_id);
                 }
             }
         } // release epoch guard for UpdateForDescendants
         UpdateForDescendants(it, mapMemPoolDescendantsToUpdate, setAlreadyIncluded, descendants_to_remove, ancestor_size_limit, ancestor_count_limit);
     }
+    UpdateClusters();
 
     for (const auto& txid : descendants_to_remove) {
         // This txid may have been removed already in a prior call to removeRecursive.
@@ -224,7 +235,7 @@ void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256> &vHashes
 bool CTxMemPool::CalculateAncestorsAndCheckLimits(size_t entry_size,
                                                   size_t entry_count,
                                                   setEntries& setAncestors,
-                                                  CTxMemPoolEntry::Parents& staged_ancestors,
+                                                  std::vector<txiter>& staged_ancestors,
                                                   uint64_t limitAncestorCount,
                                                   uint64_t limitAncestorSize,
                                                   uint64_t limitDescendantCount,
@@ -234,11 +245,10 @@ bool CTxMemPool::CalculateAncestorsAndCheckLimits(size_t entry_size,
     size_t totalSizeWithAncestors = entry_size;
 
     while (!staged_ancestors.empty()) {
-        const CTxMemPoolEntry& stage = staged_ancestors.begin()->get();
-        txiter stageit = mapTx.iterator_to(stage);
+        const txiter stageit{staged_ancestors.back()};
+        staged_ancestors.pop_back();
 
         setAncestors.insert(stageit);
-        staged_ancestors.erase(stage);
         totalSizeWithAncestors += stageit->GetTxSize();
 
         if (stageit->GetSizeWithDescendants() + entry_size > limitDescendantSize) {
@@ -257,8 +267,8 @@ bool CTxMemPool::CalculateAncestorsAndCheckLimits(size_t entry_size,
             txiter parent_it = mapTx.iterator_to(parent);
 
             // If this is a new ancestor, add it.
-            if (setAncestors.count(parent_it) == 0) {
-                staged_ancestors.insert(parent);
+            if (!visited(parent_it)) {
+                staged_ancestors.push_back(parent_it);
             }
             if (staged_ancestors.size() + setAncestors.size() + entry_count > limitAncestorCount) {
                 errString = strprintf("too many unconfirmed ancestors [limit: %u]", limitAncestorCount);
@@ -277,14 +287,16 @@ bool CTxMemPool::CheckPackageLimits(const Package& package,
                                     uint64_t limitDescendantSize,
                                     std::string &errString) const
 {
-    CTxMemPoolEntry::Parents staged_ancestors;
+    WITH_FRESH_EPOCH(m_epoch);
+    std::vector<txiter>& staged_ancestors{m_epoch_walk};
+    staged_ancestors.clear();
     size_t total_size = 0;
     for (const auto& tx : package) {
         total_size += GetVirtualTransactionSize(*tx);
         for (const auto& input : tx->vin) {
             std::optional<txiter> piter = GetIter(input.prevout.hash);
-            if (piter) {
-                staged_ancestors.insert(**piter);
+            if (piter && !visited(*piter)) {
+                staged_ancestors.push_back(*piter);
                 if (staged_ancestors.size() + package.size() > limitAncestorCount) {
                     errString = strprintf("too many unconfirmed parents [limit: %u]", limitAncestorCount);
                     return false;
@@ -305,6 +317,33 @@ bool CTxMemPool::CheckPackageLimits(const Package& package,
     return ret;
 }
 
+bool CTxMemPool::CheckClusterLimit(const setEntries& ancestors,
+                                   size_t new_count,
+                                   const setEntries& replaced,
+                                   uint64_t limitClusterCount,
+                                   std::string& errString) const
+{
+    AssertLockHeld(cs);
+    std::set<uint64_t> clusters;
+    for (const txiter& it : ancestors) {
+        clusters.insert(it->m_cluster_id);
+    }
+    uint64_t cluster_count{new_count};
+    for (const uint64_t cluster_id : clusters) {
+        const TxMemPoolCluster& cluster{m_clusters.at(cluster_id)};
+        cluster_count += cluster.txs.size() - cluster.removed;
+    }
+    for (const txiter& it : replaced) {
+        if (clusters.count(it->m_cluster_id)) --cluster_count;
+    }
+    if (cluster_count > limitClusterCount) {
+        errString = strprintf("too many transactions in cluster [%u merging %u clusters, limit: %u]",
+                              cluster_count, clusters.size(), limitClusterCount);
+        return false;
+    }
+    return true;
+}
+
 bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry,
                                            setEntries &setAncestors,
                                            uint64_t limitAncestorCount,
@@ -314,7 +353,9 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry,
                                            std::string &errString,
                                            bool fSearchForParents /* = true */) const
 {
-    CTxMemPoolEntry::Parents staged_ancestors;
+    WITH_FRESH_EPOCH(m_epoch);
+    std::vector<txiter>& staged_ancestors{m_epoch_walk};
+    staged_ancestors.clear();
     const CTransaction &tx = entry.GetTx();
 
     if (fSearchForParents) {
@@ -323,8 +364,8 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry,
         // iterate mapTx to find parents.
         for (unsigned int i = 0; i < tx.vin.size(); i++) {
             std::optional<txiter> piter = GetIter(tx.vin[i].prevout.hash);
-            if (piter) {
-                staged_ancestors.insert(**piter);
+            if (piter && !visited(*piter)) {
+                staged_ancestors.push_back(*piter);
                 if (staged_ancestors.size() + 1 > limitAncestorCount) {
                     errString = strprintf("too many unconfirmed parents [limit: %u]", limitAncestorCount);
                     return false;
@@ -335,7 +376,10 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry,
         // If we're not searching for parents, we require this to already be an
         // entry in the mempool and use the entry's cached parents.
         txiter it = mapTx.iterator_to(entry);
-        staged_ancestors = it->GetMemPoolParentsConst();
+        for (const CTxMemPoolEntry& parent : it->GetMemPoolParentsConst()) {
+            const txiter parent_it{mapTx.iterator_to(parent)};
+            if (!visited(parent_it)) staged_ancestors.push_back(parent_it);
+        }
     }
 
     return CalculateAncestorsAndCheckLimits(entry.GetTxSize(), /* entry_count */ 1,
@@ -344,7 +388,8 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry,
                                             limitDescendantCount, limitDescendantSize, errString);
 }
 
-void CTxMemPool::UpdateAncestorsOf(bool add, txiter it, setEntries &setAncestors)
+template <typename Entries>
+void CTxMemPool::UpdateAncestorsOf(bool add, txiter it, const Entries& ancestors)
 {
     const CTxMemPoolEntry::Parents& parents = it->GetMemPoolParentsConst();
     // add or remove this tx as a child of each parent
@@ -354,11 +399,45 @@ void CTxMemPool::UpdateAncestorsOf(bool add, txiter it, setEntries &setAncestors
     const int64_t updateCount = (add ? 1 : -1);
     const int64_t updateSize = updateCount * it->GetTxSize();
     const CAmount updateFee = updateCount * it->GetModifiedFee();
-    for (txiter ancestorIt : setAncestors) {
+    for (txiter ancestorIt : ancestors) {
         mapTx.modify(ancestorIt, update_descendant_state(updateSize, updateFee, updateCount));
     }
 }
 
+void CTxMemPool::GetAncestors(txiter it, std::vector<txiter>& ancestors) const
+{
+    WITH_FRESH_EPOCH(m_epoch);
+    ancestors.clear();
+    visited(it); // mark it, so that it is not added
+    // ancestors doubles as the work list: the parents of each of its entries
+    // are appended to it, unless they were seen before.
+    txiter entry{it};
+    for (size_t i{0};; ++i) {
+        for (const CTxMemPoolEntry& parent : entry->GetMemPoolParentsConst()) {
+            const txiter parent_it{mapTx.iterator_to(parent)};
+            if (!visited(parent_it)) ancestors.push_back(parent_it);
+        }
+        if (i == ancestors.size()) break;
+        entry = ancestors[i];
+    }
+}
+
+void CTxMemPool::GetDescendants(txiter it, std::vector<txiter>& descendants) const
+{
+    WITH_FRESH_EPOCH(m_epoch);
+    descendants.clear();
+    visited(it); // mark it, so that it is not added
+    txiter entry{it};
+    for (size_t i{0};; ++i) {
+        for (const CTxMemPoolEntry& child : entry->GetMemPoolChildrenConst()) {
+            const txiter child_it{mapTx.iterator_to(child)};
+            if (!visited(child_it)) descendants.push_back(child_it);
+        }
+        if (i == descendants.size()) break;
+        entry = descendants[i];
+    }
+}
+
 void CTxMemPool::UpdateEntryForAncestors(txiter it, const setEntries &setAncestors)
 {
     int64_t updateCount = setAncestors.size();
@@ -385,7 +464,7 @@ void CTxMemPool::UpdateForRemoveFromMempool(const setEntries &entriesToRemove, b
 {
     // For each entry, walk back all ancestors and decrement size associated with this
     // transaction
-    const uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    std::vector<txiter> walk;
     if (updateDescendants) {
         // updateDescendants should be true whenever we're not recursively
         // removing a tx and all its descendants, eg when a transaction is
@@ -394,25 +473,20 @@ void CTxMemPool::UpdateForRemoveFromMempool(const setEntries &entriesToRemove, b
         // and CTxMemPoolEntry::Children (which we need to preserve until we're
         // finished with all operations that need to traverse the mempool).
         for (txiter removeIt : entriesToRemove) {
-            setEntries setDescendants;
-            CalculateDescendants(removeIt, setDescendants);
-            setDescendants.erase(removeIt); // don't update state for self
+            GetDescendants(removeIt, walk);
             int64_t modifySize = -((int64_t)removeIt->GetTxSize());
             CAmount modifyFee = -removeIt->GetModifiedFee();
             int modifySigOps = -removeIt->GetSigOpCost();
-            for (txiter dit : setDescendants) {
+            for (txiter dit : walk) {
                 mapTx.modify(dit, update_ancestor_state(modifySize, modifyFee, -1, modifySigOps));
             }
         }
     }
     for (txiter removeIt : entriesToRemove) {
-        setEntries setAncestors;
-        const CTxMemPoolEntry &entry = *removeIt;
-        std::string dummy;
-        // Since this is a tx that is already in the mempool, we can call CMPA
-        // with fSearchForParents = false.  If the mempool is in a consistent
-        // state, then using true or false should both be correct, though false
-        // should be a bit faster.
+        // Since this is a tx that is already in the mempool, we can walk its
+        // cached parents instead of searching for them.  If the mempool is in a
+        // consistent state, then both should be correct, though walking the
+        // cached parents should be a bit faster.
         // However, if we happen to be in the middle of processing a reorg, then
         // the mempool can be in an inconsistent state.  In this case, the set
         // of ancestors reachable via GetMemPoolParents()/GetMemPoolChildren()
@@ -428,10 +502,10 @@ void CTxMemPool::UpdateForRemoveFromMempool(const setEntries &entriesToRemove, b
         // mempool parents we'd calculate by searching, and it's important that
         // we use the cached notion of ancestor transactions as the set of
         // things to update for removal.
-        CalculateMemPoolAncestors(entry, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+        GetAncestors(removeIt, walk);
         // Note that UpdateAncestorsOf severs the child links that point to
         // removeIt in the entries for the parents of removeIt.
-        UpdateAncestorsOf(false, removeIt, setAncestors);
+        UpdateAncestorsOf(false, removeIt, walk);
     }
     // After updating all the ancestor sizes, we can now sever the link between each
     // transaction being removed and any mempool children (ie, update CTxMemPoolEntry::m_parents
@@ -533,6 +607,11 @@ void CTxMemPool::addUnchecked(const CTxMemPoolEntry &entry, setEntries &setAnces
 
     vTxHashes.emplace_back(tx.GetWitnessHash(), newit);
     newit->vTxHashesIdx = vTxHashes.size() - 1;
+
+    AddToCluster(newit);
+    UpdateFeeEstimatorBacklog(/*force=*/false);
+    // The caller reports the addition with the current sequence.
+    LogChange(tx.GetHash(), /*added=*/true, GetSequence());
 }
 
 void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
@@ -550,6 +629,7 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
     }
 
     const uint256 hash = it->GetTx().GetHash();
+    LogChange(hash, /*added=*/false, mempool_sequence);
     for (const CTxIn& txin : it->GetTx().vin)
         mapNextTx.erase(txin.prevout);
 
@@ -567,7 +647,11 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
     totalTxSize -= it->GetTxSize();
     m_total_fee -= it->GetFee();
     cachedInnerUsage -= it->DynamicMemoryUsage();
-    cachedInnerUsage -= memusage::DynamicUsage(it->GetMemPoolParentsConst()) + memusage::DynamicUsage(it->GetMemPoolChildrenConst());
+    cachedInnerUsage -= it->GetMemPoolParentsConst().DynamicMemoryUsage() + it->GetMemPoolChildrenConst().DynamicMemoryUsage();
+    TxMemPoolCluster& cluster{m_clusters.at(it->m_cluster_id)};
+    cluster.txs[it->m_cluster_pos] = nullptr;
+    ++cluster.removed;
+    m_dirty_clusters.insert(it->m_cluster_id);
     mapTx.erase(it);
     nTransactionsUpdated++;
     if (minerPolicyEstimator) {minerPolicyEstimator->removeTx(hash, false);}
@@ -581,23 +665,26 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
 // can save time by not iterating over those entries.
 void CTxMemPool::CalculateDescendants(txiter entryit, setEntries& setDescendants) const
 {
-    setEntries stage;
+    WITH_FRESH_EPOCH(m_epoch);
+    std::vector<txiter>& stage{m_epoch_walk};
+    stage.clear();
     if (setDescendants.count(entryit) == 0) {
-        stage.insert(entryit);
+        visited(entryit);
+        stage.push_back(entryit);
     }
     // Traverse down the children of entry, only adding children that are not
     // accounted for in setDescendants already (because those children have either
     // already been walked, or will be walked in this iteration).
     while (!stage.empty()) {
-        txiter it = *stage.begin();
+        txiter it = stage.back();
         setDescendants.insert(it);
-        stage.erase(it);
+        stage.pop_back();
 
         const CTxMemPoolEntry::Children& children = it->GetMemPoolChildrenConst();
         for (const CTxMemPoolEntry& child : children) {
             txiter childiter = mapTx.iterator_to(child);
-            if (!setDescendants.count(childiter)) {
-                stage.insert(childiter);
+            if (!setDescendants.count(childiter) && !visited(childiter)) {
+                stage.push_back(childiter);
             }
         }
     }
@@ -687,6 +774,8 @@ void CTxMemPool::removeForBlock(const std::vector<CTransactionRef>& vtx, unsigne
     }
     // Before the txs in the new block have been removed from the mempool, update policy estimates
     if (minerPolicyEstimator) {minerPolicyEstimator->processBlock(nBlockHeight, entries);}
+    // Update the clusters once, after all transactions have been removed.
+    m_defer_cluster_updates = true;
     for (const auto& tx : vtx)
     {
         txiter it = mapTx.find(tx->GetHash());
@@ -698,6 +787,9 @@ void CTxMemPool::removeForBlock(const std::vector<CTransactionRef>& vtx, unsigne
         removeConflicts(*tx);
         ClearPrioritisation(tx->GetHash());
     }
+    m_defer_cluster_updates = false;
+    UpdateClusters();
+    UpdateFeeEstimatorBacklog(/*force=*/true);
     lastRollingFeeUpdate = GetTime();
     blockSinceLastRollingFeeBump = true;
 }
@@ -709,6 +801,14 @@ void CTxMemPool::_clear()
     totalTxSize = 0;
     m_total_fee = 0;
     cachedInnerUsage = 0;
+    m_clusters.clear();
+    m_chunks.clear();
+    m_dirty_clusters.clear();
+    m_cluster_usage = 0;
+    m_backlog_size = 0;
+    // The removals are not logged, so changes from before cannot be reported.
+    m_change_log.clear();
+    m_change_log_start = GetAndIncrementSequence() + 1;
     lastRollingFeeUpdate = GetTime();
     blockSinceLastRollingFeeBump = false;
     rollingMinimumFeeRate = 0;
@@ -743,7 +843,7 @@ void CTxMemPool::check(const CCoinsViewCache& active_coins_tip, int64_t spendhei
         check_total_fee += it->GetFee();
         innerUsage += it->DynamicMemoryUsage();
         const CTransaction& tx = it->GetTx();
-        innerUsage += memusage::DynamicUsage(it->GetMemPoolParentsConst()) + memusage::DynamicUsage(it->GetMemPoolChildrenConst());
+        innerUsage += it->GetMemPoolParentsConst().DynamicMemoryUsage() + it->GetMemPoolChildrenConst().DynamicMemoryUsage();
         CTxMemPoolEntry::Parents setParentCheck;
         for (const CTxIn &txin : tx.vin) {
             // Check that every mempool transaction's inputs refer to available coins, or other mempool tx's.
@@ -827,6 +927,47 @@ void CTxMemPool::check(const CCoinsViewCache& active_coins_tip, int64_t spendhei
     assert(totalTxSize == checkTotal);
     assert(m_total_fee == check_total_fee);
     assert(innerUsage == cachedInnerUsage);
+
+    // Check that every transaction is in the linearization of its cluster,
+    // after its parents, and that the chunks of each cluster cover it.
+    assert(m_dirty_clusters.empty());
+    size_t cluster_tx_count{0};
+    size_t chunk_count{0};
+    uint64_t cluster_usage{0};
+    for (const auto& [cluster_id, cluster] : m_clusters) {
+        assert(!cluster.txs.empty() && cluster.removed == 0 && cluster.topological);
+        for (size_t pos = 0; pos < cluster.txs.size(); ++pos) {
+            const CTxMemPoolEntry& entry{*cluster.txs[pos]};
+            assert(entry.m_cluster_id == cluster_id && entry.m_cluster_pos == pos);
+            for (const CTxMemPoolEntry& parent : entry.GetMemPoolParentsConst()) {
+                assert(parent.m_cluster_id == cluster_id && parent.m_cluster_pos < pos);
+            }
+        }
+        size_t chunk_begin{0};
+        for (size_t index = 0; index < cluster.chunks.size(); ++index) {
+            const TxMemPoolChunk& chunk{cluster.chunks[index]};
+            assert(chunk.cluster_id == cluster_id && chunk.index == index);
+            assert(chunk.begin == chunk_begin && chunk.end > chunk.begin);
+            CAmount chunk_fee{0};
+            int64_t chunk_size{0};
+            for (size_t pos = chunk.begin; pos < chunk.end; ++pos) {
+                chunk_fee += cluster.txs[pos]->GetModifiedFee();
+                chunk_size += cluster.txs[pos]->GetTxSize();
+            }
+            assert(chunk.fee == chunk_fee && chunk.size == chunk_size);
+            if (index > 0) assert(CompareTxMemPoolChunkByFeerate()(cluster.chunks[index - 1], chunk));
+            assert(m_chunks.count(chunk));
+            chunk_begin = chunk.end;
+        }
+        assert(chunk_begin == cluster.txs.size());
+        cluster_tx_count += cluster.txs.size();
+        chunk_count += cluster.chunks.size();
+        assert(cluster.usage == memusage::DynamicUsage(cluster.txs) + memusage::DynamicUsage(cluster.chunks));
+        cluster_usage += cluster.usage;
+    }
+    assert(cluster_tx_count == mapTx.size());
+    assert(chunk_count == m_chunks.size());
+    assert(cluster_usage == m_cluster_usage);
 }
 
 bool CTxMemPool::CompareDepthAndScore(const uint256& hasha, const uint256& hashb, bool wtxid)
@@ -933,20 +1074,20 @@ void CTxMemPool::PrioritiseTransaction(const uint256& hash, const CAmount& nFeeD
         if (it != mapTx.end()) {
             mapTx.modify(it, update_fee_delta(delta));
             // Now update all ancestors' modified fees with descendants
-            setEntries setAncestors;
-            uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
-            std::string dummy;
-            CalculateMemPoolAncestors(*it, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
-            for (txiter ancestorIt : setAncestors) {
+            std::vector<txiter> walk;
+            GetAncestors(it, walk);
+            for (txiter ancestorIt : walk) {
                 mapTx.modify(ancestorIt, update_descendant_state(0, nFeeDelta, 0));
             }
             // Now update all descendants' modified fees with ancestors
-            setEntries setDescendants;
-            CalculateDescendants(it, setDescendants);
-            setDescendants.erase(it);
-            for (txiter descendantIt : setDescendants) {
+            GetDescendants(it, walk);
+            for (txiter descendantIt : walk) {
                 mapTx.modify(descendantIt, update_ancestor_state(0, nFeeDelta, 0, 0));
             }
+            // The chunks of the cluster have to be recomputed from scratch.
+            ClearClusterChunks(m_clusters.at(it->m_cluster_id));
+            m_dirty_clusters.insert(it->m_cluster_id);
+            UpdateClusters();
             ++nTransactionsUpdated;
         }
     }
@@ -1034,8 +1175,13 @@ void CCoinsViewMemPool::PackageAddTransaction(const CTransactionRef& tx)
 
 size_t CTxMemPool::DynamicMemoryUsage() const {
     LOCK(cs);
-    // Estimate the overhead of mapTx to be 15 pointers + an allocation, as no exact formula for boost::multi_index_contained is implemented.
-    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 15 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(vTxHashes) + cachedInnerUsage;
+    // The nodes of mapTx, and the bucket arrays of its hashed indexes, are allocated from m_entry_resource.
+    return m_entry_resource.DynamicMemoryUsage() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(vTxHashes) + memusage::DynamicUsage(m_clusters) + memusage::DynamicUsage(m_chunks) + m_cluster_usage + cachedInnerUsage;
+}
+
+size_t CTxMemPool::UsageForSizeLimit() const {
+    LOCK(cs);
+    return DynamicMemoryUsage() - m_entry_resource.FreeBytes() + PoolResource::CHUNK_SIZE_BYTES;
 }
 
 void CTxMemPool::RemoveUnbroadcastTx(const uint256& txid, const bool unchecked) {
@@ -1053,6 +1199,7 @@ void CTxMemPool::RemoveStaged(setEntries &stage, bool updateDescendants, MemPool
     for (txiter it : stage) {
         removeUnchecked(it, reason);
     }
+    if (!m_defer_cluster_updates) UpdateClusters();
 }
 
 int CTxMemPool::Expire(std::chrono::seconds time)
@@ -1084,23 +1231,27 @@ void CTxMemPool::addUnchecked(const CTxMemPoolEntry &entry, bool validFeeEstimat
 void CTxMemPool::UpdateChild(txiter entry, txiter child, bool add)
 {
     AssertLockHeld(cs);
-    CTxMemPoolEntry::Children s;
-    if (add && entry->GetMemPoolChildren().insert(*child).second) {
-        cachedInnerUsage += memusage::IncrementalDynamicUsage(s);
-    } else if (!add && entry->GetMemPoolChildren().erase(*child)) {
-        cachedInnerUsage -= memusage::IncrementalDynamicUsage(s);
+    CTxMemPoolEntry::Children& children = entry->GetMemPoolChildren();
+    cachedInnerUsage -= children.DynamicMemoryUsage();
+    if (add) {
+        children.insert(*child);
+    } else {
+        children.erase(*child);
     }
+    cachedInnerUsage += children.DynamicMemoryUsage();
 }
 
 void CTxMemPool::UpdateParent(txiter entry, txiter parent, bool add)
 {
     AssertLockHeld(cs);
-    CTxMemPoolEntry::Parents s;
-    if (add && entry->GetMemPoolParents().insert(*parent).second) {
-        cachedInnerUsage += memusage::IncrementalDynamicUsage(s);
-    } else if (!add && entry->GetMemPoolParents().erase(*parent)) {
-        cachedInnerUsage -= memusage::IncrementalDynamicUsage(s);
+    CTxMemPoolEntry::Parents& parents = entry->GetMemPoolParents();
+    cachedInnerUsage -= parents.DynamicMemoryUsage();
+    if (add) {
+        parents.insert(*parent);
+    } else {
+        parents.erase(*parent);
     }
+    cachedInnerUsage += parents.DynamicMemoryUsage();
 }
 
 CFeeRate CTxMemPool::GetMinFee(size_t sizelimit) const {
@@ -1111,9 +1262,9 @@ CFeeRate CTxMemPool::GetMinFee(size_t sizelimit) const {
     int64_t time = GetTime();
     if (time > lastRollingFeeUpdate + 10) {
         double halflife = ROLLING_FEE_HALFLIFE;
-        if (DynamicMemoryUsage() < sizelimit / 4)
+        if (UsageForSizeLimit() < sizelimit / 4)
             halflife /= 4;
-        else if (DynamicMemoryUsage() < sizelimit / 2)
+        else if (UsageForSizeLimit() < sizelimit / 2)
             halflife /= 2;
 
         rollingMinimumFeeRate = rollingMinimumFeeRate / pow(2.0, (time - lastRollingFeeUpdate) / halflife);
@@ -1127,6 +1278,353 @@ CFeeRate CTxMemPool::GetMinFee(size_t sizelimit) const {
     return std::max(CFeeRate(llround(rollingMinimumFeeRate)), incrementalRelayFee);
 }
 
+namespace {
+//! Clusters up to this many transactions are linearized from scratch whenever
+//! they change. Larger ones keep their linearization, and are only chunked again.
+constexpr size_t MAX_CLUSTER_LINEARIZATION_SIZE{64};
+
+/** Whether a set of transactions with fee a_fee and size a_size has a higher feerate than another one. */
+bool HigherFeerate(CAmount a_fee, int64_t a_size, CAmount b_fee, int64_t b_size)
+{
+    // Computed exactly like CompareTxMemPoolChunkByFeerate, so that both agree.
+    return (double)a_fee * b_size > (double)b_fee * a_size;
+}
+
+/**
+ * Linearize a cluster whose transactions are in topological order: repeatedly
+ * take the transaction whose remaining in-cluster ancestors have the highest
+ * feerate, and append these ancestors. This is the ancestor feerate based
+ * transaction selection of block assembly, applied to a single cluster.
+ */
+void LinearizeCluster(std::vector<const CTxMemPoolEntry*>& txs)
+{
+    const size_t count{txs.size()};
+    if (count < 2 || count > MAX_CLUSTER_LINEARIZATION_SIZE) return;
+    static_assert(MAX_CLUSTER_LINEARIZATION_SIZE <= 64, "ancestors must fit in a uint64_t bitset");
+
+    for (size_t i = 0; i < count; ++i) {
+        txs[i]->m_cluster_pos = i;
+    }
+    // Bitsets of the in-cluster ancestors of each transaction, including itself,
+    // and the fee and size of the ancestors which have not been appended yet.
+    std::vector<uint64_t> ancestors(count);
+    std::vector<CAmount> fees(count);
+    std::vector<int64_t> sizes(count);
+    for (size_t i = 0; i < count; ++i) {
+        ancestors[i] = uint64_t{1} << i;
+        for (const CTxMemPoolEntry& parent : txs[i]->GetMemPoolParentsConst()) {
+            ancestors[i] |= ancestors[parent.m_cluster_pos];
+        }
+        for (size_t j = 0; j <= i; ++j) {
+            if (ancestors[i] >> j & 1) {
+                fees[i] += txs[j]->GetModifiedFee();
+                sizes[i] += txs[j]->GetTxSize();
+            }
+        }
+    }
+
+    std::vector<const CTxMemPoolEntry*> linearization;
+    linearization.reserve(count);
+    std::vector<size_t> appended;
+    uint64_t remaining{count == 64 ? ~uint64_t{0} : (uint64_t{1} << count) - 1};
+    while (remaining) {
+        size_t best{count};
+        for (size_t i = 0; i < count; ++i) {
+            if (!(remaining >> i & 1)) continue;
+            if (best == count || HigherFeerate(fees[i], sizes[i], fees[best], sizes[best])) best = i;
+        }
+        const uint64_t selected{ancestors[best] & remaining};
+        appended.clear();
+        for (size_t j = 0; j < count; ++j) {
+            if (selected >> j & 1) {
+                appended.push_back(j);
+                linearization.push_back(txs[j]);
+            }
+        }
+        remaining &= ~selected;
+        for (size_t i = 0; i < count; ++i) {
+            if (!(remaining >> i & 1) || !(ancestors[i] & selected)) continue;
+            for (const size_t j : appended) {
+                if (ancestors[i] >> j & 1) {
+                    fees[i] -= txs[j]->GetModifiedFee();
+                    sizes[i] -= txs[j]->GetTxSize();
+                }
+            }
+        }
+    }
+    txs = std::move(linearization);
+}
+
+} // namespace
+
+std::vector<CTxMemPool::txiter> CTxMemPool::GetChunkTxs(const TxMemPoolChunk& chunk) const
+{
+    AssertLockHeld(cs);
+    const TxMemPoolCluster& cluster{m_clusters.at(chunk.cluster_id)};
+    std::vector<txiter> txs;
+    txs.reserve(chunk.end - chunk.begin);
+    for (size_t pos = chunk.begin; pos < chunk.end; ++pos) {
+        txs.push_back(mapTx.iterator_to(*cluster.txs[pos]));
+    }
+    return txs;
+}
+
+void CTxMemPool::ClearClusterChunks(TxMemPoolCluster& cluster)
+{
+    AssertLockHeld(cs);
+    for (const TxMemPoolChunk& chunk : cluster.chunks) {
+        m_chunks.erase(chunk);
+    }
+    cluster.chunks.clear();
+}
+
+void CTxMemPool::EraseCluster(uint64_t cluster_id)
+{
+    AssertLockHeld(cs);
+    auto cluster_it{m_clusters.find(cluster_id)};
+    ClearClusterChunks(cluster_it->second);
+    m_cluster_usage -= cluster_it->second.usage;
+    m_clusters.erase(cluster_it);
+    m_dirty_clusters.erase(cluster_id);
+}
+
+void CTxMemPool::UpdateChunks(uint64_t cluster_id, TxMemPoolCluster& cluster)
+{
+    AssertLockHeld(cs);
+    // Drop the chunks of transactions removed from the end of the linearization.
+    while (!cluster.chunks.empty() && cluster.chunks.back().end > cluster.txs.size()) {
+        m_chunks.erase(cluster.chunks.back());
+        cluster.chunks.pop_back();
+    }
+    // Append the transactions that are not in a chunk yet, merging the
+    // preceding chunks into them as long as these have a lower feerate.
+    for (size_t pos = cluster.chunks.empty() ? 0 : cluster.chunks.back().end; pos < cluster.txs.size(); ++pos) {
+        const CTxMemPoolEntry& entry{*cluster.txs[pos]};
+        entry.m_cluster_id = cluster_id;
+        entry.m_cluster_pos = pos;
+        TxMemPoolChunk chunk{cluster_id, 0, pos, pos + 1, entry.GetModifiedFee(), int64_t(entry.GetTxSize())};
+        while (!cluster.chunks.empty() && HigherFeerate(chunk.fee, chunk.size, cluster.chunks.back().fee, cluster.chunks.back().size)) {
+            chunk.begin = cluster.chunks.back().begin;
+            chunk.fee += cluster.chunks.back().fee;
+            chunk.size += cluster.chunks.back().size;
+            m_chunks.erase(cluster.chunks.back());
+            cluster.chunks.pop_back();
+        }
+        chunk.index = cluster.chunks.size();
+        cluster.chunks.push_back(chunk);
+        m_chunks.insert(chunk);
+    }
+    m_cluster_usage -= cluster.usage;
+    cluster.usage = memusage::DynamicUsage(cluster.txs) + memusage::DynamicUsage(cluster.chunks);
+    m_cluster_usage += cluster.usage;
+}
+
+std::vector<CFeeRate> CTxMemPool::GetBlockFeerates(unsigned int num_blocks) const
+{
+    AssertLockHeld(cs);
+    // Fill blocks with the chunks in the order they would be mined. A block
+    // is full once a chunk does not fit anymore, and that chunk's feerate has
+    // to be beaten to get into it.
+    const int64_t block_size{DEFAULT_BLOCK_MAX_WEIGHT / WITNESS_SCALE_FACTOR};
+    std::vector<CFeeRate> feerates(num_blocks);
+    unsigned int full_blocks{0};
+    int64_t total_size{0};
+    for (const TxMemPoolChunk& chunk : m_chunks) {
+        if (full_blocks == num_blocks) break;
+        total_size += chunk.size;
+        while (full_blocks < num_blocks && total_size > (full_blocks + 1) * block_size) {
+            feerates[full_blocks++] = CFeeRate(chunk.fee, chunk.size);
+        }
+    }
+    return feerates;
+}
+
+void CTxMemPool::UpdateFeeEstimatorBacklog(bool force)
+{
+    AssertLockHeld(cs);
+    if (!minerPolicyEstimator || m_defer_cluster_updates) return;
+    const uint64_t threshold{DEFAULT_BLOCK_MAX_WEIGHT / WITNESS_SCALE_FACTOR / 4};
+    if (!force && std::max(totalTxSize, m_backlog_size) - std::min(totalTxSize, m_backlog_size) < threshold) return;
+    m_backlog_size = totalTxSize;
+    minerPolicyEstimator->processMempoolBacklog(GetBlockFeerates(minerPolicyEstimator->MempoolBacklogBlocks()));
+}
+
+void CTxMemPool::AddToCluster(txiter it)
+{
+    AssertLockHeld(cs);
+    std::set<uint64_t> parent_clusters;
+    for (const CTxMemPoolEntry& parent : it->GetMemPoolParentsConst()) {
+        parent_clusters.insert(parent.m_cluster_id);
+    }
+
+    uint64_t cluster_id{0};
+    if (parent_clusters.empty()) {
+        cluster_id = m_next_cluster_id++;
+        m_clusters.emplace(cluster_id, TxMemPoolCluster{});
+    } else if (parent_clusters.size() == 1) {
+        cluster_id = *parent_clusters.begin();
+    } else {
+        // The clusters do not depend on each other, so interleaving their
+        // chunks by feerate keeps each of them linearized. The largest one
+        // keeps its id.
+        size_t max_size{0};
+        std::vector<TxMemPoolChunk> chunks;
+        for (const uint64_t parent_cluster : parent_clusters) {
+            const TxMemPoolCluster& cluster{m_clusters.at(parent_cluster)};
+            if (cluster.txs.size() > max_size) {
+                max_size = cluster.txs.size();
+                cluster_id = parent_cluster;
+            }
+            chunks.insert(chunks.end(), cluster.chunks.begin(), cluster.chunks.end());
+        }
+        std::stable_sort(chunks.begin(), chunks.end(), [](const TxMemPoolChunk& a, const TxMemPoolChunk& b) {
+            return HigherFeerate(a.fee, a.size, b.fee, b.size);
+        });
+        std::vector<const CTxMemPoolEntry*> txs;
+        for (const TxMemPoolChunk& chunk : chunks) {
+            const TxMemPoolCluster& cluster{m_clusters.at(chunk.cluster_id)};
+            txs.insert(txs.end(), cluster.txs.begin() + chunk.begin, cluster.txs.begin() + chunk.end);
+        }
+        for (const uint64_t parent_cluster : parent_clusters) {
+            if (parent_cluster != cluster_id) EraseCluster(parent_cluster);
+        }
+        TxMemPoolCluster& cluster{m_clusters.at(cluster_id)};
+        ClearClusterChunks(cluster);
+        cluster.txs = std::move(txs);
+    }
+    // A new transaction has no children in the mempool, so it can go last.
+    m_clusters.at(cluster_id).txs.push_back(&*it);
+    m_dirty_clusters.insert(cluster_id);
+    UpdateClusters();
+}
+
+void CTxMemPool::MergeClusters(uint64_t cluster_a, uint64_t cluster_b)
+{
+    AssertLockHeld(cs);
+    if (cluster_a == cluster_b) return;
+    if (m_clusters.at(cluster_a).txs.size() < m_clusters.at(cluster_b).txs.size()) {
+        std::swap(cluster_a, cluster_b);
+    }
+    TxMemPoolCluster& cluster{m_clusters.at(cluster_a)};
+    const TxMemPoolCluster& merged{m_clusters.at(cluster_b)};
+    for (const CTxMemPoolEntry* entry : merged.txs) {
+        if (entry) entry->m_cluster_id = cluster_a;
+        cluster.txs.push_back(entry);
+    }
+    cluster.removed += merged.removed;
+    // The transactions of the two clusters may depend on each other in any order.
+    cluster.topological = false;
+    EraseCluster(cluster_b);
+    m_dirty_clusters.insert(cluster_a);
+}
+
+void CTxMemPool::UpdateClusters()
+{
+    AssertLockHeld(cs);
+    while (!m_dirty_clusters.empty()) {
+        const uint64_t cluster_id{*m_dirty_clusters.begin()};
+        m_dirty_clusters.erase(m_dirty_clusters.begin());
+        TxMemPoolCluster& cluster{m_clusters.at(cluster_id)};
+
+        while (cluster.removed > 0 && cluster.txs.back() == nullptr) {
+            cluster.txs.pop_back();
+            --cluster.removed;
+        }
+        if (cluster.txs.empty()) {
+            EraseCluster(cluster_id);
+            continue;
+        }
+        if (cluster.removed == 0 && cluster.topological && cluster.txs.size() > MAX_CLUSTER_LINEARIZATION_SIZE) {
+            // Transactions were only appended to or removed from the end of
+            // the linearization, which remains valid. Only the last chunks
+            // change. The cluster is not split until it is updated in full.
+            UpdateChunks(cluster_id, cluster);
+            continue;
+        }
+
+        std::vector<const CTxMemPoolEntry*> txs;
+        txs.reserve(cluster.txs.size() - cluster.removed);
+        for (const CTxMemPoolEntry* entry : cluster.txs) {
+            if (entry) txs.push_back(entry);
+        }
+        if (!cluster.topological) {
+            // A transaction has more ancestors than any of its ancestors.
+            std::stable_sort(txs.begin(), txs.end(), [](const CTxMemPoolEntry* a, const CTxMemPoolEntry* b) {
+                return a->GetCountWithAncestors() < b->GetCountWithAncestors();
+            });
+        }
+        EraseCluster(cluster_id);
+
+        // Removals may have split the cluster. Each connected component becomes
+        // a cluster of its own; the first one keeps the id of the original one.
+        {
+            WITH_FRESH_EPOCH(m_epoch);
+            bool first{true};
+            std::vector<const CTxMemPoolEntry*> stack;
+            for (const CTxMemPoolEntry* entry : txs) {
+                if (visited(mapTx.iterator_to(*entry))) continue;
+                const uint64_t component_id{first ? cluster_id : m_next_cluster_id++};
+                first = false;
+                stack.push_back(entry);
+                while (!stack.empty()) {
+                    const CTxMemPoolEntry* component_entry{stack.back()};
+                    stack.pop_back();
+                    component_entry->m_cluster_id = component_id;
+                    for (const CTxMemPoolEntry& parent : component_entry->GetMemPoolParentsConst()) {
+                        if (!visited(mapTx.iterator_to(parent))) stack.push_back(&parent);
+                    }
+                    for (const CTxMemPoolEntry& child : component_entry->GetMemPoolChildrenConst()) {
+                        if (!visited(mapTx.iterator_to(child))) stack.push_back(&child);
+                    }
+                }
+            }
+        }
+        std::map<uint64_t, std::vector<const CTxMemPoolEntry*>> components;
+        for (const CTxMemPoolEntry* entry : txs) {
+            components[entry->m_cluster_id].push_back(entry);
+        }
+
+        for (auto& [component_id, component_txs] : components) {
+            TxMemPoolCluster& component{m_clusters[component_id]};
+            component.txs = std::move(component_txs);
+            LinearizeCluster(component.txs);
+            UpdateChunks(component_id, component);
+        }
+    }
+}
+
+void CTxMemPool::LogChange(const uint256& txid, bool added, uint64_t sequence)
+{
+    AssertLockHeld(cs);
+    m_change_log.push_back({sequence, txid, added});
+    if (m_change_log.size() > MAX_CHANGE_LOG_SIZE) {
+        m_change_log_start = m_change_log.front().sequence + 1;
+        m_change_log.pop_front();
+    }
+}
+
+bool CTxMemPool::GetChangesSince(uint64_t since, std::vector<uint256>& added, std::vector<uint256>& removed) const
+{
+    AssertLockHeld(cs);
+    if (since < m_change_log_start || since > GetSequence()) return false;
+    auto it = std::lower_bound(m_change_log.begin(), m_change_log.end(), since,
+                               [](const MempoolChange& change, uint64_t sequence) { return change.sequence < sequence; });
+    // Whether each changed transaction was in the mempool at `since`, which
+    // the first change after it tells.
+    std::map<uint256, bool> changed;
+    for (; it != m_change_log.end(); ++it) {
+        changed.try_emplace(it->txid, !it->added);
+    }
+    for (const auto& [txid, was_present] : changed) {
+        if (exists(GenTxid::Txid(txid))) {
+            added.push_back(txid);
+        } else if (was_present) {
+            removed.push_back(txid);
+        }
+    }
+    return true;
+}
+
 void CTxMemPool::trackPackageRemoved(const CFeeRate& rate) {
     AssertLockHeld(cs);
     if (rate.GetFeePerK() > rollingMinimumFeeRate) {
@@ -1140,20 +1638,24 @@ void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<COutPoint>* pvNoSpends
 
     unsigned nTxnRemoved = 0;
     CFeeRate maxFeeRateRemoved(0);
-    while (!mapTx.empty() && DynamicMemoryUsage() > sizelimit) {
-        indexed_transaction_set::index<descendant_score>::type::iterator it = mapTx.get<descendant_score>().begin();
+    while (!mapTx.empty() && UsageForSizeLimit() > sizelimit) {
+        // Evict the chunk with the lowest feerate. It is the last chunk of its
+        // cluster, so no other transaction depends on it.
+        const TxMemPoolChunk& chunk{*m_chunks.rbegin()};
 
         // We set the new mempool min fee to the feerate of the removed set, plus the
         // "minimum reasonable fee rate" (ie some value under which we consider txn
         // to have 0 fee). This way, we don't allow txn to enter mempool with feerate
         // equal to txn which were removed with no block in between.
-        CFeeRate removed(it->GetModFeesWithDescendants(), it->GetSizeWithDescendants());
+        CFeeRate removed(chunk.fee, chunk.size);
         removed += incrementalRelayFee;
         trackPackageRemoved(removed);
         maxFeeRateRemoved = std::max(maxFeeRateRemoved, removed);
 
         setEntries stage;
-        CalculateDescendants(mapTx.project<0>(it), stage);
+        for (txiter it : GetChunkTxs(chunk)) {
+            CalculateDescendants(it, stage);
+        }
         nTxnRemoved += stage.size();
 
         std::vector<CTransaction> txn;
@@ -1180,14 +1682,15 @@ void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<COutPoint>* pvNoSpends
 
 uint64_t CTxMemPool::CalculateDescendantMaximum(txiter entry) const {
     // find parent with highest descendant count
-    std::vector<txiter> candidates;
-    setEntries counted;
+    WITH_FRESH_EPOCH(m_epoch);
+    std::vector<txiter>& candidates{m_epoch_walk};
+    candidates.clear();
     candidates.push_back(entry);
     uint64_t maximum = 0;
     while (candidates.size()) {
         txiter candidate = candidates.back();
         candidates.pop_back();
-        if (!counted.insert(candidate).second) continue;
+        if (visited(candidate)) continue;
         const CTxMemPoolEntry::Parents& parents = candidate->GetMemPoolParentsConst();
         if (parents.size() == 0) {
             maximum = std::max(maximum, candidate->GetCountWithDescendants());
@@ -6,21 +6,26 @@
 #ifndef BITCOIN_TXMEMPOOL_H
 #define BITCOIN_TXMEMPOOL_H
 
+#include <algorithm>
 #include <atomic>
+#include <deque>
 #include <map>
 #include <optional>
 #include <set>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
 #include <coins.h>
 #include <consensus/amount.h>
 #include <indirectmap.h>
+#include <memusage.h>
 #include <policy/feerate.h>
 #include <policy/packages.h>
 #include <primitives/transaction.h>
 #include <random.h>
+#include <support/allocators/pool.h>
 #include <sync.h>
 #include <util/epochguard.h>
 #include <util/hasher.h>
@@ -70,6 +75,52 @@ struct CompareIteratorByHash {
     }
 };
 
+/**
+ * Set kept as a sorted vector.
+ *
+ * Mempool entries link to their in-mempool parents and children, and most
+ * have only one or two of either. A sorted vector stores such small sets in a
+ * single allocation, where a std::set allocates a node for every element.
+ */
+template <typename T, typename Compare>
+class SortedVectorSet
+{
+    std::vector<T> m_elements;
+
+public:
+    using value_type = T;
+    using const_iterator = typename std::vector<T>::const_iterator;
+    using iterator = const_iterator;
+
+    const_iterator begin() const { return m_elements.begin(); }
+    const_iterator end() const { return m_elements.end(); }
+    size_t size() const { return m_elements.size(); }
+    bool empty() const { return m_elements.empty(); }
+    void clear() { m_elements.clear(); }
+
+    std::pair<const_iterator, bool> insert(const T& value)
+    {
+        auto it{std::lower_bound(m_elements.begin(), m_elements.end(), value, Compare{})};
+        if (it != m_elements.end() && !Compare{}(value, *it)) return {it, false};
+        return {m_elements.insert(it, value), true};
+    }
+
+    size_t erase(const T& value)
+    {
+        auto it{std::lower_bound(m_elements.begin(), m_elements.end(), value, Compare{})};
+        if (it == m_elements.end() || Compare{}(value, *it)) return 0;
+        m_elements.erase(it);
+        return 1;
+    }
+
+    size_t count(const T& value) const
+    {
+        return std::binary_search(m_elements.begin(), m_elements.end(), value, Compare{});
+    }
+
+    size_t DynamicMemoryUsage() const { return memusage::DynamicUsage(m_elements); }
+};
+
 /** \class CTxMemPoolEntry
  *
  * CTxMemPoolEntry stores data about the corresponding transaction, as well
@@ -87,20 +138,17 @@ class CTxMemPoolEntry
 public:
     typedef std::reference_wrapper<const CTxMemPoolEntry> CTxMemPoolEntryRef;
     // two aliases, should the types ever diverge
-    typedef std::set<CTxMemPoolEntryRef, CompareIteratorByHash> Parents;
-    typedef std::set<CTxMemPoolEntryRef, CompareIteratorByHash> Children;
+    typedef SortedVectorSet<CTxMemPoolEntryRef, CompareIteratorByHash> Parents;
+    typedef SortedVectorSet<CTxMemPoolEntryRef, CompareIteratorByHash> Children;
 
 private:
+    // Members are ordered by size to avoid padding. Per-transaction values
+    // that are bounded by consensus rules are stored in 32 bits.
     const CTransactionRef tx;
     mutable Parents m_parents;
     mutable Children m_children;
     const CAmount nFee;             //!< Cached to avoid expensive parent-transaction lookups
-    const size_t nTxWeight;         //!< ... and avoid recomputing tx weight (also used for GetTxSize())
-    const size_t nUsageSize;        //!< ... and total memory usage
     const int64_t nTime;            //!< Local time when entering the mempool
-    const unsigned int entryHeight; //!< Chain height when entering the mempool
-    const bool spendsCoinbase;      //!< keep track of transactions that spend a coinbase
-    const int64_t sigOpCost;        //!< Total sigop cost
     int64_t feeDelta{0};            //!< Used for determining the priority of the transaction for mining in a block
     LockPoints lockPoints;     //!< Track the height and time at which tx was final
 
@@ -117,6 +165,12 @@ private:
     CAmount nModFeesWithAncestors;
     int64_t nSigOpCostWithAncestors;
 
+    const uint32_t nTxWeight;       //!< ... and avoid recomputing tx weight (also used for GetTxSize())
+    const uint32_t nUsageSize;      //!< ... and total memory usage
+    const unsigned int entryHeight; //!< Chain height when entering the mempool
+    const int32_t sigOpCost;        //!< Total sigop cost
+    const bool spendsCoinbase;      //!< keep track of transactions that spend a coinbase
+
 public:
     CTxMemPoolEntry(const CTransactionRef& tx, CAmount fee,
                     int64_t time, unsigned int entry_height,
@@ -161,8 +215,10 @@ public:
     Parents& GetMemPoolParents() const { return m_parents; }
     Children& GetMemPoolChildren() const { return m_children; }
 
-    mutable size_t vTxHashesIdx; //!< Index in mempool's vTxHashes
     mutable Epoch::Marker m_epoch_marker; //!< epoch when last touched, useful for graph algorithms
+    mutable uint64_t m_cluster_id{0}; //!< Cluster the transaction belongs to
+    mutable uint32_t vTxHashesIdx; //!< Index in mempool's vTxHashes
+    mutable uint32_t m_cluster_pos{0}; //!< Position in the linearization of its cluster
 };
 
 // extracts a transaction hash from CTxMemPoolEntry or CTransactionRef
@@ -312,6 +368,65 @@ public:
     }
 };
 
+/**
+ * A chunk of a mempool cluster: consecutive transactions of the cluster's
+ * linearization which are mined and evicted together, at their combined
+ * feerate. The chunks of a cluster have non-increasing feerates.
+ */
+struct TxMemPoolChunk
+{
+    uint64_t cluster_id;
+    size_t index; //!< Position of the chunk in its cluster
+    size_t begin; //!< Range of the chunk's transactions in the cluster's linearization
+    size_t end;
+    CAmount fee;  //!< Sum of the modified fees of the transactions
+    int64_t size; //!< Sum of the virtual sizes of the transactions
+};
+
+/** \class CompareTxMemPoolChunkByFeerate
+ *
+ *  Sort chunks by feerate in descending order. Chunks with the same feerate
+ *  are sorted by cluster and position, so the chunks of a cluster are always
+ *  visited in order, and the last chunk is always the last of its cluster.
+ */
+class CompareTxMemPoolChunkByFeerate
+{
+public:
+    bool operator()(const TxMemPoolChunk& a, const TxMemPoolChunk& b) const
+    {
+        // Avoid division by rewriting (a/b > c/d) as (a*d > c*b).
+        double f1 = (double)a.fee * b.size;
+        double f2 = (double)b.fee * a.size;
+        if (f1 != f2) {
+            return f1 > f2;
+        }
+        if (a.cluster_id != b.cluster_id) {
+            return a.cluster_id < b.cluster_id;
+        }
+        return a.index < b.index;
+    }
+};
+
+/**
+ * A connected component of the graph of in-mempool transactions and their
+ * spends, kept linearized: its transactions are in a valid order to appear in
+ * a block, with the highest feerate prefixes first.
+ */
+struct TxMemPoolCluster
+{
+    //! Transactions in linearization order. Removed transactions are null
+    //! until the cluster is updated.
+    std::vector<const CTxMemPoolEntry*> txs;
+    //! Chunks of the linearization, in order
+    std::vector<TxMemPoolChunk> chunks;
+    //! Number of removed transactions in txs
+    size_t removed{0};
+    //! Whether txs is known to be in topological order
+    bool topological{true};
+    //! Dynamic memory usage of txs and chunks, as last accounted for
+    size_t usage{0};
+};
+
 // Multi_index tag names
 struct descendant_score {};
 struct entry_time {};
@@ -418,6 +533,17 @@ enum class MemPoolRemovalReason {
  * CalculateMemPoolAncestors() and CalculateDescendants() that rely
  * on them to walk the mempool are not generally safe to use).
  *
+ * Clusters:
+ *
+ * Every transaction also belongs to exactly one cluster, a connected component
+ * of the graph of direct parents and children. Each cluster is kept linearized
+ * and split into chunks of non-increasing feerate; the chunks of all clusters
+ * are sorted by feerate in m_chunks. Block assembly takes the chunks from the
+ * front and TrimToSize() evicts them from the back, so mining and eviction use
+ * the same order. Clusters are updated whenever a transaction is added,
+ * removed or prioritised, at a cost that depends on the size of the cluster
+ * only.
+ *
  * Computational limits:
  *
  * Updating all in-mempool ancestors of a newly added transaction can be slow,
@@ -447,10 +573,33 @@ protected:
     // is added or removed from the mempool for any reason.
     mutable uint64_t m_sequence_number GUARDED_BY(cs){1};
 
+    struct MempoolChange {
+        uint64_t sequence;
+        uint256 txid;
+        bool added;
+    };
+    //! Latest transactions added to and removed from the mempool, oldest first
+    std::deque<MempoolChange> m_change_log GUARDED_BY(cs);
+    //! All changes from this mempool sequence on are in m_change_log
+    uint64_t m_change_log_start GUARDED_BY(cs){1};
+
+    void LogChange(const uint256& txid, bool added, uint64_t sequence) EXCLUSIVE_LOCKS_REQUIRED(cs);
+
     void trackPackageRemoved(const CFeeRate& rate) EXCLUSIVE_LOCKS_REQUIRED(cs);
 
     bool m_is_loaded GUARDED_BY(cs){false};
 
+    std::unordered_map<uint64_t, TxMemPoolCluster> m_clusters GUARDED_BY(cs);
+    std::set<TxMemPoolChunk, CompareTxMemPoolChunkByFeerate> m_chunks GUARDED_BY(cs); //!< Chunks of all clusters
+    std::set<uint64_t> m_dirty_clusters GUARDED_BY(cs); //!< Clusters changed since they were last chunked
+    uint64_t m_next_cluster_id GUARDED_BY(cs){1};
+    uint64_t m_cluster_usage GUARDED_BY(cs){0}; //!< sum of the dynamic memory usage of the clusters
+    bool m_defer_cluster_updates GUARDED_BY(cs){false}; //!< Do not update dirty clusters after every removal
+    uint64_t m_backlog_size GUARDED_BY(cs){0}; //!< totalTxSize when the fee estimator was last given the backlog
+
+    //! Memory of the mapTx nodes, each of which holds an entry and the links of all its indexes
+    PoolResource m_entry_resource;
+
 public:
 
     static const int ROLLING_FEE_HALFLIFE = 60 * 60 * 12; // public only for testing
@@ -484,7 +633,8 @@ public:
                 boost::multi_index::identity<CTxMemPoolEntry>,
                 CompareTxMemPoolEntryByAncestorFee
             >
-        >
+        >,
+        PoolAllocator<CTxMemPoolEntry>
     > indexed_transaction_set;
 
     /**
@@ -515,16 +665,19 @@ public:
      * the mempool is consistent with the new chain tip and fully populated.
      */
     mutable RecursiveMutex cs;
-    indexed_transaction_set mapTx GUARDED_BY(cs);
+    indexed_transaction_set mapTx GUARDED_BY(cs){indexed_transaction_set::ctor_args_list{}, indexed_transaction_set::allocator_type{m_entry_resource}};
 
     using txiter = indexed_transaction_set::nth_index<0>::type::const_iterator;
     std::vector<std::pair<uint256, txiter>> vTxHashes GUARDED_BY(cs); //!< All tx witness hashes/entries in mapTx, in random order
 
     typedef std::set<txiter, CompareIteratorByHash> setEntries;
 
-    uint64_t CalculateDescendantMaximum(txiter entry) const EXCLUSIVE_LOCKS_REQUIRED(cs);
+    uint64_t CalculateDescendantMaximum(txiter entry) const EXCLUSIVE_LOCKS_REQUIRED(cs) LOCKS_EXCLUDED(m_epoch);
 private:
-    typedef std::map<txiter, setEntries, CompareIteratorByHash> cacheMap;
+    typedef std::map<txiter, std::vector<txiter>, CompareIteratorByHash> cacheMap;
+
+    //! Work list of the epoch-based walks over ancestors and descendants, kept to reuse its capacity
+    mutable std::vector<txiter> m_epoch_walk GUARDED_BY(m_epoch);
 
 
     void UpdateParent(txiter entry, txiter parent, bool add) EXCLUSIVE_LOCKS_REQUIRED(cs);
@@ -543,18 +696,26 @@ private:
      * and descendant limits (including staged_ancestors thsemselves, entry_size and entry_count).
      * param@[in]   entry_size          Virtual size to include in the limits.
      * param@[in]   entry_count         How many entries to include in the limits.
-     * param@[in]   staged_ancestors    Should contain entries in the mempool.
+     * param@[in]   staged_ancestors    Should contain entries in the mempool, each of which was
+     *                                  visited in the current epoch. Used as the work list of the walk.
      * param@[out]  setAncestors        Will be populated with all mempool ancestors.
      */
     bool CalculateAncestorsAndCheckLimits(size_t entry_size,
                                           size_t entry_count,
                                           setEntries& setAncestors,
-                                          CTxMemPoolEntry::Parents &staged_ancestors,
+                                          std::vector<txiter>& staged_ancestors,
                                           uint64_t limitAncestorCount,
                                           uint64_t limitAncestorSize,
                                           uint64_t limitDescendantCount,
                                           uint64_t limitDescendantSize,
-                                          std::string &errString) const EXCLUSIVE_LOCKS_REQUIRED(cs);
+                                          std::string &errString) const EXCLUSIVE_LOCKS_REQUIRED(cs, m_epoch);
+
+    /** Fill ancestors with all in-mempool ancestors of it, following the cached
+     *  parents of each entry, and descendants with all in-mempool descendants
+     *  of it. it is not included. The vectors are cleared first, so they can
+     *  be reused across calls. */
+    void GetAncestors(txiter it, std::vector<txiter>& ancestors) const EXCLUSIVE_LOCKS_REQUIRED(cs) LOCKS_EXCLUDED(m_epoch);
+    void GetDescendants(txiter it, std::vector<txiter>& descendants) const EXCLUSIVE_LOCKS_REQUIRED(cs) LOCKS_EXCLUDED(m_epoch);
 
 public:
     indirectmap<COutPoint, const CTransaction*> mapNextTx GUARDED_BY(cs);
@@ -666,7 +827,7 @@ public:
      *  fSearchForParents = whether to search a tx's vin for in-mempool parents, or
      *    look up parents from mapLinks. Must be true for entries not in the mempool
      */
-    bool CalculateMemPoolAncestors(const CTxMemPoolEntry& entry, setEntries& setAncestors, uint64_t limitAncestorCount, uint64_t limitAncestorSize, uint64_t limitDescendantCount, uint64_t limitDescendantSize, std::string& errString, bool fSearchForParents = true) const EXCLUSIVE_LOCKS_REQUIRED(cs);
+    bool CalculateMemPoolAncestors(const CTxMemPoolEntry& entry, setEntries& setAncestors, uint64_t limitAncestorCount, uint64_t limitAncestorSize, uint64_t limitDescendantCount, uint64_t limitDescendantSize, std::string& errString, bool fSearchForParents = true) const EXCLUSIVE_LOCKS_REQUIRED(cs) LOCKS_EXCLUDED(m_epoch);
 
     /** Calculate all in-mempool ancestors of a set of transactions not already in the mempool and
      * check ancestor and descendant limits. Heuristics are used to estimate the ancestor and
@@ -688,12 +849,29 @@ public:
                             uint64_t limitAncestorSize,
                             uint64_t limitDescendantCount,
                             uint64_t limitDescendantSize,
-                            std::string &errString) const EXCLUSIVE_LOCKS_REQUIRED(cs);
+                            std::string &errString) const EXCLUSIVE_LOCKS_REQUIRED(cs) LOCKS_EXCLUDED(m_epoch);
+
+    /** Check that new transactions would not make their cluster too large.
+     * The new transactions must be connected to each other, like a single transaction or a
+     * child with its parents. Their cluster merges the clusters of all their in-mempool ancestors.
+     * Replaced transactions are not counted, but their removal is assumed not to split the
+     * cluster, so its size may be overestimated.
+     * @param[in]       ancestors               In-mempool ancestors of the new transactions.
+     * @param[in]       new_count               Number of new transactions.
+     * @param[in]       replaced                Mempool entries replaced by the new transactions.
+     * @param[in]       limitClusterCount       Max number of txns in the cluster.
+     * @param[out]      errString               Populated with error reason if the limit is hit.
+     */
+    bool CheckClusterLimit(const setEntries& ancestors,
+                           size_t new_count,
+                           const setEntries& replaced,
+                           uint64_t limitClusterCount,
+                           std::string& errString) const EXCLUSIVE_LOCKS_REQUIRED(cs);
 
     /** Populate setDescendants with all in-mempool descendants of hash.
      *  Assumes that setDescendants includes all in-mempool descendants of anything
      *  already in it.  */
-    void CalculateDescendants(txiter it, setEntries& setDescendants) const EXCLUSIVE_LOCKS_REQUIRED(cs);
+    void CalculateDescendants(txiter it, setEntries& setDescendants) const EXCLUSIVE_LOCKS_REQUIRED(cs) LOCKS_EXCLUDED(m_epoch);
 
     /** The minimum fee to get into the mempool, which may itself not be enough
       *  for larger-sized transactions.
@@ -703,7 +881,8 @@ public:
       */
     CFeeRate GetMinFee(size_t sizelimit) const;
 
-    /** Remove transactions from the mempool until its dynamic size is <= sizelimit.
+    /** Remove transactions from the mempool until UsageForSizeLimit() is <= sizelimit,
+      *  evicting the chunks with the lowest feerate first.
       *  pvNoSpendsRemaining, if set, will be populated with the list of outpoints
       *  which are not in mempool which no longer have any spends in this mempool.
       */
@@ -763,6 +942,13 @@ public:
     std::vector<TxMempoolInfo> infoAll() const;
 
     size_t DynamicMemoryUsage() const;
+    /**
+     * Memory usage that TrimToSize() and GetMinFee() compare against the size limit.
+     * Evicted entries only make their pool memory available to new entries, it is not
+     * returned to the system. So instead of the free pool memory, one chunk of room to
+     * grow is counted, which keeps DynamicMemoryUsage() within the limit.
+     */
+    size_t UsageForSizeLimit() const;
 
     /** Adds a transaction to the unbroadcast set */
     void AddUnbroadcastTx(const uint256& txid)
@@ -799,6 +985,35 @@ public:
         return m_sequence_number;
     }
 
+    /** Number of changes GetChangesSince can report at most */
+    static constexpr size_t MAX_CHANGE_LOG_SIZE{100000};
+
+    /**
+     * Get the transactions added to and removed from the mempool since
+     * GetSequence() returned `since`. A transaction that was added and then
+     * removed is left out, one that was removed and added again is reported
+     * as added.
+     *
+     * @returns false if the changes since then are not known anymore, or
+     *          `since` is a sequence the mempool has not reached yet.
+     */
+    bool GetChangesSince(uint64_t since, std::vector<uint256>& added, std::vector<uint256>& removed) const EXCLUSIVE_LOCKS_REQUIRED(cs);
+
+    /** Returns the chunks of all clusters, sorted by feerate in descending order */
+    const std::set<TxMemPoolChunk, CompareTxMemPoolChunkByFeerate>& GetChunks() const EXCLUSIVE_LOCKS_REQUIRED(cs)
+    {
+        AssertLockHeld(cs);
+        return m_chunks;
+    }
+
+    /** Returns the transactions of a chunk, in a valid order to appear in a block */
+    std::vector<txiter> GetChunkTxs(const TxMemPoolChunk& chunk) const EXCLUSIVE_LOCKS_REQUIRED(cs);
+
+    /** Returns the lowest feerate that gets into each of the next num_blocks
+     *  blocks if no other transactions arrive, CFeeRate(0) for blocks the
+     *  mempool does not fill */
+    std::vector<CFeeRate> GetBlockFeerates(unsigned int num_blocks) const EXCLUSIVE_LOCKS_REQUIRED(cs);
+
 private:
     /** UpdateForDescendants is used by UpdateTransactionsFromBlock to update
      *  the descendants for a single transaction that has been added to the
@@ -834,15 +1049,17 @@ private:
      */
     void UpdateForDescendants(txiter updateIt, cacheMap& cachedDescendants,
                               const std::set<uint256>& setExclude, std::set<uint256>& descendants_to_remove,
-                              uint64_t ancestor_size_limit, uint64_t ancestor_count_limit) EXCLUSIVE_LOCKS_REQUIRED(cs);
-    /** Update ancestors of hash to add/remove it as a descendant transaction. */
-    void UpdateAncestorsOf(bool add, txiter hash, setEntries &setAncestors) EXCLUSIVE_LOCKS_REQUIRED(cs);
+                              uint64_t ancestor_size_limit, uint64_t ancestor_count_limit) EXCLUSIVE_LOCKS_REQUIRED(cs) LOCKS_EXCLUDED(m_epoch);
+    /** Update ancestors of hash to add/remove it as a descendant transaction.
+     *  Entries is a setEntries or a std::vector<txiter>. */
+    template <typename Entries>
+    void UpdateAncestorsOf(bool add, txiter hash, const Entries& ancestors) EXCLUSIVE_LOCKS_REQUIRED(cs);
     /** Set ancestor state for an entry */
     void UpdateEntryForAncestors(txiter it, const setEntries &setAncestors) EXCLUSIVE_LOCKS_REQUIRED(cs);
     /** For each transaction being removed, update ancestors and any direct children.
       * If updateDescendants is true, then also update in-mempool descendants'
       * ancestor state. */
-    void UpdateForRemoveFromMempool(const setEntries &entriesToRemove, bool updateDescendants) EXCLUSIVE_LOCKS_REQUIRED(cs);
+    void UpdateForRemoveFromMempool(const setEntries &entriesToRemove, bool updateDescendants) EXCLUSIVE_LOCKS_REQUIRED(cs) LOCKS_EXCLUDED(m_epoch);
     /** Sever link between specified transaction and direct children. */
     void UpdateChildrenForRemoval(txiter entry) EXCLUSIVE_LOCKS_REQUIRED(cs);
 
@@ -855,6 +1072,26 @@ private:
      *  removal.
      */
     void removeUnchecked(txiter entry, MemPoolRemovalReason reason) EXCLUSIVE_LOCKS_REQUIRED(cs);
+
+    /** Remove the chunks of a cluster, so UpdateChunks() computes them from scratch. */
+    void ClearClusterChunks(TxMemPoolCluster& cluster) EXCLUSIVE_LOCKS_REQUIRED(cs);
+    /** Remove a cluster along with its chunks. */
+    void EraseCluster(uint64_t cluster_id) EXCLUSIVE_LOCKS_REQUIRED(cs);
+    /** Chunk the transactions at the end of a linearized cluster which are
+     *  not in a chunk, and drop the chunks of those which were removed from it. */
+    void UpdateChunks(uint64_t cluster_id, TxMemPoolCluster& cluster) EXCLUSIVE_LOCKS_REQUIRED(cs);
+    /** Add a new transaction, whose in-mempool parents are known, to the
+     *  cluster of its parents, merging their clusters if needed. */
+    void AddToCluster(txiter it) EXCLUSIVE_LOCKS_REQUIRED(cs);
+    /** Merge two clusters after a link between them was found. */
+    void MergeClusters(uint64_t cluster_a, uint64_t cluster_b) EXCLUSIVE_LOCKS_REQUIRED(cs);
+    /** Drop removed transactions from the dirty clusters, split them into
+     *  connected components, linearize and chunk them again. Large clusters
+     *  which were only changed at their end are chunked again from there. */
+    void UpdateClusters() EXCLUSIVE_LOCKS_REQUIRED(cs) LOCKS_EXCLUDED(m_epoch);
+    /** Pass the feerates of the next blocks to the fee estimator, if forced
+     *  or if the mempool size changed by a quarter of a block since. */
+    void UpdateFeeEstimatorBacklog(bool force) EXCLUSIVE_LOCKS_REQUIRED(cs);
 public:
     /** visited marks a CTxMemPoolEntry as having been traversed
      * during the lifetime of the most recently created Epoch::Guard
@@ -6,8 +6,10 @@
 
 #include <consensus/validation.h>
 #include <logging.h>
+#include <policy/feerate.h>
 #include <policy/policy.h>
 
+#include <algorithm>
 #include <cassert>
 
 /** Expiration time for orphan transactions in seconds */
@@ -22,8 +24,12 @@ bool TxOrphanage::AddTx(const CTransactionRef& tx, NodeId peer)
     AssertLockHeld(g_cs_orphans);
 
     const uint256& hash = tx->GetHash();
-    if (m_orphans.count(hash))
+    const auto it_existing = m_orphans.find(hash);
+    if (it_existing != m_orphans.end()) {
+        AddAnnouncement(it_existing, peer);
+        ++m_counters.duplicates;
         return false;
+    }
 
     // Ignore big transactions, to avoid a
     // send-big-orphans memory exhaustion attack. If a peer has a legitimate
@@ -39,9 +45,11 @@ bool TxOrphanage::AddTx(const CTransactionRef& tx, NodeId peer)
         return false;
     }
 
-    auto ret = m_orphans.emplace(hash, OrphanTx{tx, peer, GetTime() + ORPHAN_TX_EXPIRE_TIME, m_orphan_list.size()});
+    auto ret = m_orphans.emplace(hash, OrphanTx{tx, peer, GetTime() + ORPHAN_TX_EXPIRE_TIME, {}});
     assert(ret.second);
-    m_orphan_list.push_back(ret.first);
+    AddAnnouncement(ret.first, peer);
+    m_total_weight += sz;
+    ++m_counters.added;
     // Allow for lookups in the orphan pool by wtxid, as well as txid
     m_wtxid_to_orphan_it.emplace(tx->GetWitnessHash(), ret.first);
     for (const CTxIn& txin : tx->vin) {
@@ -53,6 +61,24 @@ bool TxOrphanage::AddTx(const CTransactionRef& tx, NodeId peer)
     return true;
 }
 
+void TxOrphanage::AddAnnouncement(OrphanMap::iterator it, NodeId peer)
+{
+    AssertLockHeld(g_cs_orphans);
+    if (it->second.announcers.insert(peer).second) {
+        ++m_peer_announcements[peer];
+    }
+}
+
+bool TxOrphanage::AddAnnouncer(const uint256& wtxid, NodeId peer)
+{
+    AssertLockHeld(g_cs_orphans);
+    const auto it = m_wtxid_to_orphan_it.find(wtxid);
+    if (it == m_wtxid_to_orphan_it.end()) return false;
+    AddAnnouncement(it->second, peer);
+    ++m_counters.duplicates;
+    return true;
+}
+
 int TxOrphanage::EraseTx(const uint256& txid)
 {
     AssertLockHeld(g_cs_orphans);
@@ -69,16 +95,11 @@ int TxOrphanage::EraseTx(const uint256& txid)
             m_outpoint_to_orphan_it.erase(itPrev);
     }
 
-    size_t old_pos = it->second.list_pos;
-    assert(m_orphan_list[old_pos] == it);
-    if (old_pos + 1 != m_orphan_list.size()) {
-        // Unless we're deleting the last entry in m_orphan_list, move the last
-        // entry to the position we're deleting.
-        auto it_last = m_orphan_list.back();
-        m_orphan_list[old_pos] = it_last;
-        it_last->second.list_pos = old_pos;
+    for (const NodeId peer : it->second.announcers) {
+        const auto it_peer = m_peer_announcements.find(peer);
+        if (--it_peer->second == 0) m_peer_announcements.erase(it_peer);
     }
-    m_orphan_list.pop_back();
+    m_total_weight -= GetTransactionWeight(*it->second.tx);
     m_wtxid_to_orphan_it.erase(it->second.tx->GetWitnessHash());
 
     m_orphans.erase(it);
@@ -89,16 +110,23 @@ void TxOrphanage::EraseForPeer(NodeId peer)
 {
     AssertLockHeld(g_cs_orphans);
 
+    if (!m_peer_announcements.count(peer)) return;
     int nErased = 0;
     std::map<uint256, OrphanTx>::iterator iter = m_orphans.begin();
     while (iter != m_orphans.end())
     {
         std::map<uint256, OrphanTx>::iterator maybeErase = iter++; // increment to avoid iterator becoming invalid
-        if (maybeErase->second.fromPeer == peer)
-        {
-            nErased += EraseTx(maybeErase->second.tx->GetHash());
+        OrphanTx& orphan = maybeErase->second;
+        if (!orphan.announcers.count(peer)) continue;
+        if (orphan.announcers.size() == 1) {
+            nErased += EraseTx(orphan.tx->GetHash());
+            continue;
         }
+        // Another peer announced it too, keep it for them
+        orphan.announcers.erase(peer);
+        if (orphan.fromPeer == peer) orphan.fromPeer = *orphan.announcers.begin();
     }
+    m_peer_announcements.erase(peer);
     if (nErased > 0) LogPrint(BCLog::MEMPOOL, "Erased %d orphan tx from peer=%d\n", nErased, peer);
 }
 
@@ -125,16 +153,28 @@ unsigned int TxOrphanage::LimitOrphans(unsigned int max_orphans)
         }
         // Sweep again 5 minutes after the next entry that expires in order to batch the linear scan.
         nNextSweep = nMinExpTime + ORPHAN_TX_EXPIRE_INTERVAL;
+        m_counters.expired += nErased;
         if (nErased > 0) LogPrint(BCLog::MEMPOOL, "Erased %d orphan tx due to expiration\n", nErased);
     }
-    FastRandomContext rng;
     while (m_orphans.size() > max_orphans)
     {
-        // Evict a random orphan:
-        size_t randompos = rng.randrange(m_orphan_list.size());
-        EraseTx(m_orphan_list[randompos]->first);
+        // Evict from the peer with the most announcements. Of its orphans,
+        // prefer those no other peer announced, then the oldest.
+        const NodeId peer = std::max_element(m_peer_announcements.begin(), m_peer_announcements.end(),
+            [](const auto& a, const auto& b) { return a.second < b.second; })->first;
+        OrphanMap::iterator to_evict = m_orphans.end();
+        for (auto iter = m_orphans.begin(); iter != m_orphans.end(); ++iter) {
+            if (!iter->second.announcers.count(peer)) continue;
+            if (to_evict == m_orphans.end() ||
+                std::make_pair(iter->second.announcers.size(), iter->second.nTimeExpire) <
+                std::make_pair(to_evict->second.announcers.size(), to_evict->second.nTimeExpire)) {
+                to_evict = iter;
+            }
+        }
+        EraseTx(to_evict->first);
         ++nEvicted;
     }
+    m_counters.evicted += nEvicted;
     return nEvicted;
 }
 
@@ -151,6 +191,42 @@ void TxOrphanage::AddChildrenToWorkSet(const CTransaction& tx, std::set<uint256>
     }
 }
 
+std::vector<CTransactionRef> TxOrphanage::GetWorkBatch(std::set<uint256>& orphan_work_set, size_t max_batch, size_t max_candidates,
+                                                     const FeeLookup& get_fee)
+{
+    AssertLockHeld(g_cs_orphans);
+
+    std::vector<std::pair<CFeeRate, CTransactionRef>> candidates;
+    for (size_t examined = 0; examined < max_candidates && !orphan_work_set.empty(); ++examined) {
+        const auto it = m_orphans.find(*orphan_work_set.begin());
+        orphan_work_set.erase(orphan_work_set.begin());
+        if (it == m_orphans.end()) continue;
+        const CTransactionRef& tx = it->second.tx;
+        const std::optional<CAmount> fee = get_fee(*tx);
+        if (!fee) {
+            // Reconsidering it would fail for missing inputs again.
+            ++m_counters.deferred;
+            continue;
+        }
+        candidates.emplace_back(CFeeRate(*fee, GetVirtualTransactionSize(*tx)), tx);
+    }
+
+    const size_t batch_size = std::min(max_batch, candidates.size());
+    std::partial_sort(candidates.begin(), candidates.begin() + batch_size, candidates.end(),
+                      [](const auto& a, const auto& b) { return a.first > b.first; });
+    std::vector<CTransactionRef> batch;
+    batch.reserve(batch_size);
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        if (i < batch_size) {
+            batch.push_back(candidates[i].second);
+        } else {
+            orphan_work_set.insert(candidates[i].second->GetHash());
+        }
+    }
+    m_counters.reconsidered += batch.size();
+    return batch;
+}
+
 bool TxOrphanage::HaveTx(const GenTxid& gtxid) const
 {
     LOCK(g_cs_orphans);
@@ -197,6 +273,22 @@ void TxOrphanage::EraseForBlock(const CBlock& block)
         for (const uint256& orphanHash : vOrphanErase) {
             nErased += EraseTx(orphanHash);
         }
+        m_counters.erased_for_block += nErased;
         LogPrint(BCLog::MEMPOOL, "Erased %d orphan tx included or conflicted by block\n", nErased);
     }
 }
+
+TxOrphanageStats TxOrphanage::GetStats() const
+{
+    LOCK(g_cs_orphans);
+
+    TxOrphanageStats stats{m_counters};
+    stats.orphans = m_orphans.size();
+    stats.weight = m_total_weight;
+    for (const auto& [peer, count] : m_peer_announcements) {
+        stats.announcements += count;
+    }
+    stats.peers = m_peer_announcements.size();
+    stats.outpoints = m_outpoint_to_orphan_it.size();
+    return stats;
+}
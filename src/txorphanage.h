@@ -5,14 +5,46 @@
 #ifndef BITCOIN_TXORPHANAGE_H
 #define BITCOIN_TXORPHANAGE_H
 
+#include <consensus/amount.h>
 #include <net.h>
 #include <primitives/block.h>
 #include <primitives/transaction.h>
 #include <sync.h>
 
+#include <functional>
+#include <optional>
+
 /** Guards orphan transactions and extra txs for compact blocks */
 extern RecursiveMutex g_cs_orphans;
 
+/** Statistics of the orphan pool */
+struct TxOrphanageStats {
+    //! Number of orphans
+    size_t orphans{0};
+    //! Total weight of the orphans
+    size_t weight{0};
+    //! Number of (orphan, peer) announcements
+    size_t announcements{0};
+    //! Number of peers with announced orphans
+    size_t peers{0};
+    //! Number of missing outpoints the orphans are indexed by
+    size_t outpoints{0};
+    //! Orphans added since startup
+    uint64_t added{0};
+    //! Announcements of orphans that were already known
+    uint64_t duplicates{0};
+    //! Orphans handed out to be reconsidered for the mempool
+    uint64_t reconsidered{0};
+    //! Orphans not reconsidered as some of their inputs were still missing
+    uint64_t deferred{0};
+    //! Orphans evicted to keep the orphan pool within its limit
+    uint64_t evicted{0};
+    //! Orphans erased as they expired
+    uint64_t expired{0};
+    //! Orphans erased as they were included in or conflicted by a block
+    uint64_t erased_for_block{0};
+};
+
 /** A class to track orphan transactions (failed on TX_MISSING_INPUTS)
  * Since we cannot distinguish orphans from bad transactions with
  * non-existent inputs, we heavily limit the number of orphans
@@ -20,13 +52,18 @@ extern RecursiveMutex g_cs_orphans;
  */
 class TxOrphanage {
 public:
-    /** Add a new orphan transaction */
+    /** Add a new orphan transaction. If it is already known, the peer is
+     * recorded as one more announcer and false is returned. */
     bool AddTx(const CTransactionRef& tx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
 
+    /** Record a peer as announcer of an orphan we already have, found by
+     * wtxid. Returns whether the orphan is known. */
+    bool AddAnnouncer(const uint256& wtxid, NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
+
     /** Check if we already have an orphan transaction (by txid or wtxid) */
     bool HaveTx(const GenTxid& gtxid) const LOCKS_EXCLUDED(::g_cs_orphans);
 
-    /** Get an orphan transaction and its originating peer
+    /** Get an orphan transaction and the peer to hold responsible for it
      * (Transaction ref will be nullptr if not found)
      */
     std::pair<CTransactionRef, NodeId> GetTx(const uint256& txid) const EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
@@ -34,19 +71,37 @@ public:
     /** Erase an orphan by txid */
     int EraseTx(const uint256& txid) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
 
-    /** Erase all orphans announced by a peer (eg, after that peer disconnects) */
+    /** Forget the announcements of a peer (eg, after that peer disconnects).
+     * Orphans that no other peer announced are erased. */
     void EraseForPeer(NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
 
     /** Erase all orphans included in or invalidated by a new block */
     void EraseForBlock(const CBlock& block) LOCKS_EXCLUDED(::g_cs_orphans);
 
-    /** Limit the orphanage to the given maximum */
+    /** Limit the orphanage to the given maximum. Orphans are evicted from the
+     * peer with the most announcements, oldest first, so that a peer flooding
+     * us with orphans does not push out the orphans of others. */
     unsigned int LimitOrphans(unsigned int max_orphans) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
 
     /** Add any orphans that list a particular tx as a parent into a peer's work set
      * (ie orphans that may have found their final missing parent, and so should be reconsidered for the mempool) */
     void AddChildrenToWorkSet(const CTransaction& tx, std::set<uint256>& orphan_work_set) const EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
 
+    /** Returns the fee of a transaction, or std::nullopt if some of its inputs are missing */
+    using FeeLookup = std::function<std::optional<CAmount>(const CTransaction&)>;
+
+    /**
+     * Take the orphans to reconsider next out of a work set.
+     *
+     * At most max_candidates orphans are taken out of the work set. Those
+     * that still miss inputs according to get_fee are not reconsidered; they
+     * are added to a work set again once a parent is accepted. Of the others,
+     * the max_batch orphans with the highest fee rate are returned, and the
+     * rest is left in the work set.
+     */
+    std::vector<CTransactionRef> GetWorkBatch(std::set<uint256>& orphan_work_set, size_t max_batch, size_t max_candidates,
+                                              const FeeLookup& get_fee) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
+
     /** Return how many entries exist in the orphange */
     size_t Size() LOCKS_EXCLUDED(::g_cs_orphans)
     {
@@ -54,12 +109,16 @@ public:
         return m_orphans.size();
     }
 
+    TxOrphanageStats GetStats() const LOCKS_EXCLUDED(::g_cs_orphans);
+
 protected:
     struct OrphanTx {
         CTransactionRef tx;
+        //! Peer to hold responsible for the orphan, one of the announcers
         NodeId fromPeer;
         int64_t nTimeExpire;
-        size_t list_pos;
+        //! Peers that sent us the orphan
+        std::set<NodeId> announcers;
     };
 
     /** Map from txid to orphan transaction record. Limited by
@@ -81,12 +140,21 @@ protected:
      *  to remove orphan transactions from the m_orphans */
     std::map<COutPoint, std::set<OrphanMap::iterator, IteratorComparator>> m_outpoint_to_orphan_it GUARDED_BY(g_cs_orphans);
 
-    /** Orphan transactions in vector for quick random eviction */
-    std::vector<OrphanMap::iterator> m_orphan_list GUARDED_BY(g_cs_orphans);
-
     /** Index from wtxid into the m_orphans to lookup orphan
      *  transactions using their witness ids. */
     std::map<uint256, OrphanMap::iterator> m_wtxid_to_orphan_it GUARDED_BY(g_cs_orphans);
+
+    /** Number of orphans announced by each peer */
+    std::map<NodeId, size_t> m_peer_announcements GUARDED_BY(g_cs_orphans);
+
+    /** Total weight of the orphans */
+    size_t m_total_weight GUARDED_BY(g_cs_orphans){0};
+
+    /** Counters reported by GetStats */
+    TxOrphanageStats m_counters GUARDED_BY(g_cs_orphans);
+
+    /** Record a peer as announcer of an orphan */
+    void AddAnnouncement(OrphanMap::iterator it, NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
 };
 
 #endif // BITCOIN_TXORPHANAGE_H
@@ -0,0 +1,95 @@
+// Copyright (c) 2022 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <util/epoll.h>
+
+#include <logging.h>
+#include <util/sock.h>
+#include <util/time.h>
+
+#ifdef USE_EPOLL
+
+#include <array>
+
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+Epoll::Epoll()
+{
+    m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epoll_fd == -1) {
+        LogPrintf("epoll_create1() failed: %s\n", NetworkErrorString(errno));
+        return;
+    }
+    m_wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (m_wake_fd == -1) {
+        LogPrintf("eventfd() failed: %s\n", NetworkErrorString(errno));
+        return;
+    }
+    if (!Add(m_wake_fd, WAKE_ID, /*edge_triggered=*/false)) {
+        close(m_wake_fd);
+        m_wake_fd = -1;
+    }
+}
+
+Epoll::~Epoll()
+{
+    if (m_wake_fd != -1) close(m_wake_fd);
+    if (m_epoll_fd != -1) close(m_epoll_fd);
+}
+
+bool Epoll::Add(SOCKET socket, uint64_t id, bool edge_triggered)
+{
+    epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLRDHUP;
+    if (edge_triggered) ev.events |= EPOLLOUT | EPOLLET;
+    ev.data.u64 = id;
+    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, socket, &ev) == -1) {
+        LogPrintf("epoll_ctl(EPOLL_CTL_ADD) failed: %s\n", NetworkErrorString(errno));
+        return false;
+    }
+    return true;
+}
+
+void Epoll::Remove(SOCKET socket)
+{
+    epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, socket, nullptr);
+}
+
+void Epoll::Wake()
+{
+    const uint64_t one{1};
+    // Fails with EAGAIN only if the counter is about to overflow, in which
+    // case a wake up is pending anyway.
+    [[maybe_unused]] const ssize_t written{write(m_wake_fd, &one, sizeof(one))};
+}
+
+bool Epoll::Wait(std::chrono::milliseconds timeout, std::vector<Event>& events)
+{
+    events.clear();
+    std::array<epoll_event, MAX_EVENTS> ready;
+    const int n{epoll_wait(m_epoll_fd, ready.data(), ready.size(), count_milliseconds(timeout))};
+    if (n == -1) {
+        return errno == EINTR;
+    }
+    for (int i = 0; i < n; ++i) {
+        const epoll_event& ev{ready[i]};
+        if (ev.data.u64 == WAKE_ID) {
+            uint64_t count;
+            [[maybe_unused]] const ssize_t read_bytes{read(m_wake_fd, &count, sizeof(count))};
+            continue;
+        }
+        events.push_back(Event{
+            ev.data.u64,
+            (ev.events & (EPOLLIN | EPOLLRDHUP)) != 0,
+            (ev.events & EPOLLOUT) != 0,
+            (ev.events & (EPOLLERR | EPOLLHUP)) != 0,
+        });
+    }
+    return true;
+}
+
+#endif // USE_EPOLL
@@ -0,0 +1,85 @@
+// Copyright (c) 2022 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_UTIL_EPOLL_H
+#define BITCOIN_UTIL_EPOLL_H
+
+#include <compat.h>
+
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#ifdef USE_EPOLL
+
+/**
+ * Sockets watched for readiness by an epoll(7) instance, and an eventfd(2)
+ * to wake up the thread waiting for them.
+ *
+ * Unlike poll(2), sockets stay registered between waits, so the cost of a
+ * wait does not grow with the number of idle sockets. A socket added as edge
+ * triggered is only reported again after it became ready anew, so the caller
+ * has to remember the sockets it did not drain.
+ *
+ * Add(), Remove() and Wake() may be called from any thread, Wait() from one
+ * thread at a time.
+ */
+class Epoll
+{
+public:
+    /** Reserved for waking up, not to be used as id of a socket. */
+    static constexpr uint64_t WAKE_ID{std::numeric_limits<uint64_t>::max()};
+    /** Maximum number of events returned by one Wait(). */
+    static constexpr int MAX_EVENTS{1024};
+
+    struct Event {
+        uint64_t id;
+        //! Data can be received, or the peer shut down its side
+        bool recv;
+        //! Data can be sent
+        bool send;
+        //! An error occurred or the connection was hung up
+        bool error;
+    };
+
+    Epoll();
+    ~Epoll();
+    Epoll(const Epoll&) = delete;
+    Epoll& operator=(const Epoll&) = delete;
+
+    /** Whether the epoll instance and the eventfd were created. */
+    bool IsValid() const { return m_epoll_fd != -1 && m_wake_fd != -1; }
+
+    /**
+     * Watch a socket until it is removed or closed.
+     * @param[in] socket Socket to watch for receiving, sending and errors.
+     * @param[in] id Reported with the socket's events.
+     * @param[in] edge_triggered Only report readiness when it changes.
+     * @returns false on error
+     */
+    bool Add(SOCKET socket, uint64_t id, bool edge_triggered);
+
+    /** Stop watching a socket. Closing a socket removes it, too. */
+    void Remove(SOCKET socket);
+
+    /** Make the current Wait() return, or the next one if no thread is waiting. */
+    void Wake();
+
+    /**
+     * Wait until a watched socket is ready, Wake() is called or the timeout expires.
+     * @param[in] timeout Maximum time to wait.
+     * @param[out] events The sockets that are ready.
+     * @returns false on error
+     */
+    bool Wait(std::chrono::milliseconds timeout, std::vector<Event>& events);
+
+private:
+    int m_epoll_fd{-1};
+    int m_wake_fd{-1};
+};
+
+#endif // USE_EPOLL
+
+#endif // BITCOIN_UTIL_EPOLL_H
@@ -22,6 +22,7 @@ std::string StringForFeeReason(FeeReason reason)
         {FeeReason::FULL_ESTIMATE, "Target 85% Threshold"},
         {FeeReason::DOUBLE_ESTIMATE, "Double Target 95% Threshold"},
         {FeeReason::CONSERVATIVE, "Conservative Double Target longer horizon"},
+        {FeeReason::MEMPOOL_BACKLOG, "Mempool Backlog"},
         {FeeReason::MEMPOOL_MIN, "Mempool Min Fee"},
         {FeeReason::PAYTXFEE, "PayTxFee set"},
         {FeeReason::FALLBACK, "Fallback fee"},
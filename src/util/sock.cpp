@@ -10,13 +10,17 @@
 #include <util/system.h>
 #include <util/time.h>
 
+#include <algorithm>
 #include <memory>
 #include <stdexcept>
 #include <string>
+#include <vector>
 
 #ifdef WIN32
 #include <codecvt>
 #include <locale>
+#else
+#include <sys/uio.h>
 #endif
 
 #ifdef USE_POLL
@@ -64,6 +68,23 @@ ssize_t Sock::Send(const void* data, size_t len, int flags) const
     return send(m_socket, static_cast<const char*>(data), len, flags);
 }
 
+ssize_t Sock::SendMany(Span<const Span<const unsigned char>> buffers, int flags) const
+{
+#ifdef WIN32
+    return Send(buffers[0].data(), buffers[0].size(), flags);
+#else
+    std::vector<iovec> iov;
+    iov.reserve(std::min<size_t>(buffers.size(), IOV_MAX));
+    for (const auto& buffer : buffers.first(std::min<size_t>(buffers.size(), IOV_MAX))) {
+        iov.push_back(iovec{const_cast<unsigned char*>(buffer.data()), buffer.size()});
+    }
+    msghdr msg{};
+    msg.msg_iov = iov.data();
+    msg.msg_iovlen = iov.size();
+    return sendmsg(m_socket, &msg, flags);
+#endif
+}
+
 ssize_t Sock::Recv(void* buf, size_t len, int flags) const
 {
     return recv(m_socket, static_cast<char*>(buf), len, flags);
@@ -6,6 +6,7 @@
 #define BITCOIN_UTIL_SOCK_H
 
 #include <compat.h>
+#include <span.h>
 #include <threadinterrupt.h>
 #include <util/time.h>
 
@@ -85,6 +86,17 @@ public:
      */
     [[nodiscard]] virtual ssize_t Send(const void* data, size_t len, int flags) const;
 
+    /**
+     * sendmsg(2) wrapper, sending several buffers with one system call as if they were
+     * concatenated. Where sendmsg(2) is not available only the first buffer is sent.
+     * Code that uses this wrapper can be unit tested if this method is overridden by a mock
+     * Sock implementation.
+     * @param[in] buffers Non-empty list of buffers to send, in order.
+     * @param[in] flags Flags as for `Send()`.
+     * @return the number of bytes sent, or -1 on error
+     */
+    [[nodiscard]] virtual ssize_t SendMany(Span<const Span<const unsigned char>> buffers, int flags) const;
+
     /**
      * recv(2) wrapper. Equivalent to `recv(this->Get(), buf, len, flags);`. Code that uses this
      * wrapper can be unit tested if this method is overridden by a mock Sock implementation.
@@ -33,7 +33,6 @@
 #include <primitives/block.h>
 #include <primitives/transaction.h>
 #include <random.h>
-#include <reverse_iterator.h>
 #include <script/script.h>
 #include <script/sigcache.h>
 #include <shutdown.h>
@@ -50,6 +49,7 @@
 #include <util/rbf.h>
 #include <util/strencodings.h>
 #include <util/system.h>
+#include <util/thread.h>
 #include <util/trace.h>
 #include <util/translation.h>
 #include <validationinterface.h>
@@ -177,6 +177,10 @@ bool CheckInputScripts(const CTransaction& tx, TxValidationState& state,
                        bool cacheFullScriptStore, PrecomputedTransactionData& txdata,
                        std::vector<CScriptCheck>* pvChecks = nullptr)
                        EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+bool CheckInputScriptsParallel(const CTransaction& tx, TxValidationState& state,
+                               const CCoinsViewCache& inputs, unsigned int flags, bool cacheSigStore,
+                               bool cacheFullScriptStore, PrecomputedTransactionData& txdata)
+                               EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
 bool CheckFinalTx(const CBlockIndex* active_chain_tip, const CTransaction &tx, int flags)
 {
@@ -449,9 +453,12 @@ static bool CheckInputsFromMempoolAndCache(const CTransaction& tx, TxValidationS
     }
 
     // Call CheckInputScripts() to cache signature and script validity against current tip consensus rules.
-    return CheckInputScripts(tx, state, view, flags, /* cacheSigStore= */ true, /* cacheFullScriptStore= */ true, txdata);
+    return CheckInputScriptsParallel(tx, state, view, flags, /* cacheSigStore= */ true, /* cacheFullScriptStore= */ true, txdata);
 }
 
+static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+static CCheckQueue<CHeaderCheck> headercheckqueue(128);
+
 namespace {
 
 class MemPoolAccept
@@ -461,7 +468,8 @@ public:
         m_limit_ancestors(gArgs.GetIntArg("-limitancestorcount", DEFAULT_ANCESTOR_LIMIT)),
         m_limit_ancestor_size(gArgs.GetIntArg("-limitancestorsize", DEFAULT_ANCESTOR_SIZE_LIMIT)*1000),
         m_limit_descendants(gArgs.GetIntArg("-limitdescendantcount", DEFAULT_DESCENDANT_LIMIT)),
-        m_limit_descendant_size(gArgs.GetIntArg("-limitdescendantsize", DEFAULT_DESCENDANT_SIZE_LIMIT)*1000) {
+        m_limit_descendant_size(gArgs.GetIntArg("-limitdescendantsize", DEFAULT_DESCENDANT_SIZE_LIMIT)*1000),
+        m_limit_cluster_count(gArgs.GetIntArg("-limitclustercount", DEFAULT_CLUSTER_LIMIT)) {
     }
 
     // We put the arguments we're handed into a struct, so we can pass them
@@ -488,6 +496,10 @@ public:
          * partially submitted.
          */
         const bool m_package_submission;
+        /** When true, the transaction is submitted along with unrelated ones. The mempool is
+         * trimmed once after all of them were added to it, instead of in Finalize().
+         */
+        const bool m_batch_submission;
 
         /** Parameters for single transaction mempool validation. */
         static ATMPArgs SingleAccept(const CChainParams& chainparams, int64_t accept_time,
@@ -500,6 +512,22 @@ public:
                             /* m_test_accept */ test_accept,
                             /* m_allow_bip125_replacement */ true,
                             /* m_package_submission */ false,
+                            /* m_batch_submission */ false,
+            };
+        }
+
+        /** Parameters for the validation of unrelated transactions submitted together. Transactions
+         * replacing mempool transactions are left to single transaction validation. */
+        static ATMPArgs BatchAccept(const CChainParams& chainparams, int64_t accept_time,
+                                    std::vector<COutPoint>& coins_to_uncache) {
+            return ATMPArgs{/* m_chainparams */ chainparams,
+                            /* m_accept_time */ accept_time,
+                            /* m_bypass_limits */ false,
+                            /* m_coins_to_uncache */ coins_to_uncache,
+                            /* m_test_accept */ false,
+                            /* m_allow_bip125_replacement */ false,
+                            /* m_package_submission */ false,
+                            /* m_batch_submission */ true,
             };
         }
 
@@ -513,6 +541,7 @@ public:
                             /* m_test_accept */ true,
                             /* m_allow_bip125_replacement */ false,
                             /* m_package_submission */ false, // not submitting to mempool
+                            /* m_batch_submission */ false,
             };
         }
 
@@ -526,6 +555,7 @@ public:
                             /* m_test_accept */ false,
                             /* m_allow_bip125_replacement */ false,
                             /* m_package_submission */ true,
+                            /* m_batch_submission */ false,
             };
         }
         // No default ctor to avoid exposing details to clients and allowing the possibility of
@@ -549,6 +579,15 @@ public:
      */
     PackageMempoolAcceptResult AcceptPackage(const Package& package, ATMPArgs& args) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+    /**
+     * Accept transactions that do not depend on each other under a single acquisition of the
+     * mempool lock, verifying their scripts in parallel on the script check worker threads.
+     * Transactions that spend or conflict with an earlier one of the batch, replace mempool
+     * transactions or no longer fit the mempool chain limits after the earlier ones were added
+     * are left for single transaction validation: their result is std::nullopt.
+     */
+    std::vector<std::optional<MempoolAcceptResult>> AcceptBatch(const std::vector<CTransactionRef>& txns, ATMPArgs& args) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
 private:
     // All the intermediate state that gets passed between the various levels
     // of checking a given transaction.
@@ -601,9 +640,14 @@ private:
     // Run checks for mempool replace-by-fee.
     bool ReplacementChecks(Workspace& ws) EXCLUSIVE_LOCKS_REQUIRED(cs_main, m_pool.cs);
 
-    // Enforce package mempool ancestor/descendant limits (distinct from individual
-    // ancestor/descendant limits done in PreChecks).
+    // Enforce the cluster size limit, not counting the transactions the
+    // transaction would replace. Requires ws.m_ancestors and ws.m_all_conflicting.
+    bool ClusterChecks(Workspace& ws) EXCLUSIVE_LOCKS_REQUIRED(cs_main, m_pool.cs);
+
+    // Enforce package mempool ancestor/descendant and cluster limits (distinct from individual
+    // limits done in PreChecks).
     bool PackageMempoolChecks(const std::vector<CTransactionRef>& txns,
+                              const std::vector<Workspace>& workspaces,
                               PackageValidationState& package_state) EXCLUSIVE_LOCKS_REQUIRED(cs_main, m_pool.cs);
 
     // Run the script checks using our policy flags. As this can be slow, we should
@@ -660,6 +704,7 @@ private:
     // in-mempool conflicts; see below).
     size_t m_limit_descendants;
     size_t m_limit_descendant_size;
+    const size_t m_limit_cluster_count;
 
     /** Whether the transaction(s) would replace any mempool transactions. If so, RBF rules apply. */
     bool m_rbf{false};
@@ -902,6 +947,8 @@ bool MemPoolAccept::PreChecks(ATMPArgs& args, Workspace& ws)
     }
 
     m_rbf = !ws.m_conflicts.empty();
+    // Replacements are checked once all transactions they replace are known.
+    if (!m_rbf && !ClusterChecks(ws)) return false; // state filled in by ClusterChecks()
     return true;
 }
 
@@ -948,10 +995,23 @@ bool MemPoolAccept::ReplacementChecks(Workspace& ws)
                                          ::incrementalRelayFee, hash)}) {
         return state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "insufficient fee", *err_string);
     }
+    return ClusterChecks(ws);
+}
+
+bool MemPoolAccept::ClusterChecks(Workspace& ws)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(m_pool.cs);
+
+    std::string err_string;
+    if (!m_pool.CheckClusterLimit(ws.m_ancestors, /*new_count=*/1, ws.m_all_conflicting, m_limit_cluster_count, err_string)) {
+        return ws.m_state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "too-large-cluster", err_string);
+    }
     return true;
 }
 
 bool MemPoolAccept::PackageMempoolChecks(const std::vector<CTransactionRef>& txns,
+                                         const std::vector<Workspace>& workspaces,
                                          PackageValidationState& package_state)
 {
     AssertLockHeld(cs_main);
@@ -967,6 +1027,15 @@ bool MemPoolAccept::PackageMempoolChecks(const std::vector<CTransactionRef>& txn
         // This is a package-wide error, separate from an individual transaction error.
         return package_state.Invalid(PackageValidationResult::PCKG_POLICY, "package-mempool-limits", err_string);
     }
+
+    // The package transactions are connected, so they join the clusters of all their ancestors.
+    CTxMemPool::setEntries ancestors;
+    for (const Workspace& ws : workspaces) {
+        ancestors.insert(ws.m_ancestors.begin(), ws.m_ancestors.end());
+    }
+    if (!m_pool.CheckClusterLimit(ancestors, txns.size(), /*replaced=*/{}, m_limit_cluster_count, err_string)) {
+        return package_state.Invalid(PackageValidationResult::PCKG_POLICY, "package-mempool-limits", err_string);
+    }
    return true;
 }
 
@@ -981,7 +1050,7 @@ bool MemPoolAccept::PolicyScriptChecks(const ATMPArgs& args, Workspace& ws)
 
     // Check input scripts and signatures.
     // This is done last to help prevent CPU exhaustion denial-of-service attacks.
-    if (!CheckInputScripts(tx, state, m_view, scriptVerifyFlags, true, false, ws.m_precomputed_txdata)) {
+    if (!CheckInputScriptsParallel(tx, state, m_view, scriptVerifyFlags, true, false, ws.m_precomputed_txdata)) {
         // SCRIPT_VERIFY_CLEANSTACK requires SCRIPT_VERIFY_WITNESS, so we
         // need to turn both off, and compare against just turning off CLEANSTACK
         // to see if the failure is specifically due to witness validation.
@@ -1070,7 +1139,7 @@ bool MemPoolAccept::Finalize(const ATMPArgs& args, Workspace& ws)
     // If we are validating a package, don't trim here because we could evict a previous transaction
     // in the package. LimitMempoolSize() should be called at the very end to make sure the mempool
     // is still within limits and package submission happens atomically.
-    if (!args.m_package_submission && !bypass_limits) {
+    if (!args.m_package_submission && !args.m_batch_submission && !bypass_limits) {
         LimitMempoolSize(m_pool, m_active_chainstate.CoinsTip(), gArgs.GetIntArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, std::chrono::hours{gArgs.GetIntArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY)});
         if (!m_pool.exists(GenTxid::Txid(hash)))
             return state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "mempool full");
@@ -1218,7 +1287,7 @@ PackageMempoolAcceptResult MemPoolAccept::AcceptMultipleTransactions(const std::
     // because it's unnecessary. Also, CPFP carve out can increase the limit for individual
     // transactions, but this exemption is not extended to packages in CheckPackageLimits().
     std::string err_string;
-    if (txns.size() > 1 && !PackageMempoolChecks(txns, package_state)) {
+    if (txns.size() > 1 && !PackageMempoolChecks(txns, workspaces, package_state)) {
         return PackageMempoolAcceptResult(package_state, std::move(results));
     }
 
@@ -1248,6 +1317,95 @@ PackageMempoolAcceptResult MemPoolAccept::AcceptMultipleTransactions(const std::
     return PackageMempoolAcceptResult(package_state, std::move(results));
 }
 
+std::vector<std::optional<MempoolAcceptResult>> MemPoolAccept::AcceptBatch(const std::vector<CTransactionRef>& txns, ATMPArgs& args)
+{
+    AssertLockHeld(cs_main);
+    assert(!args.m_allow_bip125_replacement && !args.m_test_accept);
+    LOCK(m_pool.cs); // mempool "read lock" (held through GetMainSignals().TransactionAddedToMempool())
+
+    std::vector<std::optional<MempoolAcceptResult>> results(txns.size());
+    std::vector<std::pair<size_t, Workspace>> workspaces;
+    workspaces.reserve(txns.size());
+
+    // Coins of the inputs and outputs of the transactions seen so far. A transaction touching
+    // any of them is validated after the batch, once the transactions it depends on are in
+    // the mempool.
+    std::set<COutPoint> batch_spent;
+    std::set<uint256> batch_txids;
+    for (size_t i = 0; i < txns.size(); ++i) {
+        const CTransaction& tx{*txns[i]};
+        bool related{!batch_txids.insert(tx.GetHash()).second};
+        for (const CTxIn& txin : tx.vin) {
+            if (!batch_spent.insert(txin.prevout).second || batch_txids.count(txin.prevout.hash)) related = true;
+        }
+        if (related) continue;
+
+        Workspace& ws{workspaces.emplace_back(i, Workspace(txns[i])).second};
+        if (!PreChecks(args, ws)) {
+            if (ws.m_state.GetRejectReason() != "bip125-replacement-disallowed") {
+                results[i].emplace(MempoolAcceptResult::Failure(ws.m_state));
+            }
+            workspaces.pop_back();
+        }
+    }
+
+    // Verify the scripts of all transactions together. If any of them fails, PolicyScriptChecks()
+    // tells which ones; the signature cache then holds the signatures that were valid.
+    bool all_scripts_valid{false};
+    if (g_parallel_script_checks) {
+        std::vector<CScriptCheck> checks;
+        for (auto& [i, ws] : workspaces) {
+            std::vector<CScriptCheck> tx_checks;
+            CheckInputScripts(*ws.m_ptx, ws.m_state, m_view, STANDARD_SCRIPT_VERIFY_FLAGS, /*cacheSigStore=*/true,
+                              /*cacheFullScriptStore=*/true, ws.m_precomputed_txdata, &tx_checks);
+            std::move(tx_checks.begin(), tx_checks.end(), std::back_inserter(checks));
+        }
+        CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+        control.Add(checks);
+        all_scripts_valid = control.Wait();
+    }
+
+    std::vector<std::pair<size_t, Workspace>*> submitted;
+    for (auto& entry : workspaces) {
+        auto& [i, ws] = entry;
+        if ((!all_scripts_valid && !PolicyScriptChecks(args, ws)) || !ConsensusScriptChecks(args, ws)) {
+            results[i].emplace(MempoolAcceptResult::Failure(ws.m_state));
+            continue;
+        }
+        // The transactions added before may have grown the ancestors, descendants and cluster
+        // this transaction is counted against.
+        std::string unused_err_string;
+        ws.m_ancestors.clear();
+        if (!m_pool.CalculateMemPoolAncestors(*ws.m_entry, ws.m_ancestors, m_limit_ancestors,
+                                              m_limit_ancestor_size, m_limit_descendants,
+                                              m_limit_descendant_size, unused_err_string) ||
+            !ClusterChecks(ws)) {
+            continue;
+        }
+        if (!Finalize(args, ws)) {
+            results[i].emplace(MempoolAcceptResult::Failure(ws.m_state));
+            continue;
+        }
+        submitted.push_back(&entry);
+    }
+
+    LimitMempoolSize(m_pool, m_active_chainstate.CoinsTip(),
+                     gArgs.GetIntArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000,
+                     std::chrono::hours{gArgs.GetIntArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY)});
+
+    for (auto* entry : submitted) {
+        auto& [i, ws] = *entry;
+        if (m_pool.exists(GenTxid::Wtxid(ws.m_ptx->GetWitnessHash()))) {
+            GetMainSignals().TransactionAddedToMempool(ws.m_ptx, m_pool.GetAndIncrementSequence());
+            results[i].emplace(MempoolAcceptResult::Success(std::move(ws.m_replaced_transactions), ws.m_vsize, ws.m_base_fees));
+        } else {
+            ws.m_state.Invalid(TxValidationResult::TX_MEMPOOL_POLICY, "mempool full");
+            results[i].emplace(MempoolAcceptResult::Failure(ws.m_state));
+        }
+    }
+    return results;
+}
+
 PackageMempoolAcceptResult MemPoolAccept::AcceptPackage(const Package& package, ATMPArgs& args)
 {
     AssertLockHeld(cs_main);
@@ -1382,6 +1540,44 @@ MempoolAcceptResult AcceptToMemoryPool(CChainState& active_chainstate, const CTr
     return result;
 }
 
+std::vector<MempoolAcceptResult> AcceptBatchToMemoryPool(CChainState& active_chainstate, const std::vector<CTransactionRef>& txns,
+                                                         int64_t accept_time)
+{
+    AssertLockHeld(::cs_main);
+    assert(active_chainstate.GetMempool() != nullptr);
+    CTxMemPool& pool{*active_chainstate.GetMempool()};
+
+    std::vector<COutPoint> coins_to_uncache;
+    auto args = MemPoolAccept::ATMPArgs::BatchAccept(active_chainstate.m_params, accept_time, coins_to_uncache);
+    auto batch_results{MemPoolAccept(pool, active_chainstate).AcceptBatch(txns, args)};
+
+    // Remove the coins that were only cached for the transactions that were not accepted, see
+    // AcceptToMemoryPool().
+    std::set<COutPoint> accepted_prevouts;
+    for (size_t i = 0; i < txns.size(); ++i) {
+        if (!batch_results[i] || batch_results[i]->m_result_type != MempoolAcceptResult::ResultType::VALID) continue;
+        for (const CTxIn& txin : txns[i]->vin) {
+            accepted_prevouts.insert(txin.prevout);
+        }
+    }
+    for (const COutPoint& outpoint : coins_to_uncache) {
+        if (!accepted_prevouts.count(outpoint)) active_chainstate.CoinsTip().Uncache(outpoint);
+    }
+
+    std::vector<MempoolAcceptResult> results;
+    results.reserve(txns.size());
+    for (size_t i = 0; i < txns.size(); ++i) {
+        if (batch_results[i]) {
+            results.push_back(*batch_results[i]);
+        } else {
+            results.push_back(AcceptToMemoryPool(active_chainstate, txns[i], accept_time, /*bypass_limits=*/false, /*test_accept=*/false));
+        }
+    }
+    BlockValidationState state_dummy;
+    active_chainstate.FlushStateToDisk(state_dummy, FlushStateMode::PERIODIC);
+    return results;
+}
+
 PackageMempoolAcceptResult ProcessNewPackage(CChainState& active_chainstate, CTxMemPool& pool,
                                                    const Package& package, bool test_accept)
 {
@@ -1464,6 +1660,9 @@ void CChainState::InitCoinsDB(
 
     m_coins_views = std::make_unique<CoinsViews>(
         leveldb_name, cache_size_bytes, in_memory, should_wipe);
+    if (gArgs.GetBoolArg("-coinswritebehind", DEFAULT_COINS_WRITE_BEHIND)) {
+        m_coins_views->m_dbview.StartWriteBehind();
+    }
 }
 
 void CChainState::InitCoinsCache(size_t cache_size_bytes)
@@ -1598,15 +1797,22 @@ bool CScriptCheck::operator()() {
 
 static CuckooCache::cache<uint256, SignatureCacheHasher> g_scriptExecutionCache;
 static CSHA256 g_scriptExecutionCacheHasher;
+static uint256 g_scriptExecutionCacheNonce;
 
-void InitScriptExecutionCache() {
-    // Setup the salted hasher
-    uint256 nonce = GetRandHash();
+static void SaltScriptExecutionCache(const uint256& nonce)
+{
+    g_scriptExecutionCacheNonce = nonce;
     // We want the nonce to be 64 bytes long to force the hasher to process
     // this chunk, which makes later hash computations more efficient. We
     // just write our 32-byte entropy twice to fill the 64 bytes.
+    g_scriptExecutionCacheHasher.Reset();
     g_scriptExecutionCacheHasher.Write(nonce.begin(), 32);
     g_scriptExecutionCacheHasher.Write(nonce.begin(), 32);
+}
+
+void InitScriptExecutionCache() {
+    // Setup the salted hasher
+    SaltScriptExecutionCache(GetRandHash());
     // nMaxCacheSize is unsigned. If -maxsigcachesize is set to zero,
     // setup_bytes creates the minimum possible cache (2 elements).
     size_t nMaxCacheSize = std::min(std::max((int64_t)0, gArgs.GetIntArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE) / 2), MAX_MAX_SIG_CACHE_SIZE) * ((size_t) 1 << 20);
@@ -1615,6 +1821,15 @@ void InitScriptExecutionCache() {
             (nElems*sizeof(uint256)) >>20, (nMaxCacheSize*2)>>20, nElems);
 }
 
+/** Key of the script execution cache entry of a transaction whose scripts passed under flags. */
+static uint256 ScriptExecutionCacheEntry(const CTransaction& tx, unsigned int flags)
+{
+    uint256 entry;
+    CSHA256 hasher = g_scriptExecutionCacheHasher;
+    hasher.Write(tx.GetWitnessHash().begin(), 32).Write((unsigned char*)&flags, sizeof(flags)).Finalize(entry.begin());
+    return entry;
+}
+
 /**
  * Check whether all of this transaction's input scripts succeed.
  *
@@ -1650,9 +1865,7 @@ bool CheckInputScripts(const CTransaction& tx, TxValidationState& state,
     // correct (ie that the transaction hash which is in tx's prevouts
     // properly commits to the scriptPubKey in the inputs view of that
     // transaction).
-    uint256 hashCacheEntry;
-    CSHA256 hasher = g_scriptExecutionCacheHasher;
-    hasher.Write(tx.GetWitnessHash().begin(), 32).Write((unsigned char*)&flags, sizeof(flags)).Finalize(hashCacheEntry.begin());
+    const uint256 hashCacheEntry{ScriptExecutionCacheEntry(tx, flags)};
     AssertLockHeld(cs_main); //TODO: Remove this requirement by making CuckooCache not require external locks
     if (g_scriptExecutionCache.contains(hashCacheEntry, !cacheFullScriptStore)) {
         return true;
@@ -1722,6 +1935,42 @@ bool CheckInputScripts(const CTransaction& tx, TxValidationState& state,
     return true;
 }
 
+/**
+ * Same as CheckInputScripts(), but the inputs of the transaction are verified
+ * on the script check threads if there are any, so that a transaction with
+ * many inputs does not hold up the calling thread for as long. The remaining
+ * inputs are skipped as soon as one of them fails.
+ */
+bool CheckInputScriptsParallel(const CTransaction& tx, TxValidationState& state,
+                               const CCoinsViewCache& inputs, unsigned int flags, bool cacheSigStore,
+                               bool cacheFullScriptStore, PrecomputedTransactionData& txdata)
+{
+    AssertLockHeld(cs_main);
+    if (!g_parallel_script_checks || tx.vin.size() < 2) {
+        return CheckInputScripts(tx, state, inputs, flags, cacheSigStore, cacheFullScriptStore, txdata);
+    }
+
+    std::vector<CScriptCheck> checks;
+    if (!CheckInputScripts(tx, state, inputs, flags, cacheSigStore, cacheFullScriptStore, txdata, &checks)) {
+        return false;
+    }
+    // No checks are returned if the script execution was cached.
+    if (checks.empty()) return true;
+
+    CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+    control.Add(checks);
+    if (!control.Wait()) {
+        // Check the inputs again one at a time to find out which one failed
+        // and why. Those that were verified already hit the signature cache
+        // if cacheSigStore is set.
+        return CheckInputScripts(tx, state, inputs, flags, cacheSigStore, cacheFullScriptStore, txdata);
+    }
+    if (cacheFullScriptStore) {
+        g_scriptExecutionCache.insert(ScriptExecutionCacheEntry(tx, flags));
+    }
+    return true;
+}
+
 bool AbortNode(BlockValidationState& state, const std::string& strMessage, const bilingual_str& userMessage)
 {
     AbortNode(strMessage, userMessage);
@@ -1824,18 +2073,53 @@ DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockI
     return fClean ? DISCONNECT_OK : DISCONNECT_UNCLEAN;
 }
 
-static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
-
 void StartScriptCheckWorkerThreads(int threads_num)
 {
     scriptcheckqueue.StartWorkerThreads(threads_num);
+    headercheckqueue.StartWorkerThreads(threads_num, "headerch");
 }
 
 void StopScriptCheckWorkerThreads()
 {
     scriptcheckqueue.StopWorkerThreads();
+    headercheckqueue.StopWorkerThreads();
 }
 
+/**
+ * Script checks of consecutive blocks that are connected before any of them
+ * has been verified.
+ *
+ * Connecting a block queues its script checks and returns, so the script
+ * check threads keep working while the inputs of the next block are looked
+ * up, instead of idling until the master thread queues the next block. The
+ * blocks are connected to a view on top of the coins tip, which is only
+ * flushed into it once all checks passed. If any check fails, the view is
+ * dropped and the blocks are connected again one at a time.
+ */
+class ScriptCheckWindow
+{
+public:
+    //! Upper bound on the number of queued checks, which hold a copy of the spent output
+    static constexpr size_t MAX_CHECKS{100000};
+
+    struct Block {
+        CBlockIndex* pindex;
+        std::shared_ptr<const CBlock> block;
+    };
+
+    explicit ScriptCheckWindow(CCoinsView* coins_tip) : m_view{coins_tip}, m_control{&scriptcheckqueue} {}
+
+    CCoinsViewCache m_view;
+    //! Precomputed data referenced by the queued checks, one vector per block
+    std::vector<std::vector<PrecomputedTransactionData>> m_txsdata;
+    std::vector<Block> m_blocks;
+    size_t m_checks{0};
+    //! Declared last, so the checks are finished before the data they refer to is destroyed
+    CCheckQueueControl<CScriptCheck> m_control;
+
+    bool Full(size_t max_blocks) const { return m_blocks.size() >= max_blocks || m_checks >= MAX_CHECKS; }
+};
+
 /**
  * Threshold condition checker that triggers when unknown versionbits are seen on the network.
  */
@@ -1922,7 +2206,7 @@ static int64_t nBlocksTotal = 0;
  *  Validity checks that depend on the UTXO set are also done; ConnectBlock()
  *  can fail if those validity checks fail (among other reasons). */
 bool CChainState::ConnectBlock(const CBlock& block, BlockValidationState& state, CBlockIndex* pindex,
-                               CCoinsViewCache& view, bool fJustCheck)
+                               CCoinsViewCache& view, bool fJustCheck, ScriptCheckWindow* window)
 {
     AssertLockHeld(cs_main);
     assert(pindex);
@@ -2108,9 +2392,15 @@ bool CChainState::ConnectBlock(const CBlock& block, BlockValidationState& state,
     // until after `control` has run the script checks (potentially
     // in multiple threads). Preallocate the vector size so a new allocation
     // doesn't invalidate pointers into the vector, and keep txsdata in scope
-    // for as long as `control`.
-    CCheckQueueControl<CScriptCheck> control(fScriptChecks && g_parallel_script_checks ? &scriptcheckqueue : nullptr);
-    std::vector<PrecomputedTransactionData> txsdata(block.vtx.size());
+    // for as long as `control`. With a script check window, the checks are
+    // only waited for once later blocks have been connected, so both are
+    // owned by the window.
+    assert(!window || (g_parallel_script_checks && !fJustCheck));
+    CCheckQueueControl<CScriptCheck> block_control(fScriptChecks && g_parallel_script_checks && !window ? &scriptcheckqueue : nullptr);
+    CCheckQueueControl<CScriptCheck>& control{window ? window->m_control : block_control};
+    std::vector<PrecomputedTransactionData> block_txsdata;
+    std::vector<PrecomputedTransactionData>& txsdata{window ? window->m_txsdata.emplace_back() : block_txsdata};
+    txsdata.resize(block.vtx.size());
 
     std::vector<int> prevheights;
     CAmount nFees = 0;
@@ -2175,6 +2465,7 @@ bool CChainState::ConnectBlock(const CBlock& block, BlockValidationState& state,
                 return error("ConnectBlock(): CheckInputScripts on %s failed with %s",
                     tx.GetHash().ToString(), state.ToString());
             }
+            if (window) window->m_checks += vChecks.size();
             control.Add(vChecks);
         }
 
@@ -2193,7 +2484,7 @@ bool CChainState::ConnectBlock(const CBlock& block, BlockValidationState& state,
         return state.Invalid(BlockValidationResult::BLOCK_CONSENSUS, "bad-cb-amount");
     }
 
-    if (!control.Wait()) {
+    if (!window && !control.Wait()) {
         LogPrintf("ERROR: %s: CheckQueue failed\n", __func__);
         return state.Invalid(BlockValidationResult::BLOCK_CONSENSUS, "block-validation-failed");
     }
@@ -2207,7 +2498,7 @@ bool CChainState::ConnectBlock(const CBlock& block, BlockValidationState& state,
         return false;
     }
 
-    if (!pindex->IsValid(BLOCK_VALID_SCRIPTS)) {
+    if (!window && !pindex->IsValid(BLOCK_VALID_SCRIPTS)) {
         pindex->RaiseValidity(BLOCK_VALID_SCRIPTS);
         m_blockman.m_dirty_blockindex.insert(pindex);
     }
@@ -2245,7 +2536,8 @@ CoinsCacheSizeState CChainState::GetCoinsCacheSizeState(
 {
     AssertLockHeld(::cs_main);
     const int64_t nMempoolUsage = m_mempool ? m_mempool->DynamicMemoryUsage() : 0;
-    int64_t cacheSize = CoinsTip().DynamicMemoryUsage();
+    // Coins that are still being written in the background are kept in memory as well.
+    int64_t cacheSize = CoinsTip().DynamicMemoryUsage() + CoinsDB().PendingMemoryUsage();
     int64_t nTotalSpace =
         max_coins_cache_size_bytes + std::max<int64_t>(int64_t(max_mempool_size_bytes) - nMempoolUsage, 0);
 
@@ -2263,6 +2555,28 @@ CoinsCacheSizeState CChainState::GetCoinsCacheSizeState(
     return CoinsCacheSizeState::OK;
 }
 
+size_t CChainState::GetCoinsCacheRetainSize()
+{
+    AssertLockHeld(::cs_main);
+    return this->GetCoinsCacheRetainSize(
+        m_coinstip_cache_size_bytes,
+        gArgs.GetIntArg("-dbcacheretain", nDefaultDbCacheRetain));
+}
+
+size_t CChainState::GetCoinsCacheRetainSize(
+    size_t max_coins_cache_size_bytes,
+    int64_t retain_percent)
+{
+    AssertLockHeld(::cs_main);
+    // The LARGE state starts at 90% of the budget at the latest. Stay well
+    // below, so that a few blocks can be connected before the next flush.
+    static constexpr int64_t MAX_RETAIN_PERCENT{80};
+    retain_percent = std::clamp<int64_t>(retain_percent, 0, MAX_RETAIN_PERCENT);
+    const size_t retain_size{max_coins_cache_size_bytes / 100 * retain_percent};
+    const size_t pending{CoinsDB().PendingMemoryUsage()};
+    return retain_size > pending ? retain_size - pending : 0;
+}
+
 bool CChainState::FlushStateToDisk(
     BlockValidationState &state,
     FlushStateMode mode,
@@ -2283,7 +2597,22 @@ bool CChainState::FlushStateToDisk(
         bool fFlushForPrune = false;
         bool fDoFullFlush = false;
 
+        if (CoinsDB().WriteFailed()) {
+            return AbortNode(state, "Failed to write to coin database");
+        }
+        const bool write_pending{CoinsDB().HasPendingWrite()};
+
         CoinsCacheSizeState cache_state = GetCoinsCacheSizeState();
+        // Make room by evicting unmodified coins instead of writing the
+        // modified ones, while those fit in the size kept across flushes.
+        if (cache_state >= CoinsCacheSizeState::LARGE && (mode == FlushStateMode::IF_NEEDED || mode == FlushStateMode::PERIODIC)) {
+            const size_t retain_size{GetCoinsCacheRetainSize()};
+            if (retain_size > 0 && CoinsTip().Trim(retain_size)) {
+                LogPrint(BCLog::COINDB, "Evicted unmodified coins from the coins cache (%d coins, %.2fkB left)\n",
+                    CoinsTip().GetCacheSize(), CoinsTip().DynamicMemoryUsage() / 1000.0);
+                cache_state = GetCoinsCacheSizeState();
+            }
+        }
         LOCK(m_blockman.cs_LastBlockFile);
         if (fPruneMode && (m_blockman.m_check_for_pruning || nManualPruneHeight > 0) && !fReindex) {
             // make sure we don't prune above the blockfilterindexes bestblocks
@@ -2320,7 +2649,8 @@ bool CChainState::FlushStateToDisk(
             nLastFlush = nNow;
         }
         // The cache is large and we're within 10% and 10 MiB of the limit, but we have time now (not in the middle of a block processing).
-        bool fCacheLarge = mode == FlushStateMode::PERIODIC && cache_state >= CoinsCacheSizeState::LARGE;
+        // If the coins of the previous flush are still being written in the background, this waits until the cache is over the limit.
+        bool fCacheLarge = mode == FlushStateMode::PERIODIC && cache_state >= CoinsCacheSizeState::LARGE && !write_pending;
         // The cache is over the limit, we have to write now.
         bool fCacheCritical = mode == FlushStateMode::IF_NEEDED && cache_state >= CoinsCacheSizeState::CRITICAL;
         // It's been a while since we wrote the block index to disk. Do this frequently, so we don't need to redownload after a crash.
@@ -2354,6 +2684,11 @@ bool CChainState::FlushStateToDisk(
             if (fFlushForPrune) {
                 LOG_TIME_MILLIS_WITH_CATEGORY("unlink pruned files", BCLog::BENCH);
 
+                // Coins still being written may need the pruned blocks to be replayed after a crash.
+                if (!CoinsDB().WaitForWrites()) {
+                    return AbortNode(state, "Failed to write to coin database");
+                }
+
                 UnlinkPrunedFiles(setFilesToPrune);
             }
             nLastWrite = nNow;
@@ -2372,10 +2707,19 @@ bool CChainState::FlushStateToDisk(
                 return AbortNode(state, "Disk space is too low!", _("Disk space is too low!"));
             }
             // Flush the chainstate (which may refer to block index entries).
-            if (!CoinsTip().Flush())
+            // Unless the cache is full or flushed for good, keep it, so the
+            // next blocks are not connected against a cold cache.
+            const bool retain{mode != FlushStateMode::ALWAYS && !fCacheLarge && !fCacheCritical && gArgs.GetIntArg("-dbcacheretain", nDefaultDbCacheRetain) > 0};
+            if (!(retain ? CoinsTip().Sync() : CoinsTip().Flush()))
+                return AbortNode(state, "Failed to write to coin database");
+            // With -coinswritebehind the coins are written in the
+            // background, unless the caller needs them to be on disk.
+            if ((mode == FlushStateMode::ALWAYS || fFlushForPrune) && !CoinsDB().WaitForWrites()) {
                 return AbortNode(state, "Failed to write to coin database");
+            }
             nLastFlush = nNow;
-            full_flush_completed = true;
+            full_flush_completed = !CoinsDB().HasPendingWrite();
+            if (!full_flush_completed) m_write_behind_locator = m_chain.GetLocator();
             TRACE5(utxocache, flush,
                    (int64_t)(GetTimeMicros() - nNow.count()), // in microseconds (µs)
                    (u_int32_t)mode,
@@ -2384,9 +2728,17 @@ bool CChainState::FlushStateToDisk(
                    (bool)fFlushForPrune);
         }
     }
-    if (full_flush_completed) {
+    if (this != &m_chainman.ActiveChainstate()) {
+        // The wallet and the indexes follow the active chainstate only.
+        m_write_behind_locator.reset();
+    } else if (full_flush_completed) {
         // Update best block in wallet (so we can detect restored wallets).
+        m_write_behind_locator.reset();
         GetMainSignals().ChainStateFlushed(m_chain.GetLocator());
+    } else if (m_write_behind_locator && !CoinsDB().HasPendingWrite()) {
+        // The coins of an earlier flush have been written in the background since.
+        GetMainSignals().ChainStateFlushed(*m_write_behind_locator);
+        m_write_behind_locator.reset();
     }
     } catch (const std::runtime_error& e) {
         return AbortNode(state, std::string("System error while flushing: ") + e.what());
@@ -2590,6 +2942,14 @@ public:
         blocksConnected.emplace_back();
     }
 
+    /** Forget the last connected block, which was disconnected again before anyone was told about it. */
+    void BlockDisconnected() {
+        assert(!blocksConnected.back().pindex);
+        blocksConnected.pop_back();
+        assert(!blocksConnected.empty());
+        blocksConnected.back() = PerBlockConnectTrace();
+    }
+
     std::vector<PerBlockConnectTrace>& GetBlocksConnected() {
         // We always keep one extra block at the end of our list because
         // blocks are added after all the conflicted transactions have
@@ -2608,7 +2968,7 @@ public:
  *
  * The block is added to connectTrace if connection succeeds.
  */
-bool CChainState::ConnectTip(BlockValidationState& state, CBlockIndex* pindexNew, const std::shared_ptr<const CBlock>& pblock, ConnectTrace& connectTrace, DisconnectedBlockTransactions& disconnectpool)
+bool CChainState::ConnectTip(BlockValidationState& state, CBlockIndex* pindexNew, const std::shared_ptr<const CBlock>& pblock, ConnectTrace& connectTrace, DisconnectedBlockTransactions& disconnectpool, ScriptCheckWindow* window)
 {
     AssertLockHeld(cs_main);
     if (m_mempool) AssertLockHeld(m_mempool->cs);
@@ -2617,14 +2977,25 @@ bool CChainState::ConnectTip(BlockValidationState& state, CBlockIndex* pindexNew
     // Read block from disk.
     int64_t nTime1 = GetTimeMicros();
     std::shared_ptr<const CBlock> pthisBlock;
-    if (!pblock) {
+    if (m_chainman.m_coins_prefetcher && this == &m_chainman.ActiveChainstate()) {
+        // Move the coins prefetched for this block into the cache, so
+        // ConnectBlock finds them in memory. If the prefetcher read the block
+        // from disk, reuse it.
+        pthisBlock = m_chainman.m_coins_prefetcher->Merge(pindexNew->GetBlockHash(), CoinsDB(), CoinsTip());
+        if (LogAcceptCategory(BCLog::BENCH)) {
+            const node::CoinsPrefetchStats stats{m_chainman.m_coins_prefetcher->GetStats()};
+            LogPrint(BCLog::BENCH, "  - Prefetched coins: %.2fms [hit rate %.2f%% (%u/%u inputs), %u stale blocks, %.2fs waiting]\n",
+                     (GetTimeMicros() - nTime1) * MILLI, 100.0 * stats.HitRate(), stats.hits, stats.lookups, stats.stale, count_microseconds(stats.wait_time) * MICRO);
+        }
+    }
+    if (pblock) {
+        pthisBlock = pblock;
+    } else if (!pthisBlock) {
         std::shared_ptr<CBlock> pblockNew = std::make_shared<CBlock>();
         if (!ReadBlockFromDisk(*pblockNew, pindexNew, m_params.GetConsensus())) {
             return AbortNode(state, "Failed to read block");
         }
         pthisBlock = pblockNew;
-    } else {
-        pthisBlock = pblock;
     }
     const CBlock& blockConnecting = *pthisBlock;
     // Apply the block atomically to the chain state.
@@ -2632,11 +3003,14 @@ bool CChainState::ConnectTip(BlockValidationState& state, CBlockIndex* pindexNew
     int64_t nTime3;
     LogPrint(BCLog::BENCH, "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * MILLI, nTimeReadFromDisk * MICRO);
     {
-        CCoinsViewCache view(&CoinsTip());
-        bool rv = ConnectBlock(blockConnecting, state, pindexNew, view);
-        GetMainSignals().BlockChecked(blockConnecting, state);
+        CCoinsViewCache view(window ? &window->m_view : &CoinsTip());
+        bool rv = ConnectBlock(blockConnecting, state, pindexNew, view, /*fJustCheck=*/false, window);
+        // The result of a block in a script check window is only known once
+        // the window is committed. If connecting it fails, the window is
+        // rolled back and the block connected again without one.
+        if (!window) GetMainSignals().BlockChecked(blockConnecting, state);
         if (!rv) {
-            if (state.IsInvalid())
+            if (state.IsInvalid() && !window)
                 InvalidBlockFound(pindexNew, state);
             return error("%s: ConnectBlock %s failed, %s", __func__, pindexNew->GetBlockHash().ToString(), state.ToString());
         }
@@ -2648,8 +3022,9 @@ bool CChainState::ConnectTip(BlockValidationState& state, CBlockIndex* pindexNew
     }
     int64_t nTime4 = GetTimeMicros(); nTimeFlush += nTime4 - nTime3;
     LogPrint(BCLog::BENCH, "  - Flush: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime4 - nTime3) * MILLI, nTimeFlush * MICRO, nTimeFlush * MILLI / nBlocksTotal);
-    // Write the chain state to disk, if necessary.
-    if (!FlushStateToDisk(state, FlushStateMode::IF_NEEDED)) {
+    // Write the chain state to disk, if necessary. Blocks in a script check
+    // window are not in the coins tip yet, it is flushed once they are.
+    if (!window && !FlushStateToDisk(state, FlushStateMode::IF_NEEDED)) {
         return false;
     }
     int64_t nTime5 = GetTimeMicros(); nTimeChainState += nTime5 - nTime4;
@@ -2667,10 +3042,54 @@ bool CChainState::ConnectTip(BlockValidationState& state, CBlockIndex* pindexNew
     LogPrint(BCLog::BENCH, "  - Connect postprocess: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime6 - nTime5) * MILLI, nTimePostConnect * MICRO, nTimePostConnect * MILLI / nBlocksTotal);
     LogPrint(BCLog::BENCH, "- Connect block: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime6 - nTime1) * MILLI, nTimeTotal * MICRO, nTimeTotal * MILLI / nBlocksTotal);
 
+    if (window) window->m_blocks.push_back({pindexNew, pthisBlock});
     connectTrace.BlockConnected(pindexNew, std::move(pthisBlock));
     return true;
 }
 
+void CChainState::CommitScriptCheckWindow(ScriptCheckWindow& window)
+{
+    AssertLockHeld(cs_main);
+
+    bool flushed = window.m_view.Flush();
+    assert(flushed);
+    for (const ScriptCheckWindow::Block& connected : window.m_blocks) {
+        if (!connected.pindex->IsValid(BLOCK_VALID_SCRIPTS)) {
+            connected.pindex->RaiseValidity(BLOCK_VALID_SCRIPTS);
+            m_blockman.m_dirty_blockindex.insert(connected.pindex);
+        }
+        BlockValidationState state;
+        GetMainSignals().BlockChecked(*connected.block, state);
+    }
+}
+
+void CChainState::RollbackScriptCheckWindow(ScriptCheckWindow& window, ConnectTrace& connectTrace, DisconnectedBlockTransactions& disconnectpool)
+{
+    AssertLockHeld(cs_main);
+    if (m_mempool) AssertLockHeld(m_mempool->cs);
+
+    // Nothing was written for the blocks but their undo data, so dropping
+    // the view undoes their effect on the coins.
+    window.m_control.Wait();
+    for (auto it = window.m_blocks.rbegin(); it != window.m_blocks.rend(); ++it) {
+        assert(m_chain.Tip() == it->pindex);
+        if (m_mempool) {
+            // Save transactions to re-add to mempool, like DisconnectTip
+            for (auto tx = it->block->vtx.rbegin(); tx != it->block->vtx.rend(); ++tx) {
+                disconnectpool.addTransaction(*tx);
+            }
+            while (disconnectpool.DynamicMemoryUsage() > MAX_DISCONNECTED_TX_POOL_SIZE * 1000) {
+                auto entry = disconnectpool.queuedTx.get<insertion_order>().begin();
+                m_mempool->removeRecursive(**entry, MemPoolRemovalReason::REORG);
+                disconnectpool.removeEntry(entry);
+            }
+        }
+        connectTrace.BlockDisconnected();
+        m_chain.SetTip(it->pindex->pprev);
+    }
+    if (!window.m_blocks.empty()) UpdateTip(m_chain.Tip());
+}
+
 /**
  * Return the tip of the chain with the most work in it, that isn't
  * known to be invalid (it's however far from certain to be valid).
@@ -2777,6 +3196,19 @@ bool CChainState::ActivateBestChainStep(BlockValidationState& state, CBlockIndex
         fBlocksDisconnected = true;
     }
 
+    // During initial block download, consecutive blocks are connected in a
+    // script check window and verified together.
+    size_t window_size{0};
+    if (g_parallel_script_checks && IsInitialBlockDownload()) {
+        window_size = std::max<int64_t>(0, gArgs.GetIntArg("-scriptcheckwindow", DEFAULT_SCRIPT_CHECK_WINDOW));
+    }
+    // Once a window failed, its blocks are connected without releasing cs_main
+    // in between, so they are not verified again in another window.
+    bool window_failed{false};
+
+    // Coins are prefetched for the active chainstate only.
+    node::CoinsPrefetcher* const prefetcher{this == &m_chainman.ActiveChainstate() ? m_chainman.m_coins_prefetcher.get() : nullptr};
+
     // Build list of new blocks to connect (in descending height order).
     std::vector<CBlockIndex*> vpindexToConnect;
     bool fContinue = true;
@@ -2795,8 +3227,51 @@ bool CChainState::ActivateBestChainStep(BlockValidationState& state, CBlockIndex
         nHeight = nTargetHeight;
 
         // Connect new blocks.
-        for (CBlockIndex* pindexConnect : reverse_iterate(vpindexToConnect)) {
-            if (!ConnectTip(state, pindexConnect, pindexConnect == pindexMostWork ? pblock : std::shared_ptr<const CBlock>(), connectTrace, disconnectpool)) {
+        std::optional<ScriptCheckWindow> window;
+        for (auto it = vpindexToConnect.rbegin(); it != vpindexToConnect.rend(); ++it) {
+            CBlockIndex* pindexConnect{*it};
+            if (prefetcher) {
+                // Look up the coins spent by the next few blocks while this
+                // one is being connected.
+                for (auto next = std::next(it); next != vpindexToConnect.rend() && next - it <= node::COINS_PREFETCH_LOOKAHEAD; ++next) {
+                    if (*next == pindexMostWork && pblock) {
+                        prefetcher->Prefetch(pblock, CoinsDB());
+                    } else {
+                        prefetcher->Prefetch((*next)->GetBlockHash(), (*next)->GetBlockPos(), CoinsDB());
+                    }
+                }
+            }
+            if (!window && window_size > 1 && std::next(it) != vpindexToConnect.rend()) {
+                window.emplace(&CoinsTip());
+            }
+            const bool connected{ConnectTip(state, pindexConnect, pindexConnect == pindexMostWork ? pblock : std::shared_ptr<const CBlock>(), connectTrace, disconnectpool, window ? &*window : nullptr)};
+            if (window && (!connected || std::next(it) == vpindexToConnect.rend() || window->Full(window_size))) {
+                const bool verified{connected && window->m_control.Wait()};
+                if (verified) {
+                    CommitScriptCheckWindow(*window);
+                } else {
+                    RollbackScriptCheckWindow(*window, connectTrace, disconnectpool);
+                    fBlocksDisconnected = true;
+                }
+                window.reset();
+                if (verified) {
+                    if (!FlushStateToDisk(state, FlushStateMode::IF_NEEDED)) {
+                        MaybeUpdateMempoolForReorg(disconnectpool, false);
+                        return false;
+                    }
+                } else if (connected || state.IsInvalid()) {
+                    // A block in the window is invalid. Connect the blocks
+                    // again one at a time, so that the failure is found and
+                    // handled for the block it belongs to.
+                    LogPrintf("Script check window at height %d failed, connecting its blocks one at a time\n", m_chain.Height() + 1);
+                    state = BlockValidationState();
+                    window_size = 0;
+                    window_failed = true;
+                    nHeight = m_chain.Height();
+                    break;
+                }
+            }
+            if (!connected) {
                 if (state.IsInvalid()) {
                     // The block violates a consensus rule.
                     if (state.GetResult() != BlockValidationResult::BLOCK_MUTATED) {
@@ -2815,7 +3290,7 @@ bool CChainState::ActivateBestChainStep(BlockValidationState& state, CBlockIndex
                 }
             } else {
                 PruneBlockIndexCandidates();
-                if (!pindexOldTip || m_chain.Tip()->nChainWork > pindexOldTip->nChainWork) {
+                if (!window && !window_failed && (!pindexOldTip || m_chain.Tip()->nChainWork > pindexOldTip->nChainWork)) {
                     // We're in a better position than we were. Return temporarily to release the lock.
                     fContinue = false;
                     break;
@@ -2891,7 +3366,10 @@ bool CChainState::ActivateBestChain(BlockValidationState& state, std::shared_ptr
 
     CBlockIndex *pindexMostWork = nullptr;
     CBlockIndex *pindexNewTip = nullptr;
-    int nStopAtHeight = gArgs.GetIntArg("-stopatheight", DEFAULT_STOPATHEIGHT);
+    // A background validation chainstate neither notifies the rest of the
+    // node about the blocks it connects nor stops at -stopatheight.
+    const bool is_active{this == &m_chainman.ActiveChainstate()};
+    int nStopAtHeight = is_active ? gArgs.GetIntArg("-stopatheight", DEFAULT_STOPATHEIGHT) : 0;
     do {
         // Block until the validation queue drains. This should largely
         // never happen in normal operation, however may happen during
@@ -2935,9 +3413,11 @@ bool CChainState::ActivateBestChain(BlockValidationState& state, std::shared_ptr
                 }
                 pindexNewTip = m_chain.Tip();
 
-                for (const PerBlockConnectTrace& trace : connectTrace.GetBlocksConnected()) {
-                    assert(trace.pblock && trace.pindex);
-                    GetMainSignals().BlockConnected(trace.pblock, trace.pindex);
+                if (is_active) {
+                    for (const PerBlockConnectTrace& trace : connectTrace.GetBlocksConnected()) {
+                        assert(trace.pblock && trace.pindex);
+                        GetMainSignals().BlockConnected(trace.pblock, trace.pindex);
+                    }
                 }
             } while (!m_chain.Tip() || (starting_tip && CBlockIndexWorkComparator()(m_chain.Tip(), starting_tip)));
             if (!blocks_connected) return true;
@@ -2947,7 +3427,7 @@ bool CChainState::ActivateBestChain(BlockValidationState& state, std::shared_ptr
 
             // Notify external listeners about the new tip.
             // Enqueue while holding cs_main to ensure that UpdatedBlockTip is called in the order in which blocks are connected
-            if (pindexFork != pindexNewTip) {
+            if (is_active && pindexFork != pindexNewTip) {
                 // Notify ValidationInterface subscribers
                 GetMainSignals().UpdatedBlockTip(pindexNewTip, pindexFork, fInitialDownload);
 
@@ -3212,8 +3692,8 @@ void CChainState::ReceivedBlockTransactions(const CBlock& block, CBlockIndex* pi
             queue.pop_front();
             pindex->nChainTx = (pindex->pprev ? pindex->pprev->nChainTx : 0) + pindex->nTx;
             pindex->nSequenceId = nBlockSequenceId++;
-            if (m_chain.Tip() == nullptr || !setBlockIndexCandidates.value_comp()(pindex, m_chain.Tip())) {
-                setBlockIndexCandidates.insert(pindex);
+            for (CChainState* chainstate : m_chainman.GetAll()) {
+                chainstate->TryAddBlockIndexCandidate(pindex);
             }
             std::pair<std::multimap<CBlockIndex*, CBlockIndex*>::iterator, std::multimap<CBlockIndex*, CBlockIndex*>::iterator> range = m_blockman.m_blocks_unlinked.equal_range(pindex);
             while (range.first != range.second) {
@@ -3230,10 +3710,33 @@ void CChainState::ReceivedBlockTransactions(const CBlock& block, CBlockIndex* pi
     }
 }
 
-static bool CheckBlockHeader(const CBlockHeader& block, BlockValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW = true)
+void CChainState::TryAddBlockIndexCandidate(CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    if (m_chain.Tip() != nullptr && setBlockIndexCandidates.value_comp()(pindex, m_chain.Tip())) {
+        return;
+    }
+    if (this != &m_chainman.ActiveChainstate()) {
+        // A background chainstate never goes past the snapshot base block.
+        const CBlockIndex* snapshot_base{m_chainman.GetSnapshotBaseBlock()};
+        if (!snapshot_base || snapshot_base->GetAncestor(pindex->nHeight) != pindex) {
+            return;
+        }
+    }
+    setBlockIndexCandidates.insert(pindex);
+}
+
+bool CHeaderCheck::operator()()
+{
+    m_result->hash = m_header->GetHash();
+    m_result->valid_pow = CheckProofOfWork(m_result->hash, m_header->nBits, *m_consensus);
+    return true;
+}
+
+static bool CheckBlockHeader(const CBlockHeader& block, BlockValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW = true, const HeaderPrecheck* precheck = nullptr)
 {
     // Check proof of work matches claimed amount
-    if (fCheckPOW && !CheckProofOfWork(block.GetHash(), block.nBits, consensusParams))
+    if (fCheckPOW && !(precheck ? precheck->valid_pow : CheckProofOfWork(block.GetHash(), block.nBits, consensusParams)))
         return state.Invalid(BlockValidationResult::BLOCK_INVALID_HEADER, "high-hash", "proof of work failed");
 
     return true;
@@ -3491,11 +3994,11 @@ static bool ContextualCheckBlock(const CBlock& block, BlockValidationState& stat
     return true;
 }
 
-bool ChainstateManager::AcceptBlockHeader(const CBlockHeader& block, BlockValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex)
+bool ChainstateManager::AcceptBlockHeader(const CBlockHeader& block, BlockValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, const HeaderPrecheck* precheck)
 {
     AssertLockHeld(cs_main);
     // Check for duplicate
-    uint256 hash = block.GetHash();
+    const uint256 hash{precheck ? precheck->hash : block.GetHash()};
     BlockMap::iterator miSelf{m_blockman.m_block_index.find(hash)};
     if (hash != chainparams.GetConsensus().hashGenesisBlock) {
         if (miSelf != m_blockman.m_block_index.end()) {
@@ -3510,7 +4013,7 @@ bool ChainstateManager::AcceptBlockHeader(const CBlockHeader& block, BlockValida
             return true;
         }
 
-        if (!CheckBlockHeader(block, state, chainparams.GetConsensus())) {
+        if (!CheckBlockHeader(block, state, chainparams.GetConsensus(), /*fCheckPOW=*/true, precheck)) {
             LogPrint(BCLog::VALIDATION, "%s: Consensus::CheckBlockHeader: %s, %s\n", __func__, hash.ToString(), state.ToString());
             return false;
         }
@@ -3571,7 +4074,7 @@ bool ChainstateManager::AcceptBlockHeader(const CBlockHeader& block, BlockValida
             }
         }
     }
-    CBlockIndex* pindex{m_blockman.AddToBlockIndex(block)};
+    CBlockIndex* pindex{m_blockman.AddToBlockIndex(block, hash)};
 
     if (ppindex)
         *ppindex = pindex;
@@ -3583,11 +4086,30 @@ bool ChainstateManager::AcceptBlockHeader(const CBlockHeader& block, BlockValida
 bool ChainstateManager::ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, BlockValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex)
 {
     AssertLockNotHeld(cs_main);
+
+    // Hashing the headers is the bulk of the work, so do it and check their
+    // proof of work in parallel, without holding cs_main.
+    std::vector<HeaderPrecheck> prechecks(headers.size());
+    {
+        std::vector<CHeaderCheck> checks;
+        checks.reserve(headers.size());
+        for (size_t i = 0; i < headers.size(); ++i) {
+            checks.emplace_back(headers[i], chainparams.GetConsensus(), prechecks[i]);
+        }
+        if (g_parallel_script_checks && checks.size() > 1) {
+            CCheckQueueControl<CHeaderCheck> control(&headercheckqueue);
+            control.Add(checks);
+            control.Wait();
+        } else {
+            for (CHeaderCheck& check : checks) check();
+        }
+    }
+
     {
         LOCK(cs_main);
-        for (const CBlockHeader& header : headers) {
+        for (size_t i = 0; i < headers.size(); ++i) {
             CBlockIndex *pindex = nullptr; // Use a temp pindex instead of ppindex to avoid a const_cast
-            bool accepted{AcceptBlockHeader(header, state, chainparams, &pindex)};
+            bool accepted{AcceptBlockHeader(headers[i], state, chainparams, &pindex, &prechecks[i])};
             ActiveChainstate().CheckBlockIndex();
 
             if (!accepted) {
@@ -3720,6 +4242,7 @@ bool ChainstateManager::ProcessNewBlock(const CChainParams& chainparams, const s
             GetMainSignals().BlockChecked(*block, state);
             return error("%s: AcceptBlock FAILED (%s)", __func__, state.ToString());
         }
+        if (BackgroundSyncInProgress()) NotifyBackgroundValidation();
     }
 
     NotifyHeaderTip(ActiveChainstate());
@@ -3746,6 +4269,20 @@ MempoolAcceptResult ChainstateManager::ProcessTransaction(const CTransactionRef&
     return result;
 }
 
+std::vector<MempoolAcceptResult> ChainstateManager::ProcessTransactions(const std::vector<CTransactionRef>& txs)
+{
+    AssertLockHeld(cs_main);
+    CChainState& active_chainstate = ActiveChainstate();
+    if (!active_chainstate.GetMempool()) {
+        TxValidationState state;
+        state.Invalid(TxValidationResult::TX_NO_MEMPOOL, "no-mempool");
+        return std::vector<MempoolAcceptResult>(txs.size(), MempoolAcceptResult::Failure(state));
+    }
+    auto results = AcceptBatchToMemoryPool(active_chainstate, txs, GetTime());
+    active_chainstate.GetMempool()->check(active_chainstate.CoinsTip(), active_chainstate.m_chain.Height() + 1);
+    return results;
+}
+
 bool TestBlockValidity(BlockValidationState& state,
                        const CChainParams& chainparams,
                        CChainState& chainstate,
@@ -3861,7 +4398,7 @@ bool CVerifyDB::VerifyDB(
     int reportDone = 0;
     LogPrintf("[0%%]..."); /* Continued */
 
-    const bool is_snapshot_cs{!chainstate.m_from_snapshot_blockhash};
+    const bool is_snapshot_cs{chainstate.m_from_snapshot_blockhash.has_value()};
 
     for (pindex = chainstate.m_chain.Tip(); pindex && pindex->pprev; pindex = pindex->pprev) {
         const int percentageDone = std::max(1, std::min(99, (int)(((double)(chainstate.m_chain.Height() - pindex->nHeight)) / (double)nCheckDepth * (nCheckLevel >= 4 ? 50 : 100))));
@@ -4121,7 +4658,7 @@ bool CChainState::LoadGenesisBlock()
         if (blockPos.IsNull()) {
             return error("%s: writing genesis block to disk failed", __func__);
         }
-        CBlockIndex *pindex = m_blockman.AddToBlockIndex(block);
+        CBlockIndex *pindex = m_blockman.AddToBlockIndex(block, block.GetHash());
         ReceivedBlockTransactions(block, pindex, blockPos);
     } catch (const std::runtime_error& e) {
         return error("%s: failed to write genesis block: %s", __func__, e.what());
@@ -4491,6 +5028,8 @@ bool CChainState::ResizeCoinsCaches(size_t coinstip_size, size_t coinsdb_size)
     size_t old_coinstip_size = m_coinstip_cache_size_bytes;
     m_coinstip_cache_size_bytes = coinstip_size;
     m_coinsdb_cache_size_bytes = coinsdb_size;
+    // Resizing reopens the database, which must not be read from concurrently.
+    if (m_chainman.m_coins_prefetcher) m_chainman.m_coins_prefetcher->Clear();
     CoinsDB().ResizeCache(coinsdb_size);
 
     LogPrintf("[%s] resized coinsdb cache to %.1f MiB\n",
@@ -4512,7 +5051,51 @@ bool CChainState::ResizeCoinsCaches(size_t coinstip_size, size_t coinsdb_size)
     return ret;
 }
 
-static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+//! Transactions only, as written by -persistmempoolv1
+static const uint64_t MEMPOOL_DUMP_VERSION_NO_HASHES = 1;
+//! Every transaction is preceded by a fixed size header with its hashes, so
+//! that it can be skipped without being deserialized
+static const uint64_t MEMPOOL_DUMP_VERSION = 2;
+//! Number of transactions whose scripts are verified in parallel before they are accepted
+static constexpr size_t MEMPOOL_LOAD_BATCH_SIZE{1000};
+
+/**
+ * Verify the scripts of a batch of transactions loaded from disk with the
+ * script check worker threads, so the signature cache already holds their
+ * signatures when they are accepted to the mempool one by one. Inputs that
+ * are neither in the chainstate, the mempool nor the batch are left to
+ * AcceptToMemoryPool to reject. Failures are found again there as well.
+ */
+static void PreverifyMempoolScripts(CTxMemPool& pool, CChainState& active_chainstate, const std::vector<CTransactionRef>& txs)
+{
+    std::vector<PrecomputedTransactionData> txdata(txs.size());
+    std::vector<CScriptCheck> checks;
+    {
+        LOCK2(cs_main, pool.cs);
+        CCoinsViewMemPool view_mempool(&active_chainstate.CoinsTip(), pool);
+        CCoinsViewCache view(&view_mempool);
+        for (size_t i = 0; i < txs.size(); ++i) {
+            const CTransaction& tx{*txs[i]};
+            if (tx.IsCoinBase() || !view.HaveInputs(tx)) continue;
+            std::vector<CTxOut> spent_outputs;
+            spent_outputs.reserve(tx.vin.size());
+            for (const CTxIn& txin : tx.vin) {
+                spent_outputs.push_back(view.AccessCoin(txin.prevout).out);
+            }
+            txdata[i].Init(tx, std::move(spent_outputs));
+            AddCoins(view, tx, MEMPOOL_HEIGHT);
+
+            TxValidationState state;
+            std::vector<CScriptCheck> tx_checks;
+            if (CheckInputScripts(tx, state, view, STANDARD_SCRIPT_VERIFY_FLAGS, /*cacheSigStore=*/true, /*cacheFullScriptStore=*/true, txdata[i], &tx_checks)) {
+                std::move(tx_checks.begin(), tx_checks.end(), std::back_inserter(checks));
+            }
+        }
+    }
+    CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+    control.Add(checks);
+    control.Wait();
+}
 
 bool LoadMempool(CTxMemPool& pool, CChainState& active_chainstate, FopenFn mockable_fopen_function)
 {
@@ -4534,27 +5117,67 @@ bool LoadMempool(CTxMemPool& pool, CChainState& active_chainstate, FopenFn mocka
     try {
         uint64_t version;
         file >> version;
-        if (version != MEMPOOL_DUMP_VERSION) {
+        if (version != MEMPOOL_DUMP_VERSION_NO_HASHES && version != MEMPOOL_DUMP_VERSION) {
             return false;
         }
-        uint64_t num;
-        file >> num;
+        uint64_t total_txns_to_load;
+        file >> total_txns_to_load;
+        uint64_t num{total_txns_to_load};
+        int last_progress{0};
+        std::vector<CTransactionRef> batch;
+        std::vector<int64_t> batch_times;
         while (num) {
-            --num;
-            CTransactionRef tx;
-            int64_t nTime;
-            int64_t nFeeDelta;
-            file >> tx;
-            file >> nTime;
-            file >> nFeeDelta;
-
-            CAmount amountdelta = nFeeDelta;
-            if (amountdelta) {
-                pool.PrioritiseTransaction(tx->GetHash(), amountdelta);
+            batch.clear();
+            batch_times.clear();
+            while (num && batch.size() < MEMPOOL_LOAD_BATCH_SIZE) {
+                --num;
+                CTransactionRef tx;
+                int64_t nTime;
+                int64_t nFeeDelta;
+                if (version == MEMPOOL_DUMP_VERSION_NO_HASHES) {
+                    file >> tx;
+                    file >> nTime;
+                    file >> nFeeDelta;
+                    if (nFeeDelta) {
+                        pool.PrioritiseTransaction(tx->GetHash(), nFeeDelta);
+                    }
+                    if (nTime <= nNow - nExpiryTimeout) {
+                        ++expired;
+                        continue;
+                    }
+                } else {
+                    uint256 txid;
+                    uint256 wtxid;
+                    uint32_t tx_size;
+                    file >> txid >> wtxid >> nTime >> nFeeDelta >> tx_size;
+                    if (nFeeDelta) {
+                        pool.PrioritiseTransaction(txid, nFeeDelta);
+                    }
+                    // Skip the transactions that would not be accepted anyway
+                    // without deserializing them.
+                    if (nTime <= nNow - nExpiryTimeout) {
+                        file.ignore(tx_size);
+                        ++expired;
+                        continue;
+                    }
+                    if (pool.exists(GenTxid::Wtxid(wtxid))) {
+                        file.ignore(tx_size);
+                        ++already_there;
+                        continue;
+                    }
+                    file >> tx;
+                    if (tx->GetHash() != txid || tx->GetWitnessHash() != wtxid) {
+                        throw std::ios_base::failure("transaction does not match its hashes");
+                    }
+                }
+                batch.push_back(tx);
+                batch_times.push_back(nTime);
             }
-            if (nTime > nNow - nExpiryTimeout) {
+
+            if (g_parallel_script_checks) PreverifyMempoolScripts(pool, active_chainstate, batch);
+            for (size_t i = 0; i < batch.size(); ++i) {
                 LOCK(cs_main);
-                const auto& accepted = AcceptToMemoryPool(active_chainstate, tx, nTime, /*bypass_limits=*/false, /*test_accept=*/false);
+                const auto& accepted = AcceptToMemoryPool(active_chainstate, batch[i], batch_times[i], /*bypass_limits=*/false, /*test_accept=*/false);
                 if (accepted.m_result_type == MempoolAcceptResult::ResultType::VALID) {
                     ++count;
                 } else {
@@ -4562,17 +5185,21 @@ bool LoadMempool(CTxMemPool& pool, CChainState& active_chainstate, FopenFn mocka
                     // wallet(s) having loaded it while we were processing
                     // mempool transactions; consider these as valid, instead of
                     // failed, but mark them as 'already there'
-                    if (pool.exists(GenTxid::Txid(tx->GetHash()))) {
+                    if (pool.exists(GenTxid::Txid(batch[i]->GetHash()))) {
                         ++already_there;
                     } else {
                         ++failed;
                     }
                 }
-            } else {
-                ++expired;
             }
             if (ShutdownRequested())
                 return false;
+
+            const int progress{int(100 * (total_txns_to_load - num) / total_txns_to_load)};
+            if (progress / 10 > last_progress / 10) {
+                LogPrintf("Progress loading mempool transactions from disk: %d%% (tried %u, %u remaining)\n", progress, total_txns_to_load - num, num);
+                last_progress = progress;
+            }
         }
         std::map<uint256, CAmount> mapDeltas;
         file >> mapDeltas;
@@ -4628,14 +5255,23 @@ bool DumpMempool(const CTxMemPool& pool, FopenFn mockable_fopen_function, bool s
 
         CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
 
-        uint64_t version = MEMPOOL_DUMP_VERSION;
+        const bool v1{gArgs.GetBoolArg("-persistmempoolv1", DEFAULT_PERSIST_V1_DAT)};
+        uint64_t version = v1 ? MEMPOOL_DUMP_VERSION_NO_HASHES : MEMPOOL_DUMP_VERSION;
         file << version;
 
         file << (uint64_t)vinfo.size();
         for (const auto& i : vinfo) {
-            file << *(i.tx);
-            file << int64_t{count_seconds(i.m_time)};
-            file << int64_t{i.nFeeDelta};
+            if (v1) {
+                file << *(i.tx);
+                file << int64_t{count_seconds(i.m_time)};
+                file << int64_t{i.nFeeDelta};
+            } else {
+                file << i.tx->GetHash() << i.tx->GetWitnessHash();
+                file << int64_t{count_seconds(i.m_time)};
+                file << int64_t{i.nFeeDelta};
+                file << uint32_t(GetSerializeSize(*i.tx, file.GetVersion()));
+                file << *(i.tx);
+            }
             mapDeltas.erase(i.tx->GetHash());
         }
 
@@ -4659,6 +5295,81 @@ bool DumpMempool(const CTxMemPool& pool, FopenFn mockable_fopen_function, bool s
     return true;
 }
 
+static const uint64_t SIGCACHE_DUMP_VERSION = 1;
+
+bool DumpSignatureCaches(FopenFn mockable_fopen_function, bool skip_file_commit)
+{
+    int64_t start = GetTimeMicros();
+
+    std::vector<uint256> scripts;
+    uint256 script_nonce;
+    {
+        LOCK(cs_main);
+        script_nonce = g_scriptExecutionCacheNonce;
+        g_scriptExecutionCache.for_each([&](const uint256& entry) { scripts.push_back(entry); });
+    }
+
+    try {
+        FILE* filestr{mockable_fopen_function(gArgs.GetDataDirNet() / "sigcache.dat.new", "wb")};
+        if (!filestr) {
+            return false;
+        }
+
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+        file << SIGCACHE_DUMP_VERSION;
+        DumpSignatureCache(file);
+        file << script_nonce << scripts;
+
+        if (!skip_file_commit && !FileCommit(file.Get()))
+            throw std::runtime_error("FileCommit failed");
+        file.fclose();
+        if (!RenameOver(gArgs.GetDataDirNet() / "sigcache.dat.new", gArgs.GetDataDirNet() / "sigcache.dat")) {
+            throw std::runtime_error("Rename failed");
+        }
+        LogPrintf("Dumped signature caches: %gs\n", (GetTimeMicros() - start) * MICRO);
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to dump signature caches: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+    return true;
+}
+
+bool LoadSignatureCaches(FopenFn mockable_fopen_function)
+{
+    const fs::path path{gArgs.GetDataDirNet() / "sigcache.dat"};
+    FILE* filestr{mockable_fopen_function(path, "rb")};
+    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        LogPrintf("Failed to open signature cache file from disk. Continuing anyway.\n");
+        return false;
+    }
+
+    try {
+        uint64_t version;
+        file >> version;
+        if (version != SIGCACHE_DUMP_VERSION) {
+            LogPrintf("Ignoring signature cache file %s of version %u, expected version %u. Continuing anyway.\n", fs::PathToString(path), version, SIGCACHE_DUMP_VERSION);
+            return false;
+        }
+        const size_t signatures{LoadSignatureCache(file)};
+        uint256 script_nonce;
+        std::vector<uint256> scripts;
+        file >> script_nonce >> scripts;
+        {
+            LOCK(cs_main);
+            SaltScriptExecutionCache(script_nonce);
+            for (const uint256& entry : scripts) {
+                g_scriptExecutionCache.insert(entry);
+            }
+        }
+        LogPrintf("Imported signature caches from disk: %u signatures, %u scripts\n", signatures, scripts.size());
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to deserialize signature cache data on disk: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+    return true;
+}
+
 //! Guess how far we are in the verification process at the given block index
 //! require cs_main if pindex has not been validated yet (because nChainTx might be unset)
 double GuessVerificationProgress(const ChainTxData& data, const CBlockIndex *pindex) {
@@ -4752,6 +5463,24 @@ bool ChainstateManager::ActivateSnapshot(
         return false;
     }
 
+    {
+        LOCK(::cs_main);
+        if (fPruneMode) {
+            LogPrintf("[snapshot] can't activate a snapshot when pruning\n");
+            return false;
+        }
+        const CBlockIndex* snapshot_start_block{m_blockman.LookupBlockIndex(base_blockhash)};
+        if (snapshot_start_block && ActiveHeight() > snapshot_start_block->nHeight) {
+            LogPrintf("[snapshot] can't activate a snapshot whose base block is beneath the current tip\n");
+            return false;
+        }
+        const CTxMemPool* mempool{ActiveChainstate().GetMempool()};
+        if (mempool && WITH_LOCK(mempool->cs, return mempool->size()) > 0) {
+            LogPrintf("[snapshot] can't activate a snapshot when the mempool is not empty\n");
+            return false;
+        }
+    }
+
     int64_t current_coinsdb_cache_size{0};
     int64_t current_coinstip_cache_size{0};
 
@@ -4812,7 +5541,15 @@ bool ChainstateManager::ActivateSnapshot(
         const bool chaintip_loaded = m_snapshot_chainstate->LoadChainTip();
         assert(chaintip_loaded);
 
+        // The mempool follows the active chainstate. The IBD chainstate
+        // continues beneath the snapshot base block only.
+        m_snapshot_chainstate->m_mempool = m_ibd_chainstate->m_mempool;
+        m_ibd_chainstate->m_mempool = nullptr;
         m_active_chainstate = m_snapshot_chainstate.get();
+        const CBlockIndex* snapshot_base{GetSnapshotBaseBlock()};
+        for (auto it = m_ibd_chainstate->setBlockIndexCandidates.begin(); it != m_ibd_chainstate->setBlockIndexCandidates.end();) {
+            it = snapshot_base->GetAncestor((*it)->nHeight) == *it ? std::next(it) : m_ibd_chainstate->setBlockIndexCandidates.erase(it);
+        }
 
         LogPrintf("[snapshot] successfully activated snapshot %s\n", base_blockhash.ToString());
         LogPrintf("[snapshot] (%.2f MB)\n",
@@ -4820,6 +5557,7 @@ bool ChainstateManager::ActivateSnapshot(
 
         this->MaybeRebalanceCaches();
     }
+    NotifyBackgroundValidation();
     return true;
 }
 
@@ -5043,6 +5781,133 @@ bool ChainstateManager::IsSnapshotActive() const
     return m_snapshot_chainstate && m_active_chainstate == m_snapshot_chainstate.get();
 }
 
+const CBlockIndex* ChainstateManager::GetSnapshotBaseBlock() const
+{
+    AssertLockHeld(::cs_main);
+    const std::optional<uint256> base_blockhash{SnapshotBlockhash()};
+    return base_blockhash ? m_blockman.LookupBlockIndex(*base_blockhash) : nullptr;
+}
+
+CChainState& ChainstateManager::ActivateExistingSnapshot(CTxMemPool* mempool, const uint256& base_blockhash)
+{
+    AssertLockHeld(::cs_main);
+    assert(m_ibd_chainstate && !m_snapshot_chainstate);
+    LogPrintf("[snapshot] using snapshot chainstate based on %s, validating its history in the background\n", base_blockhash.ToString());
+    m_ibd_chainstate->m_mempool = nullptr;
+    return InitializeChainstate(mempool, base_blockhash);
+}
+
+SnapshotCompletionResult ChainstateManager::MaybeCompleteSnapshotValidation()
+{
+    CCoinsViewDB* ibd_coinsdb;
+    int base_height;
+    {
+        LOCK(::cs_main);
+        if (!BackgroundSyncInProgress()) return SnapshotCompletionResult::SKIPPED;
+        const CBlockIndex* snapshot_base{GetSnapshotBaseBlock()};
+        if (!snapshot_base || m_ibd_chainstate->m_chain.Tip() != snapshot_base) {
+            return SnapshotCompletionResult::SKIPPED;
+        }
+        // The background chainstate does not move past the base block, so
+        // its coins database stays the same while it is hashed.
+        m_ibd_chainstate->ForceFlushStateToDisk();
+        if (!m_ibd_chainstate->CoinsDB().WaitForWrites()) return SnapshotCompletionResult::STATS_FAILED;
+        ibd_coinsdb = &m_ibd_chainstate->CoinsDB();
+        base_height = snapshot_base->nHeight;
+    }
+
+    LogPrintf("[snapshot] background chainstate reached the snapshot base block at height %d, hashing its UTXO set\n", base_height);
+    const AssumeutxoData* au_data{ExpectedAssumeutxo(base_height, ::Params())};
+    if (!au_data) {
+        LogPrintf("[snapshot] no assumeutxo data for height %d\n", base_height);
+        return SnapshotCompletionResult::STATS_FAILED;
+    }
+    CCoinsStats stats{CoinStatsHashType::HASH_SERIALIZED};
+    try {
+        if (!GetUTXOStats(ibd_coinsdb, m_blockman, stats, [] { if (ShutdownRequested()) throw std::runtime_error("shutdown requested"); })) {
+            LogPrintf("[snapshot] failed to generate coins stats of the background chainstate\n");
+            return SnapshotCompletionResult::STATS_FAILED;
+        }
+    } catch (const std::runtime_error& e) {
+        LogPrintf("[snapshot] hashing the UTXO set of the background chainstate interrupted: %s\n", e.what());
+        return SnapshotCompletionResult::SKIPPED;
+    }
+    if (AssumeutxoHash{stats.hashSerialized} != au_data->hash_serialized) {
+        LogPrintf("[snapshot] UTXO set hash of the background chainstate does not match the snapshot: expected %s, got %s\n",
+                  au_data->hash_serialized.ToString(), stats.hashSerialized.ToString());
+        return SnapshotCompletionResult::HASH_MISMATCH;
+    }
+
+    LOCK(::cs_main);
+    m_snapshot_validated = true;
+    LogPrintf("[snapshot] snapshot based on %s has been fully validated\n", SnapshotBlockhash()->ToString());
+    MaybeRebalanceCaches();
+    return SnapshotCompletionResult::SUCCESS;
+}
+
+void ChainstateManager::ThreadBackgroundValidation()
+{
+    ScheduleBatchPriority();
+    while (true) {
+        {
+            WAIT_LOCK(m_background_validation_mutex, lock);
+            m_background_validation_cv.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_background_validation_mutex) {
+                return m_background_validation_pending || m_background_validation_stop;
+            });
+            if (m_background_validation_stop) return;
+            m_background_validation_pending = false;
+        }
+        // Wait for a snapshot to be activated, if none is in use yet.
+        CChainState* background_chainstate{WITH_LOCK(::cs_main, return BackgroundSyncInProgress() ? m_ibd_chainstate.get() : nullptr)};
+        if (!background_chainstate) continue;
+
+        BlockValidationState state;
+        if (!background_chainstate->ActivateBestChain(state)) {
+            LogPrintf("[snapshot] background validation failed (%s)\n", state.ToString());
+            return;
+        }
+        if (ShutdownRequested()) return;
+        switch (MaybeCompleteSnapshotValidation()) {
+        case SnapshotCompletionResult::SKIPPED:
+        case SnapshotCompletionResult::SUCCESS:
+            break;
+        case SnapshotCompletionResult::HASH_MISMATCH:
+            AbortNode(state, "UTXO set hash of the background chainstate does not match the snapshot",
+                      _("The UTXO snapshot in use turned out to be invalid. Restart the node to discard it and resume the initial block download."));
+            return;
+        case SnapshotCompletionResult::STATS_FAILED:
+            // Keep the snapshot, the next start hashes the background chainstate again.
+            AbortNode(state, "Failed to hash the UTXO set of the background chainstate");
+            return;
+        }
+    }
+}
+
+void ChainstateManager::StartBackgroundValidation()
+{
+    assert(!m_background_validation_thread.joinable());
+    {
+        LOCK(m_background_validation_mutex);
+        m_background_validation_stop = false;
+        // Connect the blocks stored before the thread started.
+        m_background_validation_pending = true;
+    }
+    m_background_validation_thread = std::thread(&util::TraceThread, "bgvalid", [this] { ThreadBackgroundValidation(); });
+}
+
+void ChainstateManager::NotifyBackgroundValidation()
+{
+    WITH_LOCK(m_background_validation_mutex, m_background_validation_pending = true);
+    m_background_validation_cv.notify_one();
+}
+
+void ChainstateManager::StopBackgroundValidation()
+{
+    WITH_LOCK(m_background_validation_mutex, m_background_validation_stop = true);
+    m_background_validation_cv.notify_one();
+    if (m_background_validation_thread.joinable()) m_background_validation_thread.join();
+}
+
 void ChainstateManager::Unload()
 {
     AssertLockHeld(::cs_main);
@@ -5059,6 +5924,7 @@ void ChainstateManager::Unload()
 void ChainstateManager::Reset()
 {
     LOCK(::cs_main);
+    if (m_coins_prefetcher) m_coins_prefetcher->Clear();
     m_ibd_chainstate.reset();
     m_snapshot_chainstate.reset();
     m_active_chainstate = nullptr;
@@ -5073,8 +5939,12 @@ void ChainstateManager::MaybeRebalanceCaches()
         // Allocate everything to the IBD chainstate.
         m_ibd_chainstate->ResizeCoinsCaches(m_total_coinstip_cache, m_total_coinsdb_cache);
     }
-    else if (m_snapshot_chainstate && !m_ibd_chainstate) {
+    else if (m_snapshot_chainstate && (!m_ibd_chainstate || m_snapshot_validated)) {
         LogPrintf("[snapshot] allocating all cache to the snapshot chainstate\n");
+        if (m_ibd_chainstate && m_ibd_chainstate->CanFlushToDisk()) {
+            // The validated background chainstate is not used anymore.
+            m_ibd_chainstate->ResizeCoinsCaches(0, 0);
+        }
         // Allocate everything to the snapshot chainstate.
         m_snapshot_chainstate->ResizeCoinsCaches(m_total_coinstip_cache, m_total_coinsdb_cache);
     }
@@ -16,6 +16,7 @@
 #include <consensus/amount.h>
 #include <fs.h>
 #include <node/blockstorage.h>
+#include <node/coinsprefetch.h>
 #include <policy/feerate.h>
 #include <policy/packages.h>
 #include <script/script_error.h>
@@ -28,6 +29,7 @@
 #include <util/translation.h>
 
 #include <atomic>
+#include <condition_variable>
 #include <map>
 #include <memory>
 #include <optional>
@@ -62,6 +64,9 @@ static const unsigned int DEFAULT_ANCESTOR_SIZE_LIMIT = 101;
 static const unsigned int DEFAULT_DESCENDANT_LIMIT = 25;
 /** Default for -limitdescendantsize, maximum kilobytes of in-mempool descendants */
 static const unsigned int DEFAULT_DESCENDANT_SIZE_LIMIT = 101;
+/** Default for -limitclustercount, max number of transactions in a mempool cluster.
+ *  Clusters up to this size are linearized from scratch whenever they change. */
+static const unsigned int DEFAULT_CLUSTER_LIMIT = 64;
 
 // If a package is submitted, it must be within the mempool's ancestor/descendant limits. Since a
 // submitted package must be child-with-unconfirmed-parents (all of the transactions are an ancestor
@@ -69,15 +74,18 @@ static const unsigned int DEFAULT_DESCENDANT_SIZE_LIMIT = 101;
 // defaults reflect this constraint.
 static_assert(DEFAULT_DESCENDANT_LIMIT >= MAX_PACKAGE_COUNT);
 static_assert(DEFAULT_ANCESTOR_LIMIT >= MAX_PACKAGE_COUNT);
+static_assert(DEFAULT_CLUSTER_LIMIT >= MAX_PACKAGE_COUNT);
 static_assert(DEFAULT_ANCESTOR_SIZE_LIMIT >= MAX_PACKAGE_SIZE);
 static_assert(DEFAULT_DESCENDANT_SIZE_LIMIT >= MAX_PACKAGE_SIZE);
 
 /** Default for -mempoolexpiry, expiration time for mempool transactions in hours */
 static const unsigned int DEFAULT_MEMPOOL_EXPIRY = 336;
 /** Maximum number of dedicated script-checking threads allowed */
-static const int MAX_SCRIPTCHECK_THREADS = 15;
+static const int MAX_SCRIPTCHECK_THREADS = 63;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** -scriptcheckwindow default (number of blocks whose script checks may be in flight at once during initial block download) */
+static const int DEFAULT_SCRIPT_CHECK_WINDOW = 16;
 static const int64_t DEFAULT_MAX_TIP_AGE = 24 * 60 * 60;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
 static const bool DEFAULT_TXINDEX = false;
@@ -85,6 +93,10 @@ static constexpr bool DEFAULT_COINSTATSINDEX{false};
 static const char* const DEFAULT_BLOCKFILTERINDEX = "0";
 /** Default for -persistmempool */
 static const bool DEFAULT_PERSIST_MEMPOOL = true;
+/** Default for -persistmempoolv1 */
+static constexpr bool DEFAULT_PERSIST_V1_DAT{false};
+/** Default for -persistsigcache */
+static constexpr bool DEFAULT_PERSIST_SIGCACHE{true};
 /** Default for -stopatheight */
 static const int DEFAULT_STOPATHEIGHT = 0;
 /** Block files containing a block-height within MIN_BLOCKS_TO_KEEP of ActiveChain().Tip() will not be pruned. */
@@ -139,9 +151,9 @@ extern const std::vector<std::string> CHECKLEVEL_DOC;
 
 /** Unload database information */
 void UnloadBlockIndex(CTxMemPool* mempool, ChainstateManager& chainman);
-/** Run instances of script checking worker threads */
+/** Run instances of script checking worker threads, and as many threads checking block headers */
 void StartScriptCheckWorkerThreads(int threads_num);
-/** Stop all of the script checking worker threads */
+/** Stop all of the script and header checking worker threads */
 void StopScriptCheckWorkerThreads();
 
 CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams);
@@ -261,6 +273,20 @@ MempoolAcceptResult AcceptToMemoryPool(CChainState& active_chainstate, const CTr
                                        int64_t accept_time, bool bypass_limits, bool test_accept)
     EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+/**
+ * Try to add transactions to the mempool together. This is an internal function and is exposed only
+ * for testing. Client code should use ChainstateManager::ProcessTransactions()
+ *
+ * Transactions that neither depend on nor conflict with each other are validated under a single
+ * acquisition of the mempool lock, with their scripts verified in parallel. The others are passed to
+ * AcceptToMemoryPool() after them, in order.
+ *
+ * @returns a MempoolAcceptResult for each transaction, in the same order.
+ */
+std::vector<MempoolAcceptResult> AcceptBatchToMemoryPool(CChainState& active_chainstate, const std::vector<CTransactionRef>& txns,
+                                                         int64_t accept_time)
+    EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
 /**
 * Validate (and maybe submit) a package to the mempool. See doc/policy/packages.md for full details
 * on package validation rules.
@@ -345,6 +371,38 @@ public:
     ScriptError GetScriptError() const { return error; }
 };
 
+/** Hash and proof of work validity of a block header, computed ahead of AcceptBlockHeader() */
+struct HeaderPrecheck {
+    uint256 hash;
+    bool valid_pow{false};
+};
+
+/**
+ * Closure computing the hash of one block header and checking its proof of
+ * work. The result is stored in the given HeaderPrecheck, so the check
+ * itself always succeeds.
+ */
+class CHeaderCheck
+{
+private:
+    const CBlockHeader* m_header{nullptr};
+    const Consensus::Params* m_consensus{nullptr};
+    HeaderPrecheck* m_result{nullptr};
+
+public:
+    CHeaderCheck() = default;
+    CHeaderCheck(const CBlockHeader& header, const Consensus::Params& consensus, HeaderPrecheck& result) :
+        m_header(&header), m_consensus(&consensus), m_result(&result) { }
+
+    bool operator()();
+
+    void swap(CHeaderCheck& check) {
+        std::swap(m_header, check.m_header);
+        std::swap(m_consensus, check.m_consensus);
+        std::swap(m_result, check.m_result);
+    }
+};
+
 /** Initializes the script-execution cache */
 void InitScriptExecutionCache();
 
@@ -389,6 +447,7 @@ enum DisconnectResult
 };
 
 class ConnectTrace;
+class ScriptCheckWindow;
 
 /** @see CChainState::FlushStateToDisk */
 enum class FlushStateMode {
@@ -442,6 +501,20 @@ enum class CoinsCacheSizeState
     OK = 0
 };
 
+//! Outcome of ChainstateManager::MaybeCompleteSnapshotValidation().
+enum class SnapshotCompletionResult
+{
+    //! No background validation has reached the snapshot base block yet.
+    SKIPPED,
+    //! The UTXO set of the background chainstate matches the snapshot.
+    SUCCESS,
+    //! The UTXO set of the background chainstate does not match the snapshot.
+    HASH_MISMATCH,
+    //! The UTXO set of the background chainstate could not be hashed, or
+    //! there is nothing to compare it to. Says nothing about the snapshot.
+    STATS_FAILED,
+};
+
 /**
  * CChainState stores and provides an API to update our local knowledge of the
  * current best chain.
@@ -596,6 +669,10 @@ public:
     //! The cache size of the in-memory coins view.
     size_t m_coinstip_cache_size_bytes{0};
 
+    //! Chain tip at the last flush whose coins are still being written in the
+    //! background (see -coinswritebehind), reported as flushed once they are.
+    std::optional<CBlockLocator> m_write_behind_locator GUARDED_BY(::cs_main);
+
     //! Resize the CoinsViews caches dynamically and flush state to disk.
     //! @returns true unless an error occurred during the flush.
     bool ResizeCoinsCaches(size_t coinstip_size, size_t coinsdb_size)
@@ -655,7 +732,7 @@ public:
     DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& view)
         EXCLUSIVE_LOCKS_REQUIRED(::cs_main);
     bool ConnectBlock(const CBlock& block, BlockValidationState& state, CBlockIndex* pindex,
-                      CCoinsViewCache& view, bool fJustCheck = false) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+                      CCoinsViewCache& view, bool fJustCheck = false, ScriptCheckWindow* window = nullptr) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
     // Apply the effects of a block disconnection on the UTXO set.
     bool DisconnectTip(BlockValidationState& state, DisconnectedBlockTransactions* disconnectpool) EXCLUSIVE_LOCKS_REQUIRED(cs_main, m_mempool->cs);
@@ -717,11 +794,33 @@ public:
         size_t max_coins_cache_size_bytes,
         size_t max_mempool_size_bytes) EXCLUSIVE_LOCKS_REQUIRED(::cs_main);
 
+    //! Memory usage the coins cache is trimmed to by evicting unmodified
+    //! coins once it is LARGE, instead of writing it to disk. Well below the
+    //! LARGE state, so that a few blocks fit before the next eviction. Coins
+    //! still being written in the background count towards it.
+    //!
+    //! @return 0 if unmodified coins are not kept across flushes.
+    size_t GetCoinsCacheRetainSize() EXCLUSIVE_LOCKS_REQUIRED(::cs_main);
+
+    size_t GetCoinsCacheRetainSize(
+        size_t max_coins_cache_size_bytes,
+        int64_t retain_percent) EXCLUSIVE_LOCKS_REQUIRED(::cs_main);
+
     std::string ToString() EXCLUSIVE_LOCKS_REQUIRED(::cs_main);
 
+    //! Add a block whose transactions (and those of its ancestors) were
+    //! received to setBlockIndexCandidates, unless it has less work than the
+    //! tip. A background validation chainstate only takes blocks beneath the
+    //! snapshot base block.
+    void TryAddBlockIndexCandidate(CBlockIndex* pindex) EXCLUSIVE_LOCKS_REQUIRED(::cs_main);
+
 private:
     bool ActivateBestChainStep(BlockValidationState& state, CBlockIndex* pindexMostWork, const std::shared_ptr<const CBlock>& pblock, bool& fInvalidFound, ConnectTrace& connectTrace) EXCLUSIVE_LOCKS_REQUIRED(cs_main, m_mempool->cs);
-    bool ConnectTip(BlockValidationState& state, CBlockIndex* pindexNew, const std::shared_ptr<const CBlock>& pblock, ConnectTrace& connectTrace, DisconnectedBlockTransactions& disconnectpool) EXCLUSIVE_LOCKS_REQUIRED(cs_main, m_mempool->cs);
+    bool ConnectTip(BlockValidationState& state, CBlockIndex* pindexNew, const std::shared_ptr<const CBlock>& pblock, ConnectTrace& connectTrace, DisconnectedBlockTransactions& disconnectpool, ScriptCheckWindow* window = nullptr) EXCLUSIVE_LOCKS_REQUIRED(cs_main, m_mempool->cs);
+    //! Apply the blocks of a script check window whose checks all passed to the coins tip.
+    void CommitScriptCheckWindow(ScriptCheckWindow& window) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+    //! Undo the connection of the blocks of a script check window, returning m_chain to the block before it.
+    void RollbackScriptCheckWindow(ScriptCheckWindow& window, ConnectTrace& connectTrace, DisconnectedBlockTransactions& disconnectpool) EXCLUSIVE_LOCKS_REQUIRED(cs_main, m_mempool->cs);
 
     void InvalidBlockFound(CBlockIndex* pindex, const BlockValidationState& state) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
     CBlockIndex* FindMostWorkChain() EXCLUSIVE_LOCKS_REQUIRED(cs_main);
@@ -835,6 +934,15 @@ private:
     //! by the background validation chainstate.
     bool m_snapshot_validated{false};
 
+    //! Connects the blocks of the background validation chainstate.
+    std::thread m_background_validation_thread;
+    Mutex m_background_validation_mutex;
+    std::condition_variable m_background_validation_cv;
+    //! Set when new blocks may be connected by the background chainstate.
+    bool m_background_validation_pending GUARDED_BY(m_background_validation_mutex){false};
+    bool m_background_validation_stop GUARDED_BY(m_background_validation_mutex){false};
+    void ThreadBackgroundValidation();
+
     CBlockIndex* m_best_invalid;
     friend bool node::BlockManager::LoadBlockIndex(const Consensus::Params&, ChainstateManager&);
 
@@ -847,12 +955,16 @@ private:
     /**
      * If a block header hasn't already been seen, call CheckBlockHeader on it, ensure
      * that it doesn't descend from an invalid block, and then add it to m_block_index.
+     *
+     * @param[in] precheck If set, the header's hash and proof of work validity,
+     *                     which are then not computed again.
      */
     bool AcceptBlockHeader(
         const CBlockHeader& block,
         BlockValidationState& state,
         const CChainParams& chainparams,
-        CBlockIndex** ppindex) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+        CBlockIndex** ppindex,
+        const HeaderPrecheck* precheck = nullptr) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
     friend CChainState;
 
 public:
@@ -861,6 +973,10 @@ public:
     //! chainstate to avoid duplicating block metadata.
     node::BlockManager m_blockman;
 
+    //! Warms the coins caches for blocks that are about to be connected.
+    //! nullptr if prefetching is disabled (-prefetchthreads=0).
+    std::unique_ptr<node::CoinsPrefetcher> m_coins_prefetcher;
+
     /**
      * In order to efficiently track invalidity of headers, we keep the set of
      * blocks which we tried to connect and found to be invalid here (ie which
@@ -942,6 +1058,48 @@ public:
     //! Is there a snapshot in use and has it been fully validated?
     bool IsSnapshotValidated() const { return m_snapshot_validated; }
 
+    //! @returns the block the snapshot in use is based on, or nullptr.
+    const CBlockIndex* GetSnapshotBaseBlock() const EXCLUSIVE_LOCKS_REQUIRED(::cs_main);
+
+    //! @returns true if a background chainstate is still validating the
+    //!          blocks beneath the snapshot base block.
+    bool BackgroundSyncInProgress() const EXCLUSIVE_LOCKS_REQUIRED(::cs_main)
+    {
+        return IsSnapshotActive() && !m_snapshot_validated;
+    }
+
+    //! @returns the tip of the background validation chainstate, or nullptr
+    //!          if no background sync is in progress.
+    const CBlockIndex* GetBackgroundSyncTip() const EXCLUSIVE_LOCKS_REQUIRED(::cs_main)
+    {
+        return BackgroundSyncInProgress() ? m_ibd_chainstate->m_chain.Tip() : nullptr;
+    }
+
+    //! Construct the chainstate of a snapshot that was activated in an
+    //! earlier run, so its coins database is loaded again. The mempool is
+    //! moved over from the IBD chainstate, which continues to validate the
+    //! blocks beneath the snapshot base in the background.
+    CChainState& ActivateExistingSnapshot(CTxMemPool* mempool, const uint256& base_blockhash)
+        EXCLUSIVE_LOCKS_REQUIRED(::cs_main);
+
+    //! Once the background validation chainstate reached the snapshot base
+    //! block, compare the hash of its UTXO set to the one expected by the
+    //! assumeutxo chain parameters. If they match, the snapshot is marked as
+    //! validated and its chainstate takes over all of the cache.
+    //!
+    //! Hashes the whole UTXO set of the background chainstate. Unless held by
+    //! the caller, cs_main is only held to flush it.
+    SnapshotCompletionResult MaybeCompleteSnapshotValidation();
+
+    //! Start a thread that runs ActivateBestChain() on the background
+    //! validation chainstate at low priority whenever a snapshot is in use and
+    //! not validated yet.
+    void StartBackgroundValidation();
+    //! Wake the background validation thread, e.g. after new blocks were stored.
+    void NotifyBackgroundValidation();
+    //! Stop the background validation thread, if running.
+    void StopBackgroundValidation();
+
     /**
      * Process an incoming block. This only returns after the best known valid
      * block is made active. Note that it does not, however, guarantee that the
@@ -966,6 +1124,9 @@ public:
     /**
      * Process incoming block headers.
      *
+     * The hashes and proof of work of the headers are checked in parallel
+     * before cs_main is taken, only adding them to the block index is serial.
+     *
      * May not be called in a
      * validationinterface callback.
      *
@@ -985,6 +1146,15 @@ public:
     [[nodiscard]] MempoolAcceptResult ProcessTransaction(const CTransactionRef& tx, bool test_accept=false)
         EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+    /**
+     * Try to add transactions to the memory pool together, see AcceptBatchToMemoryPool().
+     *
+     * @param[in]  txs             The transactions to submit for mempool acceptance.
+     * @returns a MempoolAcceptResult for each transaction, in the same order.
+     */
+    [[nodiscard]] std::vector<MempoolAcceptResult> ProcessTransactions(const std::vector<CTransactionRef>& txs)
+        EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
     //! Load the block tree and coins database from disk, initializing state if we're running with -reindex
     bool LoadBlockIndex() EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
@@ -999,6 +1169,9 @@ public:
     void MaybeRebalanceCaches() EXCLUSIVE_LOCKS_REQUIRED(::cs_main);
 
     ~ChainstateManager() {
+        StopBackgroundValidation();
+        // Stop the prefetch threads before the coins databases they read from go away.
+        m_coins_prefetcher.reset();
         LOCK(::cs_main);
         UnloadBlockIndex(/* mempool */ nullptr, *this);
         Reset();
@@ -1013,6 +1186,12 @@ bool DumpMempool(const CTxMemPool& pool, FopenFn mockable_fopen_function = fsbri
 /** Load the mempool from disk. */
 bool LoadMempool(CTxMemPool& pool, CChainState& active_chainstate, FopenFn mockable_fopen_function = fsbridge::fopen);
 
+/** Dump the signature cache and the script execution cache to disk, with the salts of their entries. */
+bool DumpSignatureCaches(FopenFn mockable_fopen_function = fsbridge::fopen, bool skip_file_commit = false);
+
+/** Load the signature cache and the script execution cache from disk. Must be called before they are used. */
+bool LoadSignatureCaches(FopenFn mockable_fopen_function = fsbridge::fopen);
+
 /**
  * Return the expected assumeutxo value for a given height, if one exists.
  *
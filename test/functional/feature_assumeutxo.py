@@ -0,0 +1,97 @@
+#!/usr/bin/env python3
+# Copyright (c) 2022 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test loading a UTXO snapshot with loadtxoutset and validating it in the background.
+
+The first 299 blocks are mined deterministically, so their UTXO set matches
+the assumeutxo chain parameters of regtest at that height.
+
+  - node0 mines the blocks, dumps the UTXO set and mines some more blocks.
+  - node1 learns the headers of the snapshot chain and loads the snapshot,
+    which it continues to use after a restart.
+  - node1 syncs from node0 on top of the snapshot, while the blocks beneath it
+    are downloaded and validated in the background until the snapshot is
+    validated.
+  - When restarted, node1 replaces its IBD chainstate with the snapshot
+    chainstate.
+"""
+import os
+
+from test_framework.address import ADDRESS_BCRT1_P2WSH_OP_TRUE
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_raises_rpc_error,
+)
+
+SNAPSHOT_BASE_HEIGHT = 299
+FINAL_HEIGHT = SNAPSHOT_BASE_HEIGHT + 20
+# Keep the block hashes of the snapshot chain fixed
+MOCKTIME = 1640995200
+
+
+class AssumeutxoTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 2
+
+    def setup_network(self):
+        # The nodes are connected once the snapshot is loaded.
+        self.setup_nodes()
+
+    def run_test(self):
+        node0, node1 = self.nodes
+
+        self.log.info("Mine the snapshot chain and dump its UTXO set")
+        node0.setmocktime(MOCKTIME)
+        self.generatetoaddress(node0, SNAPSHOT_BASE_HEIGHT, ADDRESS_BCRT1_P2WSH_OP_TRUE, sync_fun=self.no_op)
+        dump = node0.dumptxoutset('utxos.dat')
+        assert_equal(dump['base_height'], SNAPSHOT_BASE_HEIGHT)
+        assert_equal(dump['txoutset_hash'], 'c824341476dda73a2c194d11561532aa7ede143084fc2c4ce4a07171b367fe6c')
+        assert_equal(dump['nchaintx'], SNAPSHOT_BASE_HEIGHT + 1)
+        # Bring node0 out of initial block download, so it serves headers.
+        node0.setmocktime(0)
+        self.generatetoaddress(node0, FINAL_HEIGHT - SNAPSHOT_BASE_HEIGHT, ADDRESS_BCRT1_P2WSH_OP_TRUE, sync_fun=self.no_op)
+
+        self.log.info("Refuse to load the snapshot without the header of its base block")
+        assert_raises_rpc_error(-8, "must appear in the headers chain", node1.loadtxoutset, dump['path'])
+
+        self.log.info("Load the snapshot")
+        for height in range(1, SNAPSHOT_BASE_HEIGHT + 1):
+            block = node0.getblock(node0.getblockhash(height), 0)
+            node1.submitheader(block[:160])
+        loaded = node1.loadtxoutset(dump['path'])
+        assert_equal(loaded['coins_loaded'], dump['coins_written'])
+        assert_equal(loaded['base_height'], SNAPSHOT_BASE_HEIGHT)
+        assert_equal(loaded['tip_hash'], dump['base_hash'])
+        assert_equal(node1.getbestblockhash(), dump['base_hash'])
+        assert_equal(node1.gettxoutsetinfo()['hash_serialized_2'], dump['txoutset_hash'])
+        assert_raises_rpc_error(-32603, "Unable to load UTXO snapshot", node1.loadtxoutset, dump['path'])
+
+        self.log.info("Keep using the snapshot after a restart")
+        with node1.assert_debug_log([f"[snapshot] using snapshot chainstate based on {dump['base_hash']}"]):
+            self.restart_node(1)
+        assert_equal(node1.getbestblockhash(), dump['base_hash'])
+        assert_raises_rpc_error(-32603, "Unable to load UTXO snapshot", node1.loadtxoutset, dump['path'])
+
+        self.log.info("Sync on top of the snapshot and validate it in the background")
+        with node1.assert_debug_log([f"[snapshot] snapshot based on {dump['base_hash']} has been fully validated"], timeout=60):
+            self.connect_nodes(1, 0)
+            self.sync_blocks()
+        assert_equal(node1.getblockcount(), FINAL_HEIGHT)
+        # The blocks beneath the snapshot were downloaded.
+        assert_equal(node1.getblock(node0.getblockhash(1)), node0.getblock(node0.getblockhash(1)))
+
+        self.log.info("Retire the snapshot chainstate when restarting")
+        with node1.assert_debug_log(["[snapshot] replacing the IBD chainstate with the validated snapshot chainstate"]):
+            self.restart_node(1)
+        datadir = os.path.join(node1.datadir, self.chain)
+        assert_equal([d for d in os.listdir(datadir) if d.startswith('chainstate_')], [])
+        assert_equal(node1.getblockcount(), FINAL_HEIGHT)
+        assert_equal(node1.gettxoutsetinfo()['hash_serialized_2'], node0.gettxoutsetinfo()['hash_serialized_2'])
+        assert_equal(node1.verifychain(4, 0), True)
+
+
+if __name__ == '__main__':
+    AssumeutxoTest().main()
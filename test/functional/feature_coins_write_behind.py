@@ -0,0 +1,52 @@
+#!/usr/bin/env python3
+# Copyright (c) 2022 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test writing the coins cache to disk in the background (-coinswritebehind).
+
+1) A periodic flush while connecting blocks hands the coins to the
+   background writer, and the UTXO set matches a node writing synchronously.
+2) The UTXO set survives a restart.
+"""
+import time
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal
+
+# DATABASE_FLUSH_INTERVAL in validation.cpp
+FLUSH_INTERVAL = 24 * 60 * 60
+
+
+class CoinsWriteBehindTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 2
+        self.setup_clean_chain = True
+        self.extra_args = [[], ["-coinswritebehind", "-debug=coindb"]]
+
+    def assert_utxo_sets_equal(self):
+        hashes = [node.gettxoutsetinfo()["hash_serialized_2"] for node in self.nodes]
+        assert_equal(hashes[0], hashes[1])
+
+    def run_test(self):
+        node = self.nodes[1]
+        self.generate(self.nodes[0], 150)
+
+        self.log.info("Write the coins in the background on a periodic flush")
+        mocktime = int(time.time()) + FLUSH_INTERVAL + 60 * 60
+        for n in self.nodes:
+            n.setmocktime(mocktime)
+        with node.assert_debug_log(expected_msgs=["coins in the background"], timeout=30):
+            self.generate(self.nodes[0], 1)
+        self.generate(self.nodes[0], 10)
+        self.assert_utxo_sets_equal()
+
+        self.log.info("Coins are on disk after a restart")
+        # The blocks were mined at mocktime, so keep it on startup.
+        self.restart_node(1, extra_args=self.extra_args[1] + [f"-mocktime={mocktime}"])
+        self.connect_nodes(0, 1)
+        self.assert_utxo_sets_equal()
+        assert_equal(node.getbestblockhash(), self.nodes[0].getbestblockhash())
+
+
+if __name__ == '__main__':
+    CoinsWriteBehindTest().main()
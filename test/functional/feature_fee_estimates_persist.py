@@ -0,0 +1,64 @@
+#!/usr/bin/env python3
+# Copyright (c) 2022 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test that fee estimates survive the node being killed.
+
+Every block the fee estimator processes is appended to fee_estimates.journal,
+which is replayed on top of fee_estimates.dat on startup.
+
+  - Mine blocks with transactions at different feerates.
+  - Kill the node. Check that the journal is replayed on startup and the
+    estimates are the same as before.
+  - Restart the node cleanly. Check that the estimates are read from
+    fee_estimates.dat alone and are still the same.
+"""
+from decimal import Decimal
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal
+from test_framework.wallet import MiniWallet
+
+TARGETS = [1, 2, 3, 6, 12, 24]
+
+
+class FeeEstimatesPersistTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 1
+
+    def raw_estimates(self):
+        return [self.nodes[0].estimaterawfee(target) for target in TARGETS]
+
+    def run_test(self):
+        node = self.nodes[0]
+        wallet = MiniWallet(node)
+        self.generate(wallet, 40, sync_fun=self.no_op)
+        self.generate(node, 100, sync_fun=self.no_op)
+
+        self.log.info("Mine blocks with transactions at different feerates")
+        for _ in range(30):
+            for i in range(8):
+                wallet.send_self_transfer(from_node=node, fee_rate=Decimal("0.0001") * (i + 1))
+            self.generate(node, 1, sync_fun=self.no_op)
+        assert_equal(node.getrawmempool(), [])
+        estimates = self.raw_estimates()
+        assert 'feerate' in estimates[1]['short']
+        height = node.getblockcount()
+
+        self.log.info("Kill the node, the journal is replayed on startup")
+        node.kill_process()
+        with node.assert_debug_log([f"Replayed {height} blocks from the fee estimates journal up to height {height}"]):
+            self.start_node(0)
+        assert_equal(self.raw_estimates(), estimates)
+        assert 'feerate' in node.estimatesmartfee(2)
+
+        self.log.info("Restart cleanly, the estimates file is up to date")
+        with node.assert_debug_log([], unexpected_msgs=["Replayed", "Failed to read fee estimates"]):
+            self.restart_node(0)
+        assert_equal(self.raw_estimates(), estimates)
+        assert 'feerate' in node.estimatesmartfee(2)
+
+
+if __name__ == '__main__':
+    FeeEstimatesPersistTest().main()
@@ -41,6 +41,7 @@ class ReplaceByFeeTest(BitcoinTestFramework):
                 "-limitancestorsize=101",
                 "-limitdescendantcount=200",
                 "-limitdescendantsize=101",
+                "-limitclustercount=200",
             ],
         ]
         self.supports_cli = False
@@ -0,0 +1,82 @@
+#!/usr/bin/env python3
+# Copyright (c) 2022 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test verifying the scripts of several blocks at once during initial block download.
+
+We build a chain in which every block after the coinbase maturity spends a
+coinbase output, and block 110 spends an output whose script always fails:
+
+    1:       block 1 with an unspendable coinbase output
+    2-101:   bury that block with 100 blocks
+    102-109: blocks spending the coinbase outputs of blocks 2-9
+    110:     a block spending the coinbase output of block 1
+
+The node accepts blocks 1-109 and stores, but rejects, block 110. When
+reindexing, the blocks are connected in script check windows of 4 blocks.
+The window containing block 110 fails, is rolled back, and its blocks are
+connected again one at a time, so the node ends up at block 109 with block 110
+marked invalid.
+"""
+
+from test_framework.blocktools import (
+    COINBASE_MATURITY,
+    create_block,
+    create_coinbase,
+    create_tx_with_script,
+)
+from test_framework.script import (
+    CScript,
+    OP_FALSE,
+    OP_TRUE,
+)
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal
+
+
+class ScriptCheckWindowTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 1
+        self.extra_args = [["-par=2", "-scriptcheckwindow=4"]]
+
+    def run_test(self):
+        node = self.nodes[0]
+        tip = int(node.getbestblockhash(), 16)
+        # Keep the block times in the past, so the node stays in initial block download.
+        block_time = node.getblock(node.getbestblockhash())['time'] + 1
+
+        blocks = []
+        for height in range(1, COINBASE_MATURITY + 11):
+            coinbase = create_coinbase(height, nValue=15)
+            if height == 1:
+                coinbase.vout[0].scriptPubKey = CScript([OP_FALSE])
+                coinbase.rehash()
+            txlist = []
+            if height > COINBASE_MATURITY + 1:
+                # blocks[i] is the block at height i + 1
+                spent = blocks[0 if height == COINBASE_MATURITY + 10 else height - COINBASE_MATURITY - 1].vtx[0]
+                txlist.append(create_tx_with_script(spent, 0, amount=spent.vout[0].nValue, script_pub_key=CScript([OP_TRUE])))
+            block = create_block(tip, coinbase, block_time, txlist=txlist)
+            block.solve()
+            blocks.append(block)
+            tip = block.sha256
+            block_time += 1
+
+        self.log.info("Submit the blocks, block 110 is rejected")
+        for block in blocks[:-1]:
+            assert_equal(node.submitblock(block.serialize().hex()), None)
+        assert node.submitblock(blocks[-1].serialize().hex()) is not None
+        assert_equal(node.getblockcount(), COINBASE_MATURITY + 9)
+
+        self.log.info("Reindex, connecting the blocks in script check windows")
+        with node.assert_debug_log(["Script check window at height 109 failed"], timeout=60):
+            self.restart_node(0, extra_args=self.extra_args[0] + ["-reindex"])
+            self.wait_until(lambda: node.getblockcount() == COINBASE_MATURITY + 9)
+            self.wait_until(lambda: {"height": COINBASE_MATURITY + 10, "hash": blocks[-1].hash, "branchlen": 1, "status": "invalid"} in node.getchaintips())
+        assert_equal(node.getbestblockhash(), blocks[-2].hash)
+        assert_equal(node.getblockchaininfo()['initialblockdownload'], True)
+
+
+if __name__ == '__main__':
+    ScriptCheckWindowTest().main()
@@ -0,0 +1,93 @@
+#!/usr/bin/env python3
+# Copyright (c) 2022 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test signature cache persistence.
+
+By default, the node dumps its signature and script execution caches to
+sigcache.dat on shutdown and reloads them on startup. This can be overridden
+with the -persistsigcache=0 command line option.
+
+  - Accept a transaction to the mempool, which caches its signature and its
+    script execution.
+  - Restart without reloading the mempool. Check that both cache entries are
+    imported.
+  - Restart with -persistsigcache=0. Check that nothing is imported, and that
+    sigcache.dat is not overwritten on shutdown.
+  - Restart again, and check that the cache entries are still imported.
+  - Mine the transaction. Its scripts are not run again, as the script
+    execution cache entry is found and marked for removal. Check that only
+    the signature is saved anymore.
+  - Restart with a sigcache.dat of an unknown version. Check that it is
+    ignored with a log message.
+"""
+from decimal import Decimal
+import os
+
+from test_framework.address import key_to_p2wpkh
+from test_framework.descriptors import descsum_create
+from test_framework.key import ECKey
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal
+from test_framework.wallet_util import bytes_to_wif
+
+
+class SigcachePersistTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 1
+        self.extra_args = [["-persistmempool=0"]]
+
+    def run_test(self):
+        node = self.nodes[0]
+        sigcache_path = os.path.join(node.datadir, self.chain, "sigcache.dat")
+
+        key = ECKey()
+        key.generate()
+        address = key_to_p2wpkh(key.get_pubkey().get_bytes())
+        blockhash = self.generatetoaddress(node, 1, address)[0]
+        coinbase_txid = node.getblock(blockhash)['tx'][0]
+        self.generatetodescriptor(node, 100, descsum_create("raw(51)"))
+
+        self.log.info("Accept a transaction to the mempool")
+        prevout = node.getrawtransaction(coinbase_txid, True, blockhash)['vout'][0]
+        raw_tx = node.createrawtransaction([{"txid": coinbase_txid, "vout": 0}], {address: prevout['value'] - Decimal('0.001')})
+        signed = node.signrawtransactionwithkey(raw_tx, [bytes_to_wif(key.get_bytes())], [{
+            "txid": coinbase_txid,
+            "vout": 0,
+            "scriptPubKey": prevout['scriptPubKey']['hex'],
+            "amount": prevout['value'],
+        }])
+        assert signed['complete']
+        node.sendrawtransaction(signed['hex'])
+
+        self.log.info("Restart, the cache entries are imported")
+        with node.assert_debug_log(["Imported signature caches from disk: 1 signatures, 1 scripts"]):
+            self.restart_node(0)
+        assert_equal(node.getrawmempool(), [])
+
+        self.log.info("Restart with -persistsigcache=0, nothing is imported or saved")
+        with node.assert_debug_log([], unexpected_msgs=["Imported signature caches"]):
+            self.restart_node(0, extra_args=self.extra_args[0] + ["-persistsigcache=0"])
+        mtime = os.path.getmtime(sigcache_path)
+        self.stop_node(0)
+        assert_equal(os.path.getmtime(sigcache_path), mtime)
+
+        with node.assert_debug_log(["Imported signature caches from disk: 1 signatures, 1 scripts"]):
+            self.start_node(0)
+
+        self.log.info("Mine the transaction, its script execution cache entry is not saved anymore")
+        self.generateblock(node, address, [signed['hex']])
+        with node.assert_debug_log(["Imported signature caches from disk: 1 signatures, 0 scripts"]):
+            self.restart_node(0)
+
+        self.log.info("Restart with a file of an unknown version, it is ignored")
+        self.stop_node(0)
+        with open(sigcache_path, "r+b") as f:
+            f.write((2).to_bytes(8, "little"))
+        with node.assert_debug_log([f"Ignoring signature cache file {sigcache_path} of version 2, expected version 1"], unexpected_msgs=["Imported signature caches"]):
+            self.start_node(0)
+
+
+if __name__ == '__main__':
+    SigcachePersistTest().main()
@@ -57,7 +57,7 @@ class RESTTest (BitcoinTestFramework):
             args.append("-whitelist=noban@127.0.0.1")
         self.supports_cli = False
 
-    def test_rest_request(self, uri, http_method='GET', req_type=ReqType.JSON, body='', status=200, ret_type=RetType.JSON):
+    def test_rest_request(self, uri, http_method='GET', req_type=ReqType.JSON, body='', status=200, ret_type=RetType.JSON, query_params=None):
         rest_uri = '/rest' + uri
         if req_type == ReqType.JSON:
             rest_uri += '.json'
@@ -65,6 +65,8 @@ class RESTTest (BitcoinTestFramework):
             rest_uri += '.bin'
         elif req_type == ReqType.HEX:
             rest_uri += '.hex'
+        if query_params:
+            rest_uri += f'?{urllib.parse.urlencode(query_params)}'
 
         conn = http.client.HTTPConnection(self.url.hostname, self.url.port)
         self.log.debug(f'{http_method} {rest_uri} {body}')
@@ -320,6 +322,24 @@ class RESTTest (BitcoinTestFramework):
             assert tx in json_obj
             assert_equal(json_obj[tx]['spentby'], txs[i + 1:i + 2])
             assert_equal(json_obj[tx]['depends'], txs[i - 1:i])
+        assert_equal(json_obj, self.nodes[0].getrawmempool(True))
+
+        self.log.info("Test the mempool sequence of /mempool/contents and /mempool/changes")
+        json_obj = self.test_rest_request("/mempool/contents", query_params={"mempool_sequence": "true"})
+        mempool_sequence = json_obj['mempool_sequence']
+        assert_equal(mempool_sequence, self.nodes[0].getrawmempool(False, True)['mempool_sequence'])
+        assert_equal(sorted(json_obj['txs']), sorted(txs))
+        assert_equal(self.test_rest_request("/mempool/contents", query_params={"mempool_sequence": "false"}), json_obj['txs'])
+        resp = self.test_rest_request("/mempool/contents", query_params={"mempool_sequence": "1"}, status=400, ret_type=RetType.BYTES)
+        assert_equal(resp, b'The "mempool_sequence" query parameter must be either "true" or "false".\r\n')
+
+        assert_equal(self.test_rest_request(f"/mempool/changes/{mempool_sequence}"), {"mempool_sequence": mempool_sequence, "added": {}, "removed": []})
+        changes = self.test_rest_request(f"/mempool/changes/{mempool_sequence - 3}")
+        assert_equal(changes['mempool_sequence'], mempool_sequence)
+        assert_equal(changes['added'], json_obj['txs'])
+        assert_equal(changes['removed'], [])
+        self.test_rest_request(f"/mempool/changes/{mempool_sequence + 1}", status=404, ret_type=RetType.OBJ)
+        self.test_rest_request(f"/mempool/changes/{INVALID_PARAM}", status=400, ret_type=RetType.OBJ)
 
         # Now mine the transactions
         newblockhash = self.generate(self.nodes[1], 1)
@@ -344,6 +364,13 @@ class RESTTest (BitcoinTestFramework):
         for tx in txs:
             assert tx in json_obj['tx']
 
+        # The mined transactions are removed from the mempool
+        self.sync_all()
+        changes = self.test_rest_request(f"/mempool/changes/{mempool_sequence}")
+        assert_equal(changes['mempool_sequence'], mempool_sequence + 3)
+        assert_equal(changes['added'], {})
+        assert_equal(sorted(changes['removed']), sorted(txs))
+
         self.log.info("Test the /chaininfo URI")
 
         bb_hash = self.nodes[0].getbestblockhash()
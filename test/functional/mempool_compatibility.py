@@ -66,6 +66,9 @@ class MempoolCompatibilityTest(BitcoinTestFramework):
         assert old_tx_hash in new_node.getrawmempool()
 
         self.log.info("Add unbroadcasted tx to mempool on new node and shutdown")
+        # Previous releases only read the version 1 format
+        self.restart_node(1, extra_args=["-persistmempoolv1"])
+        assert old_tx_hash in new_node.getrawmempool()
         unbroadcasted_tx_hash = new_wallet.send_self_transfer(from_node=new_node)['txid']
         assert unbroadcasted_tx_hash in new_node.getrawmempool()
         assert new_node.getmempoolentry(unbroadcasted_tx_hash)['unbroadcast']
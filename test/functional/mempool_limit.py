@@ -12,6 +12,7 @@ from test_framework.test_framework import BitcoinTestFramework
 from test_framework.util import (
     assert_equal,
     assert_greater_than,
+    assert_greater_than_or_equal,
     assert_raises_rpc_error,
     gen_return_txouts,
 )
@@ -48,6 +49,7 @@ class MempoolLimitTest(BitcoinTestFramework):
         self.log.info('Check that mempoolminfee is minrelaytxfee')
         assert_equal(node.getmempoolinfo()['minrelaytxfee'], Decimal('0.00001000'))
         assert_equal(node.getmempoolinfo()['mempoolminfee'], Decimal('0.00001000'))
+        assert_equal(node.getmempoolinfo()['usage_per_tx'], 0)
 
         tx_batch_size = 25
         num_of_batches = 3
@@ -79,6 +81,11 @@ class MempoolLimitTest(BitcoinTestFramework):
         # Initial tx created should not be present in the mempool anymore as it had a lower fee rate
         assert tx_to_be_evicted_id not in node.getrawmempool()
 
+        self.log.info('Check that the memory usage stays within maxmempool')
+        mempoolinfo = node.getmempoolinfo()
+        assert_greater_than_or_equal(mempoolinfo['maxmempool'], mempoolinfo['usage'])
+        assert_equal(mempoolinfo['usage_per_tx'], mempoolinfo['usage'] // mempoolinfo['size'])
+
         self.log.info('Check that mempoolminfee is larger than minrelaytxfee')
         assert_equal(node.getmempoolinfo()['minrelaytxfee'], Decimal('0.00001000'))
         assert_greater_than(node.getmempoolinfo()['mempoolminfee'], Decimal('0.00001000'))
@@ -33,6 +33,8 @@ Test is as follows:
     mempool.
   - Verify that savemempool throws when the RPC is called if
     node1 can't write to disk.
+  - Dump mempool.dat in the version 1 format with -persistmempoolv1 and
+    verify that node1 loads it again.
 
 """
 from decimal import Decimal
@@ -152,6 +154,7 @@ class MempoolPersistTest(BitcoinTestFramework):
         result0 = self.nodes[0].savemempool()
         assert os.path.isfile(mempooldat0)
         assert_equal(result0['filename'], mempooldat0)
+        assert_equal(self.read_dump_version(mempooldat0), 2)
 
         self.log.debug("Stop nodes, make node1 use mempool.dat from node0. Verify it has 6 transactions")
         os.rename(mempooldat0, mempooldat1)
@@ -168,8 +171,19 @@ class MempoolPersistTest(BitcoinTestFramework):
         assert_raises_rpc_error(-1, "Unable to dump mempool to disk", self.nodes[1].savemempool)
         os.rmdir(mempooldotnew1)
 
+        self.log.debug("Dump mempool.dat in the version 1 format with -persistmempoolv1. Verify it is loaded again")
+        self.restart_node(1, extra_args=["-persistmempool", "-persistmempoolv1"])
+        self.nodes[1].savemempool()
+        assert_equal(self.read_dump_version(mempooldat1), 1)
+        self.restart_node(1, extra_args=["-persistmempool"])
+        assert_equal(len(self.nodes[1].getrawmempool()), 6)
+
         self.test_persist_unbroadcast()
 
+    def read_dump_version(self, path):
+        with open(path, 'rb') as f:
+            return int.from_bytes(f.read(8), 'little')
+
     def test_persist_unbroadcast(self):
         node0 = self.nodes[0]
         self.start_node(0)
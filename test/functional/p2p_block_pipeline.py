@@ -0,0 +1,65 @@
+#!/usr/bin/env python3
+# Copyright (c) 2022 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test block processing through the block pipeline (-blockpipelinethreads).
+
+1) Blocks synced from another node are decoded, checked and connected by the
+   pipeline, and getblockpipelineinfo reports them.
+2) A block failing the context-free checks is reported as such and the peer
+   that sent it is disconnected, as with synchronous processing.
+3) getblockpipelineinfo reports the pipeline as disabled by default.
+"""
+
+from test_framework.blocktools import (
+    create_block,
+    create_coinbase,
+)
+from test_framework.p2p import P2PDataStore
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal
+
+
+class BlockPipelineTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 2
+        self.setup_clean_chain = True
+        self.extra_args = [[], ["-blockpipelinethreads=2"]]
+
+    def setup_network(self):
+        # Connect the nodes only after generating, so all blocks are
+        # downloaded with getdata instead of being announced.
+        self.setup_nodes()
+
+    def run_test(self):
+        self.log.info("Pipeline is disabled by default")
+        assert_equal(self.nodes[0].getblockpipelineinfo(), {"enabled": False})
+
+        self.log.info("Sync blocks through the pipeline")
+        self.generate(self.nodes[0], 200, sync_fun=self.no_op)
+        self.connect_nodes(1, 0)
+        self.sync_blocks()
+        # The completion is accounted for after the block is connected.
+        self.wait_until(lambda: self.nodes[1].getblockpipelineinfo()["completed"] == 200)
+        info = self.nodes[1].getblockpipelineinfo()
+        assert_equal(info["enabled"], True)
+        assert_equal(info["threads"], 2)
+        assert_equal(info["submitted"], 200)
+        assert_equal(info["completed"], 200)
+        assert_equal(info["check_failures"], 0)
+        assert_equal(info["queues"], {"decode": 0, "checking": 0, "reorder": 0, "connect": 0})
+
+        self.log.info("Reject a block with a bad merkle root")
+        self.disconnect_nodes(0, 1)
+        node = self.nodes[1]
+        peer = node.add_p2p_connection(P2PDataStore())
+        tip = node.getblock(node.getbestblockhash())
+        block = create_block(int(tip["hash"], 16), create_coinbase(tip["height"] + 1), tip["time"] + 1)
+        block.hashMerkleRoot += 1
+        block.solve()
+        peer.send_blocks_and_test([block], node, success=False, reject_reason="bad-txnmrklroot", expect_disconnect=True)
+        assert_equal(node.getblockpipelineinfo()["check_failures"], 1)
+
+
+if __name__ == '__main__':
+    BlockPipelineTest().main()
@@ -0,0 +1,89 @@
+#!/usr/bin/env python3
+# Copyright (c) 2022 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the orphan pool and the getorphaninfo RPC.
+
+  - An orphan sent by two peers is stored once, with both peers as announcers.
+  - It is kept when one of the peers disconnects.
+  - Once its parent arrives, it is reconsidered and accepted to the mempool.
+  - A child whose other parent is still missing is not reconsidered.
+"""
+from decimal import Decimal
+
+from test_framework.messages import (
+    COIN,
+    COutPoint,
+    CTxIn,
+    msg_tx,
+)
+from test_framework.p2p import P2PTxInvStore
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal
+from test_framework.wallet import MiniWallet
+
+
+class OrphanPoolTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 1
+        self.extra_args = [["-whitelist=relay@127.0.0.1"]]
+
+    def run_test(self):
+        node = self.nodes[0]
+        wallet = MiniWallet(node)
+        self.generate(wallet, 20, sync_fun=self.no_op)
+        self.generate(node, 100, sync_fun=self.no_op)
+
+        def first_output(tx):
+            return {'txid': tx['txid'], 'vout': 0, 'value': Decimal(tx['tx'].vout[0].nValue) / COIN}
+
+        parent = wallet.create_self_transfer(from_node=node)
+        child = wallet.create_self_transfer(from_node=node, utxo_to_spend=first_output(parent), mempool_valid=False)
+        other_parent = wallet.create_self_transfer(from_node=node)
+        # The grandchild also spends other_parent, with the same anyone-can-spend witness.
+        grandchild = wallet.create_self_transfer(from_node=node, utxo_to_spend=first_output(child), mempool_valid=False)['tx']
+        grandchild.vin.append(CTxIn(COutPoint(int(other_parent['txid'], 16), 0)))
+        grandchild.wit.vtxinwit.append(grandchild.wit.vtxinwit[0])
+        grandchild.rehash()
+
+        self.log.info("Send the same orphan from two peers")
+        peer1 = node.add_p2p_connection(P2PTxInvStore())
+        peer2 = node.add_p2p_connection(P2PTxInvStore())
+        for peer in [peer1, peer2]:
+            peer.send_and_ping(msg_tx(child['tx']))
+        info = node.getorphaninfo()
+        assert_equal(info['size'], 1)
+        assert_equal(info['announcements'], 2)
+        assert_equal(info['peers'], 2)
+        assert_equal(info['added'], 1)
+        assert_equal(info['duplicates'], 1)
+        assert_equal(info['weight'], child['tx'].get_weight())
+
+        self.log.info("The orphan is kept when one of its announcers disconnects")
+        peer1.peer_disconnect()
+        peer1.wait_for_disconnect()
+        self.wait_until(lambda: node.getorphaninfo()['announcements'] == 1)
+        assert_equal(node.getorphaninfo()['size'], 1)
+
+        self.log.info("A child still missing a parent is not reconsidered")
+        peer2.send_and_ping(msg_tx(grandchild))
+        assert_equal(node.getorphaninfo()['size'], 2)
+        peer2.send_and_ping(msg_tx(parent['tx']))
+        assert_equal(sorted(node.getrawmempool()), sorted([parent['txid'], child['txid']]))
+        info = node.getorphaninfo()
+        assert_equal(info['size'], 1)
+        assert_equal(info['reconsidered'], 1)
+        assert_equal(info['deferred'], 1)
+
+        self.log.info("The child is reconsidered once its last parent arrives")
+        peer2.send_and_ping(msg_tx(other_parent['tx']))
+        assert_equal(len(node.getrawmempool()), 4)
+        info = node.getorphaninfo()
+        assert_equal(info['size'], 0)
+        assert_equal(info['reconsidered'], 2)
+        assert_equal(info['peers'], 0)
+
+
+if __name__ == '__main__':
+    OrphanPoolTest().main()
@@ -0,0 +1,97 @@
+#!/usr/bin/env python3
+# Copyright (c) 2022 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the socket handler with peers that pause receiving or disconnect.
+
+- A peer that sends faster than its messages are processed is paused and
+  resumed until all of its messages are processed.
+- A peer that disconnects while a lot of data is sent to it does not keep
+  the net thread busy.
+"""
+
+import os
+import platform
+import time
+
+from test_framework.messages import (
+    CInv,
+    MSG_BLOCK,
+    MSG_WITNESS_FLAG,
+    msg_getdata,
+    msg_ping,
+)
+from test_framework.p2p import P2PInterface
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal
+
+NUM_PINGS = 500
+# Clock ticks the net thread may use while it is idle for IDLE_SECONDS
+IDLE_SECONDS = 3
+MAX_IDLE_TICKS = 50
+
+
+class PongCollector(P2PInterface):
+    def __init__(self):
+        super().__init__()
+        self.pong_nonces = set()
+
+    def on_pong(self, message):
+        self.pong_nonces.add(message.nonce)
+
+
+class SocketHandlerTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 1
+        # Pause receiving from a peer as soon as 1000 bytes of its messages are queued
+        self.extra_args = [['-maxreceivebuffer=1']]
+
+    def net_thread_ticks(self):
+        """CPU time used by the net thread, in clock ticks."""
+        task_dir = f"/proc/{self.nodes[0].process.pid}/task"
+        for tid in os.listdir(task_dir):
+            with open(os.path.join(task_dir, tid, "comm"), encoding="utf8") as f:
+                if f.read().strip() != "b-net":
+                    continue
+            with open(os.path.join(task_dir, tid, "stat"), encoding="utf8") as f:
+                # Skip the command, which may contain spaces, then read utime and stime
+                fields = f.read().rsplit(")", 1)[1].split()
+            return int(fields[11]) + int(fields[12])
+        assert False, "net thread not found"
+
+    def run_test(self):
+        self.log.info("Check that a paused peer is resumed until all its messages are processed")
+        peer = self.nodes[0].add_p2p_connection(PongCollector())
+        nonces = set(range(1000, 1000 + NUM_PINGS))
+        for nonce in nonces:
+            peer.send_message(msg_ping(nonce))
+        peer.wait_until(lambda: nonces <= peer.pong_nonces)
+        peer.peer_disconnect()
+        peer.wait_for_disconnect()
+
+        self.log.info("Check that peers can disconnect while blocks are sent to them")
+        block_hash = int(self.generate(self.nodes[0], 1)[0], 16)
+        for _ in range(3):
+            peer = self.nodes[0].add_p2p_connection(P2PInterface())
+            peer.send_message(msg_getdata([CInv(MSG_BLOCK | MSG_WITNESS_FLAG, block_hash)] * 10000))
+            peer.peer_disconnect()
+            peer.wait_for_disconnect()
+        self.wait_until(lambda: len(self.nodes[0].getpeerinfo()) == 0)
+        self.nodes[0].add_p2p_connection(P2PInterface()).sync_with_ping()
+        self.nodes[0].disconnect_p2ps()
+
+        if platform.system() != "Linux":
+            self.log.info("Skip the check of the net thread CPU usage, which is read from /proc")
+            return
+        self.log.info("Check that the net thread is idle without peers")
+        ticks = self.net_thread_ticks()
+        time.sleep(IDLE_SECONDS)
+        ticks = self.net_thread_ticks() - ticks
+        self.log.debug(f"The net thread used {ticks} clock ticks in {IDLE_SECONDS} seconds")
+        assert ticks < MAX_IDLE_TICKS, f"The net thread used {ticks} clock ticks"
+        assert_equal(self.nodes[0].getpeerinfo(), [])
+
+
+if __name__ == '__main__':
+    SocketHandlerTest().main()
@@ -0,0 +1,101 @@
+#!/usr/bin/env python3
+# Copyright (c) 2022 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test accepting transactions received back to back from a peer.
+
+Transactions that are queued up for the same peer are accepted to the mempool
+together. The outcome must not differ from accepting them one by one:
+
+  - unrelated transactions are all accepted,
+  - a child sent after its parent in the same batch is accepted,
+  - a transaction sent before its parent is accepted as an orphan once the
+    parent arrives,
+  - a replacement in the same batch evicts the transaction it conflicts with,
+  - a transaction below the minimum relay fee is rejected without the peer
+    being disconnected,
+  - transactions sent before the version handshake is complete are ignored.
+"""
+from decimal import Decimal
+
+from test_framework.messages import (
+    COIN,
+    msg_tx,
+)
+from test_framework.p2p import (
+    P2PDataStore,
+    P2PInterface,
+)
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal
+from test_framework.wallet import MiniWallet
+
+
+class NoVerackPeer(P2PInterface):
+    def on_version(self, message):
+        # Never complete the handshake
+        pass
+
+
+class TxBatchTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 1
+        self.extra_args = [["-par=4", "-whitelist=relay@127.0.0.1"]]
+
+    def run_test(self):
+        node = self.nodes[0]
+        wallet = MiniWallet(node)
+        self.generate(wallet, 20, sync_fun=self.no_op)
+        self.generate(node, 100, sync_fun=self.no_op)
+
+        def first_output(tx):
+            return {'txid': tx['txid'], 'vout': 0, 'value': Decimal(tx['tx'].vout[0].nValue) / COIN}
+
+        unrelated = [wallet.create_self_transfer(from_node=node) for _ in range(8)]
+        child = wallet.create_self_transfer(from_node=node, utxo_to_spend=first_output(unrelated[0]), mempool_valid=False)
+        grandchild = wallet.create_self_transfer(from_node=node, utxo_to_spend=first_output(child), mempool_valid=False)
+        utxo = wallet.get_utxo()
+        original = wallet.create_self_transfer(from_node=node, utxo_to_spend=utxo)
+        replacement = wallet.create_self_transfer(from_node=node, utxo_to_spend=utxo, fee_rate=Decimal("0.004"))
+        low_fee = wallet.create_self_transfer(from_node=node, fee_rate=0, mempool_valid=False)
+        early = [wallet.create_self_transfer(from_node=node) for _ in range(2)]
+
+        def send_early(peer, log_msg):
+            """Send the early transactions back to back and wait until both are ignored."""
+            log_start = node.debug_log_bytes()
+            for tx in early:
+                peer.send_message(msg_tx(tx['tx']))
+
+            def ignored():
+                with open(node.debug_log_path, encoding='utf-8') as dl:
+                    dl.seek(log_start)
+                    return dl.read().count(log_msg) == len(early)
+            self.wait_until(ignored)
+            peer.peer_disconnect()
+            peer.wait_for_disconnect()
+            assert_equal(node.getrawmempool(), [])
+
+        self.log.info("Send transactions back to back before the version message")
+        peer = node.add_p2p_connection(P2PInterface(), send_version=False, wait_for_verack=False)
+        send_early(peer, 'non-version message before version handshake. Message "tx"')
+
+        self.log.info("Send transactions back to back before the verack message")
+        peer = node.add_p2p_connection(NoVerackPeer(), wait_for_verack=False)
+        peer.wait_until(lambda: "version" in peer.last_message)
+        send_early(peer, 'Unsupported message "tx" prior to verack')
+
+        self.log.info("Send the transactions back to back")
+        peer = node.add_p2p_connection(P2PDataStore())
+        for tx in [grandchild] + unrelated + [child, original, replacement, low_fee]:
+            peer.send_message(msg_tx(tx['tx']))
+        peer.sync_with_ping()
+
+        self.log.info("Check that the mempool is the same as after accepting them one by one")
+        expected = unrelated + [child, grandchild, replacement]
+        assert_equal(sorted(node.getrawmempool()), sorted(tx['txid'] for tx in expected))
+        assert peer.is_connected
+
+
+if __name__ == '__main__':
+    TxBatchTest().main()
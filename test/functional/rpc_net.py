@@ -22,6 +22,7 @@ from test_framework.util import (
     assert_approx,
     assert_equal,
     assert_greater_than,
+    assert_greater_than_or_equal,
     assert_raises_rpc_error,
     p2p_port,
 )
@@ -45,7 +46,7 @@ class NetTest(BitcoinTestFramework):
     def set_test_params(self):
         self.setup_clean_chain = True
         self.num_nodes = 2
-        self.extra_args = [["-minrelaytxfee=0.00001000"], ["-minrelaytxfee=0.00000500"]]
+        self.extra_args = [["-minrelaytxfee=0.00001000", "-msghandthreads=3"], ["-minrelaytxfee=0.00000500"]]
         self.supports_cli = False
 
     def run_test(self):
@@ -150,6 +151,15 @@ class NetTest(BitcoinTestFramework):
         assert_equal(info['connections_in'], 1)
         assert_equal(info['connections_out'], 1)
 
+        self.log.info("Test the message handler threads in getnetworkinfo")
+        handlers = info['message_handlers']
+        assert_equal(len(handlers), 3)
+        assert_equal(sum(handler['peers'] for handler in handlers), 2)
+        for handler in handlers:
+            assert_greater_than_or_equal(handler['busy_time'], 0)
+            assert 0 <= handler['utilization'] <= 1
+        assert_equal(len(self.nodes[1].getnetworkinfo()['message_handlers']), 2)
+
         # check the `servicesnames` field
         network_info = [node.getnetworkinfo() for node in self.nodes]
         for info in network_info: